@@ -14,12 +14,8 @@
 
 LOCAL_PATH := $(call my-dir)
 
-include $(CLEAR_VARS)
-
-LOCAL_MODULE := iio_testing_framework
-
-LOCAL_SRC_FILES := \
-		iio_testing_framework.c \
+# sources shared by the framework and the microbenchmark
+IIO_COMMON_SRC_FILES := \
 		iio_parser.c \
 		iio_tests.c \
 		iio_control.c \
@@ -29,11 +25,74 @@ LOCAL_SRC_FILES := \
 		iio_pld_information.c \
 		iio_set_trigger.c \
 		iio_utils.c \
+		iio_histogram.c \
+		iio_activation_latency.c \
+		iio_cache.c \
+		iio_server.c \
+		iio_arena.c \
+		iio_results.c \
+		iio_profile.c \
+		iio_trace.c \
+		iio_perf.c \
+		iio_selfbench.c \
+		iio_allan_variance.c \
+		iio_noise_spectrum.c \
+		iio_sync.c \
+		iio_fusion.c \
+		iio_events.c \
+		iio_trigger_accuracy.c \
+		iio_fanout.c \
+		iio_soak.c \
+		iio_stall.c \
+		iio_early_stop.c \
 
-APP_STL := stlport_static
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := iio_testing_framework
 
-LOCAL_SHARED_LIBRARIES := libcutils
+LOCAL_SRC_FILES := \
+		iio_testing_framework.c \
+		$(IIO_COMMON_SRC_FILES)
+
+APP_STL := stlport_static
 
 LDFLAGS=-ldl -lpthread -lm -lrt
 
-include $(BUILD_EXECUTABLE)
\ No newline at end of file
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := iio_microbench
+
+LOCAL_SRC_FILES := \
+		iio_microbench.c \
+		$(IIO_COMMON_SRC_FILES)
+
+LOCAL_CFLAGS := -O2
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := iio_microbench
+
+LOCAL_SRC_FILES := \
+		iio_microbench.c \
+		$(IIO_COMMON_SRC_FILES)
+
+LOCAL_CFLAGS := -O2
+
+LOCAL_LDLIBS := -lm -lpthread
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := iio_compare_results
+
+LOCAL_SRC_FILES := \
+		iio_compare_results.c \
+
+LOCAL_LDLIBS := -lm
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,265 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include "iio_activation_latency.h"
+#include "iio_results.h"
+#include "iio_control.h"
+#include "iio_histogram.h"
+#include "iio_utils.h"
+
+/* expected time between two samples, 0 if data rate is unknown */
+static int get_period_ms(int sensor_index) {
+	float data_rate;
+
+	data_rate = g_sensor_info_iio_ext[sensor_index].data_rate;
+	if (data_rate <= 0)
+		return 0;
+	return (int)(CONVERT_SEC_TO_MILLI(1) / data_rate) + 1;
+}
+
+/* read everything that is available on a non blocking fd
+** returns number of bytes read
+*/
+static int drain_fd(int fd) {
+	char buf[BUFFER_SIZE];
+	int len;
+	int total;
+
+	total = 0;
+	while ((len = read(fd, buf, BUFFER_SIZE)) > 0)
+		total += len;
+	return total;
+}
+
+void reset_activation_latency(int sensor_index) {
+	activation_latency_struct *latency;
+
+	latency = &g_sensor_info_iio_ext[sensor_index].activation_latency;
+	histogram_reset(&latency->enable_write);
+	histogram_reset(&latency->first_sample);
+	histogram_reset(&latency->disable_write);
+	histogram_reset(&latency->stream_stop);
+	latency->missed_first_samples = 0;
+	latency->enable_timestamp = -1;
+	latency->disable_timestamp = -1;
+	latency->disable_write_timestamp = -1;
+}
+
+/* called with monotonic timestamps taken around buffer/enable write */
+void record_buffer_write_latency(int sensor_index, int enabled, int64_t start, int64_t end) {
+	activation_latency_struct *latency;
+
+	latency = &g_sensor_info_iio_ext[sensor_index].activation_latency;
+	if (enabled) {
+		latency->enable_timestamp = start;
+		histogram_add(&latency->enable_write, end - start);
+	}
+	else {
+		latency->disable_timestamp = start;
+		latency->disable_write_timestamp = end;
+		histogram_add(&latency->disable_write, end - start);
+	}
+	log_msg_and_exit_on_error(VERBOSE, "Device %s buffer write %d took %lld ns\n",
+		g_sensor_info_iio_ext[sensor_index].id, enabled, end - start);
+}
+
+/* open device before enabling it so that the first sample can be caught */
+int open_activation_latency_fd(int sensor_index) {
+	char sysfs_path[PATH_MAX];
+	int fd;
+
+	if (g_sensor_info_iio_ext[sensor_index].mode != MODE_TRIGGER)
+		return -1;
+
+	memset(sysfs_path, '\0', PATH_MAX);
+	snprintf(sysfs_path, PATH_MAX, DEV_FILE_PATH, g_sensor_info_iio_ext[sensor_index].dev_num);
+	fd = open_device_fd(sensor_index, O_NONBLOCK);
+	if (fd == -1) {
+		log_msg_and_exit_on_error(DEBUG, "Can't open %s, sample latency won't be "
+			"measured for %s (%s)\n", sysfs_path, g_sensor_info_iio_ext[sensor_index].id,
+			strerror(errno));
+		return -1;
+	}
+	drain_fd(fd);
+	return fd;
+}
+
+void close_activation_latency_fd(int sensor_index, int fd) {
+	if (fd == -1)
+		return;
+	if (close_device_fd(sensor_index, fd) == -1)
+		log_msg_and_exit_on_error(DEBUG, "Error closing fd %d for device %s: %s\n",
+			fd, g_sensor_info_iio_ext[sensor_index].id, strerror(errno));
+}
+
+/* wait for first sample after buffers were enabled; fds of all sensors
+** are polled together so that a slow sensor doesn't delay the others
+*/
+void measure_first_samples(int sensor_indexes[], int fds[], int count) {
+	activation_latency_struct *latency;
+	struct pollfd pfds[count];
+	int64_t now;
+	int64_t deadline;
+	int timeout;
+	int pending;
+	int sensor_timeout;
+	int i;
+	int ret;
+
+	timeout = FIRST_SAMPLE_TIMEOUT_MS;
+	pending = 0;
+	for (i = 0; i < count; i++) {
+		latency = &g_sensor_info_iio_ext[sensor_indexes[i]].activation_latency;
+		pfds[i].fd = (latency->enable_timestamp == -1) ? -1 : fds[i];
+		pfds[i].events = POLLIN;
+		pfds[i].revents = 0;
+		if (pfds[i].fd == -1)
+			continue;
+		pending++;
+		sensor_timeout = get_period_ms(sensor_indexes[i]) * FIRST_SAMPLE_TIMEOUT_PERIODS;
+		if (sensor_timeout > timeout)
+			timeout = sensor_timeout;
+	}
+
+	deadline = get_timestamp_monotonic() + CONVERT_MILLI_TO_NANO((int64_t)timeout);
+	while (pending) {
+		now = get_timestamp_monotonic();
+		if (now >= deadline)
+			break;
+		ret = poll(pfds, count, (int)CONVERT_NANO_TO_MILLI(deadline - now) + 1);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+
+		now = get_timestamp_monotonic();
+		for (i = 0; i < count; i++) {
+			if (pfds[i].fd == -1 || !(pfds[i].revents & POLLIN))
+				continue;
+			latency = &g_sensor_info_iio_ext[sensor_indexes[i]].activation_latency;
+			histogram_add(&latency->first_sample, now - latency->enable_timestamp);
+			log_msg_and_exit_on_error(VERBOSE, "Device %s has first sample after %lld ns\n",
+				g_sensor_info_iio_ext[sensor_indexes[i]].id, now - latency->enable_timestamp);
+			drain_fd(pfds[i].fd);
+			pfds[i].fd = -1;
+			pending--;
+		}
+	}
+
+	/* software triggers without a rate don't generate data, don't fail */
+	for (i = 0; i < count; i++) {
+		if (pfds[i].fd == -1)
+			continue;
+		latency = &g_sensor_info_iio_ext[sensor_indexes[i]].activation_latency;
+		latency->missed_first_samples++;
+		log_msg_and_exit_on_error(DEBUG, "Device %s has no sample %d ms after enable\n",
+			g_sensor_info_iio_ext[sensor_indexes[i]].id, timeout);
+	}
+}
+
+/* keep reading after buffers were disabled until every stream is quiet;
+** a stream stopped when its last sample arrived or when disable returned
+*/
+void measure_stream_stops(int sensor_indexes[], int fds[], int count) {
+	activation_latency_struct *latency;
+	struct pollfd pfds[count];
+	int64_t last_samples[count];
+	int64_t now;
+	int timeout;
+	int sensor_timeout;
+	int pending;
+	int i;
+	int ret;
+
+	timeout = STREAM_STOP_QUIET_MS;
+	pending = 0;
+	for (i = 0; i < count; i++) {
+		latency = &g_sensor_info_iio_ext[sensor_indexes[i]].activation_latency;
+		pfds[i].fd = (latency->disable_timestamp == -1) ? -1 : fds[i];
+		pfds[i].events = POLLIN;
+		last_samples[i] = latency->disable_write_timestamp;
+		if (pfds[i].fd == -1)
+			continue;
+		pending++;
+		sensor_timeout = get_period_ms(sensor_indexes[i]) * STREAM_STOP_QUIET_PERIODS;
+		if (sensor_timeout > timeout)
+			timeout = sensor_timeout;
+	}
+	if (!pending)
+		return;
+
+	for (;;) {
+		for (i = 0; i < count; i++)
+			pfds[i].revents = 0;
+		ret = poll(pfds, count, timeout);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+
+		now = get_timestamp_monotonic();
+		for (i = 0; i < count; i++) {
+			if (pfds[i].fd == -1 || !(pfds[i].revents & POLLIN))
+				continue;
+			if (drain_fd(pfds[i].fd) > 0)
+				last_samples[i] = now;
+			else
+				pfds[i].fd = -1;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (fds[i] == -1)
+			continue;
+		latency = &g_sensor_info_iio_ext[sensor_indexes[i]].activation_latency;
+		if (latency->disable_timestamp == -1)
+			continue;
+		histogram_add(&latency->stream_stop, last_samples[i] - latency->disable_timestamp);
+		log_msg_and_exit_on_error(VERBOSE, "Device %s stream stopped after %lld ns\n",
+			g_sensor_info_iio_ext[sensor_indexes[i]].id,
+			last_samples[i] - latency->disable_timestamp);
+	}
+}
+
+void print_activation_latency(int sensor_index) {
+	activation_latency_struct *latency;
+	const char *tag;
+
+	latency = &g_sensor_info_iio_ext[sensor_index].activation_latency;
+	tag = g_sensor_info_iio_ext[sensor_index].id;
+
+	histogram_print(&latency->enable_write, tag, "enable write latency");
+	histogram_print(&latency->first_sample, tag, "first sample latency");
+	histogram_print(&latency->disable_write, tag, "disable write latency");
+	histogram_print(&latency->stream_stop, tag, "stream stop latency");
+	record_histogram(sensor_index, "enable_write_latency", &latency->enable_write);
+	record_histogram(sensor_index, "first_sample_latency", &latency->first_sample);
+	record_histogram(sensor_index, "disable_write_latency", &latency->disable_write);
+	record_histogram(sensor_index, "stream_stop_latency", &latency->stream_stop);
+	record_metric(sensor_index, "missed_first_samples", latency->missed_first_samples, NAN, NULL);
+	if (latency->missed_first_samples)
+		log_msg_and_exit_on_error(DEBUG, "Device %s had no sample after %d activations\n",
+			tag, latency->missed_first_samples);
+}
@@ -0,0 +1,28 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "iio_common.h"
+#ifndef __IIO_ACTIVATION_LATENCY_H__
+#define __IIO_ACTIVATION_LATENCY_H__
+
+void reset_activation_latency(int sensor_index);
+void record_buffer_write_latency(int sensor_index, int enabled, int64_t start, int64_t end);
+int open_activation_latency_fd(int sensor_index);
+void close_activation_latency_fd(int sensor_index, int fd);
+void measure_first_samples(int sensor_indexes[], int fds[], int count);
+void measure_stream_stops(int sensor_indexes[], int fds[], int count);
+void print_activation_latency(int sensor_index);
+#endif
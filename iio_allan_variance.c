@@ -0,0 +1,197 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "iio_allan_variance.h"
+#include "iio_arena.h"
+#include "iio_results.h"
+#include "iio_utils.h"
+
+/*
+** Overlapping Allan variance computed while streaming. For a cluster
+** size m, the difference of two consecutive cluster averages is
+** (S[k+2m] - 2 S[k+m] + S[k]) / m where S is the cumulative sum of the
+** values, so only the sums m and 2m samples back are needed. Small
+** cluster sizes start a cluster at every sample; large ones every
+** m / ALLAN_OVERLAP samples, which keeps memory bounded and costs little
+** accuracy as their clusters overlap anyway.
+**
+** The deviations over octave spaced cluster times give the noise terms:
+** white noise follows a -1/2 slope in log-log (angle random walk for a
+** gyroscope, velocity random walk for an accelerometer, read at 1 s),
+** bias instability is the flat floor of the curve.
+*/
+
+void allan_variance_init(allan_variance_struct *allan, int num_channels) {
+	allan_octave_struct *octave;
+	int c;
+	int j;
+
+	memset(allan, 0, sizeof(allan_variance_struct));
+	allan->num_channels = num_channels;
+	allan->first_timestamp = -1;
+	allan->last_timestamp = -1;
+	allan->channels = (allan_channel_struct*)arena_alloc(&g_test_arena,
+		num_channels * sizeof(allan_channel_struct));
+	memset(allan->channels, 0, num_channels * sizeof(allan_channel_struct));
+
+	for (c = 0; c < num_channels; c++) {
+		for (j = 0; j < ALLAN_OCTAVES; j++) {
+			octave = &allan->channels[c].octaves[j];
+			octave->cluster_size = 1 << j;
+			octave->stride = octave->cluster_size > ALLAN_OVERLAP ?
+				octave->cluster_size / ALLAN_OVERLAP : 1;
+			octave->lag = octave->cluster_size / octave->stride;
+			octave->sums = (double*)arena_alloc(&g_test_arena,
+				(2 * octave->lag + 1) * sizeof(double));
+			/* S[0] = 0 */
+			octave->sums[0] = 0;
+			octave->recorded = 1;
+		}
+	}
+}
+
+void allan_variance_add(allan_variance_struct *allan, int channel, double value) {
+	allan_channel_struct *data;
+	allan_octave_struct *octave;
+	int size;
+	int j;
+	double diff;
+
+	data = &allan->channels[channel];
+	if (data->counter == 0)
+		data->offset = value;
+	data->sum += value - data->offset;
+	data->counter++;
+
+	for (j = 0; j < ALLAN_OCTAVES; j++) {
+		octave = &data->octaves[j];
+		/* strides are powers of 2 */
+		if (data->counter & (octave->stride - 1))
+			continue;
+		size = 2 * octave->lag + 1;
+		octave->sums[octave->recorded % size] = data->sum;
+		octave->recorded++;
+		if (octave->recorded < size)
+			continue;
+		/* S[k] is 2 * lag sums back, in the slot written next */
+		diff = (data->sum - 2 * octave->sums[(octave->recorded - 1 - octave->lag) % size] +
+			octave->sums[octave->recorded % size]) / octave->cluster_size;
+		octave->total += diff * diff;
+		octave->terms++;
+	}
+}
+
+/* print deviations and record noise terms of every channel; fails when
+** the capture is too short for two cluster sizes
+*/
+int allan_variance_report(int sensor_index, const allan_variance_struct *allan) {
+	const allan_channel_struct *data;
+	const allan_octave_struct *octave;
+	const char *tag;
+	const char *name;
+	char metric_name[MAX_NAME_SIZE];
+	double deviations[ALLAN_OCTAVES];
+	double taus[ALLAN_OCTAVES];
+	double sample_period;
+	double white_noise;
+	double bias_instability;
+	double slope;
+	double best;
+	int count;
+	int c;
+	int j;
+
+	tag = g_sensor_info_iio_ext[sensor_index].tag;
+	if (allan->counter < 2 || allan->last_timestamp <= allan->first_timestamp) {
+		log_msg_and_exit_on_error(ERROR, "No data received from %s\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(FAILED);
+		return -1;
+	}
+	sample_period = (double)(allan->last_timestamp - allan->first_timestamp) /
+		(allan->counter - 1) / CONVERT_SEC_TO_NANO(1);
+
+	for (c = 0; c < allan->num_channels; c++) {
+		data = &allan->channels[c];
+		name = g_sensor_info_iio_ext[sensor_index].channel_descriptor[c].name;
+
+		count = 0;
+		for (j = 0; j < ALLAN_OCTAVES; j++) {
+			octave = &data->octaves[j];
+			if (octave->terms == 0 ||
+				data->counter < (int64_t)ALLAN_MIN_CLUSTERS * octave->cluster_size)
+				break;
+			taus[count] = octave->cluster_size * sample_period;
+			deviations[count] = sqrt(octave->total / (2 * octave->terms));
+			log_msg_and_exit_on_error(DEBUG, "Device %s channel %s has Allan deviation %g at %g s\n",
+				g_sensor_info_iio_ext[sensor_index].id, name, deviations[count], taus[count]);
+			count++;
+		}
+		if (count < 2) {
+			log_msg_and_exit_on_error(ERROR, "Capture of %s is too short for Allan variance!\n",
+				g_sensor_info_iio_ext[sensor_index].id);
+			set_test_state(FAILED);
+			return -1;
+		}
+
+		/* white noise where the local slope is closest to -1/2 */
+		white_noise = deviations[0] * sqrt(taus[0]);
+		best = INF;
+		bias_instability = deviations[0];
+		for (j = 0; j < count; j++) {
+			if (deviations[j] < bias_instability)
+				bias_instability = deviations[j];
+			if (j + 1 == count || deviations[j] <= 0 || deviations[j + 1] <= 0)
+				continue;
+			slope = log(deviations[j + 1] / deviations[j]) / log(taus[j + 1] / taus[j]);
+			if (fabs(slope + 0.5) < best) {
+				best = fabs(slope + 0.5);
+				white_noise = deviations[j] * sqrt(taus[j]);
+			}
+		}
+		bias_instability /= BIAS_INSTABILITY_FACTOR;
+
+		/* rad/s and m/s^2 from iio, reported in the usual datasheet units */
+		if (strcmp(tag, "anglvel") == 0) {
+			snprintf(metric_name, MAX_NAME_SIZE, "arw_%s", name);
+			record_metric(sensor_index, metric_name, white_noise * 180 / M_PI * 60, NAN,
+				"deg/sqrt(h)");
+			snprintf(metric_name, MAX_NAME_SIZE, "bias_instability_%s", name);
+			record_metric(sensor_index, metric_name, bias_instability * 180 / M_PI * 3600, NAN,
+				"deg/h");
+		}
+		else if (strcmp(tag, "accel") == 0) {
+			snprintf(metric_name, MAX_NAME_SIZE, "vrw_%s", name);
+			record_metric(sensor_index, metric_name, white_noise * 60, NAN, "m/s/sqrt(h)");
+			snprintf(metric_name, MAX_NAME_SIZE, "bias_instability_%s", name);
+			record_metric(sensor_index, metric_name, bias_instability, NAN, "m/s^2");
+		}
+		else {
+			snprintf(metric_name, MAX_NAME_SIZE, "white_noise_%s", name);
+			record_metric(sensor_index, metric_name, white_noise, NAN, NULL);
+			snprintf(metric_name, MAX_NAME_SIZE, "bias_instability_%s", name);
+			record_metric(sensor_index, metric_name, bias_instability, NAN, NULL);
+		}
+		log_msg_and_exit_on_error(DEBUG, "Device %s channel %s has white noise %g/sqrt(Hz) "
+			"and bias instability %g\n", g_sensor_info_iio_ext[sensor_index].id, name,
+			white_noise, bias_instability);
+	}
+	return 0;
+}
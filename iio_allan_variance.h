@@ -0,0 +1,23 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_ALLAN_VARIANCE_H__
+#define __IIO_ALLAN_VARIANCE_H__
+
+void allan_variance_init(allan_variance_struct *allan, int num_channels);
+void allan_variance_add(allan_variance_struct *allan, int channel, double value);
+int allan_variance_report(int sensor_index, const allan_variance_struct *allan);
+#endif
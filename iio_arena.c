@@ -0,0 +1,114 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "iio_arena.h"
+#include "iio_utils.h"
+
+/*
+** Bump allocator for everything a test allocates: command parsing,
+** accumulators and scratch buffers. Nothing is freed one by one, the
+** whole arena is rewound at the end of each test and its blocks are
+** reused by the next one, so memory stays at the high-water mark of
+** the largest test instead of growing with the number of tests.
+*/
+
+arena_struct g_test_arena;
+
+static arena_block_struct* new_block(size_t size) {
+	arena_block_struct *block;
+
+	if (size < ARENA_BLOCK_SIZE)
+		size = ARENA_BLOCK_SIZE;
+	block = (arena_block_struct*)malloc(sizeof(arena_block_struct) + size);
+	if (block == NULL) {
+		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+		exit(-1);
+	}
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	return block;
+}
+
+/* return zeroed memory aligned for any type, valid until arena_reset */
+void* arena_alloc(arena_struct *arena, size_t size) {
+	arena_block_struct *block;
+	void *ptr;
+
+	size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	if (arena->current == NULL) {
+		if (arena->first == NULL)
+			arena->first = new_block(size);
+		arena->current = arena->first;
+	}
+
+	/* blocks kept from previous tests are reused before adding new ones */
+	block = arena->current;
+	while (block->size - block->used < size) {
+		if (block->next == NULL)
+			block->next = new_block(size);
+		block = block->next;
+		block->used = 0;
+	}
+	arena->current = block;
+
+	ptr = block->data + block->used;
+	block->used += size;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+/* arena replacement for realloc; old memory is only reclaimed at reset,
+** callers grow geometrically so it stays bounded
+*/
+void* arena_grow(arena_struct *arena, void *old, size_t old_size, size_t new_size) {
+	void *ptr;
+
+	ptr = arena_alloc(arena, new_size);
+	if (old != NULL)
+		memcpy(ptr, old, old_size < new_size ? old_size : new_size);
+	return ptr;
+}
+
+char* arena_strdup(arena_struct *arena, const char *str) {
+	char *copy;
+
+	copy = (char*)arena_alloc(arena, strlen(str) + 1);
+	strcpy(copy, str);
+	return copy;
+}
+
+/* drop every allocation but keep the blocks */
+void arena_reset(arena_struct *arena) {
+	if (arena->first != NULL)
+		arena->first->used = 0;
+	arena->current = arena->first;
+}
+
+void arena_release(arena_struct *arena) {
+	arena_block_struct *block;
+	arena_block_struct *next;
+
+	for (block = arena->first; block != NULL; block = next) {
+		next = block->next;
+		free(block);
+	}
+	arena->first = NULL;
+	arena->current = NULL;
+}
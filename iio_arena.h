@@ -0,0 +1,25 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_ARENA_H__
+#define __IIO_ARENA_H__
+
+void* arena_alloc(arena_struct *arena, size_t size);
+void* arena_grow(arena_struct *arena, void *old, size_t old_size, size_t new_size);
+char* arena_strdup(arena_struct *arena, const char *str);
+void arena_reset(arena_struct *arena);
+void arena_release(arena_struct *arena);
+#endif
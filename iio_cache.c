@@ -0,0 +1,360 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "iio_cache.h"
+#include "iio_enumeration.h"
+#include "iio_sample_format.h"
+#include "iio_set_trigger.h"
+#include "iio_utils.h"
+
+/*
+** Enumeration, sample format and trigger selection cost hundreds of sysfs
+** accesses; their result is saved in a text file and reused while the
+** boot id and the names of the iio devices stay the same. Only the boot id
+** and device names are read to validate it, and the data rates, which
+** anything may change between runs, are read again.
+*/
+
+/* key is "boot_id dev_num:name dev_num:name ..." */
+static int get_cache_key(char key[CACHE_KEY_SIZE]) {
+	char sysfs_path[PATH_MAX];
+	char name[MAX_NAME_SIZE];
+	int *devices;
+	int devices_count;
+	int len;
+	int d;
+
+	memset(key, '\0', CACHE_KEY_SIZE);
+	snprintf(sysfs_path, PATH_MAX, "%s", BOOT_ID_PATH);
+	if (sysfs_read_str(sysfs_path, key, CACHE_KEY_SIZE) <= 0)
+		return -1;
+
+	len = strlen(key);
+	devices_count = list_iio_entries(DEVICE_PREFIX, &devices);
+	for (d = 0; d < devices_count; d++) {
+		memset(name, '\0', MAX_NAME_SIZE);
+		snprintf(sysfs_path, PATH_MAX, NAME_PATH, devices[d]);
+		sysfs_read_str(sysfs_path, name, MAX_NAME_SIZE);
+		len += snprintf(key + len, CACHE_KEY_SIZE - len, " %d:%s", devices[d], name);
+		if (len >= CACHE_KEY_SIZE) {
+			free(devices);
+			return -1;
+		}
+	}
+	free(devices);
+	return 0;
+}
+
+/* names are written as single words, "-" stands for an empty one */
+static int is_cacheable(const char *name) {
+	return strpbrk(name, " \t\n") == NULL && strcmp(name, "-");
+}
+
+static const char* to_word(const char *name) {
+	return name[0] ? name : "-";
+}
+
+static void from_word(char *name, int size, const char *word) {
+	snprintf(name, size, "%s", strcmp(word, "-") ? word : "");
+}
+
+/* channel base of a sensor channel; ex: accel_x */
+static void get_channel_base(int s, int c, char base[MAX_NAME_SIZE]) {
+	const char *en_path;
+	int len;
+
+	en_path = g_sensor_info_iio_ext[s].channel_descriptor[c].en_path;
+	len = strlen(en_path) - strlen("in_") - strlen("_en");
+	snprintf(base, MAX_NAME_SIZE, "%.*s", len > 0 ? len : 0, en_path + strlen("in_"));
+}
+
+/* the rate in the cache is only what the last run left */
+static void read_data_rate(sensor_info_iio_ext_t *sensor) {
+	char sysfs_path[PATH_MAX];
+	float data_rate;
+
+	snprintf(sysfs_path, PATH_MAX, SENSOR_SAMPLING_PATH, sensor->dev_num, sensor->tag);
+	if (sysfs_read_float(sysfs_path, &data_rate) == -1) {
+		snprintf(sysfs_path, PATH_MAX, DEVICE_SAMPLING_PATH, sensor->dev_num);
+		if (sysfs_read_float(sysfs_path, &data_rate) == -1) {
+			log_msg_and_exit_on_error(DEBUG, "%s: Cannot read frequency for device%d!.\n",
+				sysfs_path, sensor->dev_num);
+			data_rate = 0;
+		}
+	}
+	if (data_rate != sensor->data_rate)
+		log_msg_and_exit_on_error(VERBOSE, "Data rate for %s is %f, not %f as cached\n",
+			sensor->id, data_rate, sensor->data_rate);
+	sensor->data_rate = data_rate;
+}
+
+static void drop_cached_sensors(void) {
+	int s;
+
+	for (s = 0; s < g_sensor_info_size; s++)
+		drop_sensor(s);
+	g_sensor_info_size = 0;
+	g_sensor_iio_count = 0;
+}
+
+static int load_channel_info(FILE *file, const char *expected, channel_info_t *channel,
+	char base[MAX_NAME_SIZE]) {
+	char word[MAX_NAME_SIZE];
+	char type_spec[MAX_TYPE_SPEC_LEN];
+
+	if (fscanf(file, "%31s", word) != 1 || strcmp(word, expected))
+		return -1;
+	if (base != NULL && fscanf(file, "%31s", base) != 1)
+		return -1;
+	if (fscanf(file, "%d %d %d %d %g %31s", &channel->index, &channel->offset,
+		&channel->size, &channel->opt_scale, &channel->scale, type_spec) != 6)
+		return -1;
+
+	from_word(channel->type_spec, MAX_TYPE_SPEC_LEN, type_spec);
+	if (channel->size > 0 &&
+		decode_type_spec(channel->type_spec, &channel->type_info) != channel->size)
+		return -1;
+	return 0;
+}
+
+static void save_channel_info(FILE *file, const char *label, channel_info_t *channel,
+	const char *base) {
+	fprintf(file, "%s", label);
+	if (base != NULL)
+		fprintf(file, " %s", base);
+	fprintf(file, " %d %d %d %d %.9g %s\n", channel->index, channel->offset,
+		channel->size, channel->opt_scale, channel->scale, to_word(channel->type_spec));
+}
+
+/* cache at path positioned after its key, NULL if it doesn't match this
+** boot and these devices
+*/
+static FILE* open_cache(const char *path) {
+	FILE *file;
+	char key[CACHE_KEY_SIZE];
+	char line[CACHE_KEY_SIZE];
+	int version;
+
+	if (get_cache_key(key) == -1)
+		return NULL;
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		log_msg_and_exit_on_error(VERBOSE, "No sensors cache in %s\n", path);
+		return NULL;
+	}
+
+	if (fscanf(file, "iio_testing_framework cache %d\n", &version) != 1 ||
+		version != CACHE_VERSION || fgets(line, CACHE_KEY_SIZE, file) == NULL ||
+		strncmp(line, "key ", 4)) {
+		log_msg_and_exit_on_error(VERBOSE, "Sensors cache %s has an unknown format\n", path);
+		fclose(file);
+		return NULL;
+	}
+	line[strcspn(line, "\n")] = '\0';
+	if (strcmp(line + 4, key)) {
+		log_msg_and_exit_on_error(VERBOSE, "Sensors cache %s is stale\n", path);
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+/* hrtimers made by earlier runs are the framework's, even when sensors
+** are enumerated again
+*/
+void own_cached_hrtimers(const char *path) {
+	FILE *file;
+	char word[MAX_NAME_SIZE];
+	char name[MAX_NAME_SIZE];
+
+	file = open_cache(path);
+	if (file == NULL)
+		return;
+	while (fscanf(file, "%31s", word) == 1 && !strcmp(word, "hrtimer") &&
+		fscanf(file, "%31s", name) == 1)
+		own_hrtimer(name);
+	fclose(file);
+}
+
+/* return 0 if sensors were restored from path, -1 if they must be enumerated */
+int load_sensors_cache(const char *path) {
+	FILE *file;
+	char word[MAX_NAME_SIZE];
+	char base[MAX_NAME_SIZE];
+	char tag[MAX_NAME_SIZE];
+	char name[MAX_NAME_SIZE];
+	char init_trigger_name[MAX_NAME_SIZE];
+	sensor_info_iio_ext_t *sensor;
+	int num_channels;
+	int trigger_nr;
+	int corrupted;
+	int s;
+	int c;
+	int t;
+
+	memset(word, '\0', MAX_NAME_SIZE);
+	file = open_cache(path);
+	if (file == NULL)
+		return -1;
+
+	/* a record cut off anywhere makes the whole cache unusable, even when
+	** the last word read happens to be "end"
+	*/
+	corrupted = 0;
+	while (fscanf(file, "%31s", word) == 1) {
+		/* read by own_cached_hrtimers */
+		if (!strcmp(word, "hrtimer")) {
+			if (fscanf(file, "%31s", name) != 1) {
+				corrupted = 1;
+				break;
+			}
+			continue;
+		}
+		if (strcmp(word, "sensor"))
+			break;
+		if (fscanf(file, "%31s %d", tag, &num_channels) != 2 || num_channels < 0) {
+			corrupted = 1;
+			break;
+		}
+		s = new_sensor(tag, num_channels);
+		sensor = &g_sensor_info_iio_ext[s];
+		if (fscanf(file, "%31s %31s %31s %d %d %d %d %d %d %d %d %g %g %g %d", sensor->id,
+			sensor->internal_name, init_trigger_name, &sensor->dev_num, &sensor->mode,
+			&sensor->type, &sensor->is_virtual, &sensor->instance,
+			&sensor->found_implicit_trigger, &sensor->hr_trigger_nr, &sensor->sample_size,
+			&sensor->data_rate, &sensor->offset, &sensor->scale, &trigger_nr) != 15) {
+			drop_sensor(s);
+			corrupted = 1;
+			break;
+		}
+		from_word(sensor->init_trigger_name, MAX_NAME_SIZE, init_trigger_name);
+
+		for (c = 0; c < num_channels; c++) {
+			if (load_channel_info(file, "channel", &sensor->channel_info[c], base) == -1)
+				break;
+			split_channel(base, tag, name);
+			set_channel_descriptor(&sensor->channel_descriptor[c], tag, name);
+		}
+		if (c < num_channels ||
+			load_channel_info(file, "timestamp", &sensor->timestamp, NULL) == -1) {
+			drop_sensor(s);
+			corrupted = 1;
+			break;
+		}
+
+		for (t = 0; t < trigger_nr; t++) {
+			if (fscanf(file, "%31s %31s", word, name) != 2 || strcmp(word, "trigger"))
+				break;
+			propose_new_trigger(s, name, sensor->hr_trigger_nr);
+		}
+		if (t < trigger_nr) {
+			drop_sensor(s);
+			corrupted = 1;
+			break;
+		}
+
+		read_data_rate(sensor);
+		sensor->discovered = 1;
+		g_sensor_info_size++;
+		g_sensor_iio_count++;
+	}
+	fclose(file);
+
+	if (corrupted || strcmp(word, "end")) {
+		log_msg_and_exit_on_error(VERBOSE, "Sensors cache %s is corrupted\n", path);
+		drop_cached_sensors();
+		return -1;
+	}
+
+	log_msg_and_exit_on_error(VERBOSE, "Loaded %d sensors from cache %s\n",
+		g_sensor_info_size, path);
+	return 0;
+}
+
+static void save_hrtimer(const char *name, void *context) {
+	if (is_cacheable(name))
+		fprintf((FILE*)context, "hrtimer %s\n", name);
+}
+
+/* write current sensors and the hrtimers made for them to path; sensors with names that can't be
+** written as single words are not cached at all
+*/
+int save_sensors_cache(const char *path) {
+	FILE *file;
+	char key[CACHE_KEY_SIZE];
+	char base[MAX_NAME_SIZE];
+	sensor_info_iio_ext_t *sensor;
+	int s;
+	int c;
+	int t;
+
+	for (s = 0; s < g_sensor_info_size; s++) {
+		sensor = &g_sensor_info_iio_ext[s];
+		if (!is_cacheable(sensor->internal_name) || !is_cacheable(sensor->id)) {
+			log_msg_and_exit_on_error(VERBOSE, "Device %s can't be cached\n", sensor->id);
+			return -1;
+		}
+		for (t = 0; t < sensor->trigger_nr; t++)
+			if (!is_cacheable(sensor->triggers[t]))
+				return -1;
+	}
+
+	if (get_cache_key(key) == -1)
+		return -1;
+
+	file = fopen(path, "w");
+	if (file == NULL) {
+		log_msg_and_exit_on_error(VERBOSE, "Can't write sensors cache %s: %s\n",
+			path, strerror(errno));
+		return -1;
+	}
+
+	fprintf(file, "iio_testing_framework cache %d\n", CACHE_VERSION);
+	fprintf(file, "key %s\n", key);
+	for_each_owned_hrtimer(save_hrtimer, file);
+	for (s = 0; s < g_sensor_info_size; s++) {
+		sensor = &g_sensor_info_iio_ext[s];
+		/* virtual sensors are added again from the physical ones */
+		if (!sensor->discovered || sensor->is_virtual)
+			continue;
+		fprintf(file, "sensor %s %d %s %s %s %d %d %d %d %d %d %d %d %.9g %.9g %.9g %d\n",
+			sensor->tag, sensor->num_channels, sensor->id, sensor->internal_name,
+			to_word(sensor->init_trigger_name), sensor->dev_num, sensor->mode,
+			sensor->type, sensor->is_virtual, sensor->instance,
+			sensor->found_implicit_trigger, sensor->hr_trigger_nr, sensor->sample_size,
+			sensor->data_rate, sensor->offset, sensor->scale, sensor->trigger_nr);
+		for (c = 0; c < sensor->num_channels; c++) {
+			get_channel_base(s, c, base);
+			save_channel_info(file, "channel", &sensor->channel_info[c], base);
+		}
+		save_channel_info(file, "timestamp", &sensor->timestamp, NULL);
+		for (t = 0; t < sensor->trigger_nr; t++)
+			fprintf(file, "trigger %s\n", sensor->triggers[t]);
+	}
+	fprintf(file, "end\n");
+
+	if (fclose(file)) {
+		log_msg_and_exit_on_error(VERBOSE, "Can't write sensors cache %s: %s\n",
+			path, strerror(errno));
+		remove(path);
+		return -1;
+	}
+	return 0;
+}
@@ -16,12 +16,19 @@
 
 #ifndef __IIO_COMMON_H__
 #define __IIO_COMMON_H__
-#define MAX_DEVICES	9	/* Check iio devices 0 to MAX_DEVICES-1 */
-#define MAX_SENSORS	12	/* We can handle as many sensors */
-#define MAX_CHANNELS	4	/* We can handle as many channels per sensor */
-#define MAX_TRIGGERS	8	/* Check for triggers 0 to MAX_TRIGGERS-1 */
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+/* sensors and triggers tables grow as devices are discovered */
+#define SENSORS_INITIAL_SIZE	16
+#define TRIGGERS_INITIAL_SIZE	4
+#define HRTIMERS_INITIAL_SIZE	4
+#define CHANNELS_INITIAL_SIZE	8
 
 #define DEV_FILE_PATH		"/dev/iio:device%d"
+#define IIO_DEVICES_PATH	"/sys/bus/iio/devices"
+#define DEVICE_PREFIX		"iio:device"
+#define TRIGGER_PREFIX		"trigger"
 #define BASE_PATH		"/sys/bus/iio/devices/iio:device%d/"
 #define TRIGGER_FILE_PATH	"/sys/bus/iio/devices/trigger%d/name"
 #define TRIGGER_FREQ_PATH	"/sys/bus/iio/devices/trigger%d/sampling_frequency"
@@ -39,13 +46,32 @@
 #define DEVICE_AVAIL_FREQ_PATH	BASE_PATH "sampling_frequency_available"
 #define BUFFER_PATH		BASE_PATH "buffer"
 #define SCAN_ELEMENTS_PATH		BASE_PATH "scan_elements"
+#define EVENTS_PATH		BASE_PATH "events/"
 #define CONFIGFS_TRIGGER_PATH	"/sys/kernel/config/iio/triggers/"
 #define TIMESTAMP_ENABLE_PATH	CHANNEL_PATH "in_timestamp_en"
 #define TIMESTAMP_TYPE_PATH	CHANNEL_PATH "in_timestamp_type"
 #define TIMESTAMP_INDEX_PATH	CHANNEL_PATH "in_timestamp_index"
-#define TESTS_MSG	"/tests_msg"	
+#define TESTS_MSG	"/tests_msg"
+#define BOOT_ID_PATH	"/proc/sys/kernel/random/boot_id"
+#define SENSORS_CACHE_PATH	"/data/local/tmp/iio_testing_framework.cache"
+#define CACHE_VERSION	2
+#define CACHE_KEY_SIZE	1024
+#define SERVER_SOCKET_PATH	"/data/local/tmp/iio_testing_framework.sock"
+#define SERVER_BACKLOG	4
+#define TRACEFS_PATH	"/sys/kernel/tracing"
+#define DEBUGFS_TRACING_PATH	"/sys/kernel/debug/tracing"
+#define TRACE_MARKER_SIZE	256
+#define TRACE_MARKERS	1	/* -t: markers in trace_marker */
+#define TRACE_SNAPSHOTS	2	/* -T: markers and a snapshot of failing tests */
+#define ARENA_BLOCK_SIZE	(64 * 1024)
+#define ARENA_ALIGNMENT	16
+#define USAGE	"Usage: %s -l log_level -s suite_path -p results_path [-c command] [-n] [-j] [-t|-T] [-P]\n" \
+		"       %s -l log_level -d [-u socket_path] [-p results_path] [-n] [-t|-T] [-P]\n"	
 #define TESTS_RESULTS	"/tests_results"
+#define TESTS_RESULTS_JSONL	"/tests_results.jsonl"
+#define TESTS_RESULTS_JUNIT	"/tests_results.xml"
 #define TESTS_LOGS     "/logs/test_"
+#define TESTS_TRACES	"/logs/trace_"
 #define DATA_READY_SIGNAL	"R" 
 
 #define MAX_JITTER	3
@@ -61,6 +87,8 @@
 #define CONVERT_SEC_TO_MICRO(x)	((x) * 1000000)
 #define CONVERT_SEC_TO_MILLI(x)	((x) * 1000)
 #define CONVERT_NANO_TO_MILLI(x)	((x)/1000000)
+#define CONVERT_NANO_TO_MICRO(x)	((x)/1000)
+#define CONVERT_MILLI_TO_NANO(x)	((x) * 1000000)
 #define CONVERT_MILLI_TO_SEC(x)	((x)/1000)
 #define CONVERT_MICROTESLA_TO_GAUSS(x)	((x)/100) 
 #define ARRAY_SIZE(x) sizeof(x)/sizeof(x[0])
@@ -74,6 +102,7 @@
 #define SENSOR_TYPE_ROTATION_VECTOR	6
 #define SENSOR_TYPE_AMBIENT_TEMPERATURE	7
 #define SENSOR_TYPE_PROXIMITY	8
+#define SENSOR_TYPE_UNKNOWN	-1
 /* Channel type spec len; ex: "le:u10/16>>0" */
 #define MAX_TYPE_SPEC_LEN	32	
 #define MAX_NAME_SIZE		32
@@ -82,6 +111,7 @@
 #define MODE_POLL	1
 #define MODE_TRIGGER	2
 #define MODE_EVENT	3
+#define MODE_STALL	4 /* deadline timer of a sensor in poll_sensors */
 
 #define PANEL_FRONT	4
 #define PANEL_BACK	5
@@ -91,6 +121,119 @@
 */
 #define ENABLE_BUFFER_RETRIES		3
 #define ENABLE_BUFFER_RETRY_DELAY_MS	10
+
+/* Activation latency measurement: wait at least as long for
+** the first sample after enable and keep draining after disable
+** until the stream was quiet for the given window
+*/
+#define FIRST_SAMPLE_TIMEOUT_MS	1000
+#define FIRST_SAMPLE_TIMEOUT_PERIODS	10
+#define STREAM_STOP_QUIET_MS	50
+#define STREAM_STOP_QUIET_PERIODS	3
+
+/* log-linear histogram: 4 buckets for every power of 2 */
+#define HISTOGRAM_SUB_BUCKETS_BITS	2
+#define HISTOGRAM_SUB_BUCKETS	(1 << HISTOGRAM_SUB_BUCKETS_BITS)
+#define HISTOGRAM_BUCKETS	(HISTOGRAM_SUB_BUCKETS * 42)
+
+/* streaming Allan variance: cluster sizes 1, 2, 4 ... 2^(ALLAN_OCTAVES-1)
+** samples; from ALLAN_OVERLAP samples up, clusters start every
+** cluster_size / ALLAN_OVERLAP samples instead of every sample, so each
+** cluster size keeps 2 * ALLAN_OVERLAP + 1 sums whatever the capture
+** length; a cluster size is reported once the capture holds at least
+** ALLAN_MIN_CLUSTERS clusters of it
+*/
+#define ALLAN_OCTAVES	20
+#define ALLAN_OVERLAP	64
+#define ALLAN_MIN_CLUSTERS	9
+#define ALLAN_DURATION_SECS	600
+/* bias instability is the flat floor of the deviation / sqrt(2 ln2 / pi) */
+#define BIAS_INSTABILITY_FACTOR	0.664
+
+/* Welch noise spectrum: Hann windowed FFTs of NOISE_FFT_SIZE samples
+** every NOISE_FFT_HOP samples (50% overlap); a local maximum more than
+** NOISE_PEAK_DB above the median of the NOISE_PEAK_NEIGHBOURS bins on
+** each side of it is a spectral peak
+*/
+#define NOISE_FFT_SIZE_BITS	8
+#define NOISE_FFT_SIZE	(1 << NOISE_FFT_SIZE_BITS)
+#define NOISE_FFT_HOP	(NOISE_FFT_SIZE / 2)
+#define NOISE_MIN_SEGMENTS	8
+#define NOISE_PEAK_DB	10
+#define NOISE_PEAK_NEIGHBOURS	8
+#define NOISE_DURATION_SECS	10
+
+/* sensors sharing a trigger get their timestamps from the same trigger
+** event, anything above this skew means they don't
+*/
+#define SYNC_SHARED_TRIGGER_TOLERANCE_US	100
+
+/* Virtual sensors fused from the first triggered accel, anglvel and magn:
+** a Madgwick filter with gain FUSION_BETA runs on every gyro sample and
+** gives orientation and rotation_vector samples, which are streamed to the
+** tests through a pipe with integer channels in FUSION_SCALE units
+*/
+#define FUSION_ACCEL	0
+#define FUSION_GYRO	1
+#define FUSION_MAGN	2
+#define FUSION_SOURCES	3
+#define FUSION_ORIENTATION	0
+#define FUSION_ROTATION_VECTOR	1
+#define FUSION_OUTPUTS	2
+#define FUSION_MAX_CHANNELS	4
+#define FUSION_BETA	0.1
+#define FUSION_SCALE	0.000001
+#define FUSION_TYPE_SPEC	"le:s32/32>>0"
+#define FUSION_TIMESTAMP_SPEC	"le:s64/64>>0"
+#define FUSION_POLL_TIMEOUT_MS	100
+
+/* IIO events: the event fd of a device is asked with an ioctl on its
+** device fd and reads one iio_event_struct per event; the code of an
+** event packs its type (thresh, mag, ...), direction and channel
+*/
+#ifndef IIO_GET_EVENT_FD_IOCTL
+#define IIO_GET_EVENT_FD_IOCTL	_IOR('i', 0x90, int)
+#endif
+#define EVENT_CODE_TYPE(id)	(((id) >> 56) & 0xff)
+#define EVENT_CODE_DIR(id)	(((id) >> 48) & 0x7f)
+#define EVENT_CODE_CHAN(id)	((int16_t)((id) & 0xffff))
+#define EVENTS_DURATION_SECS	10
+/* check_trigger: sample timestamps are taken when the trigger fires, an
+** hrtimer should keep its programmed rate within TRIGGER_MAX_RATE_ERROR_PPM
+*/
+#define TRIGGER_DURATION_SECS	10
+#define TRIGGER_MAX_RATE_ERROR_PPM	1000
+/* check_fanout: devices are attached to one hrtimer of the pool */
+#define FANOUT_TRIGGER_NAME	"fanout-hr"
+#define FANOUT_FREQ	100
+#define FANOUT_DURATION_SECS	5
+/* soak: streaming metrics of the sensors are written every
+** SOAK_INTERVAL_SECS in results_path/soak_metrics.jsonl along with a
+** checkpoint of the totals, which a soak run again resumes from
+*/
+#define SOAK_DURATION_SECS	3600
+#define SOAK_INTERVAL_SECS	60
+#define SOAK_GAP_PERIODS	1.5	/* a later sample follows a gap */
+#define SOAK_METRICS_JSONL	"/soak_metrics.jsonl"
+#define SOAK_CHECKPOINT	"/soak_checkpoint"
+#define SOAK_CHECKPOINT_VERSION	2
+#define SOAK_LINE_SIZE	(4 * BUFFER_SIZE)
+/* epoll_wait of poll_sensors returns at least this often, a long
+** duration in ms doesn't fit its timeout
+*/
+#define POLL_MAX_WAIT_SECS	1
+/* a sensor stalls when no sample comes for STALL_PERIODS periods, and
+** at least STALL_MIN_MILLISECS; the first sample has
+** STALL_FIRST_SAMPLE_MILLISECS more for the activation
+*/
+#define STALL_PERIODS	5
+#define STALL_MIN_MILLISECS	50
+#define STALL_FIRST_SAMPLE_MILLISECS	1000
+/* with confidence, timing tests stop once the confidence interval of
+** their metric is on one side of the threshold, looked at after
+** EARLY_STOP_MIN_SAMPLES samples then each time they double
+*/
+#define EARLY_STOP_MIN_SAMPLES	30
 #define INF	99999999
 #define MEASURE_FREQ 1
 #define CHECK_SAMPLE_TIMESTAMP_AVG_DIFF 2
@@ -99,8 +242,52 @@
 #define CHECK_CLIENT_DELAY	5
 #define JITTER	6
 #define STANDARD_DEVIATION	7
+#define CHECK_RATE_SWITCH	8
 
-#define HASHMAP_SIZE    15
+/* Rate switch test: stream at the current rate for a while, switch to
+** the new rate and wait for consecutive intervals close to the new period
+*/
+#define RATE_SWITCH_WARMUP_MS	1000
+#define RATE_SWITCH_SETTLE_INTERVALS	5
+
+/* Harness capacity benchmark: simulated sensors stream for
+** SELFBENCH_STEP_SECS at every step of the ramp; a step is sustained when
+** no sample was dropped and the p99 latency from sample timestamp to the
+** end of the wrapper is within SELFBENCH_LATENCY_MARGIN_US of the one
+** sensor, lowest rate step
+*/
+#define SELFBENCH_SENSORS	12
+#define SELFBENCH_FREQ	1000
+#define SELFBENCH_MAX_SENSORS	32
+#define SELFBENCH_STEP_SECS	1
+#define SELFBENCH_FIFO_SIZE	4096
+#define SELFBENCH_LATENCY_MARGIN_US	500
+#define SELFBENCH_MIN_RATE_RATIO	0.9
+#define SELFBENCH_CHANNELS	3
+#define SELFBENCH_TYPE_SPEC	"le:s16/16>>0"
+#define SELFBENCH_TIMESTAMP_SPEC	"le:s64/64>>0"
+
+/* Microbenchmark: every layout is decoded MICROBENCH_SAMPLES times per
+** run, from MICROBENCH_FILE_SAMPLES different samples; the best and
+** median of MICROBENCH_RUNS runs are reported
+*/
+#define MICROBENCH_SAMPLES	(1 << 20)
+#define MICROBENCH_FILE_SAMPLES	4096
+#define MICROBENCH_RUNS	5
+#define MICROBENCH_TIMESTAMP_SPEC	"le:s64/64>>0"
+#define MICROBENCH_USAGE	"Usage: %s [-n samples] [-r runs]\n"
+
+/* Results comparator: a metric regresses when it moved in the bad
+** direction by more than COMPARE_MIN_CHANGE percent and the Welch t
+** score is above COMPARE_T_SCORE, which needs several values per build
+*/
+#define COMPARE_MIN_CHANGE	5.0
+#define COMPARE_T_SCORE	3.0
+#define BASELINE	0
+#define CANDIDATE	1
+#define FAILURE_RATE	"failure_rate"
+#define COMPARE_USAGE	"Usage: %s [-r min_change_percent] [-t t_score] [-v] " \
+		"-b baseline.jsonl [-b ...] -c candidate.jsonl [-c ...]\n"
 
 #define PROCESS 1
 #define FINALIZE 0
@@ -132,7 +319,8 @@ typedef enum parsing_state_t{
 	DELAY_STATE = 3,
 	DURATION_STATE = 4,
 	COUNTER_STATE = 5,
-	FINISH_STATE = 6
+	FINISH_STATE = 6,
+	CONFIDENCE_STATE = 7
 }parsing_state;
 
 /* define tests states 
@@ -161,6 +349,7 @@ typedef struct
 	char *description;
 	int log_fd;
 	test_state state;
+	int64_t duration_ms;
 }
 test_info_t;
 
@@ -170,8 +359,29 @@ test_info_t;
 typedef struct timestamp_info_struct_t{
 	int counter;
 	int64_t all_consec_timestamps_diff;
+	int max_difference;	/* worst value checked against max_delay, ms */
 }timestamp_info_struct;
 
+/* define structure for rate switch tests
+** timestamps are sample timestamps, switch ones are taken around write_freq
+** settle_timestamp is start of the first run of intervals close to new rate
+*/
+typedef struct rate_switch_struct_t{
+	float old_rate;
+	float new_rate;
+	int switched;
+	int settled;
+	int settled_intervals;
+	int old_rate_samples;
+	int lost_samples;
+	int counter;
+	int64_t first_timestamp;
+	int64_t switch_timestamp;
+	int64_t switch_done_timestamp;
+	int64_t settle_candidate_timestamp;
+	int64_t settle_timestamp;
+}rate_switch_struct;
+
 /* define structure for jitter tests */
 typedef struct jitter_struct_t{
 	int counter;
@@ -179,6 +389,16 @@ typedef struct jitter_struct_t{
 	int64_t *timestamp_values;
 }jitter_struct;
 
+/* define structure for check_sync tests: timestamps of a sensor and
+** the current trigger of its device when the test started
+*/
+typedef struct sync_struct_t{
+	int counter;
+	int timestamp_values_size;
+	int64_t *timestamp_values;
+	char trigger[MAX_NAME_SIZE];
+}sync_struct;
+
 /* define structure for standard deviation */
 typedef struct standard_deviation_struct_t{
 	int counter;
@@ -186,19 +406,414 @@ typedef struct standard_deviation_struct_t{
 	float **channels_values;
 }standard_deviation_struct;
 
+/* arena blocks are chained, data follows the header */
+typedef struct arena_block_struct_t{
+	struct arena_block_struct_t *next;
+	size_t size;
+	size_t used;
+	char data[] __attribute__((aligned(ARENA_ALIGNMENT)));
+}arena_block_struct;
+
+typedef struct arena_struct_t{
+	arena_block_struct *first;
+	arena_block_struct *current;
+}arena_struct;
+
+/* sensor selected by a command, with its own time attributes */
+typedef struct selected_sensor_struct_t{
+	int sensor_index;
+	time_attributes_struct time_attributes;
+}selected_sensor_struct;
+
+/* perf counter of the acquisition thread, fd is -1 when the
+** kernel or the hardware doesn't provide it
+*/
+typedef struct perf_counter_struct_t{
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+	int fd;
+}perf_counter_struct;
+
+/* metric computed by a test; threshold is NAN when the test has none */
+typedef struct result_metric_struct_t{
+	int sensor_index;
+	char *name;
+	double value;
+	double threshold;
+	const char *unit;
+}result_metric_struct;
+
+/* everything written in the results record of the running test;
+** arrays live in the test arena and are gone after the record is written
+*/
+typedef struct test_record_struct_t{
+	int64_t start_realtime;
+	int64_t start_monotonic;
+	char **commands;
+	int commands_count;
+	int commands_size;
+	selected_sensor_struct *sensors;
+	int sensors_count;
+	int sensors_size;
+	result_metric_struct *metrics;
+	int metrics_count;
+	int metrics_size;
+}test_record_struct;
+
+/* sample layout of the microbenchmark: num_channels channels with the
+** same type spec followed by a 64 bit timestamp
+*/
+typedef struct microbench_layout_struct_t{
+	const char *name;
+	const char *type_spec;
+	int num_channels;
+}microbench_layout_struct;
+
+/* direction in which a metric gets worse */
+typedef enum compare_direction_t{
+	HIGHER_IS_WORSE = 0,
+	LOWER_IS_WORSE = 1,
+	ANY_CHANGE = 2
+}compare_direction;
+
+typedef struct {
+	const char *name;
+	compare_direction direction;
+} compare_metric_entry_t;
+
+/* values of one metric in one set of runs */
+typedef struct compare_values_struct_t{
+	double *values;
+	int count;
+	int size;
+}compare_values_struct;
+
+/* one metric of one sensor in one test, identified by the test
+** description, the sensor id and the metric name
+*/
+typedef struct compare_series_struct_t{
+	char *description;
+	char *sensor;
+	char *name;
+	char *unit;
+	compare_values_struct runs[2];	/* baseline, candidate */
+}compare_series_struct;
+
+/* state of one sensor during a poll_sensors run; epoll events carry
+** a pointer to it, values is the test specific accumulator and samples
+** are decoded with the channel offsets computed by set_sample_format
+*/
+typedef struct run_sensor_struct_t{
+	int sensor_index;
+	int fd;
+	time_attributes_struct *time_attributes;
+	void *values;
+	pthread_t thread;	/* data ready signal for polling mode sensors */
+	struct run_context_struct_t *context;
+	struct stage_profile_struct_t *profile;	/* stage latencies, see iio_profile.c */
+	int mode;	/* mode of the sensor, MODE_EVENT when fd is its event fd */
+	struct stall_struct_t *stall;	/* see iio_stall.c */
+	struct early_stop_struct_t *early_stop;	/* see iio_early_stop.c */
+}run_sensor_struct;
+
+/* deadline of a sensor in poll_sensors, re-armed by every sample */
+typedef struct stall_struct_t{
+	int timer_fd;
+	int64_t deadline;	/* ns */
+	int64_t last_timestamp;	/* last sample, or start of the watch */
+	int stalled;
+	int count;
+	int64_t longest;
+	int64_t total;
+}stall_struct;
+
+/* running mean and deviation of the metric of a timing test */
+typedef struct early_stop_struct_t{
+	int64_t counter;
+	double mean;
+	double m2;
+	int64_t start;	/* monotonic, first value */
+	int64_t next_look;	/* counter of the next look at the interval */
+	int looks;
+	int settled;
+}early_stop_struct;
+
+/* sensors of a poll_sensors run, in a dense array */
+typedef struct run_context_struct_t{
+	int epfd;
+	int sensors_count;
+	int watched;	/* sensors with a fd added to epfd */
+	int settled;	/* sensors whose test outcome is known, see iio_early_stop.c */
+	run_sensor_struct *sensors;
+}run_context_struct;
+
+/* define structure for latency histograms, values are in ns */
+typedef struct histogram_struct_t{
+	int64_t counter;
+	int64_t min;
+	int64_t max;
+	int64_t sum;
+	int64_t buckets[HISTOGRAM_BUCKETS];
+}histogram_struct;
+
+/* define structure for activation/deactivation latency 
+** enable_write/disable_write is time spent writing buffer/enable
+** first_sample is time from enable until first sample is readable
+** stream_stop is time from disable until last sample was received
+*/
+typedef struct activation_latency_struct_t{
+	int64_t enable_timestamp;
+	int64_t disable_timestamp;
+	int64_t disable_write_timestamp;
+	int missed_first_samples;
+	histogram_struct enable_write;
+	histogram_struct first_sample;
+	histogram_struct disable_write;
+	histogram_struct stream_stop;
+}activation_latency_struct;
+
+/* when the sample being handled went through each stage of the
+** acquisition path, -1 if it didn't; harness stages use the monotonic
+** clock, epoll_return_realtime is compared with the sample timestamp
+*/
+typedef struct stage_timestamps_struct_t{
+	int64_t epoll_return;
+	int64_t epoll_return_realtime;
+	int64_t read_done;
+	int64_t decode_done;
+	int64_t sample_timestamp;
+}stage_timestamps_struct;
+
+/* per sensor stage latencies of one test, values are in ns:
+** wakeup from sample timestamp to epoll return (device and kernel),
+** then read, decode and wrapper time spent by the harness
+*/
+typedef struct stage_profile_struct_t{
+	histogram_struct wakeup;
+	histogram_struct read;
+	histogram_struct decode;
+	histogram_struct wrapper;
+}stage_profile_struct;
+
+/* one cluster size of a streaming Allan variance; cumulative sums are
+** kept every stride samples in a ring of 2 * lag + 1 entries, so
+** cluster_size = lag * stride
+*/
+typedef struct allan_octave_struct_t{
+	int cluster_size;
+	int stride;
+	int lag;
+	double *sums;
+	int64_t recorded;
+	double total;	/* squared differences of consecutive cluster averages */
+	int64_t terms;
+}allan_octave_struct;
+
+/* one channel; values are offset by the first one to keep the
+** cumulative sum small
+*/
+typedef struct allan_channel_struct_t{
+	double offset;
+	double sum;
+	int64_t counter;
+	allan_octave_struct octaves[ALLAN_OCTAVES];
+}allan_channel_struct;
+
+typedef struct allan_variance_struct_t{
+	int num_channels;
+	int64_t first_timestamp;
+	int64_t last_timestamp;
+	int64_t counter;
+	allan_channel_struct *channels;
+}allan_variance_struct;
+
+/* one channel of a Welch noise spectrum: the last NOISE_FFT_SIZE values
+** and the sum of the periodograms, NOISE_FFT_SIZE / 2 + 1 bins
+*/
+typedef struct noise_channel_struct_t{
+	double *values;
+	double *power;
+}noise_channel_struct;
+
+/* tables and work buffers of the FFT are shared by the channels */
+typedef struct noise_spectrum_struct_t{
+	int num_channels;
+	int64_t first_timestamp;
+	int64_t last_timestamp;
+	int64_t counter;
+	int64_t segments;
+	double *window;
+	double window_power;	/* sum of the squared window */
+	double *cos_table;
+	double *sin_table;
+	double *re;
+	double *im;
+	noise_channel_struct *channels;
+}noise_spectrum_struct;
+
+/* simulated device of the capacity benchmark: a thread writes samples
+** in a pipe at freq and drops them, like a full iio buffer, when the
+** harness doesn't read them in time
+*/
+typedef struct selfbench_device_struct_t{
+	int write_fd;
+	float freq;
+	volatile int stop;
+	int started;
+	int64_t written;
+	int64_t dropped;
+	int64_t first_write;
+	int64_t last_write;
+	pthread_t thread;
+}selfbench_device_struct;
+
+/* outcome of one step of the capacity benchmark */
+typedef struct selfbench_step_struct_t{
+	int sensors;
+	float freq;
+	int64_t written;
+	int64_t dropped;
+	float produced_rate;	/* slowest simulated device */
+	histogram_struct latency;	/* sample timestamp to end of the wrapper */
+	int sustained;
+}selfbench_step_struct;
+
+/* hrtimer trigger of the pool, see iio_set_trigger.c */
+typedef struct hrtimer_struct_t{
+	char name[MAX_NAME_SIZE];	/* trigger name, ex: accel_3d-hr-dev0 */
+	int trigger_nr;
+	int created;	/* made by the framework, in this run or an earlier one */
+	float freq;	/* last sampling_frequency written, 0 if unknown */
+}hrtimer_struct;
+
+/* physical sensor feeding the fusion */
+typedef struct fusion_source_struct_t{
+	int sensor_index;	/* -1 when the device has no such sensor */
+	int fd;
+	int owner;	/* source which reads fd when sensors share a device */
+	float values[3];
+	int64_t timestamp;	/* newest sample, -1 before the first one */
+}fusion_source_struct;
+
+/* fusion shared by the virtual sensors, it runs while one of them is read */
+typedef struct fusion_struct_t{
+	fusion_source_struct sources[FUSION_SOURCES];
+	int outputs[FUSION_OUTPUTS];	/* virtual sensor indexes, -1 if not added */
+	int write_fds[FUSION_OUTPUTS];	/* -1 while no test reads the output */
+	int users;
+	int stop;	/* shared with the fusion thread, __atomic loads and stores only */
+	pthread_t thread;
+	pthread_mutex_t lock;
+	float q[4];	/* w, x, y, z from the sensor frame to the earth frame */
+	int64_t gyro_timestamp;
+	histogram_struct latency[FUSION_OUTPUTS];	/* newest source sample to output */
+	int64_t produced[FUSION_OUTPUTS];
+	int64_t dropped[FUSION_OUTPUTS];
+}fusion_struct;
+
+/* event as read from the event fd, same layout as struct iio_event_data */
+typedef struct iio_event_struct_t{
+	uint64_t id;
+	int64_t timestamp;
+}iio_event_struct;
+
+/* define structure for check_events tests: events/ attributes enabled by
+** the test, to disable them at the end, and the events delivered
+*/
+typedef struct events_struct_t{
+	int event_fd;
+	char **attributes;
+	int attributes_count;
+	int64_t counter;
+	int64_t samples;	/* data samples read from the buffer meanwhile */
+	int64_t start;
+	int violations;
+	histogram_struct latency;	/* event timestamp to delivery */
+}events_struct;
+
+/* define structure for check_trigger tests: intervals between the
+** timestamps of a sensor against the period of its hrtimer
+*/
+typedef struct trigger_accuracy_struct_t{
+	int concurrent;	/* other hrtimers fire during the test */
+	float freq;	/* sampling_frequency of the hrtimer */
+	int64_t period;
+	int64_t counter;
+	int64_t first_timestamp;
+	int64_t last_timestamp;
+	int64_t ticks;	/* periods elapsed between the first and last sample */
+	int64_t missed;
+	histogram_struct jitter;	/* |interval - period| */
+}trigger_accuracy_struct;
+
+/* one tick of a trigger shared by several devices */
+typedef struct fanout_tick_struct_t{
+	int delivered;	/* devices which read a sample of the tick */
+	int64_t first_delivery;
+	int64_t last_delivery;
+}fanout_tick_struct;
+
+/* ticks of the shared trigger during one step of check_fanout */
+typedef struct fanout_ticks_struct_t{
+	int devices;
+	float freq;
+	int64_t period;
+	int64_t base;	/* timestamp of tick 0, -1 before the first sample */
+	int size;
+	fanout_tick_struct *ticks;
+}fanout_ticks_struct;
+
+/* define structure for check_fanout tests, one per device */
+typedef struct fanout_struct_t{
+	fanout_ticks_struct *shared;
+	int64_t counter;
+	int64_t first_tick;
+	int64_t last_tick;
+	int64_t missed;
+	histogram_struct latency;	/* tick to delivery of its sample */
+}fanout_struct;
+
+/* streaming statistics of a soak sensor, over an interval or the whole
+** soak; intervals between samples and channel values use Welford sums
+*/
+typedef struct soak_stats_struct_t{
+	int64_t counter;
+	int64_t intervals;
+	int64_t gaps;
+	double interval_mean;	/* ns */
+	double interval_m2;
+	double *channel_mean;
+	double *channel_m2;
+	histogram_struct delay;	/* sample timestamp to read */
+}soak_stats_struct;
+
+/* define structure for soak tests */
+typedef struct soak_struct_t{
+	int sensor_index;
+	int num_channels;
+	int64_t period;	/* expected interval, 0 if the rate is unknown */
+	int64_t last_timestamp;
+	float worst_jitter;	/* worst interval */
+	int64_t worst_delay_p99;
+	int violations;
+	soak_stats_struct interval;
+	soak_stats_struct total;
+}soak_struct;
+
 typedef struct
 {
-	const char *name;	/* channel name ; ex: x */
+	char *name;	/* channel name ; ex: x */
 
 	/* sysfs entries located under scan_elements */
-	const char *en_path;	/* Enabled sysfs file name ; ex: "in_temp_en" */
-	const char *type_path;	/* _type sysfs file name  */
-	const char *index_path;	/* _index sysfs file name */
+	char *en_path;	/* Enabled sysfs file name ; ex: "in_temp_en" */
+	char *type_path;	/* _type sysfs file name  */
+	char *index_path;	/* _index sysfs file name */
 	
 	/* sysfs entries located in /sys/bus/iio/devices/iio:deviceX */
-	const char *raw_path;	/* _raw sysfs file name  */
-	const char *input_path;	/* _input sysfs file name */
-	const char *scale_path;	/* _scale sysfs file name */
+	char *raw_path;	/* _raw sysfs file name  */
+	char *input_path;	/* _input sysfs file name */
+	char *scale_path;	/* _scale sysfs file name */
 }
 channel_descriptor_t;
 
@@ -216,6 +831,7 @@ typedef struct
 {
 	int size;	/* Field size in bytes */
 	int index;	/*associated index*/
+	int offset;	/* Field position in a sample, in bytes */
 	float last_value;
 	int opt_scale;
 	float scale;	/* Scale for each channel */
@@ -228,9 +844,10 @@ channel_info_t;
 typedef struct {
 	char internal_name[MAX_NAME_SIZE];	/* ex: accel_3d	             */
 	char init_trigger_name[MAX_NAME_SIZE];	/* ex: accel-name-dev1	     */
-	const int type;		/* Sensor type ; ex: SENSOR_TYPE_ACCELEROMETER */
-	char triggers[MAX_TRIGGERS][MAX_NAME_SIZE];
+	int type;		/* Sensor type ; ex: SENSOR_TYPE_ACCELEROMETER */
+	char (*triggers)[MAX_NAME_SIZE];
 	int trigger_nr;	/* number of triggers associated with this device */
+	int triggers_size;	/* allocated entries in triggers */
 	int found_implicit_trigger;
 	int hr_trigger_nr;
 	float offset;		/* (cooked = raw + offset) * scale			*/
@@ -239,53 +856,65 @@ typedef struct {
 	int num_channels;	/* Actual channel count ; 0 for poll mode sensors	*/
 	int mode;	/* Usage mode, ex: poll, trigger ... */
 	int is_virtual;
-	channel_info_t channel_info[MAX_CHANNELS];
+	channel_info_t *channel_info;	/* num_channels entries */
 	channel_info_t timestamp;
-	const char *tag;	/* Prefix such as "accel", "gyro", "temp"... */
-	channel_descriptor_t channel_descriptor[MAX_CHANNELS];
+	char tag[MAX_NAME_SIZE];	/* Prefix such as "accel", "gyro", "temp"... */
+	char id[MAX_NAME_SIZE];	/* tag#instance when there are several sensors with same tag */
+	int instance;	/* 0 for first sensor with this tag, 1 for the next one... */
+	channel_descriptor_t *channel_descriptor;	/* num_channels entries */
 	int read_fd;
 	int write_fd;
+	int warm_fd;	/* device fd kept open between commands in server mode */
+	int trigger_attached;	/* init trigger is still set in server mode */
 	int64_t last_timestamp;
 	float data_rate;
 	int discovered;
 	int sample_size;
+	activation_latency_struct activation_latency;
 } sensor_info_iio_ext_t;
 
-
-
-/*
-** Macros associating iio sysfs entries to sensor types 
+/* channel found in sysfs while enumerating; ex: accel_x has tag accel
+** and name x, index is the scan index or -1 for polling channels
 */
+typedef struct {
+	char channel[MAX_NAME_SIZE];
+	char tag[MAX_NAME_SIZE];
+	char name[MAX_NAME_SIZE];
+	int index;
+} found_channel_t;
 
-#define DECLARE_VOID_CHANNEL(tag)	\
-			tag,	\
-			"",	\
-			"",	\
-			"",	\
-			"",	\
-			"",	\
-			"",	\
-
-#define DECLARE_CHANNEL(tag, spacer, name)		\
-			name,				\
-			"in_" tag spacer name "_en",	\
-			"in_" tag spacer name "_type",	\
-			"in_" tag spacer name "_index",	\
-			"in_" tag spacer name "_raw",	\
-			"in_" tag spacer name "_input",	\
-			"in_" tag spacer name "_scale",	\
-
-#define DECLARE_NAMED_CHANNEL(tag, name)	DECLARE_CHANNEL(tag, "_", name)
+/* element of a device scan, used to compute channel offsets */
+typedef struct {
+	int index;
+	int size;
+	int *offset;
+} scan_element_t;
 
-#define DECLARE_GENERIC_CHANNEL(tag)		DECLARE_CHANNEL(tag, "", "")
+/* sensor types we know about; channels come from sysfs, every
+** tag found on a device gets its own sensor entry
+*/
+typedef struct {
+	const char *tag;
+	int type;
+	int is_virtual;
+} sensor_catalog_entry_t;
 
 extern test_info_t *tests;
-extern sensor_info_iio_ext_t g_sensor_info_iio_ext[MAX_SENSORS];
+extern sensor_info_iio_ext_t *g_sensor_info_iio_ext;
 extern int g_sensor_info_size;
+extern const sensor_catalog_entry_t g_sensor_catalog[];
+extern int g_sensor_catalog_size;
 extern int g_sensor_iio_count;
 extern int current_fd;
+extern int g_keep_warm;
+extern int g_write_junit;
+extern int g_trace;
+extern int g_perf_counters;
+extern stage_timestamps_struct g_stage_timestamps;
 extern int nr_test;
 extern level log_level;
-extern Hashmap *map_sensor_index_to_time_attributes;
-extern Hashmap *map_fd_to_sensor_index;
+extern selected_sensor_struct *selected_sensors;
+extern int selected_sensors_count;
+extern float g_confidence;
+extern arena_struct g_test_arena;
 #endif
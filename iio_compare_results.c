@@ -0,0 +1,506 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "iio_common.h"
+
+/*
+** Host tool comparing tests_results.jsonl files of two builds of the
+** same device. Values of a metric are gathered from every record of a
+** test (a test repeated in the suite or several result files per build
+** give a distribution). A metric regresses when it moved in its bad
+** direction by more than the minimum change and the difference of the
+** means is significant by the Welch t score. With less than two values
+** in a build there is no spread to test against, and such a move is only
+** reported as insufficient samples. A test failing more often regresses
+** whatever the number of runs.
+**
+** The parser only handles the JSON written by iio_results.c.
+*/
+
+static compare_series_struct *series;
+static int series_count;
+static int series_size;
+
+/* metrics which don't get worse when they grow, by name prefix */
+static const compare_metric_entry_t metric_directions[] = {
+	{"samples", LOWER_IS_WORSE},
+	{"max_freq", LOWER_IS_WORSE},
+	{"spectral_peak_freq", ANY_CHANGE},
+	{"skew_mean", ANY_CHANGE},
+	{"skew_drift", ANY_CHANGE},
+	{"measured_rate", ANY_CHANGE},
+	{"average_sample_interval", ANY_CHANGE},
+	{"events", ANY_CHANGE},
+	{"event_rate", ANY_CHANGE},
+	{"trigger_freq", ANY_CHANGE},
+	{"fanout_ticks", ANY_CHANGE},
+	{"soak_samples", LOWER_IS_WORSE},
+	{"soak_rate", ANY_CHANGE},
+	{"soak_duration", ANY_CHANGE},
+	{"soak_intervals", ANY_CHANGE},
+	{"early_stop_samples", ANY_CHANGE},
+};
+
+static void* checked_realloc(void *ptr, size_t size) {
+	ptr = realloc(ptr, size);
+	if (ptr == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(-1);
+	}
+	return ptr;
+}
+
+static char* checked_strdup(const char *str) {
+	char *copy;
+
+	copy = strdup(str);
+	if (copy == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(-1);
+	}
+	return copy;
+}
+
+static compare_direction get_direction(const char *name) {
+	unsigned int i;
+
+	for (i = 0; i < sizeof(metric_directions) / sizeof(metric_directions[0]); i++)
+		if (strncmp(name, metric_directions[i].name,
+			strlen(metric_directions[i].name)) == 0)
+			return metric_directions[i].direction;
+	return HIGHER_IS_WORSE;
+}
+
+static compare_series_struct* get_series(const char *description, const char *sensor,
+	const char *name, const char *unit) {
+	compare_series_struct *entry;
+	int i;
+
+	for (i = 0; i < series_count; i++) {
+		entry = &series[i];
+		if (strcmp(entry->description, description) == 0 &&
+			strcmp(entry->sensor, sensor) == 0 && strcmp(entry->name, name) == 0)
+			return entry;
+	}
+	if (series_count == series_size) {
+		series_size = series_size ? series_size * 2 : 64;
+		series = (compare_series_struct*)checked_realloc(series,
+			series_size * sizeof(compare_series_struct));
+	}
+	entry = &series[series_count++];
+	memset(entry, 0, sizeof(compare_series_struct));
+	entry->description = checked_strdup(description);
+	entry->sensor = checked_strdup(sensor);
+	entry->name = checked_strdup(name);
+	entry->unit = checked_strdup(unit);
+	return entry;
+}
+
+static void add_value(compare_series_struct *entry, int run, double value) {
+	compare_values_struct *values;
+
+	values = &entry->runs[run];
+	if (values->count == values->size) {
+		values->size = values->size ? values->size * 2 : 8;
+		values->values = (double*)checked_realloc(values->values,
+			values->size * sizeof(double));
+	}
+	values->values[values->count++] = value;
+}
+
+/* minimal JSON reader over one record line */
+
+static const char* skip_spaces(const char *p) {
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		p++;
+	return p;
+}
+
+/* copy a JSON string in out (truncated to out_size); return the
+** position after it or NULL if p is not a string
+*/
+static const char* read_string(const char *p, char *out, int out_size) {
+	int len;
+
+	p = skip_spaces(p);
+	if (*p != '"')
+		return NULL;
+	p++;
+	len = 0;
+	while (*p && *p != '"') {
+		if (*p == '\\') {
+			p++;
+			if (*p == 'u') {
+				/* only control characters are escaped this way */
+				if (strlen(p) < 5)
+					return NULL;
+				p += 4;
+				if (len < out_size - 1)
+					out[len++] = '?';
+				p++;
+				continue;
+			}
+			if (*p == 'n' && len < out_size - 1)
+				out[len++] = '\n';
+			else if (*p == 't' && len < out_size - 1)
+				out[len++] = '\t';
+			else if (*p && len < out_size - 1)
+				out[len++] = *p;
+			if (*p)
+				p++;
+			continue;
+		}
+		if (len < out_size - 1)
+			out[len++] = *p;
+		p++;
+	}
+	if (*p != '"')
+		return NULL;
+	out[len] = '\0';
+	return p + 1;
+}
+
+/* number or null (NAN) */
+static const char* read_number(const char *p, double *value) {
+	char *end;
+
+	p = skip_spaces(p);
+	if (strncmp(p, "null", 4) == 0) {
+		*value = NAN;
+		return p + 4;
+	}
+	*value = strtod(p, &end);
+	if (end == p)
+		return NULL;
+	return end;
+}
+
+/* skip any JSON value */
+static const char* skip_value(const char *p) {
+	char buffer[BUFFER_SIZE];
+	int depth;
+
+	p = skip_spaces(p);
+	if (*p == '"')
+		return read_string(p, buffer, BUFFER_SIZE);
+	if (*p != '{' && *p != '[') {
+		while (*p && *p != ',' && *p != '}' && *p != ']')
+			p++;
+		return p;
+	}
+	depth = 0;
+	while (*p) {
+		if (*p == '"') {
+			p = read_string(p, buffer, BUFFER_SIZE);
+			if (p == NULL)
+				return NULL;
+			continue;
+		}
+		if (*p == '{' || *p == '[')
+			depth++;
+		else if (*p == '}' || *p == ']') {
+			depth--;
+			if (depth == 0)
+				return p + 1;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+static const char* read_metric(const char *p, const char *description, int run) {
+	char key[MAX_NAME_SIZE];
+	char sensor[MAX_NAME_SIZE];
+	char name[MAX_NAME_SIZE];
+	char unit[MAX_NAME_SIZE];
+	double value;
+
+	sensor[0] = name[0] = unit[0] = '\0';
+	value = NAN;
+	p = skip_spaces(p);
+	if (*p != '{')
+		return NULL;
+	p = skip_spaces(p + 1);
+	while (*p != '}') {
+		p = read_string(p, key, MAX_NAME_SIZE);
+		if (p == NULL)
+			return NULL;
+		p = skip_spaces(p);
+		if (*p != ':')
+			return NULL;
+		p++;
+		if (strcmp(key, "sensor") == 0)
+			p = read_string(p, sensor, MAX_NAME_SIZE);
+		else if (strcmp(key, "name") == 0)
+			p = read_string(p, name, MAX_NAME_SIZE);
+		else if (strcmp(key, "unit") == 0)
+			p = read_string(p, unit, MAX_NAME_SIZE);
+		else if (strcmp(key, "value") == 0)
+			p = read_number(p, &value);
+		else
+			p = skip_value(p);
+		if (p == NULL)
+			return NULL;
+		p = skip_spaces(p);
+		if (*p == ',')
+			p = skip_spaces(p + 1);
+		else if (*p != '}')
+			return NULL;
+	}
+	if (name[0] && !isnan(value))
+		add_value(get_series(description, sensor, name, unit), run, value);
+	return p + 1;
+}
+
+/* read one record; metrics are added after the description is known,
+** which iio_results.c always writes first
+*/
+static int read_record(const char *line, int run) {
+	char key[MAX_NAME_SIZE];
+	char description[BUFFER_SIZE];
+	char state[MAX_NAME_SIZE];
+	const char *p;
+
+	description[0] = state[0] = '\0';
+	p = skip_spaces(line);
+	if (*p != '{')
+		return -1;
+	p = skip_spaces(p + 1);
+	while (*p != '}') {
+		p = read_string(p, key, MAX_NAME_SIZE);
+		if (p == NULL)
+			return -1;
+		p = skip_spaces(p);
+		if (*p != ':')
+			return -1;
+		p++;
+		if (strcmp(key, "description") == 0)
+			p = read_string(p, description, BUFFER_SIZE);
+		else if (strcmp(key, "state") == 0)
+			p = read_string(p, state, MAX_NAME_SIZE);
+		else if (strcmp(key, "metrics") == 0) {
+			p = skip_spaces(p);
+			if (*p != '[')
+				return -1;
+			p = skip_spaces(p + 1);
+			while (*p != ']') {
+				p = read_metric(p, description, run);
+				if (p == NULL)
+					return -1;
+				p = skip_spaces(p);
+				if (*p == ',')
+					p = skip_spaces(p + 1);
+				else if (*p != ']')
+					return -1;
+			}
+			p++;
+		}
+		else
+			p = skip_value(p);
+		if (p == NULL)
+			return -1;
+		p = skip_spaces(p);
+		if (*p == ',')
+			p = skip_spaces(p + 1);
+		else if (*p != '}')
+			return -1;
+	}
+	if (state[0])
+		add_value(get_series(description, "-", FAILURE_RATE, "%"), run,
+			strcmp(state, "failed") == 0 ? 100 : 0);
+	return 0;
+}
+
+static int read_results(const char *path, int run) {
+	FILE *file;
+	char *line;
+	size_t line_size;
+	int line_nr;
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return -1;
+	}
+	line = NULL;
+	line_size = 0;
+	line_nr = 0;
+	while (getline(&line, &line_size, file) != -1) {
+		line_nr++;
+		if (skip_spaces(line)[0] == '\0')
+			continue;
+		if (read_record(line, run) == -1)
+			fprintf(stderr, "%s:%d: malformed record skipped\n", path, line_nr);
+	}
+	free(line);
+	fclose(file);
+	return 0;
+}
+
+static void get_mean_and_variance(compare_values_struct *values, double *mean,
+	double *variance) {
+	int i;
+
+	*mean = 0;
+	*variance = 0;
+	for (i = 0; i < values->count; i++)
+		*mean += values->values[i];
+	*mean /= values->count;
+	if (values->count < 2)
+		return;
+	for (i = 0; i < values->count; i++)
+		*variance += (values->values[i] - *mean) * (values->values[i] - *mean);
+	*variance /= values->count - 1;
+}
+
+/* compare one series; return 1 if it regressed, 2 if it moved in its
+** bad direction without enough values to tell
+*/
+static int compare_series(compare_series_struct *entry, double min_change,
+	double t_threshold, int verbose) {
+	compare_values_struct *base;
+	compare_values_struct *cand;
+	compare_direction direction;
+	double base_mean, base_var;
+	double cand_mean, cand_var;
+	double change;
+	double t_score;
+	double error;
+	int significant;
+	int worse;
+	const char *verdict;
+
+	base = &entry->runs[BASELINE];
+	cand = &entry->runs[CANDIDATE];
+	if (base->count == 0 || cand->count == 0) {
+		if (verbose)
+			printf("MISSING     %s %s %s: only in %s\n", entry->description,
+				entry->sensor, entry->name, base->count ? "baseline" : "candidate");
+		return 0;
+	}
+
+	get_mean_and_variance(base, &base_mean, &base_var);
+	get_mean_and_variance(cand, &cand_mean, &cand_var);
+
+	if (base_mean != 0)
+		change = (cand_mean - base_mean) / fabs(base_mean) * 100;
+	else
+		change = (cand_mean == 0) ? 0 : INFINITY;
+
+	/* a test failing more often is reported whatever the spread */
+	t_score = NAN;
+	significant = 1;
+	if (strcmp(entry->name, FAILURE_RATE) != 0 && (base->count < 2 || cand->count < 2))
+		significant = 0;
+	else if (strcmp(entry->name, FAILURE_RATE) != 0) {
+		error = sqrt(base_var / base->count + cand_var / cand->count);
+		if (error > 0)
+			t_score = (cand_mean - base_mean) / error;
+		else
+			t_score = (cand_mean == base_mean) ? 0 : INFINITY;
+		significant = fabs(t_score) > t_threshold;
+	}
+
+	direction = get_direction(entry->name);
+	if (direction == ANY_CHANGE)
+		worse = 1;
+	else if (direction == LOWER_IS_WORSE)
+		worse = cand_mean < base_mean;
+	else
+		worse = cand_mean > base_mean;
+
+	if (significant && fabs(change) > min_change)
+		verdict = worse ? "REGRESSION" : "IMPROVED";
+	/* single values have no spread, a change of one run proves nothing */
+	else if (isnan(t_score) && fabs(change) > min_change && worse)
+		verdict = "INSUFFICIENT";
+	else
+		verdict = "UNCHANGED";
+
+	if (verbose || strcmp(verdict, "UNCHANGED") != 0)
+		printf("%-12s %s %s %s: %g -> %g %s (%+.1f%%, t=%.2f, n=%d/%d)%s\n", verdict,
+			entry->description, entry->sensor, entry->name, base_mean, cand_mean,
+			entry->unit, change, t_score, base->count, cand->count,
+			strcmp(verdict, "INSUFFICIENT") == 0 ? " insufficient samples" : "");
+	if (strcmp(verdict, "INSUFFICIENT") == 0)
+		return 2;
+	return strcmp(verdict, "REGRESSION") == 0;
+}
+
+int main(int argc, char *argv[]) {
+	double min_change;
+	double t_threshold;
+	int verbose;
+	int opt;
+	int inputs[2];
+	int regressions;
+	int insufficient;
+	int ret;
+	int i;
+
+	min_change = COMPARE_MIN_CHANGE;
+	t_threshold = COMPARE_T_SCORE;
+	verbose = 0;
+	inputs[BASELINE] = inputs[CANDIDATE] = 0;
+	while ((opt = getopt(argc, argv, "r:t:vb:c:")) != -1) {
+		switch (opt) {
+			case 'r':
+				min_change = atof(optarg);
+				break;
+			case 't':
+				t_threshold = atof(optarg);
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			case 'b':
+				if (read_results(optarg, BASELINE) == -1)
+					return 2;
+				inputs[BASELINE]++;
+				break;
+			case 'c':
+				if (read_results(optarg, CANDIDATE) == -1)
+					return 2;
+				inputs[CANDIDATE]++;
+				break;
+			default:
+				printf(COMPARE_USAGE, argv[0]);
+				return 2;
+		}
+	}
+	if (!inputs[BASELINE] || !inputs[CANDIDATE]) {
+		printf(COMPARE_USAGE, argv[0]);
+		return 2;
+	}
+
+	regressions = 0;
+	insufficient = 0;
+	for (i = 0; i < series_count; i++) {
+		ret = compare_series(&series[i], min_change, t_threshold, verbose);
+		if (ret == 1)
+			regressions++;
+		else if (ret == 2)
+			insufficient++;
+	}
+	printf("%d metrics compared, %d regressions, %d with insufficient samples\n",
+		series_count, regressions, insufficient);
+	return regressions ? 1 : 0;
+}
@@ -27,13 +27,75 @@
 #include <time.h>
 #include <stdarg.h>
 #include <dirent.h>
-#include "cutils/hashmap.h"
 #include "iio_control.h"
+#include "iio_activation_latency.h"
 #include "iio_set_trigger.h"
 #include "iio_sample_format.h"
 #include "iio_utils.h"
+#include "iio_profile.h"
+#include "iio_trace.h"
+#include "iio_fusion.h"
 #include "iio_common.h"
 
+/* set by the server: device fds and triggers stay set up between commands */
+int g_keep_warm = 0;
+
+/* open /dev/iio:deviceN of a sensor; when warm, the fd opened once
+** for a device is handed out again instead of opening a new one
+*/
+int open_device_fd(int sensor_index, int flags) {
+	char sysfs_path[PATH_MAX];
+	int dev_num;
+	int fd;
+	int s;
+
+	/* virtual sensors are read from the pipe of the fusion */
+	if (g_sensor_info_iio_ext[sensor_index].is_virtual)
+		return open_fusion_fd(sensor_index, flags);
+
+	dev_num = g_sensor_info_iio_ext[sensor_index].dev_num;
+	for (s = 0; s < g_sensor_info_size; s++) {
+		if (g_sensor_info_iio_ext[s].dev_num != dev_num || g_sensor_info_iio_ext[s].warm_fd == -1)
+			continue;
+		fd = g_sensor_info_iio_ext[s].warm_fd;
+		if (fcntl(fd, F_SETFL, flags & O_NONBLOCK) == -1)
+			return -1;
+		log_msg_and_exit_on_error(VERBOSE, "Reusing fd %d for device %s\n", fd,
+			g_sensor_info_iio_ext[sensor_index].id);
+		return fd;
+	}
+
+	memset(sysfs_path, '\0', PATH_MAX);
+	snprintf(sysfs_path, PATH_MAX, DEV_FILE_PATH, dev_num);
+	fd = open(sysfs_path, O_RDONLY | flags);
+	if (fd != -1 && g_keep_warm)
+		g_sensor_info_iio_ext[sensor_index].warm_fd = fd;
+	return fd;
+}
+
+/* close fd unless it is kept warm */
+int close_device_fd(int sensor_index, int fd) {
+	int s;
+
+	if (g_sensor_info_iio_ext[sensor_index].is_virtual)
+		return close_fusion_fd(sensor_index, fd);
+	for (s = 0; s < g_sensor_info_size; s++)
+		if (g_sensor_info_iio_ext[s].warm_fd == fd)
+			return 0;
+	return close(fd);
+}
+
+void close_warm_fds(void) {
+	int s;
+
+	for (s = 0; s < g_sensor_info_size; s++) {
+		if (g_sensor_info_iio_ext[s].warm_fd == -1)
+			continue;
+		close(g_sensor_info_iio_ext[s].warm_fd);
+		g_sensor_info_iio_ext[s].warm_fd = -1;
+	}
+}
+
 int enable_buffer(int sensor_index, int enabled) {
 	char sysfs_path[PATH_MAX];
 	int retries = ENABLE_BUFFER_RETRIES;
@@ -44,9 +106,11 @@ int enable_buffer(int sensor_index, int enabled) {
 
 
 	snprintf(sysfs_path, PATH_MAX, ENABLE_PATH, dev_num);
+	trace_begin("iio_buffer dev%d %d", dev_num, enabled);
 	while (retries) {
 		/* Low level, non-multiplexed, enable/disable routine */
 		if (sysfs_write_int(sysfs_path, enabled) != -1) {
+			trace_end();
 			log_msg_and_exit_on_error(VERBOSE, "Buffer is set to value: %d for device%d\n",
 				enabled, dev_num);
 			return 0;
@@ -58,6 +122,7 @@ int enable_buffer(int sensor_index, int enabled) {
 		retries--;
 	}
 
+	trace_end();
 	log_msg_and_exit_on_error(DEBUG, "Could not allocate buffer to value: %d for device%d\n",
 		enabled, dev_num);
 	return -1;
@@ -81,11 +146,11 @@ int is_buffer_enable(int sensor_index, int value) {
 
 	if (set_value == value) {
 		log_msg_and_exit_on_error(VERBOSE, "%s was successfully set on %d!\n",
-			g_sensor_info_iio_ext[sensor_index].tag, value); 
+			g_sensor_info_iio_ext[sensor_index].id, value); 
 	}
 	else {
 		log_msg_and_exit_on_error(ERROR, "%s was NOT set on %d!\n",
-			g_sensor_info_iio_ext[sensor_index].tag, value);
+			g_sensor_info_iio_ext[sensor_index].id, value);
 		set_test_state(FAILED);
 		return -1;
 	}
@@ -98,11 +163,12 @@ int enable_all_buffers(int value) {
 
 	for (i = 0; i < g_sensor_info_size; i++) {
 		if(g_sensor_info_iio_ext[i].discovered) {
-			if(g_sensor_info_iio_ext[i].mode == MODE_POLL)
+			if(g_sensor_info_iio_ext[i].mode == MODE_POLL ||
+				g_sensor_info_iio_ext[i].is_virtual)
 				continue;
 			if (enable_buffer(i, value) == -1) {
 				log_msg_and_exit_on_error(ERROR, "Can't enable buffer for %s!\n",
-					g_sensor_info_iio_ext[i].tag); 
+					g_sensor_info_iio_ext[i].id); 
 				set_test_state(FAILED);
 				return -1;
 			}
@@ -126,10 +192,14 @@ int activate_sensor(int sensor_index, int value) {
 	int set_value; 
 	int dev_num;
 	int i;
+	int64_t write_start;
 	char sysfs_path[PATH_MAX];
 
 	memset(sysfs_path, '\0', PATH_MAX);
 	dev_num = g_sensor_info_iio_ext[sensor_index].dev_num;
+
+	if (g_sensor_info_iio_ext[sensor_index].is_virtual)
+		return activate_fusion_sources(sensor_index, value);
 	
 	if(g_sensor_info_iio_ext[sensor_index].mode == MODE_POLL) {
 		log_msg_and_exit_on_error(ERROR, "Device%d is polling mode and "
@@ -148,34 +218,37 @@ int activate_sensor(int sensor_index, int value) {
 	if(set_value == value) {
 		if(set_value) {
 			log_msg_and_exit_on_error(ERROR, "%s was already activated!\n",
-				g_sensor_info_iio_ext[sensor_index].tag); 
+				g_sensor_info_iio_ext[sensor_index].id); 
 			set_test_state(FAILED);
 
 		}
 		else{
 			log_msg_and_exit_on_error(ERROR, "%s was already deactivated!\n",
-				g_sensor_info_iio_ext[sensor_index].tag); 
+				g_sensor_info_iio_ext[sensor_index].id); 
 			set_test_state(FAILED);
 		}
 
 		return -1;
 
 	}
-	/* enable trigger if activate action*/
-	if(value) {
+	/* enable trigger if activate action; a warm one is still attached */
+	if(value && !g_sensor_info_iio_ext[sensor_index].trigger_attached) {
 		if (enable_trigger(dev_num, g_sensor_info_iio_ext[sensor_index].init_trigger_name) == -1) {
 			log_msg_and_exit_on_error(ERROR, "Can't enable trigger for %s!\n",
-				g_sensor_info_iio_ext[sensor_index].tag); 
+				g_sensor_info_iio_ext[sensor_index].id); 
 			set_test_state(FAILED);
 			return -1;
 		}
+		g_sensor_info_iio_ext[sensor_index].trigger_attached = g_keep_warm;
 	}
+	write_start = get_timestamp_monotonic();
 	if (enable_buffer(sensor_index, value) == -1) {
 		log_msg_and_exit_on_error(ERROR, "Can't enable buffer for %s!\n",
-			g_sensor_info_iio_ext[sensor_index].tag); 
+			g_sensor_info_iio_ext[sensor_index].id); 
 		set_test_state(FAILED);
 		return -1;
 	}
+	record_buffer_write_latency(sensor_index, value, write_start, get_timestamp_monotonic());
 	/* check if buffer was enabled/disabled properly */
 	if(sysfs_read_int(sysfs_path, &set_value) == -1) {
 		log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path); 
@@ -185,19 +258,19 @@ int activate_sensor(int sensor_index, int value) {
 
 	if (set_value == value) {
 		log_msg_and_exit_on_error(VERBOSE, "%s was successfully set on %d!\n",
-			g_sensor_info_iio_ext[sensor_index].tag, value); 
+			g_sensor_info_iio_ext[sensor_index].id, value); 
 	}
 	else {
 		log_msg_and_exit_on_error(ERROR, "%s was NOT set on %d!\n",
-			g_sensor_info_iio_ext[sensor_index].tag, value);
+			g_sensor_info_iio_ext[sensor_index].id, value);
 		set_test_state(FAILED);
 		return -1;
 	}
 	/* disable trigger if deactivate action */
-	if(!value) {
+	if(!value && !g_keep_warm) {
 		if(enable_trigger(dev_num, "\n") == -1) {
 			log_msg_and_exit_on_error(ERROR, "Can't disable trigger for %s!\n",
-				g_sensor_info_iio_ext[sensor_index].tag); 
+				g_sensor_info_iio_ext[sensor_index].id); 
 			set_test_state(FAILED);
 			return -1;
 		}
@@ -206,33 +279,56 @@ int activate_sensor(int sensor_index, int value) {
 }
 /* convert to syntax necessary for hashmap library */
 bool activate_sensor_wrapper(void* key, void* value, void* context) {
-	int sensor_index = (int)key;
-	int activate_value = (int)context;
+	int sensor_index = (int)(intptr_t)key;
+	int activate_value = (int)(intptr_t)context;
 	activate_sensor(sensor_index, activate_value);    
 
 	return true;
 }
 
+/* activate and deactivate sensor counter times and measure
+** enable/disable latencies for every cycle
+*/
 int activate_deactivate_sensor(int sensor_index, int counter) {
 	int i;
+	int fd;
+	int ret;
+
 	if(counter <= 0) {
 		log_msg_and_exit_on_error(ERROR, "Wrong value for counter!\n");
 		set_test_state(FAILED);
 		return -1;
 	}
+	/* first samples of a virtual sensor depend on the fusion, not on a device */
+	if (g_sensor_info_iio_ext[sensor_index].is_virtual) {
+		log_msg_and_exit_on_error(ERROR, "This test is not available for %s!\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(SKIPPED);
+		return -1;
+	}
+	reset_activation_latency(sensor_index);
+	fd = open_activation_latency_fd(sensor_index);
+	ret = 0;
 	for (i = 0; i < counter; ++i) {
-		if(activate_sensor(sensor_index, 1) == -1)
-			return -1;
-		if(activate_sensor(sensor_index, 0) == -1)
-			return -1;
-		
+		if(activate_sensor(sensor_index, 1) == -1) {
+			ret = -1;
+			break;
+		}
+		measure_first_samples(&sensor_index, &fd, 1);
+		if(activate_sensor(sensor_index, 0) == -1) {
+			ret = -1;
+			break;
+		}
+		measure_stream_stops(&sensor_index, &fd, 1);
 	}
-	return 0;
+	close_activation_latency_fd(sensor_index, fd);
+	print_activation_latency(sensor_index);
+	return ret;
 }
 /* convert to syntax necessary for hashmap library */
 bool activate_deactivate_sensor_wrapper(void* key, void* value, void* context) {
-	int sensor_index = (int)key;
-	int counter = (int)context;
+	int sensor_index = (int)(intptr_t)key;
+	int counter = (int)(intptr_t)context;
 	activate_deactivate_sensor(sensor_index, counter);    
 
 	return true;
@@ -243,7 +339,8 @@ int activate_all_sensors(int value) {
 
 	for (sensor = 0; sensor < g_sensor_info_size; ++sensor) {
 		if(g_sensor_info_iio_ext[sensor].discovered) {  
-			if(g_sensor_info_iio_ext[sensor].mode == MODE_POLL)
+			if(g_sensor_info_iio_ext[sensor].mode == MODE_POLL ||
+				g_sensor_info_iio_ext[sensor].is_virtual)
 				continue;
 			if(activate_sensor(sensor, value) == -1)
 				return -1;
@@ -254,20 +351,46 @@ int activate_all_sensors(int value) {
 
 int activate_deactivate_all_sensors(int counter) {
 	int i;
+	int sensor;
+	int count;
+	int ret;
+	int sensor_indexes[g_sensor_info_size];
+	int fds[g_sensor_info_size];
 
 	if(counter <= 0) {
 		log_msg_and_exit_on_error(ERROR, "Wrong value for counter!\n");
 		set_test_state(FAILED);
 		return -1;
 	}
+	count = 0;
+	for (sensor = 0; sensor < g_sensor_info_size; ++sensor) {
+		if(!g_sensor_info_iio_ext[sensor].discovered ||
+			g_sensor_info_iio_ext[sensor].mode == MODE_POLL ||
+			g_sensor_info_iio_ext[sensor].is_virtual)
+			continue;
+		reset_activation_latency(sensor);
+		sensor_indexes[count] = sensor;
+		fds[count] = open_activation_latency_fd(sensor);
+		count++;
+	}
+	ret = 0;
 	for (i = 0; i < counter; ++i) {
-		if(activate_all_sensors(1) == -1)
-			return -1;
-		if(activate_all_sensors(0) == -1)
-			return -1;
-
+		if(activate_all_sensors(1) == -1) {
+			ret = -1;
+			break;
+		}
+		measure_first_samples(sensor_indexes, fds, count);
+		if(activate_all_sensors(0) == -1) {
+			ret = -1;
+			break;
+		}
+		measure_stream_stops(sensor_indexes, fds, count);
 	}
-	return 0;
+	for (i = 0; i < count; ++i) {
+		close_activation_latency_fd(sensor_indexes[i], fds[i]);
+		print_activation_latency(sensor_indexes[i]);
+	}
+	return ret;
 }
 
 int get_index_from_dev_num(int dev_num) {
@@ -286,20 +409,34 @@ int get_index_from_dev_num(int dev_num) {
 	return -1;
 }
 
-int get_index_from_tag(char *tag) {
+/* tag is either an id (accel, accel#1) or a bare tag matching every
+** instance; fill indexes and return how many sensors matched
+*/
+int get_indexes_from_tag(char *tag, int indexes[]) {
 	if(tag == NULL)
-		return -1;
+		return 0;
 
 	int s;
+	int count;
 
+	count = 0;
 	for (s = 0; s < g_sensor_info_size; s++) {
 		if (!g_sensor_info_iio_ext[s].discovered)
 			continue;
-		if(strncmp(g_sensor_info_iio_ext[s].tag, tag, strlen(tag)) == 0) {
-		   return s;         
+		if (!strcmp(g_sensor_info_iio_ext[s].id, tag) ||
+			!strcmp(g_sensor_info_iio_ext[s].tag, tag)) {
+			indexes[count++] = s;
 		}
 	}
-	return -1;
+	return count;
+}
+
+int get_index_from_tag(char *tag) {
+	int indexes[g_sensor_info_size + 1];
+
+	if (get_indexes_from_tag(tag, indexes) == 0)
+		return -1;
+	return indexes[0];
 }
 
 /* read channels values and timestamp for polling mode sensors */
@@ -336,10 +473,10 @@ int get_data_polling_mode(int sensor_index) {
 			}    
 		}
 		log_msg_and_exit_on_error(VERBOSE, "Device %s has on channel %s value = %d\n",
-			g_sensor_info_iio_ext[sensor_index].tag, name, value);
+			g_sensor_info_iio_ext[sensor_index].id, name, value);
 		scaled_value = scale_value(sensor_index, c, value);
 		log_msg_and_exit_on_error(VERBOSE, "Device %s has on channel %s scaled value = %f\n",
-			g_sensor_info_iio_ext[sensor_index].tag, name, scaled_value);
+			g_sensor_info_iio_ext[sensor_index].id, name, scaled_value);
 		g_sensor_info_iio_ext[sensor_index].channel_info[c].last_value = scaled_value;
 	}
 	return 0;
@@ -350,80 +487,56 @@ int get_data_triggered_mode(int sensor_index) {
 	char buf[g_sensor_info_iio_ext[sensor_index].sample_size];
 	int num_channels;
 	int c;
-	int counter;
-	int index;
-	int padding;
-	int timestamp_index;
-	int return_value;
 	int fd;
 	int64_t last_timestamp;
 	int64_t value;
 	float new_value;
-	channel_info_t channel;
-	channel_info_t timestamp;
-	unsigned char* sample;
+	channel_info_t *channel;
+	channel_info_t *timestamp;
 
-	counter = 0;
-	timestamp = g_sensor_info_iio_ext[sensor_index].timestamp;
-	timestamp_index = timestamp.index;
+	timestamp = &g_sensor_info_iio_ext[sensor_index].timestamp;
 	num_channels = g_sensor_info_iio_ext[sensor_index].num_channels;
 	fd = g_sensor_info_iio_ext[sensor_index].read_fd;
 	
 	if (sysfs_read_from_fd(fd, buf, g_sensor_info_iio_ext[sensor_index].sample_size) == -1) {
 		log_msg_and_exit_on_error(ERROR, "Can't read samples from %s \n",
-			g_sensor_info_iio_ext[sensor_index].tag); 
+			g_sensor_info_iio_ext[sensor_index].id); 
 		set_test_state(FAILED);
 		return -1;
 	}
-	for (index = 0; index < (num_channels + 1); ++index) {     
-		if (index == timestamp_index) {
-			sample = (unsigned char*)malloc(timestamp.size);
-			if (sample == NULL) {   
-				log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-				exit(-1);
-			}
-			/* check if there is any padding */
-			padding = get_padding_size(counter, timestamp.type_info.storagebits);
-			counter += padding; 
-			memcpy(sample, buf + counter, timestamp.size);
-			value = sample_as_int64(sample, &timestamp.type_info);
-			free(sample);
-			counter += timestamp.size;
-			last_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
-			log_msg_and_exit_on_error(VERBOSE, "Device %s has last timestamp %lld\n",
-				g_sensor_info_iio_ext[sensor_index].tag, last_timestamp);
-			log_msg_and_exit_on_error(VERBOSE, "Device %s has new  timestamp %lld\n",
-				g_sensor_info_iio_ext[sensor_index].tag, value);
-			g_sensor_info_iio_ext[sensor_index].last_timestamp = value;
-		}
-		else
-			for (c = 0; c < num_channels; c++) {
-				channel = g_sensor_info_iio_ext[sensor_index].channel_info[c];
-				if(index == channel.index) {  
-					sample = (unsigned char*)malloc(channel.size);
-					if (sample == NULL) {   
-						log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-						exit(-1);
-					}
-					/* check if there is any padding */
-					padding = get_padding_size(counter, channel.type_info.storagebits);
-					counter += padding; 
-					memcpy(sample, buf + counter, channel.size);
-					value = sample_as_int64(sample, &channel.type_info);
-					free(sample);
-					/* scale value */
-					new_value = scale_value(sensor_index, c, value); 
-					counter += channel.size;
-					g_sensor_info_iio_ext[sensor_index].channel_info[c].last_value = new_value;
-					log_msg_and_exit_on_error(VERBOSE, "Device %s has scaled value for %s is %f\n", 
-						g_sensor_info_iio_ext[sensor_index].tag,
-						g_sensor_info_iio_ext[sensor_index].channel_descriptor[c].name, new_value);
-					log_msg_and_exit_on_error(VERBOSE, "Device %s has value for %s is %lld\n",
-						g_sensor_info_iio_ext[sensor_index].tag,
-						g_sensor_info_iio_ext[sensor_index].channel_descriptor[c].name, value);
-				}
-			}        
-	} 
+
+	/* offsets were set by set_sample_format from the device scan layout */
+	for (c = 0; c < num_channels; c++) {
+		channel = &g_sensor_info_iio_ext[sensor_index].channel_info[c];
+		if (channel->size <= 0)
+			continue;
+		value = sample_as_int64((unsigned char*)buf + channel->offset, &channel->type_info);
+		/* scale value */
+		new_value = scale_value(sensor_index, c, value); 
+		channel->last_value = new_value;
+		log_msg_and_exit_on_error(VERBOSE, "Device %s has scaled value for %s is %f\n", 
+			g_sensor_info_iio_ext[sensor_index].id,
+			g_sensor_info_iio_ext[sensor_index].channel_descriptor[c].name, new_value);
+		log_msg_and_exit_on_error(VERBOSE, "Device %s has value for %s is %lld\n",
+			g_sensor_info_iio_ext[sensor_index].id,
+			g_sensor_info_iio_ext[sensor_index].channel_descriptor[c].name, value);
+	}
+
+	if (timestamp->size > 0) {
+		value = sample_as_int64((unsigned char*)buf + timestamp->offset, &timestamp->type_info);
+		last_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		log_msg_and_exit_on_error(VERBOSE, "Device %s has last timestamp %lld\n",
+			g_sensor_info_iio_ext[sensor_index].id, last_timestamp);
+		log_msg_and_exit_on_error(VERBOSE, "Device %s has new  timestamp %lld\n",
+			g_sensor_info_iio_ext[sensor_index].id, value);
+		g_sensor_info_iio_ext[sensor_index].last_timestamp = value;
+		profile_decode_done(value);
+		trace_marker("read %s ts=%lld", g_sensor_info_iio_ext[sensor_index].id, value);
+	}
+	else{
+		profile_decode_done(-1);
+		trace_marker("read %s", g_sensor_info_iio_ext[sensor_index].id);
+	}
 	return 0;   
 }
 
@@ -433,12 +546,18 @@ void list_sensors(void) {
 
 	for (s = 0; s < g_sensor_info_size; ++s) {
 		if(g_sensor_info_iio_ext[s].discovered) {
-			if(g_sensor_info_iio_ext[s].mode == MODE_POLL)
-				log_msg_and_exit_on_error(DEBUG, "Found device %s in polling mode\n",
-					g_sensor_info_iio_ext[s].tag);
+			if(g_sensor_info_iio_ext[s].is_virtual)
+				log_msg_and_exit_on_error(DEBUG, "Found virtual device %s (%s, %d channels)\n",
+					g_sensor_info_iio_ext[s].id, g_sensor_info_iio_ext[s].internal_name,
+					g_sensor_info_iio_ext[s].num_channels);
+			else if(g_sensor_info_iio_ext[s].mode == MODE_POLL)
+				log_msg_and_exit_on_error(DEBUG, "Found device %s (%s, iio:device%d, %d channels) in polling mode\n",
+					g_sensor_info_iio_ext[s].id, g_sensor_info_iio_ext[s].internal_name,
+					g_sensor_info_iio_ext[s].dev_num, g_sensor_info_iio_ext[s].num_channels);
 			else if(g_sensor_info_iio_ext[s].mode == MODE_TRIGGER)
-				log_msg_and_exit_on_error(DEBUG, "Found device %s in triggered mode\n",
-					g_sensor_info_iio_ext[s].tag);
+				log_msg_and_exit_on_error(DEBUG, "Found device %s (%s, iio:device%d, %d channels) in triggered mode\n",
+					g_sensor_info_iio_ext[s].id, g_sensor_info_iio_ext[s].internal_name,
+					g_sensor_info_iio_ext[s].dev_num, g_sensor_info_iio_ext[s].num_channels);
 		}
 	}
 	log_msg_and_exit_on_error(DEBUG, "Found %d devices!\n", g_sensor_iio_count);
@@ -459,6 +578,13 @@ int check_channels(int sensor_index) {
 	dev_num = g_sensor_info_iio_ext[sensor_index].dev_num;
 	memset(mapped, 0, num_channels);
 	memset(sysfs_dir, '\0', PATH_MAX);
+
+	/* channels of virtual sensors are computed, there is nothing in sysfs */
+	if (g_sensor_info_iio_ext[sensor_index].is_virtual) {
+		log_msg_and_exit_on_error(DEBUG, "Device %s is virtual, its %d channels come from the fusion\n",
+			g_sensor_info_iio_ext[sensor_index].id, num_channels);
+		return 0;
+	}
 	
 	/* for triggered devices */
 	if(g_sensor_info_iio_ext[sensor_index].mode == MODE_TRIGGER) {
@@ -480,12 +606,13 @@ int check_channels(int sensor_index) {
 					
 					log_msg_and_exit_on_error(DEBUG, "Found channel %s for device %s!\n", 
 						g_sensor_info_iio_ext[sensor_index].channel_descriptor[channel].name, 
-						g_sensor_info_iio_ext[sensor_index].tag);
+						g_sensor_info_iio_ext[sensor_index].id);
 					mapped[channel] = 1;
 					break;
 				}
 			}
 		}
+		closedir(dir);
 	}
 	/* for polling devices */ 
 	else if(g_sensor_info_iio_ext[sensor_index].mode == MODE_POLL) {
@@ -507,18 +634,33 @@ int check_channels(int sensor_index) {
 					!strcmp(d->d_name, g_sensor_info_iio_ext[sensor_index].channel_descriptor[channel].input_path)) {    
 					log_msg_and_exit_on_error(DEBUG, "Found channel %s for device %s!\n", 
 						g_sensor_info_iio_ext[sensor_index].channel_descriptor[channel].name, 
-						g_sensor_info_iio_ext[sensor_index].tag);
+						g_sensor_info_iio_ext[sensor_index].id);
 					mapped[channel] = 1;
 					break;    
 				}
 			}
 		}
+		closedir(dir);
 	}
 		
+	if (num_channels == 0) {
+		log_msg_and_exit_on_error(ERROR, "Device %s doesn't have any channel!\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(FAILED);
+		return -1;
+	}
 	for (channel = 0; channel < num_channels; ++channel) {
+		if (mapped[channel] && g_sensor_info_iio_ext[sensor_index].mode == MODE_TRIGGER &&
+			g_sensor_info_iio_ext[sensor_index].channel_info[channel].size <= 0) {
+			log_msg_and_exit_on_error(ERROR, "Device %s has no valid type for channel %s!\n",
+				g_sensor_info_iio_ext[sensor_index].id,
+				g_sensor_info_iio_ext[sensor_index].channel_descriptor[channel].name);
+			set_test_state(FAILED);
+			return -1;
+		}
 		if(!mapped[channel]) {
 			log_msg_and_exit_on_error(ERROR, "Device %s doesn't have channel %s configured!", 
-				g_sensor_info_iio_ext[sensor_index].tag,
+				g_sensor_info_iio_ext[sensor_index].id,
 				g_sensor_info_iio_ext[sensor_index].channel_descriptor[channel].name);
 			set_test_state(FAILED);
 			return -1;
@@ -530,7 +672,7 @@ int check_channels(int sensor_index) {
 
 /* convert to syntax necessary for hashmap library */
 bool check_channels_wrapper(void* key, void* value, void* context) {
-	int sensor_index = (int)key;
+	int sensor_index = (int)(intptr_t)key;
 	check_channels(sensor_index);    
 	return true;
 }
@@ -14,9 +14,13 @@
 // limitations under the License.
 */
 
+#include "iio_common.h"
 #ifndef __IIO_CONTROL_H__
 #define __IIO_CONTROL_H__
 
+int open_device_fd(int sensor_index, int flags);
+int close_device_fd(int sensor_index, int fd);
+void close_warm_fds(void);
 int enable_buffer(int sensor_index, int enabled);
 int enable_all_buffers(int value);
 int clean_up_sensors(void);
@@ -27,6 +31,7 @@ bool activate_deactivate_sensor_wrapper(void* key, void* value, void* context);
 int activate_all_sensors(int value);
 int activate_deactivate_all_sensors(int counter);
 int get_index_from_dev_num(int dev_num);
+int get_indexes_from_tag(char *tag, int indexes[]);
 int get_index_from_tag(char * tag);
 int get_data_polling_mode(int sensor_index);
 int get_data_triggered_mode(int sensor_index);
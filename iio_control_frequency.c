@@ -19,12 +19,15 @@
 #include <fcntl.h> 
 #include <math.h>
 #include <errno.h>
+#include <string.h>
 #include <ctype.h>
-#include "cutils/hashmap.h"
 #include "iio_control_frequency.h"
+#include "iio_trace.h"
 #include "iio_enumeration.h"
 #include "iio_utils.h"
 #include "iio_control.h"
+#include "iio_fusion.h"
+#include "iio_set_trigger.h"
 
 float get_cdd_freq (int sensor_index, int must) {
 	switch (g_sensor_info_iio_ext[sensor_index].type) {
@@ -37,6 +40,10 @@ float get_cdd_freq (int sensor_index, int must) {
 		case SENSOR_TYPE_MAGNETIC_FIELD:
 			return (must ? 10 : 50);   /* must 10 Hz, should 50 Hz, CDD compliant */
 
+		case SENSOR_TYPE_ORIENTATION:
+		case SENSOR_TYPE_ROTATION_VECTOR:
+			return (must ? 200 : 200); /* fused at the rate of the gyroscope */
+
 		case SENSOR_TYPE_AMBIENT_TEMPERATURE:
 			return (must ? 1 : 2);     /* must 1 Hz, should 2Hz, not mentioned in CDD */
 
@@ -135,13 +142,12 @@ float select_closest_freq(int sensor_index, float required_freq) {
 	
 }
 
-int write_freq(int sensor_index, float required_rate) {
+static int do_write_freq(int sensor_index, float required_rate) {
 	char sysfs_path[PATH_MAX];
 	const char* tag;
 	int dev_num;
 	int enabled;
 	float set_rate;
-	float cur_hr_freq;
 	int hr_trigger_nr;
 
 	tag = g_sensor_info_iio_ext[sensor_index].tag;
@@ -169,19 +175,12 @@ int write_freq(int sensor_index, float required_rate) {
 
 	}
 	
+	/* the hrtimer fires at the rate the device samples at */
 	if (hr_trigger_nr != -1) {
-		snprintf(sysfs_path, PATH_MAX, TRIGGER_FREQ_PATH, hr_trigger_nr);
-		if (sysfs_read_float(sysfs_path, &cur_hr_freq) == -1) {
-			log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path); 
+		if (set_hrtimer_freq(hr_trigger_nr, set_rate ? set_rate : required_rate) == -1) {
 			set_test_state(FAILED);
 			return -1;
 		}
-		if (cur_hr_freq != required_rate)
-			if (sysfs_write_float(sysfs_path, required_rate) == -1) {
-				log_msg_and_exit_on_error(ERROR, "Can't write value to %s\n", sysfs_path); 
-				set_test_state(FAILED);
-				return -1;
-			}
 	}
 	/* new data rate is different from the old one */ 
 	if (set_rate != 0) {
@@ -207,6 +206,16 @@ int write_freq(int sensor_index, float required_rate) {
 	return 0;
 }
 
+/* rate writes are a slice in the trace, they disable and enable the buffer */
+int write_freq(int sensor_index, float required_rate) {
+	int ret;
+
+	trace_begin("iio_freq %s %f", g_sensor_info_iio_ext[sensor_index].id, required_rate);
+	ret = do_write_freq(sensor_index, required_rate);
+	trace_end();
+	return ret;
+}
+
 int set_freq(int sensor_index,  float required_value) {
 	float set_value;
 	float set_hr_value;
@@ -216,6 +225,10 @@ int set_freq(int sensor_index,  float required_value) {
 	const char* tag;
 	char sysfs_path[PATH_MAX];
  
+	/* virtual sensors follow the rate of their sources */
+	if (g_sensor_info_iio_ext[sensor_index].is_virtual)
+		return set_fusion_freq(sensor_index, required_value);
+
 	memset(sysfs_path, '\0', PATH_MAX);
 	hr_trigger_nr = g_sensor_info_iio_ext[sensor_index].hr_trigger_nr;
 	dev_num = g_sensor_info_iio_ext[sensor_index].dev_num;
@@ -249,15 +262,15 @@ int set_freq(int sensor_index,  float required_value) {
 
 	   
 	if ((set_value == new_value || new_value == 0) 
-		&& (set_hr_value == required_value || set_hr_value == -1)) {
+		&& (set_hr_value == (new_value ? new_value : required_value) || set_hr_value == -1)) {
 		log_msg_and_exit_on_error(VERBOSE, "Frequency for device %s was successfully"
-			" set to value %f\n", g_sensor_info_iio_ext[sensor_index].tag, set_value);
+			" set to value %f\n", g_sensor_info_iio_ext[sensor_index].id, set_value);
 
 		return 0;
 	}
 	else{
 		log_msg_and_exit_on_error(ERROR, "Frequency for device %s was NOT set to value %f\n", 
-			g_sensor_info_iio_ext[sensor_index].tag, required_value);
+			g_sensor_info_iio_ext[sensor_index].id, required_value);
 		set_test_state(FAILED);
 		return -1;  
 	}
@@ -271,7 +284,7 @@ int set_cdd_freq(int sensor_index) {
 }
 
 bool set_freq_wrapper(void* key, void* value, void* context) {
-	int sensor_index = (int)key;
+	int sensor_index = (int)(intptr_t)key;
 	time_attributes_struct* time_attributes = (time_attributes_struct*)value;
 	float freq = time_attributes->freq;
 	set_freq(sensor_index, freq);    
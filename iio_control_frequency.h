@@ -14,11 +14,13 @@
 // limitations under the License.
 */
 
+#include "iio_common.h"
 #ifndef __IIO_CONTROL_FREQUENCY_H__
 #define __IIO_CONTROL_FREQUENCY_H__
 
 float get_cdd_freq (int sensor_index, int must);
 float get_standard_deviation_value(int sensor_index);
+int write_freq(int sensor_index, float required_rate);
 int set_freq(int sensor_index,  float required_value);
 int set_cdd_freq(int sensor_index);
 bool set_freq_wrapper(void* key, void* value, void* context);
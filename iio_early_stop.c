@@ -0,0 +1,162 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "iio_early_stop.h"
+#include "iio_arena.h"
+#include "iio_results.h"
+#include "iio_utils.h"
+
+/*
+** Sequential early stopping. With "confidence c" in a command, timing
+** tests feed each value of their metric (sample interval, client delay)
+** to a running mean and deviation. Once the confidence interval of the
+** mean, or of the deviation for jitter, lies inside or outside the range
+** which passes, the outcome can't change with more samples and the
+** sensor is settled; poll_sensors stops when all of its sensors are, and
+** duration is only an upper bound. The checks of the tests still decide
+** at FINALIZE from everything collected.
+**
+** Looking at every sample with the same interval would settle on a
+** chance excursion far more often than 1 - c. The interval is only
+** looked at after EARLY_STOP_MIN_SAMPLES * 2^k samples, and the k-th look
+** (from 0) spends (1 - c) / 2^(k + 1) of the error, so all the looks
+** together are wrong at most 1 - c of the time (Bonferroni).
+**
+** The interval uses the normal approximation, sd / sqrt(n) for the mean
+** and sd / sqrt(2 (n - 1)) for the deviation. Consecutive sample intervals
+** are anticorrelated (a late sample shortens the next interval), so the
+** interval of their mean is wider than the true one and stopping stays on
+** the safe side.
+*/
+
+/* two sided normal quantile of error, by bisection on erfc */
+static double get_z(double error) {
+	double low;
+	double high;
+	double z;
+	int i;
+
+	low = 0;
+	high = 10;
+	for (i = 0; i < 60; i++) {
+		z = (low + high) / 2;
+		if (erfc(z / sqrt(2)) > error)
+			low = z;
+		else
+			high = z;
+	}
+	return (low + high) / 2;
+}
+
+/* z of the look due at this sample, 0 between looks */
+static double get_look_z(early_stop_struct *early_stop) {
+	if (early_stop->counter < early_stop->next_look)
+		return 0;
+	early_stop->next_look *= 2;
+	early_stop->looks++;
+	return get_z((1 - g_confidence) / ldexp(1, early_stop->looks));
+}
+
+void early_stop_add(run_sensor_struct *run_sensor, double value) {
+	early_stop_struct *early_stop;
+	double delta;
+
+	if (g_confidence <= 0)
+		return;
+	early_stop = run_sensor->early_stop;
+	if (early_stop == NULL) {
+		early_stop = (early_stop_struct*)arena_alloc(&g_test_arena, sizeof(early_stop_struct));
+		early_stop->start = get_timestamp_monotonic();
+		early_stop->next_look = EARLY_STOP_MIN_SAMPLES;
+		run_sensor->early_stop = early_stop;
+	}
+	early_stop->counter++;
+	delta = value - early_stop->mean;
+	early_stop->mean += delta / early_stop->counter;
+	early_stop->m2 += delta * (value - early_stop->mean);
+}
+
+static void settle(run_sensor_struct *run_sensor, int passed) {
+	early_stop_struct *early_stop;
+
+	early_stop = run_sensor->early_stop;
+	early_stop->settled = 1;
+	run_sensor->context->settled++;
+	log_msg_and_exit_on_error(DEBUG, "Device %s %s at %.1f%% confidence after %lld samples "
+		"(%.1f s)\n", g_sensor_info_iio_ext[run_sensor->sensor_index].id,
+		passed ? "passes" : "fails", g_confidence * 100, (long long)early_stop->counter,
+		(float)CONVERT_NANO_TO_MILLI(get_timestamp_monotonic() - early_stop->start) / 1000);
+}
+
+/* settle when the interval of the mean is within [low, high] or out of it */
+void early_stop_mean(run_sensor_struct *run_sensor, double low, double high) {
+	early_stop_struct *early_stop;
+	double half_width;
+	double z;
+
+	early_stop = run_sensor->early_stop;
+	if (early_stop == NULL || early_stop->settled)
+		return;
+	z = get_look_z(early_stop);
+	if (z == 0)
+		return;
+	half_width = z * sqrt(early_stop->m2 / (early_stop->counter - 1) /
+		early_stop->counter);
+	if (early_stop->mean - half_width >= low && early_stop->mean + half_width <= high)
+		settle(run_sensor, 1);
+	else if (early_stop->mean + half_width < low || early_stop->mean - half_width > high)
+		settle(run_sensor, 0);
+}
+
+/* settle when the interval of deviation / mean, in %, is on one side of max_jitter */
+void early_stop_jitter(run_sensor_struct *run_sensor, double max_jitter) {
+	early_stop_struct *early_stop;
+	double deviation;
+	double half_width;
+	double z;
+
+	early_stop = run_sensor->early_stop;
+	if (early_stop == NULL || early_stop->settled)
+		return;
+	z = get_look_z(early_stop);
+	if (z == 0 || early_stop->mean <= 0)
+		return;
+	deviation = sqrt(early_stop->m2 / (early_stop->counter - 1));
+	half_width = z * deviation / sqrt(2.0 * (early_stop->counter - 1));
+	if ((deviation + half_width) / early_stop->mean * 100 <= max_jitter)
+		settle(run_sensor, 1);
+	else if ((deviation - half_width) / early_stop->mean * 100 > max_jitter)
+		settle(run_sensor, 0);
+}
+
+/* time the test took to settle, if it did */
+void early_stop_report(run_sensor_struct *run_sensor) {
+	early_stop_struct *early_stop;
+
+	early_stop = run_sensor->early_stop;
+	run_sensor->early_stop = NULL;
+	if (early_stop == NULL)
+		return;
+	record_metric(run_sensor->sensor_index, "early_stop_samples", early_stop->counter, NAN, NULL);
+	if (!early_stop->settled)
+		log_msg_and_exit_on_error(DEBUG, "Device %s didn't settle at %.1f%% confidence in "
+			"%lld samples\n", g_sensor_info_iio_ext[run_sensor->sensor_index].id,
+			g_confidence * 100, (long long)early_stop->counter);
+}
@@ -0,0 +1,24 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_EARLY_STOP_H__
+#define __IIO_EARLY_STOP_H__
+
+void early_stop_add(run_sensor_struct *run_sensor, double value);
+void early_stop_mean(run_sensor_struct *run_sensor, double low, double high);
+void early_stop_jitter(run_sensor_struct *run_sensor, double max_jitter);
+void early_stop_report(run_sensor_struct *run_sensor);
+#endif
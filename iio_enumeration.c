@@ -19,29 +19,287 @@
 #include <fcntl.h> 
 #include <math.h>
 #include <errno.h>
+#include <string.h>
 #include <dirent.h>
-#include "cutils/hashmap.h"
+#include <stdarg.h>
 #include "iio_enumeration.h"
 #include "iio_utils.h"
 #include "iio_pld_information.h"
 #include "iio_set_trigger.h"
 
 int g_sensor_iio_count  = 0;
+sensor_info_iio_ext_t *g_sensor_info_iio_ext;
+int g_sensor_info_size = 0;
+static int g_sensor_info_capacity = 0;
 
-void add_sensor(int dev_num, int s, int mode) {
+/*
+** This table maps channel tags found in sysfs to sensor types. Tags which
+** are not listed here are still added, with an unknown type.
+*/
+const sensor_catalog_entry_t g_sensor_catalog[] = {
+	{ .tag = "accel",	.type = SENSOR_TYPE_ACCELEROMETER },
+	{ .tag = "anglvel",	.type = SENSOR_TYPE_GYROSCOPE },
+	{ .tag = "magn",	.type = SENSOR_TYPE_MAGNETIC_FIELD },
+	{ .tag = "intensity",	.type = SENSOR_TYPE_INTERNAL_INTENSITY },
+	{ .tag = "illuminance",	.type = SENSOR_TYPE_INTERNAL_ILLUMINANCE },
+	{ .tag = "temp",	.type = SENSOR_TYPE_AMBIENT_TEMPERATURE },
+	{ .tag = "proximity",	.type = SENSOR_TYPE_PROXIMITY },
+	/* computed by iio_fusion from accel, anglvel and magn */
+	{ .tag = "orientation",	.type = SENSOR_TYPE_ORIENTATION,	.is_virtual = 1 },
+	{ .tag = "rotation_vector",	.type = SENSOR_TYPE_ROTATION_VECTOR,	.is_virtual = 1 },
+};
+
+int g_sensor_catalog_size = ARRAY_SIZE(g_sensor_catalog);
+
+/* allocate a sysfs file name built from format */
+static char* alloc_name(const char *format, ...) {
+	va_list arg;
+	char *name;
+
+	name = (char*)malloc(MAX_NAME_SIZE);
+	if (name == NULL) {
+		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+		exit(-1);
+	}
+	va_start(arg, format);
+	vsnprintf(name, MAX_NAME_SIZE, format, arg);
+	va_end(arg);
+	return name;
+}
+
+/* build sysfs names for a channel; ex: accel and x give in_accel_x_en,
+** illuminance and no name give in_illuminance_en
+*/
+void set_channel_descriptor(channel_descriptor_t *descriptor, const char *tag,
+	const char *name) {
+	const char *spacer;
+
+	spacer = name[0] ? "_" : "";
+	descriptor->name	= alloc_name("%s", name[0] ? name : tag);
+	descriptor->en_path	= alloc_name("in_%s%s%s_en", tag, spacer, name);
+	descriptor->type_path	= alloc_name("in_%s%s%s_type", tag, spacer, name);
+	descriptor->index_path	= alloc_name("in_%s%s%s_index", tag, spacer, name);
+	descriptor->raw_path	= alloc_name("in_%s%s%s_raw", tag, spacer, name);
+	descriptor->input_path	= alloc_name("in_%s%s%s_input", tag, spacer, name);
+	descriptor->scale_path	= alloc_name("in_%s%s%s_scale", tag, spacer, name);
+}
+
+static void free_channel_descriptor(channel_descriptor_t *descriptor) {
+	free(descriptor->name);
+	free(descriptor->en_path);
+	free(descriptor->type_path);
+	free(descriptor->index_path);
+	free(descriptor->raw_path);
+	free(descriptor->input_path);
+	free(descriptor->scale_path);
+}
+
+/* split a channel like accel_x in tag and name; known tags
+** may contain '_', for others everything before the first '_' is the tag
+*/
+void split_channel(const char *channel, char tag[MAX_NAME_SIZE], char name[MAX_NAME_SIZE]) {
+	const char *cursor;
+	int len;
+	int i;
+
+	for (i = 0; i < g_sensor_catalog_size; i++) {
+		len = strlen(g_sensor_catalog[i].tag);
+		if (strncmp(channel, g_sensor_catalog[i].tag, len))
+			continue;
+		if (channel[len] == '\0' || channel[len] == '_') {
+			snprintf(tag, MAX_NAME_SIZE, "%s", g_sensor_catalog[i].tag);
+			snprintf(name, MAX_NAME_SIZE, "%s", channel[len] ? channel + len + 1 : "");
+			return;
+		}
+	}
+
+	cursor = strchr(channel, '_');
+	if (cursor == NULL) {
+		snprintf(tag, MAX_NAME_SIZE, "%s", channel);
+		name[0] = '\0';
+		return;
+	}
+	snprintf(tag, MAX_NAME_SIZE, "%.*s", (int)(cursor - channel), channel);
+	snprintf(name, MAX_NAME_SIZE, "%s", cursor + 1);
+}
+
+static int compare_found_channels(const void *a, const void *b) {
+	const found_channel_t *first = (const found_channel_t*)a;
+	const found_channel_t *second = (const found_channel_t*)b;
+	int ret;
+
+	ret = strcmp(first->tag, second->tag);
+	if (ret)
+		return ret;
+	if (first->index != second->index)
+		return first->index - second->index;
+	return strcmp(first->name, second->name);
+}
+
+/* list channels a device exposes: scan_elements/in_*_en for triggered
+** devices, in_*_raw and in_*_input for polling ones; sorted by tag, then
+** by scan index; returns channels count, *channels must be freed by caller
+*/
+int collect_channels(int dev_num, int mode, found_channel_t **channels) {
+	char sysfs_dir[PATH_MAX];
+	char sysfs_path[PATH_MAX];
+	char channel[MAX_NAME_SIZE];
+	const char *suffix;
+	found_channel_t *new_channels;
+	DIR *dir;
+	struct dirent *d;
+	int len;
+	int suffix_len;
+	int count;
+	int size;
+	int i;
+
+	*channels = NULL;
+	memset(sysfs_dir, '\0', PATH_MAX);
+	snprintf(sysfs_dir, PATH_MAX, mode == MODE_TRIGGER ? CHANNEL_PATH : BASE_PATH, dev_num);
+
+	dir = opendir(sysfs_dir);
+	if (!dir) {
+		return 0;
+	}
+
+	count = 0;
+	size = 0;
+	while ((d = readdir(dir))) {
+		if (strncmp(d->d_name, "in_", 3))
+			continue;
+
+		len = strlen(d->d_name);
+		suffix = NULL;
+		if (mode == MODE_TRIGGER)
+			suffix = "_en";
+		else if (len > 4 && !strcmp(d->d_name + len - 4, "_raw"))
+			suffix = "_raw";
+		else if (len > 6 && !strcmp(d->d_name + len - 6, "_input"))
+			suffix = "_input";
+		if (suffix == NULL)
+			continue;
+
+		suffix_len = strlen(suffix);
+		if (len <= 3 + suffix_len || strcmp(d->d_name + len - suffix_len, suffix))
+			continue;
+		snprintf(channel, MAX_NAME_SIZE, "%.*s", len - 3 - suffix_len, d->d_name + 3);
+		if (!strcmp(channel, "timestamp"))
+			continue;
+
+		/* a polling channel may expose both _raw and _input */
+		for (i = 0; i < count; i++)
+			if (!strcmp((*channels)[i].channel, channel))
+				break;
+		if (i < count)
+			continue;
+
+		if (count == size) {
+			size = size ? size * 2 : CHANNELS_INITIAL_SIZE;
+			new_channels = (found_channel_t*)realloc(*channels, size * sizeof(found_channel_t));
+			if (new_channels == NULL) {
+				log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+				exit(-1);
+			}
+			*channels = new_channels;
+		}
+		snprintf((*channels)[count].channel, MAX_NAME_SIZE, "%s", channel);
+		split_channel(channel, (*channels)[count].tag, (*channels)[count].name);
+		(*channels)[count].index = -1;
+		if (mode == MODE_TRIGGER) {
+			snprintf(sysfs_path, PATH_MAX, CHANNEL_PATH "in_%s_index", dev_num, channel);
+			sysfs_read_int(sysfs_path, &(*channels)[count].index);
+		}
+		count++;
+	}
+	closedir(dir);
+
+	if (count)
+		qsort(*channels, count, sizeof(found_channel_t), compare_found_channels);
+	return count;
+}
+
+/* prepare entry g_sensor_info_size for a sensor with given tag;
+** it only becomes visible when g_sensor_info_size is incremented
+*/
+int new_sensor(const char *tag, int num_channels) {
+	sensor_info_iio_ext_t *sensors;
+	int s;
+	int c;
+	int i;
+
+	if (g_sensor_info_size == g_sensor_info_capacity) {
+		g_sensor_info_capacity = g_sensor_info_capacity ?
+			g_sensor_info_capacity * 2 : SENSORS_INITIAL_SIZE;
+		sensors = (sensor_info_iio_ext_t*)realloc(g_sensor_info_iio_ext,
+			g_sensor_info_capacity * sizeof(sensor_info_iio_ext_t));
+		if (sensors == NULL) {
+			log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+			exit(-1);
+		}
+		g_sensor_info_iio_ext = sensors;
+	}
+
+	s = g_sensor_info_size;
+	memset(&g_sensor_info_iio_ext[s], 0, sizeof(sensor_info_iio_ext_t));
+	snprintf(g_sensor_info_iio_ext[s].tag, MAX_NAME_SIZE, "%s", tag);
+	snprintf(g_sensor_info_iio_ext[s].id, MAX_NAME_SIZE, "%s", tag);
+	g_sensor_info_iio_ext[s].type = SENSOR_TYPE_UNKNOWN;
+	for (i = 0; i < g_sensor_catalog_size; i++) {
+		if (!strcmp(g_sensor_catalog[i].tag, tag)) {
+			g_sensor_info_iio_ext[s].type = g_sensor_catalog[i].type;
+			g_sensor_info_iio_ext[s].is_virtual = g_sensor_catalog[i].is_virtual;
+			break;
+		}
+	}
+	g_sensor_info_iio_ext[s].num_channels = num_channels;
+	g_sensor_info_iio_ext[s].hr_trigger_nr = -1;
+	g_sensor_info_iio_ext[s].last_timestamp = -1;
+	g_sensor_info_iio_ext[s].read_fd = -1;
+	g_sensor_info_iio_ext[s].write_fd = -1;
+	g_sensor_info_iio_ext[s].warm_fd = -1;
+	g_sensor_info_iio_ext[s].timestamp.index = -1;
+
+	g_sensor_info_iio_ext[s].channel_info =
+		(channel_info_t*)calloc(num_channels, sizeof(channel_info_t));
+	g_sensor_info_iio_ext[s].channel_descriptor =
+		(channel_descriptor_t*)calloc(num_channels, sizeof(channel_descriptor_t));
+	if (g_sensor_info_iio_ext[s].channel_info == NULL ||
+		g_sensor_info_iio_ext[s].channel_descriptor == NULL) {
+		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+		exit(-1);
+	}
+	for (c = 0; c < num_channels; c++) {
+		g_sensor_info_iio_ext[s].channel_info[c].opt_scale = 1;
+		g_sensor_info_iio_ext[s].channel_info[c].scale = 1;
+	}
+	return s;
+}
+
+/* release an entry prepared by new_sensor which won't be added */
+void drop_sensor(int s) {
+	int c;
+
+	for (c = 0; c < g_sensor_info_iio_ext[s].num_channels; c++)
+		free_channel_descriptor(&g_sensor_info_iio_ext[s].channel_descriptor[c]);
+	free(g_sensor_info_iio_ext[s].channel_info);
+	free(g_sensor_info_iio_ext[s].channel_descriptor);
+	free(g_sensor_info_iio_ext[s].triggers);
+	memset(&g_sensor_info_iio_ext[s], 0, sizeof(sensor_info_iio_ext_t));
+}
+
+/* add a sensor for channels[0..num_channels-1], which share the same tag */
+void add_sensor(int dev_num, found_channel_t channels[], int num_channels, int mode) {
 	
 	char sysfs_path[PATH_MAX];
 	const char* prefix;
 	int index;
 	int c;
-	int num_channels;
+	int s;
 	float scale;
 	float offset;
 	
-	if (g_sensor_iio_count == MAX_SENSORS) {
-		log_msg_and_exit_on_error(DEBUG, "Too many sensors!\n");
-		return;
-	}
+	s = new_sensor(channels[0].tag, num_channels);
 	memset(sysfs_path, '\0', PATH_MAX);
 
 	/* Read name attribute, if available */
@@ -55,6 +313,7 @@ void add_sensor(int dev_num, int s, int mode) {
 		 */
 		log_msg_and_exit_on_error(DEBUG, "Device%d has no name and it won't be "
 			"added to sensors list!\n", dev_num);
+		drop_sensor(s);
 		return;
 	}
 
@@ -63,20 +322,15 @@ void add_sensor(int dev_num, int s, int mode) {
 	g_sensor_info_iio_ext[s].discovered = 1;
 
 	prefix = g_sensor_info_iio_ext[s].tag;
-	num_channels = g_sensor_info_iio_ext[s].num_channels;
+	for (c = 0; c < num_channels; c++) {
+		set_channel_descriptor(&g_sensor_info_iio_ext[s].channel_descriptor[c],
+			channels[c].tag, channels[c].name);
+		g_sensor_info_iio_ext[s].channel_info[c].index = channels[c].index;
+		log_msg_and_exit_on_error(VERBOSE, "Device%d has channel %s index:%d\n",
+			dev_num, channels[c].channel, channels[c].index);
+	}
 
 	if(mode == MODE_TRIGGER) {
-		/* Read channel specific index if any*/
-		for (c = 0; c < num_channels; c++) {
-			snprintf(sysfs_path, PATH_MAX, CHANNEL_PATH "%s", dev_num, 
-				g_sensor_info_iio_ext[s].channel_descriptor[c].index_path);
-			if (!sysfs_read_int(sysfs_path, &index)) {
-				g_sensor_info_iio_ext[s].channel_info[c].index = index;
-				log_msg_and_exit_on_error(VERBOSE, "Index path:%s " "channel index:%d dev_num:%d\n",
-					sysfs_path, index, dev_num);
-			}
-		}
-
 		/* Read timestamp specific index if any*/
 		snprintf(sysfs_path, PATH_MAX, TIMESTAMP_INDEX_PATH, dev_num);
 		if (!sysfs_read_int(sysfs_path, &index)) {
@@ -142,69 +396,10 @@ void add_sensor(int dev_num, int s, int mode) {
 
 	/* Set pld information */
 	decode_placement_information(s);
+	g_sensor_info_size++;
 	g_sensor_iio_count++;
 }
 
-/* check if sensor is in polling mode */
-void check_trig_sensors (int i, char *sysfs_file, char mapped[])
-{
-
-	if (g_sensor_info_iio_ext[i].channel_descriptor[0].en_path &&
-			!strcmp(sysfs_file, g_sensor_info_iio_ext[i].channel_descriptor[0].en_path)) {
-		mapped[i] = 1;
-		return;
-	}
-}
-
-/* check if sensor is in triggered mode */
-void check_poll_sensors (int i, char *sysfs_file, char mapped[])
-{
-	int c;
-
-	for (c = 0; c < g_sensor_info_iio_ext[i].num_channels; c++)
-		if (!strcmp(sysfs_file, g_sensor_info_iio_ext[i].channel_descriptor[c].raw_path) ||
-			!strcmp(sysfs_file, g_sensor_info_iio_ext[i].channel_descriptor[c].input_path)) {
-			mapped[i] = 1;
-			break;
-		}
-}
-/* discover sensors types */
-void discover_sensors(int dev_num, char *sysfs_base_path, char mapped[],
-			  void (*discover_sensor)(int, char*, char*))
-{
-	char sysfs_dir[PATH_MAX];
-	DIR *dir;
-	struct dirent *d;
-	int i;
-
-	memset(sysfs_dir, '\0', PATH_MAX);
-	snprintf(sysfs_dir, PATH_MAX, sysfs_base_path, dev_num);
-
-	dir = opendir(sysfs_dir);
-	if (!dir) {
-		return;
-	}
-
-	/* Enumerate entries in this iio device's base folder */
-	while ((d = readdir(dir))) {
-		if (!strncmp(d->d_name, ".", 1) || !strncmp(d->d_name, "..", 2))
-			continue;
-
-		/* If the name matches a catalog entry, flag it */
-		for (i = 0; i < g_sensor_info_size; i++) {
-
-			/* No discovery for virtual sensors */
-			if (g_sensor_info_iio_ext[i].is_virtual)
-				continue;
-			discover_sensor(i, d->d_name, mapped);
-		}
-
-	}
-
-	closedir(dir);
-}
-
-
 int find_buffer_and_scan_elem(int dev_num) {
 
 	DIR *buffer_dir;
@@ -224,143 +419,88 @@ int find_buffer_and_scan_elem(int dev_num) {
 	if (!buffer_dir && !scan_elements_dir) {
 		return 0;
 	}
+	if (buffer_dir)
+		closedir(buffer_dir);
+	if (scan_elements_dir)
+		closedir(scan_elements_dir);
 
 	return 1;	
 }
 
 
-/*
-** This table mappeds syfs entries in scan_elements directories to sensor types,
-** and will also be used to determine other sysfs names as well as the iio
-** device number associated to a specific sensor.
+/* sensors sharing a tag are told apart by their instance number,
+** ex: accel#0 and accel#1; a single sensor keeps its tag as id
 */
-
-sensor_info_iio_ext_t g_sensor_info_iio_ext[] = {
-	{
-		tag		: "accel",
-		type		: SENSOR_TYPE_ACCELEROMETER,
-		num_channels	: 3,
-		trigger_nr : 0,
-		found_implicit_trigger : 0,
-		hr_trigger_nr : -1,
-		last_timestamp : -1,
-		discovered : 0,
-		channel_descriptor  : {
-			{ DECLARE_NAMED_CHANNEL("accel", "x") },
-			{ DECLARE_NAMED_CHANNEL("accel", "y") },
-			{ DECLARE_NAMED_CHANNEL("accel", "z") },
-		}
-	},
-	{
-		tag		: "anglvel",
-		type		: SENSOR_TYPE_GYROSCOPE,
-		num_channels	: 3,
-		trigger_nr : 0,
-		found_implicit_trigger : 0,
-		hr_trigger_nr : -1,
-		last_timestamp : -1,
-		discovered : 0,
-		channel_descriptor  : {
-			{ DECLARE_NAMED_CHANNEL("anglvel", "x") },
-			{ DECLARE_NAMED_CHANNEL("anglvel", "y") },
-			{ DECLARE_NAMED_CHANNEL("anglvel", "z") },
-		}
-	},
-	{
-		.tag		= "magn",
-		.type		= SENSOR_TYPE_MAGNETIC_FIELD,
-		.num_channels	= 3,
-		.trigger_nr = 0,
-		.found_implicit_trigger = 0,
-		.hr_trigger_nr = -1,
-		.last_timestamp = -1,
-		.discovered = 0,
-		.channel_descriptor  = {
-			{ DECLARE_NAMED_CHANNEL("magn", "x") },
-			{ DECLARE_NAMED_CHANNEL("magn", "y") },
-			{ DECLARE_NAMED_CHANNEL("magn", "z") },
-		}
-	},
-	{
-		.tag		= "intensity",
-		.type		= SENSOR_TYPE_INTERNAL_INTENSITY,
-		.num_channels	= 1,
-		.trigger_nr = 0,
-		.found_implicit_trigger = 0,
-		.hr_trigger_nr = -1,
-		.last_timestamp = -1,
-		.discovered = 0,
-		.channel_descriptor  = {
-			{ DECLARE_NAMED_CHANNEL("intensity", "both") },
-		}
-	},
-	{
-		.tag		= "illuminance",
-		.type		= SENSOR_TYPE_INTERNAL_ILLUMINANCE,
-		.num_channels	= 1,
-		.trigger_nr = 0,
-		.found_implicit_trigger = 0,
-		.hr_trigger_nr = -1,
-		.last_timestamp = -1,
-		.discovered = 0,
-		.channel_descriptor  = {
-			{ DECLARE_GENERIC_CHANNEL("illuminance") },
+void assign_sensor_ids(void) {
+	char instance[MAX_NAME_SIZE];
+	int s;
+	int other;
+	int count;
+	int len;
+
+	for (s = 0; s < g_sensor_info_size; s++) {
+		g_sensor_info_iio_ext[s].instance = 0;
+		count = 0;
+		for (other = 0; other < g_sensor_info_size; other++) {
+			if (strcmp(g_sensor_info_iio_ext[other].tag, g_sensor_info_iio_ext[s].tag))
+				continue;
+			if (other < s)
+				g_sensor_info_iio_ext[s].instance++;
+			count++;
 		}
-	},
-	{
-		.tag		= "temp",
-		.type		= SENSOR_TYPE_AMBIENT_TEMPERATURE,
-		.num_channels	= 1,
-		.trigger_nr = 0,
-		.found_implicit_trigger = 0,
-		.hr_trigger_nr = -1,
-		.last_timestamp = -1,
-		.discovered = 0,
-		.channel_descriptor  = {
-			{ DECLARE_GENERIC_CHANNEL("temp") },
+		if (count > 1) {
+			len = snprintf(instance, MAX_NAME_SIZE, "#%d", g_sensor_info_iio_ext[s].instance);
+			if (snprintf(g_sensor_info_iio_ext[s].id, MAX_NAME_SIZE, "%s%s",
+				g_sensor_info_iio_ext[s].tag, instance) >= MAX_NAME_SIZE) {
+				/* the tag is cut rather than the instance, ids must stay unique */
+				strcpy(g_sensor_info_iio_ext[s].id + MAX_NAME_SIZE - 1 - len, instance);
+				log_msg_and_exit_on_error(ERROR, "Tag %s is too long, its sensor is %s\n",
+					g_sensor_info_iio_ext[s].tag, g_sensor_info_iio_ext[s].id);
+			}
 		}
+		else
+			snprintf(g_sensor_info_iio_ext[s].id, MAX_NAME_SIZE, "%s",
+				g_sensor_info_iio_ext[s].tag);
 	}
-};
-
-int g_sensor_info_size = ARRAY_SIZE(g_sensor_info_iio_ext);
+}
 
 void enumerate_sensors (void)
 {
-	char trig_sensors[g_sensor_info_size];
-	char poll_sensors[g_sensor_info_size];
+	found_channel_t *channels;
+	int channels_count;
+	int *devices;
+	int devices_count;
 	int dev_num;
-	int i;
+	int mode;
+	int first;
+	int c;
+	int d;
 
 	log_msg_and_exit_on_error(VERBOSE, "enumerate_sensors\n");
 
-	for (dev_num = 0; dev_num < MAX_DEVICES; dev_num++) {
-		memset(trig_sensors, 0, g_sensor_info_size);
-		memset(poll_sensors, 0, g_sensor_info_size);
-		if(find_buffer_and_scan_elem(dev_num) == 0) {
-			discover_sensors(dev_num, BASE_PATH, poll_sensors, check_poll_sensors);
-		}
-		else{
-			discover_sensors(dev_num, CHANNEL_PATH, trig_sensors, check_trig_sensors);
-		}
-		
-		for (i=0; i< g_sensor_info_size; i++) {
-			if (trig_sensors[i]) {
-				add_sensor(dev_num, i, MODE_TRIGGER);
+	/* device numbers may be sparse, look at what is really exposed */
+	devices_count = list_iio_entries(DEVICE_PREFIX, &devices);
+	for (d = 0; d < devices_count; d++) {
+		dev_num = devices[d];
+		mode = find_buffer_and_scan_elem(dev_num) ? MODE_TRIGGER : MODE_POLL;
+		channels_count = collect_channels(dev_num, mode, &channels);
+
+		/* one sensor for every tag found on this device */
+		first = 0;
+		for (c = 1; c <= channels_count; c++) {
+			if (c < channels_count && !strcmp(channels[c].tag, channels[first].tag))
 				continue;
-			}
-			else if(poll_sensors[i]) {
-				add_sensor(dev_num, i, MODE_POLL);
-				continue;
-			}
-
+			add_sensor(dev_num, channels + first, c - first, mode);
+			first = c;
 		}
+		free(channels);
 	}
+	free(devices);
+	assign_sensor_ids();
 
-	log_msg_and_exit_on_error(VERBOSE, "Discovered %d sensors\n", g_sensor_iio_count);
+	log_msg_and_exit_on_error(VERBOSE, "Discovered %d sensors on %d devices\n",
+		g_sensor_iio_count, devices_count);
 
 	/* Set up default - as well as custom - trigger names */
 	select_trigger();
 }
-
-
-
@@ -13,10 +13,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 */
-
+#include "iio_common.h"
 #ifndef __IIO_ENUMERATION_H__
 #define __IIO_ENUMERATION_H__
 
 void enumerate_sensors(void);
+int new_sensor(const char *tag, int num_channels);
+void drop_sensor(int s);
+void split_channel(const char *channel, char tag[MAX_NAME_SIZE], char name[MAX_NAME_SIZE]);
+void set_channel_descriptor(channel_descriptor_t *descriptor, const char *tag, const char *name);
 int enable_trigger(int dev_num, const char* trigger_val);
 #endif
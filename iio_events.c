@@ -0,0 +1,191 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "iio_events.h"
+#include "iio_arena.h"
+#include "iio_histogram.h"
+#include "iio_profile.h"
+#include "iio_results.h"
+#include "iio_trace.h"
+#include "iio_utils.h"
+
+/*
+** Threshold and motion events (wake-on-motion, proximity, ...). The test
+** enables the events/ attributes of the sensor which are off, reads the
+** event fd of its device in the epoll loop of the tests and disables
+** them again at the end. The latency of an event goes from its timestamp,
+** taken by the driver in the interrupt, to its delivery to the test.
+*/
+
+static const char *event_types[] = {"thresh", "mag", "roc", "thresh_adaptive",
+	"mag_adaptive", "change"};
+static const char *event_directions[] = {"either", "rising", "falling", "none"};
+
+/* threshold and motion attributes of a sensor; ex: in_accel_x_thresh_rising_en,
+** in_accel_x&y&z_mag_rising_en for any-motion
+*/
+static int is_sensor_event(int sensor_index, const char *name) {
+	char prefix[MAX_NAME_SIZE + 4];
+	int len;
+
+	len = snprintf(prefix, sizeof(prefix), "in_%s_", g_sensor_info_iio_ext[sensor_index].tag);
+	if (strncmp(name, prefix, len))
+		return 0;
+	len = strlen(name);
+	if (len < 3 || strcmp(name + len - 3, "_en"))
+		return 0;
+	return strstr(name, "_thresh_") != NULL || strstr(name, "_mag_") != NULL ||
+		strstr(name, "_roc_") != NULL;
+}
+
+/* enable events of the sensor, return how many it has */
+int enable_events(int sensor_index, events_struct *events) {
+	char dir_path[PATH_MAX];
+	char sysfs_path[PATH_MAX];
+	DIR *dir;
+	struct dirent *d;
+	int enabled;
+	int count;
+
+	snprintf(dir_path, PATH_MAX, EVENTS_PATH, g_sensor_info_iio_ext[sensor_index].dev_num);
+	dir = opendir(dir_path);
+	if (dir == NULL)
+		return 0;
+
+	count = 0;
+	while ((d = readdir(dir))) {
+		if (!is_sensor_event(sensor_index, d->d_name))
+			continue;
+		snprintf(sysfs_path, PATH_MAX, "%s%s", dir_path, d->d_name);
+		if (sysfs_read_int(sysfs_path, &enabled) == -1)
+			continue;
+		count++;
+		if (enabled)
+			continue;
+		if (sysfs_write_int(sysfs_path, 1) == -1) {
+			log_msg_and_exit_on_error(ERROR, "Can't enable event %s\n", sysfs_path);
+			count--;
+			continue;
+		}
+		events->attributes = (char**)arena_grow(&g_test_arena, events->attributes,
+			events->attributes_count * sizeof(char*),
+			(events->attributes_count + 1) * sizeof(char*));
+		events->attributes[events->attributes_count++] = arena_strdup(&g_test_arena,
+			sysfs_path);
+		log_msg_and_exit_on_error(VERBOSE, "Enabled event %s for %s\n", d->d_name,
+			g_sensor_info_iio_ext[sensor_index].id);
+	}
+	closedir(dir);
+	return count;
+}
+
+/* disable the events enabled by the test */
+void disable_events(int sensor_index, events_struct *events) {
+	int i;
+
+	for (i = 0; i < events->attributes_count; i++)
+		if (sysfs_write_int(events->attributes[i], 0) == -1) {
+			log_msg_and_exit_on_error(ERROR, "Can't disable event %s of %s\n",
+				events->attributes[i], g_sensor_info_iio_ext[sensor_index].id);
+			set_test_state(FAILED);
+		}
+	events->attributes_count = 0;
+}
+
+/* event fd of the device open as fd, -1 on error */
+int get_event_fd(int sensor_index, int fd) {
+	int event_fd;
+
+	if (ioctl(fd, IIO_GET_EVENT_FD_IOCTL, &event_fd) == -1 || event_fd < 0) {
+		log_msg_and_exit_on_error(ERROR, "Can't get event fd for %s: %s\n",
+			g_sensor_info_iio_ext[sensor_index].id, strerror(errno));
+		set_test_state(FAILED);
+		return -1;
+	}
+	return event_fd;
+}
+
+/* read one event and add its delivery latency */
+int read_event(int sensor_index, events_struct *events, int max_delay) {
+	iio_event_struct event;
+	int64_t latency;
+	unsigned int type;
+	unsigned int direction;
+
+	if (sysfs_read_from_fd(events->event_fd, (char*)&event, sizeof(event)) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Can't read events from %s\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(FAILED);
+		return -1;
+	}
+	/* the wakeup stage of the profile is the latency of the event */
+	profile_decode_done(event.timestamp);
+	latency = get_timestamp_realtime() - event.timestamp;
+	events->counter++;
+	if (latency >= 0)
+		histogram_add(&events->latency, latency);
+
+	type = EVENT_CODE_TYPE(event.id);
+	direction = EVENT_CODE_DIR(event.id);
+	log_msg_and_exit_on_error(VERBOSE, "Device %s has event %s %s on channel %d, latency %lld us\n",
+		g_sensor_info_iio_ext[sensor_index].id,
+		type < ARRAY_SIZE(event_types) ? event_types[type] : "unknown",
+		direction < ARRAY_SIZE(event_directions) ? event_directions[direction] : "unknown",
+		EVENT_CODE_CHAN(event.id), CONVERT_NANO_TO_MICRO(latency));
+	trace_marker("event %s ts=%lld", g_sensor_info_iio_ext[sensor_index].id, event.timestamp);
+
+	if (max_delay > 0 && CONVERT_NANO_TO_MILLI(latency) > max_delay) {
+		trace_violation(sensor_index, "event_latency", CONVERT_NANO_TO_MILLI(latency), max_delay);
+		log_msg_and_exit_on_error(ERROR, "Device %s exceed max event latency = %d ms, having %lld ms\n",
+			g_sensor_info_iio_ext[sensor_index].id, max_delay, CONVERT_NANO_TO_MILLI(latency));
+		set_test_state(FAILED);
+		events->violations++;
+	}
+	return 0;
+}
+
+/* events per second over the test and their latency */
+void events_report(int sensor_index, events_struct *events) {
+	float seconds;
+	float rate;
+
+	seconds = (float)(get_timestamp_monotonic() - events->start) / CONVERT_SEC_TO_NANO(1);
+	rate = seconds > 0 ? events->counter / seconds : 0;
+	log_msg_and_exit_on_error(DEBUG, "Device %s has %lld events in %.1f s (%.2f events/s), "
+		"%lld samples read meanwhile\n", g_sensor_info_iio_ext[sensor_index].id,
+		events->counter, seconds, rate, events->samples);
+	record_metric(sensor_index, "events", events->counter, NAN, NULL);
+	record_metric(sensor_index, "event_rate", rate, NAN, "Hz");
+
+	if (events->counter == 0) {
+		/* nothing crossed a threshold, ex: the device wasn't moved */
+		log_msg_and_exit_on_error(ERROR, "Device %s had no event!\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		if (tests[nr_test].state == PASSED)
+			set_test_state(SKIPPED);
+		return;
+	}
+	histogram_print(&events->latency, g_sensor_info_iio_ext[sensor_index].id, "event latency");
+	record_histogram(sensor_index, "event_latency", &events->latency);
+}
@@ -0,0 +1,25 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_EVENTS_H__
+#define __IIO_EVENTS_H__
+
+int enable_events(int sensor_index, events_struct *events);
+void disable_events(int sensor_index, events_struct *events);
+int get_event_fd(int sensor_index, int fd);
+int read_event(int sensor_index, events_struct *events, int max_delay);
+void events_report(int sensor_index, events_struct *events);
+#endif
@@ -0,0 +1,329 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "iio_fanout.h"
+#include "iio_arena.h"
+#include "iio_control.h"
+#include "iio_control_frequency.h"
+#include "iio_histogram.h"
+#include "iio_results.h"
+#include "iio_set_trigger.h"
+#include "iio_tests.h"
+#include "iio_trace.h"
+#include "iio_utils.h"
+
+/*
+** Several devices on one trigger. The devices of the command are attached
+** to an hrtimer of the pool and streamed in steps of 1, 2, 4, ... devices
+** up to all of them; metrics of a step end in _N, its number of devices.
+**
+** The timestamp of a sample is the time its tick fired, so it gives the
+** index of the tick. For every tick the test keeps how many devices read
+** it and when the first and the last of them did: the spread between them
+** is the cost of one more device on the trigger. Ticks are only checked
+** while every device of the step streams.
+*/
+
+/* ticks of the running step */
+static fanout_ticks_struct *current_ticks;
+
+fanout_struct* new_fanout_device(void) {
+	fanout_struct *fanout;
+
+	fanout = (fanout_struct*)arena_alloc(&g_test_arena, sizeof(fanout_struct));
+	fanout->shared = current_ticks;
+	return fanout;
+}
+
+void fanout_add_sample(int sensor_index, fanout_struct *fanout) {
+	fanout_ticks_struct *shared;
+	fanout_tick_struct *tick;
+	int64_t timestamp;
+	int64_t delivery;
+	int64_t index;
+
+	shared = fanout->shared;
+	timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+	delivery = get_timestamp_realtime();
+	if (shared->base == -1)
+		shared->base = timestamp;
+	/* before the first tick of the step, ex: a sample left in a buffer */
+	if (timestamp < shared->base - shared->period / 2)
+		return;
+	index = (timestamp - shared->base + shared->period / 2) / shared->period;
+	if (delivery >= timestamp)
+		histogram_add(&fanout->latency, delivery - timestamp);
+
+	if (fanout->counter++ == 0)
+		fanout->first_tick = index;
+	else if (index <= fanout->last_tick)
+		return;
+	else if (index - fanout->last_tick > 1)
+		fanout->missed += index - fanout->last_tick - 1;
+	fanout->last_tick = index;
+
+	if (index >= shared->size)
+		return;
+	tick = &shared->ticks[index];
+	if (tick->delivered++ == 0)
+		tick->first_delivery = delivery;
+	tick->last_delivery = delivery;
+}
+
+/* ticks every device of the step read and their latency; once for the
+** step, from the first device which streamed
+*/
+int fanout_report(run_context_struct *run_context) {
+	fanout_ticks_struct *shared;
+	fanout_struct *fanout;
+	histogram_struct spread;
+	char name[MAX_NAME_SIZE];
+	const char *id;
+	int64_t first_tick;
+	int64_t last_tick;
+	int64_t incomplete;
+	int64_t worst_p99;
+	int64_t p99;
+	int64_t t;
+	int max_delay;
+	int error;
+	int i;
+
+	shared = NULL;
+	first_tick = 0;
+	last_tick = INT64_MAX;
+	worst_p99 = 0;
+	error = 0;
+	for (i = 0; i < run_context->sensors_count; i++) {
+		fanout = (fanout_struct*)run_context->sensors[i].values;
+		id = g_sensor_info_iio_ext[run_context->sensors[i].sensor_index].id;
+		if (fanout == NULL)
+			continue;
+		shared = fanout->shared;
+		if (fanout->counter == 0) {
+			log_msg_and_exit_on_error(ERROR, "No data received from %s\n", id);
+			set_test_state(FAILED);
+			return -1;
+		}
+		if (fanout->first_tick > first_tick)
+			first_tick = fanout->first_tick;
+		if (fanout->last_tick < last_tick)
+			last_tick = fanout->last_tick;
+
+		snprintf(name, MAX_NAME_SIZE, "latency with %d devices", shared->devices);
+		histogram_print(&fanout->latency, id, name);
+		snprintf(name, MAX_NAME_SIZE, "fanout_latency_%d", shared->devices);
+		record_histogram(run_context->sensors[i].sensor_index, name, &fanout->latency);
+		snprintf(name, MAX_NAME_SIZE, "fanout_missed_%d", shared->devices);
+		record_metric(run_context->sensors[i].sensor_index, name, fanout->missed, 0, NULL);
+
+		p99 = histogram_percentile(&fanout->latency, 99);
+		if (p99 > worst_p99)
+			worst_p99 = p99;
+		if (fanout->missed) {
+			trace_violation(run_context->sensors[i].sensor_index, "fanout_missed",
+				fanout->missed, 0);
+			log_msg_and_exit_on_error(ERROR, "Device %s missed %lld ticks of the trigger shared "
+				"by %d devices\n", id, fanout->missed, shared->devices);
+			error = 1;
+		}
+		max_delay = run_context->sensors[i].time_attributes->max_delay;
+		if (max_delay > 0 && p99 > CONVERT_MILLI_TO_NANO((int64_t)max_delay)) {
+			trace_violation(run_context->sensors[i].sensor_index, "fanout_latency_p99",
+				CONVERT_NANO_TO_MICRO(p99), max_delay * 1000);
+			log_msg_and_exit_on_error(ERROR, "Device %s exceed max delay = %d ms with %d devices "
+				"on its trigger, having %lld us\n", id, max_delay, shared->devices,
+				CONVERT_NANO_TO_MICRO(p99));
+			error = 1;
+		}
+	}
+	if (shared == NULL)
+		return -1;
+
+	/* ticks while every device of the step streamed */
+	histogram_reset(&spread);
+	incomplete = 0;
+	if (last_tick >= shared->size)
+		last_tick = shared->size - 1;
+	for (t = first_tick; t <= last_tick; t++) {
+		if (shared->ticks[t].delivered < shared->devices) {
+			incomplete++;
+			continue;
+		}
+		histogram_add(&spread, shared->ticks[t].last_delivery - shared->ticks[t].first_delivery);
+	}
+	log_msg_and_exit_on_error(DEBUG, "%d devices on trigger at %f Hz: %lld ticks, %lld not read "
+		"by every device, worst p99 latency %lld us\n", shared->devices, shared->freq,
+		last_tick >= first_tick ? last_tick - first_tick + 1 : 0, incomplete,
+		CONVERT_NANO_TO_MICRO(worst_p99));
+	snprintf(name, MAX_NAME_SIZE, "spread with %d devices", shared->devices);
+	histogram_print(&spread, FANOUT_TRIGGER_NAME, name);
+
+	snprintf(name, MAX_NAME_SIZE, "fanout_ticks_%d", shared->devices);
+	record_metric(-1, name, last_tick >= first_tick ? last_tick - first_tick + 1 : 0, NAN, NULL);
+	snprintf(name, MAX_NAME_SIZE, "fanout_incomplete_ticks_%d", shared->devices);
+	record_metric(-1, name, incomplete, 0, NULL);
+	snprintf(name, MAX_NAME_SIZE, "fanout_worst_latency_p99_%d", shared->devices);
+	record_metric(-1, name, CONVERT_NANO_TO_MICRO(worst_p99), NAN, "us");
+	snprintf(name, MAX_NAME_SIZE, "fanout_spread_%d", shared->devices);
+	record_histogram(-1, name, &spread);
+
+	if (incomplete) {
+		trace_violation(-1, "fanout_incomplete_ticks", incomplete, 0);
+		log_msg_and_exit_on_error(ERROR, "%lld ticks of the trigger weren't read by all "
+			"%d devices\n", incomplete, shared->devices);
+		error = 1;
+	}
+	if (error) {
+		set_test_state(FAILED);
+		return -1;
+	}
+	return 0;
+}
+
+/* disable buffers of devices which stream, they are attached to a
+** trigger only while disabled
+*/
+static void stop_devices(selected_sensor_struct *devices, int count) {
+	char sysfs_path[PATH_MAX];
+	int enabled;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		snprintf(sysfs_path, PATH_MAX, ENABLE_PATH,
+			g_sensor_info_iio_ext[devices[i].sensor_index].dev_num);
+		if (sysfs_read_int(sysfs_path, &enabled) == 0 && enabled)
+			activate_sensor(devices[i].sensor_index, 0);
+	}
+}
+
+/* stream 1, 2, 4, ... devices of the command on one hrtimer */
+int check_fanout(int duration) {
+	selected_sensor_struct *selected;
+	selected_sensor_struct *devices;
+	char sysfs_path[PATH_MAX];
+	char (*trigger_names)[MAX_NAME_SIZE];
+	int *hr_trigger_nrs;
+	int selected_count;
+	int trigger_nr;
+	int count;
+	int steps;
+	float freq;
+	int i;
+	int s;
+
+	/* one sensor per device, a device is attached to a trigger once */
+	selected = selected_sensors;
+	selected_count = selected_sensors_count;
+	devices = (selected_sensor_struct*)arena_alloc(&g_test_arena,
+		(selected_count + 1) * sizeof(selected_sensor_struct));
+	count = 0;
+	for (s = 0; s < selected_count; s++) {
+		if (g_sensor_info_iio_ext[selected[s].sensor_index].mode != MODE_TRIGGER ||
+			g_sensor_info_iio_ext[selected[s].sensor_index].is_virtual) {
+			log_msg_and_exit_on_error(DEBUG, "Device %s isn't triggered\n",
+				g_sensor_info_iio_ext[selected[s].sensor_index].id);
+			continue;
+		}
+		for (i = 0; i < count; i++)
+			if (g_sensor_info_iio_ext[devices[i].sensor_index].dev_num ==
+				g_sensor_info_iio_ext[selected[s].sensor_index].dev_num)
+				break;
+		if (i == count)
+			devices[count++] = selected[s];
+	}
+	if (count == 0) {
+		log_msg_and_exit_on_error(ERROR, "No triggered device to attach to a trigger!\n");
+		set_test_state(SKIPPED);
+		return -1;
+	}
+
+	trigger_nr = get_shared_hrtimer(FANOUT_TRIGGER_NAME);
+	if (trigger_nr == -1) {
+		log_msg_and_exit_on_error(ERROR, "Can't create hrtimer trigger %s!\n",
+			FANOUT_TRIGGER_NAME);
+		set_test_state(SKIPPED);
+		return -1;
+	}
+	freq = devices[0].time_attributes.freq > 0 ? devices[0].time_attributes.freq : FANOUT_FREQ;
+	if (set_hrtimer_freq(trigger_nr, freq) == -1) {
+		set_test_state(FAILED);
+		return -1;
+	}
+	snprintf(sysfs_path, PATH_MAX, TRIGGER_FREQ_PATH, trigger_nr);
+	if (sysfs_read_float(sysfs_path, &freq) == -1 || freq <= 0) {
+		log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path);
+		set_test_state(FAILED);
+		return -1;
+	}
+
+	/* the shared trigger replaces the trigger of every device until the
+	** end of the test; without an hrtimer of their own, set_freq only
+	** changes the rate of the devices
+	*/
+	stop_devices(devices, count);
+	trigger_names = arena_alloc(&g_test_arena, count * MAX_NAME_SIZE);
+	hr_trigger_nrs = (int*)arena_alloc(&g_test_arena, count * sizeof(int));
+	for (i = 0; i < count; i++) {
+		s = devices[i].sensor_index;
+		memcpy(trigger_names[i], g_sensor_info_iio_ext[s].init_trigger_name, MAX_NAME_SIZE);
+		hr_trigger_nrs[i] = g_sensor_info_iio_ext[s].hr_trigger_nr;
+		snprintf(g_sensor_info_iio_ext[s].init_trigger_name, MAX_NAME_SIZE, "%s",
+			FANOUT_TRIGGER_NAME);
+		g_sensor_info_iio_ext[s].hr_trigger_nr = -1;
+		g_sensor_info_iio_ext[s].trigger_attached = 0;
+		devices[i].time_attributes.freq = freq;
+	}
+
+	for (steps = 1; ; steps = steps * 2 < count ? steps * 2 : count) {
+		current_ticks = (fanout_ticks_struct*)arena_alloc(&g_test_arena,
+			sizeof(fanout_ticks_struct));
+		current_ticks->devices = steps;
+		current_ticks->freq = freq;
+		current_ticks->period = (int64_t)(CONVERT_SEC_TO_NANO(1) / freq);
+		current_ticks->base = -1;
+		current_ticks->size = (int)((duration + 2) * freq) + 1;
+		current_ticks->ticks = (fanout_tick_struct*)arena_alloc(&g_test_arena,
+			current_ticks->size * sizeof(fanout_tick_struct));
+		log_msg_and_exit_on_error(DEBUG, "Streaming %d devices on trigger %s\n", steps,
+			FANOUT_TRIGGER_NAME);
+
+		selected_sensors = devices;
+		selected_sensors_count = steps;
+		poll_sensors(fanout_initialize, fanout_wrapper, duration);
+		stop_devices(devices, steps);
+		if (steps == count)
+			break;
+	}
+	current_ticks = NULL;
+
+	for (i = 0; i < count; i++) {
+		s = devices[i].sensor_index;
+		/* a warm device is still attached to the shared trigger */
+		if (g_keep_warm)
+			enable_trigger(g_sensor_info_iio_ext[s].dev_num, "\n");
+		memcpy(g_sensor_info_iio_ext[s].init_trigger_name, trigger_names[i], MAX_NAME_SIZE);
+		g_sensor_info_iio_ext[s].hr_trigger_nr = hr_trigger_nrs[i];
+		g_sensor_info_iio_ext[s].trigger_attached = 0;
+	}
+	selected_sensors = selected;
+	selected_sensors_count = selected_count;
+	return 0;
+}
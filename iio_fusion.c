@@ -0,0 +1,641 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "iio_fusion.h"
+#include "iio_control.h"
+#include "iio_control_frequency.h"
+#include "iio_enumeration.h"
+#include "iio_sample_format.h"
+#include "iio_histogram.h"
+#include "iio_results.h"
+#include "iio_utils.h"
+
+/*
+** Virtual sensors computed from the physical ones, like the orientation
+** and rotation vector of the sensor hub. A thread reads the devices of
+** the first triggered accel, anglvel and magn and runs a Madgwick filter
+** on every gyro sample, corrected by gravity and, when there is one, by
+** the magnetic field. Fused samples are written in the pipe of every
+** virtual sensor being read, in the layout of a triggered device, so the
+** tests read them as any other sensor.
+**
+** A fused sample has the timestamp of the newest source sample it comes
+** from; the time from that sample to the write of the fused one is the
+** fusion latency. Tests measuring client delay on a virtual sensor give
+** the latency from the physical sample to the client.
+*/
+
+static const char *source_tags[FUSION_SOURCES] = {"accel", "anglvel", "magn"};
+static const char *orientation_names[] = {"azimuth", "pitch", "roll"};
+static const char *rotation_vector_names[] = {"x", "y", "z", "w"};
+
+static fusion_struct fusion;
+
+/* first triggered sensor with tag, -1 if there is none */
+static int find_source(const char *tag) {
+	int s;
+
+	for (s = 0; s < g_sensor_info_size; s++) {
+		if (!g_sensor_info_iio_ext[s].discovered || g_sensor_info_iio_ext[s].is_virtual ||
+			g_sensor_info_iio_ext[s].mode != MODE_TRIGGER ||
+			g_sensor_info_iio_ext[s].sample_size <= 0)
+			continue;
+		if (!strcmp(g_sensor_info_iio_ext[s].tag, tag))
+			return s;
+	}
+	return -1;
+}
+
+/* output of a virtual sensor, -1 for a physical one */
+static int find_output(int sensor_index) {
+	int k;
+
+	for (k = 0; k < FUSION_OUTPUTS; k++)
+		if (fusion.outputs[k] == sensor_index)
+			return k;
+	return -1;
+}
+
+/* virtual sensor with the layout of a triggered device of its own */
+static int add_virtual_sensor(const char *tag, const char *names[], int num_channels) {
+	sensor_info_iio_ext_t *sensor;
+	channel_info_t *channel;
+	int s;
+	int c;
+
+	s = new_sensor(tag, num_channels);
+	sensor = &g_sensor_info_iio_ext[s];
+	snprintf(sensor->internal_name, MAX_NAME_SIZE, "fusion");
+	/* set_scan_layout groups sensors by device */
+	sensor->dev_num = -1 - s;
+	sensor->mode = MODE_TRIGGER;
+	sensor->discovered = 1;
+	sensor->is_virtual = 1;
+	sensor->scale = 0;
+	sensor->data_rate = g_sensor_info_iio_ext[fusion.sources[FUSION_GYRO].sensor_index].data_rate;
+	for (c = 0; c < num_channels; c++) {
+		set_channel_descriptor(&sensor->channel_descriptor[c], tag, names[c]);
+		channel = &sensor->channel_info[c];
+		snprintf(channel->type_spec, MAX_TYPE_SPEC_LEN, "%s", FUSION_TYPE_SPEC);
+		channel->size = decode_type_spec(channel->type_spec, &channel->type_info);
+		channel->index = c;
+		channel->scale = FUSION_SCALE;
+	}
+	snprintf(sensor->timestamp.type_spec, MAX_TYPE_SPEC_LEN, "%s", FUSION_TIMESTAMP_SPEC);
+	sensor->timestamp.size = decode_type_spec(sensor->timestamp.type_spec,
+		&sensor->timestamp.type_info);
+	sensor->timestamp.index = num_channels;
+	g_sensor_info_size++;
+
+	sensor->sample_size = set_scan_layout(s);
+	log_msg_and_exit_on_error(VERBOSE, "Virtual sensor %s has sample size %d\n",
+		sensor->id, sensor->sample_size);
+	return s;
+}
+
+/* add orientation and rotation_vector when there are an accel and a gyro;
+** they are never cached, sensors are added again at every start
+*/
+void add_fused_sensors(void) {
+	fusion_source_struct *source;
+	int k;
+	int j;
+
+	memset(&fusion, 0, sizeof(fusion_struct));
+	pthread_mutex_init(&fusion.lock, NULL);
+	for (k = 0; k < FUSION_OUTPUTS; k++) {
+		fusion.outputs[k] = -1;
+		fusion.write_fds[k] = -1;
+	}
+	for (k = 0; k < FUSION_SOURCES; k++) {
+		source = &fusion.sources[k];
+		source->sensor_index = find_source(source_tags[k]);
+		source->fd = -1;
+		/* sensors of the same device are read from one fd */
+		source->owner = k;
+		for (j = 0; j < k; j++)
+			if (source->sensor_index != -1 && fusion.sources[j].sensor_index != -1 &&
+				g_sensor_info_iio_ext[fusion.sources[j].sensor_index].dev_num ==
+				g_sensor_info_iio_ext[source->sensor_index].dev_num) {
+				source->owner = fusion.sources[j].owner;
+				break;
+			}
+	}
+	if (fusion.sources[FUSION_ACCEL].sensor_index == -1 ||
+		fusion.sources[FUSION_GYRO].sensor_index == -1) {
+		log_msg_and_exit_on_error(VERBOSE, "No virtual sensors, they need a triggered "
+			"accel and anglvel\n");
+		return;
+	}
+
+	fusion.outputs[FUSION_ORIENTATION] = add_virtual_sensor("orientation",
+		orientation_names, ARRAY_SIZE(orientation_names));
+	fusion.outputs[FUSION_ROTATION_VECTOR] = add_virtual_sensor("rotation_vector",
+		rotation_vector_names, ARRAY_SIZE(rotation_vector_names));
+}
+
+/* physical sensors a virtual sensor is computed from */
+int get_fusion_sources(int sensor_index, int sources[FUSION_SOURCES]) {
+	int count;
+	int k;
+
+	count = 0;
+	if (find_output(sensor_index) == -1)
+		return 0;
+	for (k = 0; k < FUSION_SOURCES; k++)
+		if (fusion.sources[k].sensor_index != -1)
+			sources[count++] = fusion.sources[k].sensor_index;
+	return count;
+}
+
+/* fused samples follow the gyro; accel is set at the same rate and
+** magn, which only corrects the heading, keeps its own
+*/
+int set_fusion_freq(int sensor_index, float required_value) {
+	float data_rate;
+	int k;
+
+	if (set_freq(fusion.sources[FUSION_ACCEL].sensor_index, required_value) == -1 ||
+		set_freq(fusion.sources[FUSION_GYRO].sensor_index, required_value) == -1)
+		return -1;
+	data_rate = g_sensor_info_iio_ext[fusion.sources[FUSION_GYRO].sensor_index].data_rate;
+	for (k = 0; k < FUSION_OUTPUTS; k++)
+		g_sensor_info_iio_ext[fusion.outputs[k]].data_rate = data_rate;
+	log_msg_and_exit_on_error(VERBOSE, "Frequency for device %s was successfully"
+		" set to value %f\n", g_sensor_info_iio_ext[sensor_index].id, data_rate);
+	return 0;
+}
+
+static int is_source_enabled(int sensor_index, int *enabled) {
+	char sysfs_path[PATH_MAX];
+
+	memset(sysfs_path, '\0', PATH_MAX);
+	snprintf(sysfs_path, PATH_MAX, ENABLE_PATH, g_sensor_info_iio_ext[sensor_index].dev_num);
+	if (sysfs_read_int(sysfs_path, enabled) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path);
+		set_test_state(FAILED);
+		return -1;
+	}
+	return 0;
+}
+
+/* a virtual sensor is active while all its sources are; sources shared
+** with the other virtual sensor are activated and deactivated for both
+*/
+int activate_fusion_sources(int sensor_index, int value) {
+	int sources[FUSION_SOURCES];
+	int count;
+	int changed;
+	int enabled;
+	int i;
+
+	count = get_fusion_sources(sensor_index, sources);
+	changed = 0;
+	for (i = 0; i < count; i++) {
+		if (is_source_enabled(sources[i], &enabled) == -1)
+			return -1;
+		if (enabled != value)
+			changed = 1;
+	}
+	if (!changed) {
+		log_msg_and_exit_on_error(ERROR, "%s was already %s!\n",
+			g_sensor_info_iio_ext[sensor_index].id, value ? "activated" : "deactivated");
+		set_test_state(FAILED);
+		return -1;
+	}
+
+	/* sources of one device are set by the first of them */
+	for (i = 0; i < count; i++) {
+		if (is_source_enabled(sources[i], &enabled) == -1)
+			return -1;
+		if (enabled != value && activate_sensor(sources[i], value) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+/* q = q + (0.5 q * gyro - beta * gradient) dt, the gradient descent step
+** of Madgwick's filter towards gravity and the magnetic field
+*/
+static void add_jacobian_step(float step[4], float jacobian[3][4], const float f[3]) {
+	int i;
+	int j;
+
+	for (i = 0; i < 4; i++)
+		for (j = 0; j < 3; j++)
+			step[i] += jacobian[j][i] * f[j];
+}
+
+static int normalize(float *v, int n) {
+	float norm;
+	int i;
+
+	norm = 0;
+	for (i = 0; i < n; i++)
+		norm += v[i] * v[i];
+	if (norm == 0)
+		return -1;
+	norm = sqrtf(norm);
+	for (i = 0; i < n; i++)
+		v[i] /= norm;
+	return 0;
+}
+
+static void madgwick_update(float dt) {
+	float *q;
+	float g[3];
+	float a[3];
+	float m[3];
+	float f[3];
+	float h[3];
+	float jacobian[3][4];
+	float q_dot[4];
+	float step[4];
+	float bx;
+	float bz;
+	int i;
+
+	q = fusion.q;
+	memcpy(g, fusion.sources[FUSION_GYRO].values, sizeof(g));
+	memcpy(a, fusion.sources[FUSION_ACCEL].values, sizeof(a));
+
+	q_dot[0] = 0.5 * (-q[1] * g[0] - q[2] * g[1] - q[3] * g[2]);
+	q_dot[1] = 0.5 * (q[0] * g[0] + q[2] * g[2] - q[3] * g[1]);
+	q_dot[2] = 0.5 * (q[0] * g[1] - q[1] * g[2] + q[3] * g[0]);
+	q_dot[3] = 0.5 * (q[0] * g[2] + q[1] * g[1] - q[2] * g[0]);
+
+	memset(step, 0, sizeof(step));
+	if (normalize(a, 3) == 0) {
+		/* gravity in the sensor frame minus the measured one */
+		f[0] = 2 * (q[1] * q[3] - q[0] * q[2]) - a[0];
+		f[1] = 2 * (q[0] * q[1] + q[2] * q[3]) - a[1];
+		f[2] = 2 * (0.5 - q[1] * q[1] - q[2] * q[2]) - a[2];
+		jacobian[0][0] = -2 * q[2]; jacobian[0][1] = 2 * q[3];
+		jacobian[0][2] = -2 * q[0]; jacobian[0][3] = 2 * q[1];
+		jacobian[1][0] = 2 * q[1]; jacobian[1][1] = 2 * q[0];
+		jacobian[1][2] = 2 * q[3]; jacobian[1][3] = 2 * q[2];
+		jacobian[2][0] = 0; jacobian[2][1] = -4 * q[1];
+		jacobian[2][2] = -4 * q[2]; jacobian[2][3] = 0;
+		add_jacobian_step(step, jacobian, f);
+
+		memcpy(m, fusion.sources[FUSION_MAGN].values, sizeof(m));
+		if (fusion.sources[FUSION_MAGN].timestamp != -1 && normalize(m, 3) == 0) {
+			/* field in the earth frame, with its horizontal part on x */
+			h[0] = m[0] * (q[0] * q[0] + q[1] * q[1] - q[2] * q[2] - q[3] * q[3]) +
+				2 * m[1] * (q[1] * q[2] - q[0] * q[3]) + 2 * m[2] * (q[1] * q[3] + q[0] * q[2]);
+			h[1] = 2 * m[0] * (q[1] * q[2] + q[0] * q[3]) +
+				m[1] * (q[0] * q[0] - q[1] * q[1] + q[2] * q[2] - q[3] * q[3]) +
+				2 * m[2] * (q[2] * q[3] - q[0] * q[1]);
+			h[2] = 2 * m[0] * (q[1] * q[3] - q[0] * q[2]) + 2 * m[1] * (q[2] * q[3] + q[0] * q[1]) +
+				m[2] * (q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]);
+			bx = sqrtf(h[0] * h[0] + h[1] * h[1]);
+			bz = h[2];
+
+			f[0] = 2 * bx * (0.5 - q[2] * q[2] - q[3] * q[3]) +
+				2 * bz * (q[1] * q[3] - q[0] * q[2]) - m[0];
+			f[1] = 2 * bx * (q[1] * q[2] - q[0] * q[3]) +
+				2 * bz * (q[0] * q[1] + q[2] * q[3]) - m[1];
+			f[2] = 2 * bx * (q[0] * q[2] + q[1] * q[3]) +
+				2 * bz * (0.5 - q[1] * q[1] - q[2] * q[2]) - m[2];
+			jacobian[0][0] = -2 * bz * q[2];
+			jacobian[0][1] = 2 * bz * q[3];
+			jacobian[0][2] = -4 * bx * q[2] - 2 * bz * q[0];
+			jacobian[0][3] = -4 * bx * q[3] + 2 * bz * q[1];
+			jacobian[1][0] = -2 * bx * q[3] + 2 * bz * q[1];
+			jacobian[1][1] = 2 * bx * q[2] + 2 * bz * q[0];
+			jacobian[1][2] = 2 * bx * q[1] + 2 * bz * q[3];
+			jacobian[1][3] = -2 * bx * q[0] + 2 * bz * q[2];
+			jacobian[2][0] = 2 * bx * q[2];
+			jacobian[2][1] = 2 * bx * q[3] - 4 * bz * q[1];
+			jacobian[2][2] = 2 * bx * q[0] - 4 * bz * q[2];
+			jacobian[2][3] = 2 * bx * q[1];
+			add_jacobian_step(step, jacobian, f);
+		}
+		if (normalize(step, 4) == 0)
+			for (i = 0; i < 4; i++)
+				q_dot[i] -= FUSION_BETA * step[i];
+	}
+
+	for (i = 0; i < 4; i++)
+		q[i] += q_dot[i] * dt;
+	normalize(q, 4);
+}
+
+/* write a fused sample in the layout of output k */
+static void write_output(int k, const float *values, int64_t timestamp) {
+	sensor_info_iio_ext_t *sensor;
+	int32_t value;
+	int c;
+	int i;
+
+	sensor = &g_sensor_info_iio_ext[fusion.outputs[k]];
+	unsigned char sample[sensor->sample_size];
+
+	memset(sample, 0, sensor->sample_size);
+	for (c = 0; c < sensor->num_channels; c++) {
+		value = (int32_t)lrintf(values[c] / FUSION_SCALE);
+		for (i = 0; i < 4; i++)
+			sample[sensor->channel_info[c].offset + i] = ((uint32_t)value >> (8 * i)) & 0xff;
+	}
+	for (i = 0; i < 8; i++)
+		sample[sensor->timestamp.offset + i] = ((uint64_t)timestamp >> (8 * i)) & 0xff;
+
+	/* a full pipe drops samples like a full iio buffer */
+	if (write(fusion.write_fds[k], sample, sensor->sample_size) == -1) {
+		fusion.dropped[k]++;
+		return;
+	}
+	fusion.produced[k]++;
+	histogram_add(&fusion.latency[k], get_timestamp_realtime() - timestamp);
+}
+
+/* filter step for a new gyro sample, then write the outputs being read */
+static void fuse(void) {
+	float values[FUSION_OUTPUTS][FUSION_MAX_CHANNELS];
+	float *q;
+	float data_rate;
+	float dt;
+	float yaw;
+	int64_t timestamp;
+	int k;
+
+	timestamp = fusion.sources[FUSION_GYRO].timestamp;
+	if (fusion.sources[FUSION_ACCEL].timestamp == -1) {
+		fusion.gyro_timestamp = timestamp;
+		return;
+	}
+	data_rate = g_sensor_info_iio_ext[fusion.sources[FUSION_GYRO].sensor_index].data_rate;
+	dt = data_rate > 0 ? 1 / data_rate : 0;
+	if (fusion.gyro_timestamp != -1 && timestamp > fusion.gyro_timestamp &&
+		timestamp - fusion.gyro_timestamp < CONVERT_SEC_TO_NANO(1))
+		dt = (float)(timestamp - fusion.gyro_timestamp) / CONVERT_SEC_TO_NANO(1);
+	fusion.gyro_timestamp = timestamp;
+	madgwick_update(dt);
+
+	/* newest sample the output comes from */
+	for (k = 0; k < FUSION_SOURCES; k++)
+		if (fusion.sources[k].timestamp > timestamp)
+			timestamp = fusion.sources[k].timestamp;
+
+	q = fusion.q;
+	/* azimuth clockwise from magnetic north, pitch and roll in degrees */
+	yaw = atan2f(2 * (q[0] * q[3] + q[1] * q[2]), 1 - 2 * (q[2] * q[2] + q[3] * q[3]));
+	values[FUSION_ORIENTATION][0] = fmodf(360 - yaw * 180 / M_PI, 360);
+	values[FUSION_ORIENTATION][1] = asinf(fmaxf(-1, fminf(1,
+		2 * (q[0] * q[2] - q[3] * q[1])))) * 180 / M_PI;
+	values[FUSION_ORIENTATION][2] = atan2f(2 * (q[0] * q[1] + q[2] * q[3]),
+		1 - 2 * (q[1] * q[1] + q[2] * q[2])) * 180 / M_PI;
+	values[FUSION_ROTATION_VECTOR][0] = q[1];
+	values[FUSION_ROTATION_VECTOR][1] = q[2];
+	values[FUSION_ROTATION_VECTOR][2] = q[3];
+	values[FUSION_ROTATION_VECTOR][3] = q[0];
+
+	pthread_mutex_lock(&fusion.lock);
+	for (k = 0; k < FUSION_OUTPUTS; k++)
+		if (fusion.write_fds[k] != -1)
+			write_output(k, values[k], timestamp);
+	pthread_mutex_unlock(&fusion.lock);
+}
+
+/* read a sample from the device of source owner and decode it for
+** every source of that device
+*/
+static int read_source(int owner) {
+	fusion_source_struct *source;
+	sensor_info_iio_ext_t *sensor;
+	const char *name;
+	int64_t value;
+	int gyro;
+	int c;
+	int k;
+
+	sensor = &g_sensor_info_iio_ext[fusion.sources[owner].sensor_index];
+	unsigned char sample[sensor->sample_size];
+
+	if (read(fusion.sources[owner].fd, sample, sensor->sample_size) != sensor->sample_size) {
+		log_msg_and_exit_on_error(ERROR, "Can't read samples from %s \n", sensor->id);
+		set_test_state(FAILED);
+		return -1;
+	}
+
+	gyro = 0;
+	for (k = 0; k < FUSION_SOURCES; k++) {
+		source = &fusion.sources[k];
+		if (source->sensor_index == -1 || source->owner != owner)
+			continue;
+		sensor = &g_sensor_info_iio_ext[source->sensor_index];
+		for (c = 0; c < sensor->num_channels; c++) {
+			name = sensor->channel_descriptor[c].name;
+			if (sensor->channel_info[c].size <= 0 || name[0] < 'x' || name[0] > 'z' || name[1])
+				continue;
+			value = sample_as_int64(sample + sensor->channel_info[c].offset,
+				&sensor->channel_info[c].type_info);
+			source->values[name[0] - 'x'] = scale_value(source->sensor_index, c, value);
+		}
+		if (sensor->timestamp.size > 0)
+			source->timestamp = sample_as_int64(sample + sensor->timestamp.offset,
+				&sensor->timestamp.type_info);
+		else
+			source->timestamp = get_timestamp_realtime();
+		if (k == FUSION_GYRO)
+			gyro = 1;
+	}
+	if (gyro)
+		fuse();
+	return 0;
+}
+
+static void* fusion_routine(void* params __attribute__((unused))) {
+	struct epoll_event ev;
+	struct epoll_event ret_ev[FUSION_SOURCES];
+	int events_count;
+	int epfd;
+	int i;
+	int k;
+
+	epfd = epoll_create(FUSION_SOURCES);
+	if (epfd == -1) {
+		log_msg_and_exit_on_error(ERROR, "Error epoll_create: %s\n", strerror(errno));
+		set_test_state(FAILED);
+		return NULL;
+	}
+	for (k = 0; k < FUSION_SOURCES; k++) {
+		if (fusion.sources[k].sensor_index == -1 || fusion.sources[k].owner != k)
+			continue;
+		ev.data.u32 = k;
+		ev.events = EPOLLIN;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fusion.sources[k].fd, &ev) == -1) {
+			log_msg_and_exit_on_error(ERROR, "Error epoll_ctl ADD for %s: %s\n",
+				g_sensor_info_iio_ext[fusion.sources[k].sensor_index].id, strerror(errno));
+			set_test_state(FAILED);
+			close(epfd);
+			return NULL;
+		}
+	}
+
+	while (!__atomic_load_n(&fusion.stop, __ATOMIC_ACQUIRE)) {
+		events_count = epoll_wait(epfd, ret_ev, FUSION_SOURCES, FUSION_POLL_TIMEOUT_MS);
+		if (events_count == -1) {
+			if (errno == EINTR)
+				continue;
+			log_msg_and_exit_on_error(ERROR, "Error epoll_wait: %s\n", strerror(errno));
+			set_test_state(FAILED);
+			break;
+		}
+		for (i = 0; i < events_count; i++)
+			if ((ret_ev[i].events & EPOLLIN) && read_source(ret_ev[i].data.u32) == -1)
+				__atomic_store_n(&fusion.stop, 1, __ATOMIC_RELEASE);
+	}
+	close(epfd);
+	return NULL;
+}
+
+static void close_sources(void) {
+	int k;
+
+	for (k = 0; k < FUSION_SOURCES; k++) {
+		if (fusion.sources[k].fd == -1)
+			continue;
+		if (fusion.sources[k].owner == k)
+			close_device_fd(fusion.sources[k].sensor_index, fusion.sources[k].fd);
+		fusion.sources[k].fd = -1;
+	}
+}
+
+/* open the source devices and start the filter from the identity */
+static int start_fusion(void) {
+	fusion_source_struct *source;
+	int saved_errno;
+	int k;
+
+	for (k = 0; k < FUSION_SOURCES; k++) {
+		source = &fusion.sources[k];
+		source->timestamp = -1;
+		memset(source->values, 0, sizeof(source->values));
+		if (source->sensor_index == -1)
+			continue;
+		if (source->owner != k) {
+			source->fd = fusion.sources[source->owner].fd;
+			continue;
+		}
+		source->fd = open_device_fd(source->sensor_index, 0);
+		if (source->fd == -1) {
+			saved_errno = errno;
+			log_msg_and_exit_on_error(ERROR, "Can't open %s for the fusion: %s\n",
+				g_sensor_info_iio_ext[source->sensor_index].id, strerror(errno));
+			close_sources();
+			errno = saved_errno;
+			return -1;
+		}
+	}
+
+	fusion.q[0] = 1;
+	fusion.q[1] = 0;
+	fusion.q[2] = 0;
+	fusion.q[3] = 0;
+	fusion.gyro_timestamp = -1;
+	__atomic_store_n(&fusion.stop, 0, __ATOMIC_RELEASE);
+	if (pthread_create(&fusion.thread, NULL, &fusion_routine, NULL)) {
+		log_msg_and_exit_on_error(ERROR, "Can't create thread for the fusion\n");
+		close_sources();
+		return -1;
+	}
+	return 0;
+}
+
+static void stop_fusion(void) {
+	__atomic_store_n(&fusion.stop, 1, __ATOMIC_RELEASE);
+	if (pthread_join(fusion.thread, NULL)) {
+		log_msg_and_exit_on_error(ERROR, "Can't destroy thread for the fusion\n");
+		set_test_state(FAILED);
+	}
+	close_sources();
+}
+
+/* pipe of a virtual sensor; the fusion runs while one of them is open */
+int open_fusion_fd(int sensor_index, int flags) {
+	int pfd[2];
+	int k;
+
+	k = find_output(sensor_index);
+	if (k == -1 || fusion.write_fds[k] != -1) {
+		errno = EBUSY;
+		return -1;
+	}
+	if (pipe(pfd) == -1)
+		return -1;
+	fcntl(pfd[WRITE], F_SETFL, O_NONBLOCK);
+	fcntl(pfd[READ], F_SETFL, flags & O_NONBLOCK);
+
+	if (fusion.users == 0 && start_fusion() == -1) {
+		close(pfd[READ]);
+		close(pfd[WRITE]);
+		return -1;
+	}
+	fusion.users++;
+
+	pthread_mutex_lock(&fusion.lock);
+	histogram_reset(&fusion.latency[k]);
+	fusion.produced[k] = 0;
+	fusion.dropped[k] = 0;
+	fusion.write_fds[k] = pfd[WRITE];
+	pthread_mutex_unlock(&fusion.lock);
+	return pfd[READ];
+}
+
+/* close the pipe of a virtual sensor and report the fusion latency */
+int close_fusion_fd(int sensor_index, int fd) {
+	int64_t p50;
+	int64_t p99;
+	int k;
+
+	k = find_output(sensor_index);
+	if (k == -1) {
+		log_msg_and_exit_on_error(ERROR, "Device %s is not an output of the fusion\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(FAILED);
+		close(fd);
+		return -1;
+	}
+	pthread_mutex_lock(&fusion.lock);
+	close(fusion.write_fds[k]);
+	fusion.write_fds[k] = -1;
+	pthread_mutex_unlock(&fusion.lock);
+
+	fusion.users--;
+	if (fusion.users == 0)
+		stop_fusion();
+
+	if (fusion.produced[k]) {
+		p50 = histogram_percentile(&fusion.latency[k], 50);
+		p99 = histogram_percentile(&fusion.latency[k], 99);
+		log_msg_and_exit_on_error(DEBUG, "Fusion of %s: %lld samples, %lld dropped, "
+			"latency p50 = %lld us p99 = %lld us\n", g_sensor_info_iio_ext[sensor_index].id,
+			fusion.produced[k], fusion.dropped[k], CONVERT_NANO_TO_MICRO(p50),
+			CONVERT_NANO_TO_MICRO(p99));
+		record_histogram(sensor_index, "fusion_latency", &fusion.latency[k]);
+		record_metric(sensor_index, "fusion_dropped", fusion.dropped[k], NAN, NULL);
+	}
+	return close(fd);
+}
@@ -0,0 +1,26 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_FUSION_H__
+#define __IIO_FUSION_H__
+
+void add_fused_sensors(void);
+int get_fusion_sources(int sensor_index, int sources[FUSION_SOURCES]);
+int set_fusion_freq(int sensor_index, float required_value);
+int activate_fusion_sources(int sensor_index, int value);
+int open_fusion_fd(int sensor_index, int flags);
+int close_fusion_fd(int sensor_index, int fd);
+#endif
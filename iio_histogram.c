@@ -0,0 +1,127 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "iio_histogram.h"
+#include "iio_utils.h"
+
+/* values up to 3 have their own bucket, then every power of 2
+** is split in HISTOGRAM_SUB_BUCKETS equal buckets
+*/
+static int get_bucket_index(int64_t value) {
+	int msb;
+	int index;
+
+	if (value < HISTOGRAM_SUB_BUCKETS)
+		return value < 0 ? 0 : (int)value;
+
+	msb = 63 - __builtin_clzll((uint64_t)value);
+	index = (msb - HISTOGRAM_SUB_BUCKETS_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+		(int)((value >> (msb - HISTOGRAM_SUB_BUCKETS_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+
+	if (index >= HISTOGRAM_BUCKETS)
+		return HISTOGRAM_BUCKETS - 1;
+	return index;
+}
+
+/* lowest value which is counted in a bucket */
+static int64_t get_bucket_lower_bound(int index) {
+	int octave;
+	int sub_bucket;
+
+	if (index < HISTOGRAM_SUB_BUCKETS)
+		return index;
+
+	octave = index / HISTOGRAM_SUB_BUCKETS;
+	sub_bucket = index % HISTOGRAM_SUB_BUCKETS;
+	return (int64_t)(HISTOGRAM_SUB_BUCKETS + sub_bucket) << (octave - 1);
+}
+
+void histogram_reset(histogram_struct *histogram) {
+	memset(histogram, 0, sizeof(histogram_struct));
+}
+
+void histogram_add(histogram_struct *histogram, int64_t value) {
+	if (histogram->counter == 0 || value < histogram->min)
+		histogram->min = value;
+	if (histogram->counter == 0 || value > histogram->max)
+		histogram->max = value;
+	histogram->sum += value;
+	histogram->counter++;
+	histogram->buckets[get_bucket_index(value)]++;
+}
+
+/* estimate percentile (0..100) as the middle of the bucket holding it */
+int64_t histogram_percentile(const histogram_struct *histogram, float percentile) {
+	int64_t rank;
+	int64_t seen;
+	int64_t value;
+	int i;
+
+	if (histogram->counter == 0)
+		return 0;
+
+	rank = (int64_t)(percentile / 100 * histogram->counter);
+	if (rank >= histogram->counter)
+		rank = histogram->counter - 1;
+
+	seen = 0;
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen > rank)
+			break;
+	}
+	if (i == HISTOGRAM_BUCKETS)
+		return histogram->max;
+
+	value = (get_bucket_lower_bound(i) + get_bucket_lower_bound(i + 1)) / 2;
+	if (value < histogram->min)
+		return histogram->min;
+	if (value > histogram->max)
+		return histogram->max;
+	return value;
+}
+
+/* print summary on DEBUG and non empty buckets on VERBOSE, values in us */
+void histogram_print(const histogram_struct *histogram, const char *tag, const char *name) {
+	int i;
+
+	if (histogram->counter == 0) {
+		log_msg_and_exit_on_error(DEBUG, "Device %s has no %s values\n", tag, name);
+		return;
+	}
+
+	log_msg_and_exit_on_error(DEBUG, "Device %s has %s: samples = %lld min = %lld us "
+		"avg = %lld us p50 = %lld us p90 = %lld us p99 = %lld us max = %lld us\n",
+		tag, name, histogram->counter,
+		CONVERT_NANO_TO_MICRO(histogram->min),
+		CONVERT_NANO_TO_MICRO(histogram->sum / histogram->counter),
+		CONVERT_NANO_TO_MICRO(histogram_percentile(histogram, 50)),
+		CONVERT_NANO_TO_MICRO(histogram_percentile(histogram, 90)),
+		CONVERT_NANO_TO_MICRO(histogram_percentile(histogram, 99)),
+		CONVERT_NANO_TO_MICRO(histogram->max));
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		if (!histogram->buckets[i])
+			continue;
+		log_msg_and_exit_on_error(VERBOSE, "Device %s %s [%lld us, %lld us): %lld\n",
+			tag, name, CONVERT_NANO_TO_MICRO(get_bucket_lower_bound(i)),
+			CONVERT_NANO_TO_MICRO(get_bucket_lower_bound(i + 1)), histogram->buckets[i]);
+	}
+}
@@ -0,0 +1,290 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "iio_sample_format.h"
+#include "iio_control.h"
+#include "iio_utils.h"
+
+/*
+** Microbenchmark of the decode and scaling primitives. Each layout is a
+** sensor with channels of one type spec and a 64 bit timestamp, set up
+** as set_sample_format would do it. The full decode reads samples with
+** get_data_triggered_mode from a temporary file instead of a device, so
+** it includes the read syscall. Results are ns per call (type spec and
+** padding) or per sample (all channels of one sample).
+*/
+
+int current_fd;
+int nr_test;
+level log_level;
+
+static volatile int64_t sink;
+static const char *channel_names[] = {"x", "y", "z"};
+
+static const microbench_layout_struct layouts[] = {
+	{"le:s16/16", "le:s16/16>>0", 3},
+	{"be:s32/32", "be:s32/32>>0", 3},
+	{"le:u10/16", "le:u10/16>>0", 3},
+};
+
+/* one trigger mode sensor with the layout */
+static int setup_sensor(const microbench_layout_struct *layout) {
+	sensor_info_iio_ext_t *sensor;
+	channel_info_t *channel;
+	int c;
+
+	sensor = &g_sensor_info_iio_ext[0];
+	free(sensor->channel_info);
+	free(sensor->channel_descriptor);
+	memset(sensor, 0, sizeof(sensor_info_iio_ext_t));
+	snprintf(sensor->id, MAX_NAME_SIZE, "bench");
+	sensor->mode = MODE_TRIGGER;
+	sensor->discovered = 1;
+	sensor->num_channels = layout->num_channels;
+	/* channel specific scales, as for most 3 axis sensors */
+	sensor->scale = 0;
+	sensor->read_fd = -1;
+	sensor->channel_info = (channel_info_t*)calloc(layout->num_channels,
+		sizeof(channel_info_t));
+	sensor->channel_descriptor = (channel_descriptor_t*)calloc(layout->num_channels,
+		sizeof(channel_descriptor_t));
+	if (sensor->channel_info == NULL || sensor->channel_descriptor == NULL) {
+		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+		exit(-1);
+	}
+
+	for (c = 0; c < layout->num_channels; c++) {
+		channel = &sensor->channel_info[c];
+		snprintf(channel->type_spec, MAX_TYPE_SPEC_LEN, "%s", layout->type_spec);
+		channel->size = decode_type_spec(channel->type_spec, &channel->type_info);
+		if (channel->size == -1)
+			return -1;
+		channel->index = c;
+		channel->opt_scale = 1;
+		channel->scale = 0.001;
+		sensor->channel_descriptor[c].name = (char*)channel_names[c % 3];
+	}
+	snprintf(sensor->timestamp.type_spec, MAX_TYPE_SPEC_LEN, "%s", MICROBENCH_TIMESTAMP_SPEC);
+	sensor->timestamp.size = decode_type_spec(sensor->timestamp.type_spec,
+		&sensor->timestamp.type_info);
+	sensor->timestamp.index = layout->num_channels;
+	sensor->sample_size = set_scan_layout(0);
+	return 0;
+}
+
+/* samples with random channel values and increasing timestamps */
+static unsigned char* make_samples(int count) {
+	sensor_info_iio_ext_t *sensor;
+	unsigned char *samples;
+	int64_t timestamp;
+	int i;
+	int j;
+
+	sensor = &g_sensor_info_iio_ext[0];
+	samples = (unsigned char*)malloc((size_t)count * sensor->sample_size);
+	if (samples == NULL) {
+		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+		exit(-1);
+	}
+	srand(1);
+	for (i = 0; i < count * sensor->sample_size; i++)
+		samples[i] = rand() & 0xff;
+	for (i = 0; i < count; i++) {
+		timestamp = 1000000LL * i;
+		for (j = 0; j < 8; j++)
+			samples[i * sensor->sample_size + sensor->timestamp.offset + j] =
+				(timestamp >> (8 * j)) & 0xff;
+	}
+	return samples;
+}
+
+static int64_t bench_decode_type_spec(const microbench_layout_struct *layout, int count) {
+	datum_info_t type_info;
+	int64_t start;
+	int i;
+
+	start = get_timestamp_monotonic();
+	for (i = 0; i < count; i++)
+		sink += decode_type_spec(layout->type_spec, &type_info);
+	return get_timestamp_monotonic() - start;
+}
+
+static int64_t bench_get_padding_size(const microbench_layout_struct *layout __attribute__((unused)),
+	int count) {
+	int64_t start;
+	int storagebits;
+	int i;
+
+	storagebits = g_sensor_info_iio_ext[0].channel_info[0].type_info.storagebits;
+	start = get_timestamp_monotonic();
+	for (i = 0; i < count; i++)
+		sink += get_padding_size(i & 0x1f, storagebits);
+	return get_timestamp_monotonic() - start;
+}
+
+static int64_t bench_sample_as_int64(unsigned char *samples, int count) {
+	sensor_info_iio_ext_t *sensor;
+	unsigned char *sample;
+	int64_t start;
+	int i;
+	int c;
+
+	sensor = &g_sensor_info_iio_ext[0];
+	start = get_timestamp_monotonic();
+	for (i = 0; i < count; i++) {
+		sample = samples + (i % MICROBENCH_FILE_SAMPLES) * sensor->sample_size;
+		for (c = 0; c < sensor->num_channels; c++)
+			sink += sample_as_int64(sample + sensor->channel_info[c].offset,
+				&sensor->channel_info[c].type_info);
+		sink += sample_as_int64(sample + sensor->timestamp.offset,
+			&sensor->timestamp.type_info);
+	}
+	return get_timestamp_monotonic() - start;
+}
+
+static int64_t bench_scale_value(int count) {
+	sensor_info_iio_ext_t *sensor;
+	int64_t start;
+	float sum;
+	int i;
+	int c;
+
+	sensor = &g_sensor_info_iio_ext[0];
+	sum = 0;
+	start = get_timestamp_monotonic();
+	for (i = 0; i < count; i++)
+		for (c = 0; c < sensor->num_channels; c++)
+			sum += scale_value(0, c, i);
+	sink += (int64_t)sum;
+	return get_timestamp_monotonic() - start;
+}
+
+/* full decode of samples read from a file, rewound when all were read */
+static int64_t bench_get_data_triggered_mode(int fd, int count) {
+	int64_t start;
+	int i;
+
+	g_sensor_info_iio_ext[0].read_fd = fd;
+	start = get_timestamp_monotonic();
+	for (i = 0; i < count; i++) {
+		if (i % MICROBENCH_FILE_SAMPLES == 0)
+			lseek(fd, 0, SEEK_SET);
+		if (get_data_triggered_mode(0) == -1)
+			return -1;
+	}
+	sink += g_sensor_info_iio_ext[0].last_timestamp;
+	return get_timestamp_monotonic() - start;
+}
+
+static int compare_int64(const void *a, const void *b) {
+	int64_t x = *(const int64_t*)a;
+	int64_t y = *(const int64_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+static void report(const char *layout, const char *name, int64_t elapsed[], int runs, int count) {
+	qsort(elapsed, runs, sizeof(int64_t), compare_int64);
+	printf("%-10s %-26s %8.2f ns min %8.2f ns median\n", layout, name,
+		(double)elapsed[0] / count, (double)elapsed[runs / 2] / count);
+}
+
+int main(int argc, char *argv[]) {
+	const microbench_layout_struct *layout;
+	unsigned char *samples;
+	int64_t *elapsed;
+	FILE *file;
+	int count;
+	int runs;
+	int opt;
+	int l;
+	int r;
+
+	count = MICROBENCH_SAMPLES;
+	runs = MICROBENCH_RUNS;
+	while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+		switch (opt) {
+			case 'n':
+				count = atoi(optarg);
+				break;
+			case 'r':
+				runs = atoi(optarg);
+				break;
+			default:
+				printf(MICROBENCH_USAGE, argv[0]);
+				exit(-1);
+		}
+	}
+	if (count <= 0 || runs <= 0) {
+		printf(MICROBENCH_USAGE, argv[0]);
+		exit(-1);
+	}
+
+	current_fd = STDOUT_FILENO;
+	log_level = ERROR;
+	tests = (test_info_t*)calloc(1, sizeof(test_info_t));
+	g_sensor_info_iio_ext = (sensor_info_iio_ext_t*)calloc(1, sizeof(sensor_info_iio_ext_t));
+	elapsed = (int64_t*)calloc(runs, sizeof(int64_t));
+	if (tests == NULL || g_sensor_info_iio_ext == NULL || elapsed == NULL) {
+		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+		exit(-1);
+	}
+	g_sensor_info_size = 1;
+
+	printf("%d samples per run, %d runs\n", count, runs);
+	for (l = 0; l < (int)(sizeof(layouts) / sizeof(layouts[0])); l++) {
+		layout = &layouts[l];
+		if (setup_sensor(layout) == -1)
+			exit(-1);
+		samples = make_samples(MICROBENCH_FILE_SAMPLES);
+
+		for (r = 0; r < runs; r++)
+			elapsed[r] = bench_decode_type_spec(layout, count);
+		report(layout->name, "decode_type_spec", elapsed, runs, count);
+
+		for (r = 0; r < runs; r++)
+			elapsed[r] = bench_get_padding_size(layout, count);
+		report(layout->name, "get_padding_size", elapsed, runs, count);
+
+		for (r = 0; r < runs; r++)
+			elapsed[r] = bench_sample_as_int64(samples, count);
+		report(layout->name, "sample_as_int64/sample", elapsed, runs, count);
+
+		for (r = 0; r < runs; r++)
+			elapsed[r] = bench_scale_value(count);
+		report(layout->name, "scale_value/sample", elapsed, runs, count);
+
+		file = tmpfile();
+		if (file == NULL ||
+			fwrite(samples, g_sensor_info_iio_ext[0].sample_size, MICROBENCH_FILE_SAMPLES, file) !=
+			MICROBENCH_FILE_SAMPLES || fflush(file) != 0) {
+			log_msg_and_exit_on_error(FATAL, "Can't write samples file: %s\n", strerror(errno));
+			exit(-1);
+		}
+		for (r = 0; r < runs; r++)
+			elapsed[r] = bench_get_data_triggered_mode(fileno(file), count);
+		report(layout->name, "get_data_triggered_mode", elapsed, runs, count);
+		fclose(file);
+		free(samples);
+	}
+	free(elapsed);
+	return 0;
+}
@@ -0,0 +1,283 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "iio_noise_spectrum.h"
+#include "iio_arena.h"
+#include "iio_results.h"
+#include "iio_trace.h"
+#include "iio_utils.h"
+
+/*
+** Noise power spectral density by Welch's method, computed while
+** streaming. Each channel keeps its last NOISE_FFT_SIZE values in a ring;
+** every NOISE_FFT_HOP samples the ring is detrended, Hann windowed and
+** transformed by an in-place radix-2 FFT, and the periodogram is added
+** to the channel sums. The work is O(log NOISE_FFT_SIZE) per sample and
+** memory doesn't depend on the capture length.
+**
+** The noise density is the median of the spectrum, so that peaks don't
+** raise it; peaks (fan, vibration, mains pickup) are local maxima well
+** above the median of the bins around them.
+*/
+
+void noise_spectrum_init(noise_spectrum_struct *spectrum, int num_channels) {
+	int c;
+	int i;
+
+	memset(spectrum, 0, sizeof(noise_spectrum_struct));
+	spectrum->num_channels = num_channels;
+	spectrum->first_timestamp = -1;
+	spectrum->last_timestamp = -1;
+
+	spectrum->window = (double*)arena_alloc(&g_test_arena, NOISE_FFT_SIZE * sizeof(double));
+	spectrum->cos_table = (double*)arena_alloc(&g_test_arena,
+		NOISE_FFT_SIZE / 2 * sizeof(double));
+	spectrum->sin_table = (double*)arena_alloc(&g_test_arena,
+		NOISE_FFT_SIZE / 2 * sizeof(double));
+	spectrum->re = (double*)arena_alloc(&g_test_arena, NOISE_FFT_SIZE * sizeof(double));
+	spectrum->im = (double*)arena_alloc(&g_test_arena, NOISE_FFT_SIZE * sizeof(double));
+	for (i = 0; i < NOISE_FFT_SIZE; i++) {
+		spectrum->window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / NOISE_FFT_SIZE);
+		spectrum->window_power += spectrum->window[i] * spectrum->window[i];
+	}
+	for (i = 0; i < NOISE_FFT_SIZE / 2; i++) {
+		spectrum->cos_table[i] = cos(2 * M_PI * i / NOISE_FFT_SIZE);
+		spectrum->sin_table[i] = -sin(2 * M_PI * i / NOISE_FFT_SIZE);
+	}
+
+	spectrum->channels = (noise_channel_struct*)arena_alloc(&g_test_arena,
+		num_channels * sizeof(noise_channel_struct));
+	for (c = 0; c < num_channels; c++) {
+		spectrum->channels[c].values = (double*)arena_alloc(&g_test_arena,
+			NOISE_FFT_SIZE * sizeof(double));
+		spectrum->channels[c].power = (double*)arena_alloc(&g_test_arena,
+			(NOISE_FFT_SIZE / 2 + 1) * sizeof(double));
+		memset(spectrum->channels[c].power, 0, (NOISE_FFT_SIZE / 2 + 1) * sizeof(double));
+	}
+}
+
+/* in-place radix-2 decimation in time FFT of re + j im */
+static void fft(const noise_spectrum_struct *spectrum, double *re, double *im) {
+	double tmp;
+	double t_re;
+	double t_im;
+	int half;
+	int step;
+	int i;
+	int j;
+	int k;
+
+	/* bit reversed order */
+	for (i = 1, j = 0; i < NOISE_FFT_SIZE; i++) {
+		for (k = NOISE_FFT_SIZE >> 1; j & k; k >>= 1)
+			j ^= k;
+		j |= k;
+		if (i < j) {
+			tmp = re[i];
+			re[i] = re[j];
+			re[j] = tmp;
+			tmp = im[i];
+			im[i] = im[j];
+			im[j] = tmp;
+		}
+	}
+
+	for (half = 1; half < NOISE_FFT_SIZE; half <<= 1) {
+		step = NOISE_FFT_SIZE / (2 * half);
+		for (i = 0; i < NOISE_FFT_SIZE; i += 2 * half) {
+			for (k = 0; k < half; k++) {
+				j = i + k + half;
+				t_re = re[j] * spectrum->cos_table[k * step] - im[j] * spectrum->sin_table[k * step];
+				t_im = re[j] * spectrum->sin_table[k * step] + im[j] * spectrum->cos_table[k * step];
+				re[j] = re[i + k] - t_re;
+				im[j] = im[i + k] - t_im;
+				re[i + k] += t_re;
+				im[i + k] += t_im;
+			}
+		}
+	}
+}
+
+/* periodogram of the last NOISE_FFT_SIZE values of a channel */
+static void add_segment(noise_spectrum_struct *spectrum, noise_channel_struct *channel) {
+	double mean;
+	int first;
+	int i;
+
+	mean = 0;
+	for (i = 0; i < NOISE_FFT_SIZE; i++)
+		mean += channel->values[i];
+	mean /= NOISE_FFT_SIZE;
+
+	/* oldest value is where the next one goes */
+	first = spectrum->counter % NOISE_FFT_SIZE;
+	for (i = 0; i < NOISE_FFT_SIZE; i++) {
+		spectrum->re[i] = (channel->values[(first + i) % NOISE_FFT_SIZE] - mean) *
+			spectrum->window[i];
+		spectrum->im[i] = 0;
+	}
+	fft(spectrum, spectrum->re, spectrum->im);
+	for (i = 0; i <= NOISE_FFT_SIZE / 2; i++)
+		channel->power[i] += spectrum->re[i] * spectrum->re[i] +
+			spectrum->im[i] * spectrum->im[i];
+}
+
+/* values of all channels for one sample */
+void noise_spectrum_add(noise_spectrum_struct *spectrum, const float *values) {
+	int c;
+
+	for (c = 0; c < spectrum->num_channels; c++)
+		spectrum->channels[c].values[spectrum->counter % NOISE_FFT_SIZE] = values[c];
+	spectrum->counter++;
+
+	if (spectrum->counter < NOISE_FFT_SIZE ||
+		(spectrum->counter - NOISE_FFT_SIZE) % NOISE_FFT_HOP)
+		return;
+	for (c = 0; c < spectrum->num_channels; c++)
+		add_segment(spectrum, &spectrum->channels[c]);
+	spectrum->segments++;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+
+	return (x > y) - (x < y);
+}
+
+static double median(double *values, int count) {
+	qsort(values, count, sizeof(double), compare_double);
+	if (count % 2)
+		return values[count / 2];
+	return (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/* median of the bins around bin, without bin and its window leakage */
+static double local_floor(const double *psd, int bin) {
+	double neighbours[2 * NOISE_PEAK_NEIGHBOURS];
+	int count;
+	int k;
+
+	count = 0;
+	for (k = bin - NOISE_PEAK_NEIGHBOURS; k <= bin + NOISE_PEAK_NEIGHBOURS; k++) {
+		if (k < 1 || k > NOISE_FFT_SIZE / 2 || abs(k - bin) < 2)
+			continue;
+		neighbours[count++] = psd[k];
+	}
+	return median(neighbours, count);
+}
+
+/* print and record noise density and spectral peaks of every channel;
+** fails when there is a peak or the capture is too short
+*/
+int noise_spectrum_report(int sensor_index, const noise_spectrum_struct *spectrum) {
+	const char *tag;
+	const char *name;
+	const char *unit;
+	char metric_name[MAX_NAME_SIZE];
+	double psd[NOISE_FFT_SIZE / 2 + 1];
+	double sorted[NOISE_FFT_SIZE / 2 + 1];
+	double sample_rate;
+	double scale;
+	double density;
+	double floor_power;
+	double peak_db;
+	double max_peak_db;
+	double max_peak_freq;
+	int error;
+	int c;
+	int k;
+
+	if (spectrum->counter < 2 || spectrum->last_timestamp <= spectrum->first_timestamp) {
+		log_msg_and_exit_on_error(ERROR, "No data received from %s\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(FAILED);
+		return -1;
+	}
+	if (spectrum->segments < NOISE_MIN_SEGMENTS) {
+		log_msg_and_exit_on_error(ERROR, "Capture of %s is too short for noise spectrum!\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(FAILED);
+		return -1;
+	}
+	sample_rate = (double)CONVERT_SEC_TO_NANO(1) * (spectrum->counter - 1) /
+		(spectrum->last_timestamp - spectrum->first_timestamp);
+
+	tag = g_sensor_info_iio_ext[sensor_index].tag;
+	if (strcmp(tag, "accel") == 0)
+		unit = "m/s^2/sqrt(Hz)";
+	else if (strcmp(tag, "anglvel") == 0)
+		unit = "rad/s/sqrt(Hz)";
+	else
+		unit = NULL;
+
+	/* one-sided density */
+	scale = 2 / (spectrum->segments * sample_rate * spectrum->window_power);
+	error = 0;
+	for (c = 0; c < spectrum->num_channels; c++) {
+		name = g_sensor_info_iio_ext[sensor_index].channel_descriptor[c].name;
+		for (k = 0; k <= NOISE_FFT_SIZE / 2; k++)
+			psd[k] = spectrum->channels[c].power[k] * scale;
+		psd[0] /= 2;
+		psd[NOISE_FFT_SIZE / 2] /= 2;
+
+		/* bin 1 gets the leakage of the removed mean */
+		memcpy(sorted, psd + 2, (NOISE_FFT_SIZE / 2 - 1) * sizeof(double));
+		density = sqrt(median(sorted, NOISE_FFT_SIZE / 2 - 1));
+		log_msg_and_exit_on_error(DEBUG, "Device %s channel %s has noise density %g "
+			"from %lld segments at %.1f Hz\n", g_sensor_info_iio_ext[sensor_index].id,
+			name, density, spectrum->segments, sample_rate);
+		snprintf(metric_name, MAX_NAME_SIZE, "noise_density_%s", name);
+		record_metric(sensor_index, metric_name, density, NAN, unit);
+
+		max_peak_db = 0;
+		max_peak_freq = 0;
+		for (k = 2; k < NOISE_FFT_SIZE / 2; k++) {
+			if (psd[k] < psd[k - 1] || psd[k] < psd[k + 1])
+				continue;
+			floor_power = local_floor(psd, k);
+			if (floor_power <= 0)
+				continue;
+			peak_db = 10 * log10(psd[k] / floor_power);
+			if (peak_db < NOISE_PEAK_DB)
+				continue;
+			trace_violation(sensor_index, "spectral_peak", peak_db, NOISE_PEAK_DB);
+			log_msg_and_exit_on_error(ERROR, "Device %s channel %s has spectral peak "
+				"at %.1f Hz, %.1f dB above noise floor\n", g_sensor_info_iio_ext[sensor_index].id,
+				name, k * sample_rate / NOISE_FFT_SIZE, peak_db);
+			if (peak_db > max_peak_db) {
+				max_peak_db = peak_db;
+				max_peak_freq = k * sample_rate / NOISE_FFT_SIZE;
+			}
+		}
+		if (max_peak_db > 0) {
+			snprintf(metric_name, MAX_NAME_SIZE, "spectral_peak_%s", name);
+			record_metric(sensor_index, metric_name, max_peak_db, NOISE_PEAK_DB, "dB");
+			snprintf(metric_name, MAX_NAME_SIZE, "spectral_peak_freq_%s", name);
+			record_metric(sensor_index, metric_name, max_peak_freq, NAN, "Hz");
+			error = 1;
+		}
+	}
+	if (error) {
+		set_test_state(FAILED);
+		return -1;
+	}
+	return 0;
+}
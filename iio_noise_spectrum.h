@@ -0,0 +1,23 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_NOISE_SPECTRUM_H__
+#define __IIO_NOISE_SPECTRUM_H__
+
+void noise_spectrum_init(noise_spectrum_struct *spectrum, int num_channels);
+void noise_spectrum_add(noise_spectrum_struct *spectrum, const float *values);
+int noise_spectrum_report(int sensor_index, const noise_spectrum_struct *spectrum);
+#endif
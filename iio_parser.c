@@ -28,53 +28,85 @@
 #include <unistd.h>
 #include <time.h>
 #include <dirent.h>
-#include "cutils/hashmap.h"
 #include "iio_utils.h"
 #include "iio_control.h"
 #include "iio_parser.h"
+#include "iio_arena.h"
+#include "iio_results.h"
 #include "iio_tests.h"
 #include "iio_control_frequency.h"
 #include "iio_set_trigger.h"
+#include "iio_selfbench.h"
+#include "iio_trigger_accuracy.h"
+#include "iio_fanout.h"
+#include "iio_soak.h"
 
 test_info_t *tests;
-Hashmap *map_sensor_index_to_time_attributes;
-int current_fd;
+selected_sensor_struct *selected_sensors;
+int selected_sensors_count;
 static int duration;
 static int counter;
+float g_confidence;
+
+/* call callback(sensor_index, time_attributes, context) for every sensor
+** selected by the current command, in command order; same callback
+** signature as hashmapForEach
+*/
+void for_each_selected_sensor(bool (*callback) (void*, void*, void*), void* context) {
+	int i;
+
+	for (i = 0; i < selected_sensors_count; i++)
+		if (!callback((void*)(intptr_t)selected_sensors[i].sensor_index,
+			(void*)&selected_sensors[i].time_attributes, context))
+			break;
+}
+
+/* every sensor matched by a tag gets its own copy of the attributes,
+** tests update them per sensor
+*/
+static void put_time_attributes(int sensor_indexes[], int count,
+	time_attributes_struct* time_attributes) {
+	int i;
+	int s;
+
+	for (i = 0; i < count; i++) {
+		for (s = 0; s < selected_sensors_count; s++)
+			if (selected_sensors[s].sensor_index == sensor_indexes[i])
+				break;
+		if (s == selected_sensors_count) {
+			selected_sensors[s].sensor_index = sensor_indexes[i];
+			selected_sensors_count++;
+		}
+		selected_sensors[s].time_attributes = *time_attributes;
+	}
+}
+
 /* get frequency or delay for each sensor and duration or counter
-** for each command
+** for each command; a tag without instance (accel) selects every
+** instance (accel#0, accel#1, ...)
 */
 int get_sensors_time_attributes(char* cmd) {
 	char *field;
 	int nr_bytes;
-	int sensor_index;
+	int sensor_count;
+	int sensor_indexes[g_sensor_info_size + 1];
+	time_attributes_struct attributes;
 	time_attributes_struct* time_attributes;
 	parsing_state state;
 
-	field = (char*)malloc(BUFFER_SIZE);
-	if (field == NULL) {
-		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-		set_test_state(FAILED);
-		exit(-1); 
-	}
-	map_sensor_index_to_time_attributes = hashmapCreate(HASHMAP_SIZE, hash, intEquals);
-	if (map_sensor_index_to_time_attributes == NULL) {
-		log_msg_and_exit_on_error(ERROR, "Error creating Hashmap!\n");
-		set_test_state(FAILED);
-		return -1;
-	}
+	/* released with the test arena */
+	field = (char*)arena_alloc(&g_test_arena, BUFFER_SIZE);
+	selected_sensors = (selected_sensor_struct*)arena_alloc(&g_test_arena,
+		(g_sensor_info_size + 1) * sizeof(selected_sensor_struct));
+	selected_sensors_count = 0;
 	
-	time_attributes = (time_attributes_struct*)malloc(sizeof(time_attributes_struct));
-	if (time_attributes == NULL) {
-		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-		set_test_state(FAILED);
-		exit(-1);
-	}
+	time_attributes = &attributes;
 	time_attributes->freq = 0;
 	time_attributes->max_delay = 0; 
-	sensor_index = -1;
+	sensor_count = 0;
 	duration = 0;
 	counter = 0;
+	g_confidence = 0;
 	state = INIT_STATE;
 
 	while ( sscanf(cmd, "%s%n", field, &nr_bytes) == 1 ) {
@@ -86,12 +118,6 @@ int get_sensors_time_attributes(char* cmd) {
 			}
 			else if (state == FREQ_STATE) {
 				state = DELAY_STATE;
-				time_attributes = (time_attributes_struct*)malloc(sizeof(time_attributes_struct));
-				if (time_attributes == NULL) {
-					log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-					set_test_state(FAILED);
-					exit(-1);
-				}
 				time_attributes->freq = atof(field);
 				time_attributes->max_delay = 0;
 			}
@@ -109,14 +135,23 @@ int get_sensors_time_attributes(char* cmd) {
 				counter = atoi(field);
 				state = FINISH_STATE;
 			} 
+			/* 95 or 0.95 */
+			else if (state == CONFIDENCE_STATE) {
+				g_confidence = atof(field);
+				if (g_confidence > 1)
+					g_confidence /= 100;
+				if (g_confidence <= 0 || g_confidence >= 1) {
+					log_msg_and_exit_on_error(ERROR, "Wrong confidence for test!\n");
+					set_test_state(FAILED);
+					return -1;
+				}
+				state = FINISH_STATE;
+			}
 			
 		}
 		/* each tag(duration, counter, freq, delay) set a parsing state */
 		else{
-			if (sensor_index != -1) {
-				hashmapPut(map_sensor_index_to_time_attributes, (void*)sensor_index,
-					(void*)time_attributes);
-			}
+			put_time_attributes(sensor_indexes, sensor_count, time_attributes);
 			if (strncmp(field, "duration", nr_bytes) == 0) {
 				cmd += nr_bytes; 
 				if ( *cmd != ' ' ) {
@@ -139,6 +174,17 @@ int get_sensors_time_attributes(char* cmd) {
 				state = COUNTER_STATE;
 				continue;
 			}
+			if (strncmp(field, "confidence", nr_bytes) == 0) {
+				cmd += nr_bytes; 
+				if ( *cmd != ' ' ) {
+					log_msg_and_exit_on_error(ERROR, "Wrong format for test!\n");
+					set_test_state(FAILED);
+					return -1;
+				}
+				++cmd;
+				state = CONFIDENCE_STATE;
+				continue;
+			}
 			if (strncmp(field, "freq", nr_bytes) == 0) {
 				cmd += nr_bytes; 
 				if ( *cmd != ' ' ) {
@@ -161,8 +207,8 @@ int get_sensors_time_attributes(char* cmd) {
 				state = DELAY_STATE;
 				continue;
 			}            
-			sensor_index = get_index_from_tag(field);
-			if (sensor_index == -1) {
+			sensor_count = get_indexes_from_tag(field, sensor_indexes);
+			if (sensor_count == 0) {
 				log_msg_and_exit_on_error(ERROR, "Device %s doesn't exist!\n", field);
 				set_test_state(SKIPPED); 
 			}
@@ -174,10 +220,7 @@ int get_sensors_time_attributes(char* cmd) {
 		++cmd; 
 		
 	}
-	free(field);
-	if (sensor_index != -1) {
-		hashmapPut(map_sensor_index_to_time_attributes, (void*)sensor_index, (void*)time_attributes);
-	}
+	put_time_attributes(sensor_indexes, sensor_count, time_attributes);
 	return 0;
 }
 /* parse each command and call proper function */
@@ -187,16 +230,14 @@ int parse_cmd(char* cmd) {
 	int sensor_index;
 	int nr_bytes;
 	int value;
+	int sensors;
+	float freq;
 	time_attributes_struct* time_attributes;
 	parsing_state state;
 	
-	action = (char*)malloc(BUFFER_SIZE);
-	if (action == NULL) {
-		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-		set_test_state(FAILED);
-		exit(-1);
-	}
-	
+	/* released with the test arena */
+	action = (char*)arena_alloc(&g_test_arena, BUFFER_SIZE);
+	record_command(cmd);
 	
 	sscanf(cmd, "%s%n", action, &nr_bytes);
 	/* for action without parameters */
@@ -207,28 +248,31 @@ int parse_cmd(char* cmd) {
 		else{
 			list_sensors();
 		}
-		free(action);
 		return 0;
 	}
 	else if (strncmp(action, "clean", 5) == 0) {
-		free(action);
 		return clean_up_sensors();
 	}
+	else if (strncmp(action, "selfbench", 9) == 0) {
+		sensors = SELFBENCH_SENSORS;
+		freq = SELFBENCH_FREQ;
+		sscanf(cmd + nr_bytes, "%d %f", &sensors, &freq);
+		return selfbench(sensors, freq);
+	}
 	else if (strncmp(action, "activate_all_sensors", 12) == 0) {
 		log_msg_and_exit_on_error(DEBUG, "activate all");
-		free(action);
 		return activate_all_sensors(1);        
 	} 
 
 	else if (strncmp(action, "deactivate_all_sensors", 14) == 0) {
 		log_msg_and_exit_on_error(DEBUG, "deactivate all");
-		free(action);
 		return activate_all_sensors(0);      
 	} 
 
 	cmd += (nr_bytes + 1);
 	if (get_sensors_time_attributes(cmd) < 0)
 		return -1;
+	record_selected_sensors();
 
 
 	if (strncmp(action, "check", 5) == 0) {
@@ -252,33 +296,60 @@ int parse_cmd(char* cmd) {
 			}
 
 		}
+		else if (strncmp(action + 6, "rate_switch", 11) == 0) {
+			poll_sensors(rate_switch_initialize, check_rate_switch_wrapper, duration);
+		}
+		else if (strncmp(action + 6, "sync", 4) == 0) {
+			poll_sensors(sync_initialize, check_sync_wrapper, duration);
+		}
+		else if (strncmp(action + 6, "events", 6) == 0) {
+			poll_sensors(events_initialize, check_events_wrapper,
+				duration ? duration : EVENTS_DURATION_SECS);
+		}
+		else if (strncmp(action + 6, "trigger", 7) == 0) {
+			check_trigger(duration ? duration : TRIGGER_DURATION_SECS);
+		}
+		else if (strncmp(action + 6, "fanout", 6) == 0) {
+			check_fanout(duration ? duration : FANOUT_DURATION_SECS);
+		}
 		else if (strncmp(action + 6, "freq", 4) == 0) {
 			poll_sensors(generic_initialize, measure_freq_wrapper, duration);
 		}
 		else if (strncmp(action + 6, "channels", 8) == 0) {
-			hashmapForEach(map_sensor_index_to_time_attributes, check_channels_wrapper, NULL);
+			for_each_selected_sensor(check_channels_wrapper, NULL);
 		}    
 	}
 	else if (strncmp(action, "jitter", 6) == 0) {
 		poll_sensors(jitter_initialize, test_jitter_wrapper, TIME_TO_MEASURE_SECS);
 	}
+	else if (strncmp(action, "soak", 4) == 0) {
+		soak(cmd, duration ? duration : SOAK_DURATION_SECS);
+	}
+	else if (strncmp(action, "allan", 5) == 0) {
+		poll_sensors(allan_variance_initialize, allan_variance_wrapper,
+			duration ? duration : ALLAN_DURATION_SECS);
+	}
+	else if (strncmp(action, "noise", 5) == 0) {
+		poll_sensors(noise_spectrum_initialize, noise_spectrum_wrapper,
+			duration ? duration : NOISE_DURATION_SECS);
+	}
 	else if (strncmp(action, "standard", 8) == 0) {
 		poll_sensors(standard_deviation_initialize, standard_deviation_wrapper, TIME_TO_MEASURE_SECS);
 	}
 
 	/* set tests */
 	else if (strncmp(action, "set", 3) == 0) {
-		hashmapForEach(map_sensor_index_to_time_attributes, set_freq_wrapper, (void*)duration);   
+		for_each_selected_sensor(set_freq_wrapper, (void*)(intptr_t)duration);   
 	}
 
 	/* activate tests */
 	else if (strncmp(action, "activ", 5) == 0) {
 		if (strlen(action) == 8) {
 			value = 1;
-			hashmapForEach(map_sensor_index_to_time_attributes, activate_sensor_wrapper, (void*)value);    
+			for_each_selected_sensor(activate_sensor_wrapper, (void*)(intptr_t)value);    
 		}
 		else if (strlen(action) == 19) {
-			hashmapForEach(map_sensor_index_to_time_attributes, activate_deactivate_sensor_wrapper, (void*)counter);
+			for_each_selected_sensor(activate_deactivate_sensor_wrapper, (void*)(intptr_t)counter);
 		} 
 		else{
 			activate_deactivate_all_sensors(counter);
@@ -286,7 +357,7 @@ int parse_cmd(char* cmd) {
 	}
 	else if (strncmp(action, "deactiv", 7) == 0) {
 		value = 0;
-		hashmapForEach(map_sensor_index_to_time_attributes, activate_sensor_wrapper, (void*)value);
+		for_each_selected_sensor(activate_sensor_wrapper, (void*)(intptr_t)value);
 	}
 	else{
 		/* this action is not defined */ 
@@ -294,9 +365,6 @@ int parse_cmd(char* cmd) {
 		set_test_state(FAILED);
 	}
 
-	hashmapFree(map_sensor_index_to_time_attributes);
-	free(action);
-
 	return 0; 
 }
 /* parse each test separately */
@@ -311,6 +379,7 @@ int parse_test(char* test, char path[PATH_MAX], int type) {
 
 	/* take time data and create file for logs info */
 	if (type == DESCRIPTION) {
+		begin_test_record();
 		time (&rawtime);
 		timeinfo = localtime (&rawtime);
 		sprintf(start_time, "%d-%d %d:%d:%d.0", timeinfo->tm_mon + 1, 
@@ -345,6 +414,9 @@ int parse_test(char* test, char path[PATH_MAX], int type) {
 		parse_cmd(line);
 		line = strtok(NULL, "\n");
 	}
+	end_test_record(nr_test, tests[nr_test].description);
+	/* everything the commands of this test allocated */
+	arena_reset(&g_test_arena);
 	system(cmd);
 	if (close(tests[nr_test].log_fd) == -1) {
 		log_msg_and_exit_on_error(ERROR, "Cannot close %s (%s)\n", sysfs_path, strerror(errno));
@@ -514,6 +586,8 @@ int read_tests(char suit_path[PATH_MAX], char path[PATH_MAX])
 	free(buf);
 	free(new_buf);
  
+	if (g_write_junit)
+		write_junit_results(path, nr_test);
 	if (print_tests_results(path) < 0) {
 		log_msg_and_exit_on_error(ERROR, "Can't write in  results in tests results file!\n");
 	}
@@ -20,4 +20,5 @@
 
 int read_tests(char suit_path[PATH_MAX], char path[PATH_MAX]);
 int parse_cmd(char* cmd);
+void for_each_selected_sensor(bool (*callback) (void*, void*, void*), void* context);
 #endif
@@ -0,0 +1,159 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "iio_perf.h"
+#include "iio_results.h"
+#include "iio_utils.h"
+
+/*
+** With -P, perf_event_open counters of the acquisition thread run
+** during every poll_sensors window. Totals and per sample values are
+** reported with the test, to check that the harness costs a negligible
+** share of the CPU and to see when a change makes it worse. Counters the
+** target doesn't have (ex: no PMU in a VM) are left out.
+*/
+
+int g_perf_counters;
+
+/* names go in metrics as perf_<name>_per_sample, within MAX_NAME_SIZE */
+static perf_counter_struct perf_counters[] = {
+	{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1},
+	{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+	{"ctx_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, -1},
+	{"migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, -1},
+	{"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, -1},
+};
+
+static const int perf_counters_nr = sizeof(perf_counters) / sizeof(perf_counters[0]);
+
+static int perf_event_open(struct perf_event_attr *attr) {
+	/* calling thread, any cpu, no group */
+	return syscall(__NR_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+/* count user and kernel time of the thread, only user time
+** if perf_event_paranoid doesn't allow more
+*/
+static int open_counter(perf_counter_struct *counter) {
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = counter->type;
+	attr.config = counter->config;
+	attr.disabled = 1;
+	attr.exclude_hv = 1;
+	counter->fd = perf_event_open(&attr);
+	if (counter->fd == -1 && (errno == EACCES || errno == EPERM)) {
+		attr.exclude_kernel = 1;
+		counter->fd = perf_event_open(&attr);
+	}
+	return counter->fd;
+}
+
+int open_perf_counters(void) {
+	int opened;
+	int i;
+
+	opened = 0;
+	for (i = 0; i < perf_counters_nr; i++) {
+		if (open_counter(&perf_counters[i]) == -1) {
+			log_msg_and_exit_on_error(DEBUG, "Perf counter %s is not available: %s\n",
+				perf_counters[i].name, strerror(errno));
+			continue;
+		}
+		opened++;
+	}
+	if (!opened) {
+		log_msg_and_exit_on_error(ERROR, "No perf counter is available\n");
+		return -1;
+	}
+	g_perf_counters = 1;
+	return 0;
+}
+
+void close_perf_counters(void) {
+	int i;
+
+	for (i = 0; i < perf_counters_nr; i++) {
+		if (perf_counters[i].fd != -1)
+			close(perf_counters[i].fd);
+		perf_counters[i].fd = -1;
+	}
+	g_perf_counters = 0;
+}
+
+void start_perf_counters(void) {
+	int i;
+
+	if (!g_perf_counters)
+		return;
+	for (i = 0; i < perf_counters_nr; i++) {
+		if (perf_counters[i].fd == -1)
+			continue;
+		ioctl(perf_counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf_counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+/* stop counting and report the window, samples is the number of
+** samples handled in it
+*/
+void stop_perf_counters(int samples) {
+	char name[MAX_NAME_SIZE];
+	uint64_t count;
+	int i;
+
+	if (!g_perf_counters)
+		return;
+	for (i = 0; i < perf_counters_nr; i++)
+		if (perf_counters[i].fd != -1)
+			ioctl(perf_counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+
+	for (i = 0; i < perf_counters_nr; i++) {
+		if (perf_counters[i].fd == -1)
+			continue;
+		if (read(perf_counters[i].fd, &count, sizeof(count)) != sizeof(count)) {
+			log_msg_and_exit_on_error(DEBUG, "Can't read perf counter %s: %s\n",
+				perf_counters[i].name, strerror(errno));
+			continue;
+		}
+		log_msg_and_exit_on_error(DEBUG, "Acquisition thread had %llu %s for %d samples "
+			"(%.1f per sample)\n", (unsigned long long)count, perf_counters[i].name, samples,
+			samples ? (double)count / samples : 0.0);
+
+		/* the longest name decides for both metrics */
+		if (snprintf(name, MAX_NAME_SIZE, "perf_%s_per_sample",
+			perf_counters[i].name) >= MAX_NAME_SIZE) {
+			log_msg_and_exit_on_error(ERROR, "Perf counter name %s is too long\n",
+				perf_counters[i].name);
+			continue;
+		}
+		if (samples)
+			record_metric(-1, name, (double)count / samples, NAN, NULL);
+		snprintf(name, MAX_NAME_SIZE, "perf_%s", perf_counters[i].name);
+		record_metric(-1, name, (double)count, NAN, NULL);
+	}
+}
@@ -18,7 +18,7 @@
 #include <stdio.h> 
 #include <fcntl.h>
 #include <errno.h>
-#include "cutils/hashmap.h"
+#include <string.h>
 #include "iio_pld_information.h"
 #include "iio_common.h"
 #include "iio_utils.h"
@@ -128,7 +128,7 @@ int read_pld_from_sysfs (int sensor_index, int* panel, int* rotation)
 	*rotation = r;
 
 	log_msg_and_exit_on_error(VERBOSE, "Sensor %s PLD from sysfs: panel = %d, rotation = %d\n", 
-		g_sensor_info_iio_ext[sensor_index].tag, p, r);
+		g_sensor_info_iio_ext[sensor_index].id, p, r);
 	return 0;
 }
 
@@ -14,6 +14,7 @@
 // limitations under the License.
 */
 
+#include "iio_common.h"
 #ifndef __IIO_PLD_INFORMATION_H__
 #define __IIO_PLD_INFORMATION_H__
 
@@ -0,0 +1,101 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "iio_profile.h"
+#include "iio_histogram.h"
+#include "iio_results.h"
+#include "iio_utils.h"
+
+/*
+** Self-profiling of the acquisition path. The sample path is driven by
+** one epoll loop, so the stages of the sample being handled are kept in
+** a single global: poll_sensors marks the epoll return, sysfs_read_from_fd
+** the end of the read and get_data_triggered_mode the end of the decode.
+** When the wrapper returns, the stage durations go to the histograms of
+** the sensor, which are reported with the test. This tells device and
+** kernel latency (wakeup) apart from time spent in the harness.
+** Sensors ready in the same epoll_wait share its return time, so the
+** read stage of the later ones includes waiting for the earlier ones.
+*/
+
+stage_timestamps_struct g_stage_timestamps = {-1, -1, -1, -1, -1};
+
+void profile_epoll_return(void) {
+	g_stage_timestamps.epoll_return = get_timestamp_monotonic();
+	g_stage_timestamps.epoll_return_realtime = get_timestamp_realtime();
+	g_stage_timestamps.read_done = -1;
+	g_stage_timestamps.decode_done = -1;
+	g_stage_timestamps.sample_timestamp = -1;
+}
+
+/* reads outside of the sample path are overwritten at the next epoll return */
+void profile_read_done(void) {
+	g_stage_timestamps.read_done = get_timestamp_monotonic();
+}
+
+void profile_decode_done(int64_t sample_timestamp) {
+	g_stage_timestamps.decode_done = get_timestamp_monotonic();
+	g_stage_timestamps.sample_timestamp = sample_timestamp;
+}
+
+/* add stages of the sample just handled; stages a wrapper didn't go
+** through (ex: no decode for polling mode) are skipped
+*/
+void profile_wrapper_done(stage_profile_struct *profile) {
+	stage_timestamps_struct *stages;
+	int64_t now;
+	int64_t last;
+
+	stages = &g_stage_timestamps;
+	now = get_timestamp_monotonic();
+	last = stages->epoll_return;
+
+	if (stages->sample_timestamp > 0 &&
+		stages->epoll_return_realtime >= stages->sample_timestamp)
+		histogram_add(&profile->wakeup,
+			stages->epoll_return_realtime - stages->sample_timestamp);
+	if (stages->read_done >= last) {
+		histogram_add(&profile->read, stages->read_done - last);
+		last = stages->read_done;
+	}
+	if (stages->decode_done >= last) {
+		histogram_add(&profile->decode, stages->decode_done - last);
+		last = stages->decode_done;
+	}
+	histogram_add(&profile->wrapper, now - last);
+
+	/* next sensor ready in the same epoll_wait */
+	stages->read_done = -1;
+	stages->decode_done = -1;
+	stages->sample_timestamp = -1;
+}
+
+void report_stage_profile(int sensor_index, stage_profile_struct *profile) {
+	const char *tag;
+
+	tag = g_sensor_info_iio_ext[sensor_index].id;
+	histogram_print(&profile->wakeup, tag, "wakeup latency");
+	histogram_print(&profile->read, tag, "read stage");
+	histogram_print(&profile->decode, tag, "decode stage");
+	histogram_print(&profile->wrapper, tag, "wrapper stage");
+	record_histogram(sensor_index, "stage_wakeup", &profile->wakeup);
+	record_histogram(sensor_index, "stage_read", &profile->read);
+	record_histogram(sensor_index, "stage_decode", &profile->decode);
+	record_histogram(sensor_index, "stage_wrapper", &profile->wrapper);
+}
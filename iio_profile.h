@@ -0,0 +1,25 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_PROFILE_H__
+#define __IIO_PROFILE_H__
+
+void profile_epoll_return(void);
+void profile_read_done(void);
+void profile_decode_done(int64_t sample_timestamp);
+void profile_wrapper_done(stage_profile_struct *profile);
+void report_stage_profile(int sensor_index, stage_profile_struct *profile);
+#endif
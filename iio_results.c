@@ -0,0 +1,345 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include "iio_results.h"
+#include "iio_arena.h"
+#include "iio_histogram.h"
+#include "iio_trace.h"
+#include "iio_utils.h"
+
+/*
+** Structured results: every test appends one JSON line to
+** tests_results.jsonl as soon as it finishes, with its commands, the
+** configuration of the sensors it used and the metrics computed by the
+** tests. Each record is a single write on an O_APPEND fd, so the file
+** holds every finished test even if the suite dies later. With -j a
+** JUnit XML summary is also written at the end of the suite.
+*/
+
+int g_write_junit;
+static int results_fd = -1;
+static char results_dir[PATH_MAX];
+static test_record_struct record;
+
+/* record text being built, in the test arena */
+static char *record_buf;
+static size_t record_len;
+static size_t record_size;
+
+const char* test_state_name(test_state state) {
+	if (state == PASSED)
+		return "passed";
+	if (state == FAILED)
+		return "failed";
+	return "skipped";
+}
+
+int open_results_file(const char *results_path) {
+	char path[PATH_MAX];
+
+	snprintf(results_dir, PATH_MAX, "%s", results_path);
+	snprintf(path, PATH_MAX, "%s%s", results_path, TESTS_RESULTS_JSONL);
+	results_fd = open(path, O_CREAT|O_WRONLY|O_TRUNC|O_APPEND, S_IWOTH);
+	if (results_fd == -1) {
+		log_msg_and_exit_on_error(ERROR, "Cannot open %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* results_path given with -p, NULL without */
+const char* get_results_dir(void) {
+	return results_dir[0] ? results_dir : NULL;
+}
+
+void close_results_file(void) {
+	if (results_fd != -1)
+		close(results_fd);
+	results_fd = -1;
+}
+
+void begin_test_record(void) {
+	memset(&record, 0, sizeof(test_record_struct));
+	record.start_realtime = get_timestamp_realtime();
+	record.start_monotonic = get_timestamp_monotonic();
+	trace_test_begin(nr_test);
+}
+
+/* arrays of the record double in the arena when full */
+static void* grow_array(void *array, int *size, int count, size_t elem_size) {
+	int new_size;
+
+	if (count < *size)
+		return array;
+	new_size = *size ? *size * 2 : 8;
+	array = arena_grow(&g_test_arena, array, *size * elem_size, new_size * elem_size);
+	*size = new_size;
+	return array;
+}
+
+void record_command(const char *cmd) {
+	record.commands = (char**)grow_array(record.commands, &record.commands_size,
+		record.commands_count, sizeof(char*));
+	record.commands[record.commands_count++] = arena_strdup(&g_test_arena, cmd);
+}
+
+/* keep sensors selected by the current command with the attributes
+** it asked for; a sensor used by several commands keeps the last ones
+*/
+void record_selected_sensors(void) {
+	int i;
+	int s;
+
+	for (i = 0; i < selected_sensors_count; i++) {
+		for (s = 0; s < record.sensors_count; s++)
+			if (record.sensors[s].sensor_index == selected_sensors[i].sensor_index)
+				break;
+		if (s == record.sensors_count) {
+			record.sensors = (selected_sensor_struct*)grow_array(record.sensors,
+				&record.sensors_size, record.sensors_count, sizeof(selected_sensor_struct));
+			record.sensors_count++;
+		}
+		record.sensors[s] = selected_sensors[i];
+	}
+}
+
+void record_metric(int sensor_index, const char *name, double value, double threshold,
+	const char *unit) {
+	result_metric_struct *metric;
+
+	record.metrics = (result_metric_struct*)grow_array(record.metrics, &record.metrics_size,
+		record.metrics_count, sizeof(result_metric_struct));
+	metric = &record.metrics[record.metrics_count++];
+	metric->sensor_index = sensor_index;
+	metric->name = arena_strdup(&g_test_arena, name);
+	metric->value = value;
+	metric->threshold = threshold;
+	metric->unit = unit;
+}
+
+/* summary of a latency histogram, values in us */
+void record_histogram(int sensor_index, const char *name, const histogram_struct *histogram) {
+	char metric_name[MAX_NAME_SIZE];
+
+	if (histogram->counter == 0)
+		return;
+	snprintf(metric_name, MAX_NAME_SIZE, "%s_p50", name);
+	record_metric(sensor_index, metric_name,
+		CONVERT_NANO_TO_MICRO(histogram_percentile(histogram, 50)), NAN, "us");
+	snprintf(metric_name, MAX_NAME_SIZE, "%s_p99", name);
+	record_metric(sensor_index, metric_name,
+		CONVERT_NANO_TO_MICRO(histogram_percentile(histogram, 99)), NAN, "us");
+	snprintf(metric_name, MAX_NAME_SIZE, "%s_max", name);
+	record_metric(sensor_index, metric_name, CONVERT_NANO_TO_MICRO(histogram->max), NAN, "us");
+}
+
+static void append(const char *format, ...) {
+	va_list arg;
+	int len;
+
+	for (;;) {
+		va_start(arg, format);
+		len = vsnprintf(record_buf + record_len, record_size - record_len, format, arg);
+		va_end(arg);
+		if (len >= 0 && record_len + len < record_size)
+			break;
+		record_buf = (char*)arena_grow(&g_test_arena, record_buf, record_size,
+			record_size * 2);
+		record_size *= 2;
+	}
+	record_len += len;
+}
+
+/* append str as a JSON string */
+static void append_json_string(const char *str) {
+	append("\"");
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			append("\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			append("\\u%04x", *str);
+		else
+			append("%c", *str);
+	}
+	append("\"");
+}
+
+/* JSON has no NaN, a missing threshold is null */
+static void append_json_number(double value) {
+	if (isnan(value) || isinf(value))
+		append("null");
+	else
+		append("%.6g", value);
+}
+
+static void append_sensor(selected_sensor_struct *selected) {
+	sensor_info_iio_ext_t *sensor;
+
+	sensor = &g_sensor_info_iio_ext[selected->sensor_index];
+	append("{\"id\":");
+	append_json_string(sensor->id);
+	append(",\"name\":");
+	append_json_string(sensor->internal_name);
+	append(",\"device\":%d,\"mode\":\"%s\",\"trigger\":", sensor->dev_num,
+		sensor->is_virtual ? "virtual" : sensor->mode == MODE_TRIGGER ? "trigger" : "poll");
+	append_json_string(sensor->init_trigger_name);
+	append(",\"channels\":%d,\"sample_size\":%d,\"data_rate\":", sensor->num_channels,
+		sensor->sample_size);
+	append_json_number(sensor->data_rate);
+	append(",\"requested_freq\":");
+	append_json_number(selected->time_attributes.freq);
+	append(",\"max_delay_ms\":%d}", selected->time_attributes.max_delay);
+}
+
+static void append_metric(result_metric_struct *metric) {
+	/* metrics of the whole test, ex: perf counters, have no sensor */
+	append("{\"sensor\":");
+	append_json_string(metric->sensor_index < 0 ? "-" :
+		g_sensor_info_iio_ext[metric->sensor_index].id);
+	append(",\"name\":");
+	append_json_string(metric->name);
+	append(",\"value\":");
+	append_json_number(metric->value);
+	append(",\"threshold\":");
+	append_json_number(metric->threshold);
+	if (metric->unit != NULL) {
+		append(",\"unit\":");
+		append_json_string(metric->unit);
+	}
+	append("}");
+}
+
+/* write the record of the test which just finished and keep its
+** duration for the JUnit summary; must run before the arena is reset
+*/
+int end_test_record(int test, const char *description) {
+	int i;
+
+	tests[test].duration_ms = (get_timestamp_monotonic() - record.start_monotonic) /
+		CONVERT_MILLI_TO_NANO(1);
+	trace_test_end(test, tests[test].state, results_dir[0] ? results_dir : NULL);
+	if (results_fd == -1)
+		return 0;
+
+	record_size = BUFFER_SIZE;
+	record_len = 0;
+	record_buf = (char*)arena_alloc(&g_test_arena, record_size);
+
+	append("{\"test\":%d,\"description\":", test);
+	append_json_string(description != NULL ? description : "");
+	append(",\"state\":\"%s\",\"start_time_ns\":%lld,\"duration_ms\":%lld,\"commands\":[",
+		test_state_name(tests[test].state), (long long)record.start_realtime,
+		(long long)tests[test].duration_ms);
+	for (i = 0; i < record.commands_count; i++) {
+		if (i)
+			append(",");
+		append_json_string(record.commands[i]);
+	}
+	append("],\"sensors\":[");
+	for (i = 0; i < record.sensors_count; i++) {
+		if (i)
+			append(",");
+		append_sensor(&record.sensors[i]);
+	}
+	append("],\"metrics\":[");
+	for (i = 0; i < record.metrics_count; i++) {
+		if (i)
+			append(",");
+		append_metric(&record.metrics[i]);
+	}
+	append("]}\n");
+
+	if (write(results_fd, record_buf, record_len) != (ssize_t)record_len) {
+		log_msg_and_exit_on_error(ERROR, "Can't write results record for test %d: %s\n",
+			test, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void write_xml_string(FILE *file, const char *str) {
+	for (; *str; str++) {
+		if (*str == '<')
+			fputs("&lt;", file);
+		else if (*str == '>')
+			fputs("&gt;", file);
+		else if (*str == '&')
+			fputs("&amp;", file);
+		else if (*str == '"')
+			fputs("&quot;", file);
+		else
+			fputc(*str, file);
+	}
+}
+
+/* JUnit summary of the first count tests */
+int write_junit_results(const char *results_path, int count) {
+	char path[PATH_MAX];
+	FILE *file;
+	int64_t total_ms;
+	int failures;
+	int skipped;
+	int i;
+
+	snprintf(path, PATH_MAX, "%s%s", results_path, TESTS_RESULTS_JUNIT);
+	file = fopen(path, "w");
+	if (file == NULL) {
+		log_msg_and_exit_on_error(ERROR, "Cannot open %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+
+	total_ms = 0;
+	failures = 0;
+	skipped = 0;
+	for (i = 0; i < count; i++) {
+		total_ms += tests[i].duration_ms;
+		if (tests[i].state == FAILED)
+			failures++;
+		else if (tests[i].state == SKIPPED)
+			skipped++;
+	}
+
+	fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(file, "<testsuite name=\"iio_testing_framework\" tests=\"%d\" failures=\"%d\" "
+		"skipped=\"%d\" time=\"%.3f\">\n", count, failures, skipped, total_ms / 1000.0);
+	for (i = 0; i < count; i++) {
+		fprintf(file, "\t<testcase classname=\"iio_testing_framework\" name=\"");
+		write_xml_string(file, tests[i].description != NULL ? tests[i].description : "");
+		fprintf(file, "\" time=\"%.3f\"", tests[i].duration_ms / 1000.0);
+		if (tests[i].state == FAILED)
+			fprintf(file, ">\n\t\t<failure message=\"see %s%d\"/>\n\t</testcase>\n",
+				TESTS_LOGS + 1, i);
+		else if (tests[i].state == SKIPPED)
+			fprintf(file, ">\n\t\t<skipped/>\n\t</testcase>\n");
+		else
+			fprintf(file, "/>\n");
+	}
+	fprintf(file, "</testsuite>\n");
+
+	if (fclose(file) == EOF) {
+		log_msg_and_exit_on_error(ERROR, "Cannot write %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
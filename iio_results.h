@@ -0,0 +1,32 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_RESULTS_H__
+#define __IIO_RESULTS_H__
+
+const char* test_state_name(test_state state);
+int open_results_file(const char *results_path);
+const char* get_results_dir(void);
+void close_results_file(void);
+void begin_test_record(void);
+void record_command(const char *cmd);
+void record_selected_sensors(void);
+void record_metric(int sensor_index, const char *name, double value, double threshold,
+	const char *unit);
+void record_histogram(int sensor_index, const char *name, const histogram_struct *histogram);
+int end_test_record(int test, const char *description);
+int write_junit_results(const char *results_path, int count);
+#endif
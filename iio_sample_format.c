@@ -18,7 +18,7 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <errno.h>
-#include "cutils/hashmap.h"
+#include <string.h>
 #include "iio_sample_format.h"
 #include "iio_enumeration.h"
 #include "iio_utils.h"
@@ -62,16 +62,88 @@ int decode_type_spec (const char type_buf[MAX_TYPE_SPEC_LEN], datum_info_t *type
 	return storagebits / 8;
 }
 
+static int compare_scan_elements(const void *a, const void *b) {
+	return ((const scan_element_t*)a)->index - ((const scan_element_t*)b)->index;
+}
+
+/* several sensors may share one device (ex: accel and anglvel on an imu),
+** the scan holds every enabled element of the device ordered by index,
+** each one aligned to its own storage size and the whole scan aligned to
+** the largest one; set offsets for sensor_index and return the scan size
+*/
+int set_scan_layout(int sensor_index) {
+	scan_element_t *elements;
+	channel_info_t *channel;
+	int dev_num;
+	int count;
+	int size;
+	int largest;
+	int i;
+	int s;
+	int c;
+
+	dev_num = g_sensor_info_iio_ext[sensor_index].dev_num;
+	count = 0;
+	for (s = 0; s < g_sensor_info_size; s++)
+		if (g_sensor_info_iio_ext[s].dev_num == dev_num &&
+			g_sensor_info_iio_ext[s].mode == MODE_TRIGGER)
+			count += g_sensor_info_iio_ext[s].num_channels;
+	/* one timestamp per device */
+	count++;
+
+	elements = (scan_element_t*)calloc(count, sizeof(scan_element_t));
+	if (elements == NULL) {
+		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+		exit(-1);
+	}
+
+	count = 0;
+	for (s = 0; s < g_sensor_info_size; s++) {
+		if (g_sensor_info_iio_ext[s].dev_num != dev_num ||
+			g_sensor_info_iio_ext[s].mode != MODE_TRIGGER)
+			continue;
+		for (c = 0; c < g_sensor_info_iio_ext[s].num_channels; c++) {
+			channel = &g_sensor_info_iio_ext[s].channel_info[c];
+			if (channel->size <= 0)
+				continue;
+			elements[count].index = channel->index;
+			elements[count].size = channel->size;
+			elements[count].offset = s == sensor_index ? &channel->offset : NULL;
+			count++;
+		}
+	}
+	channel = &g_sensor_info_iio_ext[sensor_index].timestamp;
+	if (channel->size > 0 && channel->index >= 0) {
+		elements[count].index = channel->index;
+		elements[count].size = channel->size;
+		elements[count].offset = &channel->offset;
+		count++;
+	}
+	qsort(elements, count, sizeof(scan_element_t), compare_scan_elements);
+
+	size = 0;
+	largest = 1;
+	for (i = 0; i < count; i++) {
+		size += get_padding_size(size, elements[i].size * 8);
+		if (elements[i].offset)
+			*elements[i].offset = size;
+		size += elements[i].size;
+		if (elements[i].size > largest)
+			largest = elements[i].size;
+	}
+	size += get_padding_size(size, largest * 8);
+	free(elements);
+
+	return size;
+}
+
 int set_sample_format(void) {
 	int num_channels;
 	int c;
 	int i;
-	int size;
-	int padding;
 	char sysfs_path[PATH_MAX];
 	channel_info_t channel, timestamp;
 
-	size = 0;
 	memset(sysfs_path, '\0', PATH_MAX);
 
 	for (i=0; i< g_sensor_info_size; i++) {
@@ -82,6 +154,7 @@ int set_sample_format(void) {
 			num_channels = g_sensor_info_iio_ext[i].num_channels;
 			for (c = 0; c < num_channels; c++) {
 				channel = g_sensor_info_iio_ext[i].channel_info[c];
+				channel.size = 0;
 				snprintf(sysfs_path, PATH_MAX, CHANNEL_PATH "%s", 
 					g_sensor_info_iio_ext[i].dev_num,
 					g_sensor_info_iio_ext[i].channel_descriptor[c].type_path); 
@@ -93,17 +166,16 @@ int set_sample_format(void) {
 				channel.size = decode_type_spec(channel.type_spec, &channel.type_info);
 				if (channel.size == -1) {
 					log_msg_and_exit_on_error(ERROR, "Device %s has invalid spec for channel %s!\n",
-						g_sensor_info_iio_ext[i].tag,
+						g_sensor_info_iio_ext[i].id,
 						g_sensor_info_iio_ext[i].channel_descriptor[c].name);
 					continue;
 				}
-				padding = get_padding_size(size, channel.type_info.storagebits);
-				size = size + channel.size + padding;
 				g_sensor_info_iio_ext[i].channel_info[c] = channel;
 			}
 
 			/* set sample format for timestamp */
 			timestamp = g_sensor_info_iio_ext[i].timestamp;
+			timestamp.size = 0;
 			snprintf(sysfs_path, PATH_MAX, TIMESTAMP_TYPE_PATH, g_sensor_info_iio_ext[i].dev_num); 
 			if (sysfs_read_str(sysfs_path, timestamp.type_spec, MAX_TYPE_SPEC_LEN) == -1) {
 				log_msg_and_exit_on_error(ERROR, "[%s] : %s", sysfs_path, strerror(errno));
@@ -112,15 +184,21 @@ int set_sample_format(void) {
 			timestamp.size = decode_type_spec(timestamp.type_spec, &timestamp.type_info);
 			if (timestamp.size == -1) {
 				log_msg_and_exit_on_error(ERROR, "Device %s has invalid spec for timestamp!\n",
-					g_sensor_info_iio_ext[i].tag);
+					g_sensor_info_iio_ext[i].id);
 				continue;
 			}      
-			padding = get_padding_size(size, timestamp.type_info.storagebits);
-			size = size + timestamp.size + padding;
 			g_sensor_info_iio_ext[i].timestamp = timestamp;
-			g_sensor_info_iio_ext[i].sample_size = size;
 		}
-	}    
+	}
+
+	/* offsets need every sensor of a device to be decoded first */
+	for (i=0; i< g_sensor_info_size; i++) {
+		if (!g_sensor_info_iio_ext[i].discovered || g_sensor_info_iio_ext[i].mode == MODE_POLL)
+			continue;
+		g_sensor_info_iio_ext[i].sample_size = set_scan_layout(i);
+		log_msg_and_exit_on_error(VERBOSE, "Device %s has sample size %d\n",
+			g_sensor_info_iio_ext[i].id, g_sensor_info_iio_ext[i].sample_size);
+	}
 	return 0;
 }
 int64_t sample_as_int64 (unsigned char* sample, datum_info_t* type) {
@@ -21,6 +21,7 @@
 
 int decode_type_spec (const char type_buf[MAX_TYPE_SPEC_LEN], datum_info_t *type_info);
 int get_padding_size(int total, int storagebits);
+int set_scan_layout(int sensor_index);
 int set_sample_format(void);
 int64_t sample_as_int64 (unsigned char* sample, datum_info_t* type);
 float scale_value(int sensor_index, int channel, int64_t value);
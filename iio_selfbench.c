@@ -0,0 +1,374 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "iio_selfbench.h"
+#include "iio_sample_format.h"
+#include "iio_histogram.h"
+#include "iio_results.h"
+#include "iio_arena.h"
+#include "iio_tests.h"
+#include "iio_utils.h"
+
+/*
+** Capacity benchmark of the harness itself. The sensor table is swapped
+** for simulated trigger mode sensors whose samples come from writer
+** threads through pipes, then poll_sensors runs the sample timestamp
+** wrapper on them exactly as for a device. The number of sensors and
+** their rate are ramped until the harness drops samples (the pipe of a
+** device is full) or adds latency, which gives the highest rate that is
+** sustained for every sensor count. The writer threads share the cpus
+** with the harness, so the envelope is a lower bound of its capacity.
+*/
+
+static const int sensor_steps[] = {1, 2, 4, 8, 12, 16, 24, 32};
+static const float freq_steps[] = {100, 200, 500, 1000, 2000, 5000};
+static const char *channel_names[] = {"x", "y", "z"};
+
+static selfbench_device_struct devices[SELFBENCH_MAX_SENSORS];
+static selfbench_step_struct *current_step;
+static int64_t baseline_latency;
+
+/* write samples at the rate of the device until it is stopped */
+static void* device_routine(void* params) {
+	selfbench_device_struct *device;
+	sensor_info_iio_ext_t *sensor;
+	struct timespec deadline;
+	int64_t period;
+	int64_t next;
+	int64_t timestamp;
+	int sample_size;
+	int c;
+	int i;
+
+	device = (selfbench_device_struct*)params;
+	sensor = &g_sensor_info_iio_ext[device - devices];
+	sample_size = sensor->sample_size;
+	unsigned char sample[sample_size];
+
+	memset(sample, 0, sample_size);
+	period = CONVERT_SEC_TO_NANO(1) / device->freq;
+	next = get_timestamp_monotonic();
+	while (!device->stop) {
+		next += period;
+		set_timestamp(&deadline, next);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+
+		for (c = 0; c < sensor->num_channels; c++) {
+			sample[sensor->channel_info[c].offset] = (device->written + c) & 0xff;
+			sample[sensor->channel_info[c].offset + 1] = ((device->written + c) >> 8) & 0xff;
+		}
+		timestamp = get_timestamp_realtime();
+		for (i = 0; i < 8; i++)
+			sample[sensor->timestamp.offset + i] = (timestamp >> (8 * i)) & 0xff;
+
+		if (write(device->write_fd, sample, sample_size) == -1) {
+			if (errno != EAGAIN) {
+				log_msg_and_exit_on_error(ERROR, "Can't write data in fifo for %s\n",
+					sensor->id);
+				set_test_state(FAILED);
+				break;
+			}
+			device->dropped++;
+		}
+		else {
+			device->written++;
+		}
+		if (device->first_write == -1)
+			device->first_write = timestamp;
+		device->last_write = timestamp;
+	}
+	return NULL;
+}
+
+/* stop the simulated devices of the step and collect their counters */
+static void stop_devices(void) {
+	selfbench_device_struct *device;
+	float rate;
+	int s;
+
+	for (s = 0; s < current_step->sensors; s++) {
+		device = &devices[s];
+		if (!device->started)
+			continue;
+		device->stop = 1;
+		if (pthread_join(device->thread, NULL)) {
+			log_msg_and_exit_on_error(ERROR, "Can't destroy thread for sensor %s\n",
+				g_sensor_info_iio_ext[s].id);
+			set_test_state(FAILED);
+		}
+		close(device->write_fd);
+		device->started = 0;
+
+		current_step->written += device->written;
+		current_step->dropped += device->dropped;
+		rate = 0;
+		if (device->last_write > device->first_write)
+			rate = (float)(device->written + device->dropped - 1) *
+				CONVERT_SEC_TO_NANO(1) / (device->last_write - device->first_write);
+		if (rate < current_step->produced_rate)
+			current_step->produced_rate = rate;
+	}
+}
+
+/* pipe of a simulated sensor, watched like its device */
+static int selfbench_initialize(run_sensor_struct *run_sensor) {
+	selfbench_device_struct *device;
+	int sensor_index;
+	int pfd[2];
+
+	sensor_index = run_sensor->sensor_index;
+	device = &devices[sensor_index];
+	run_sensor->values = arena_alloc(&g_test_arena, sizeof(timestamp_info_struct));
+
+	if (pipe(pfd) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Can't create pipe for simulated sensor %s\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(FAILED);
+		return -1;
+	}
+	/* a full pipe drops samples like a full iio buffer */
+	fcntl(pfd[WRITE], F_SETFL, O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+	fcntl(pfd[WRITE], F_SETPIPE_SZ, SELFBENCH_FIFO_SIZE);
+#endif
+	device->write_fd = pfd[WRITE];
+	device->freq = current_step->freq;
+	device->stop = 0;
+	device->written = 0;
+	device->dropped = 0;
+	device->first_write = -1;
+	device->last_write = -1;
+	if (pthread_create(&device->thread, NULL, &device_routine, (void*)device)) {
+		log_msg_and_exit_on_error(ERROR, "Can't create thread for sensor %s\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(FAILED);
+		close(pfd[READ]);
+		close(pfd[WRITE]);
+		return -1;
+	}
+	device->started = 1;
+	return watch_sensor_fd(run_sensor, pfd[READ]);
+}
+
+/* same work per sample as check_sample_timestamp_difference, plus the
+** latency from the sample timestamp to the end of it
+*/
+static int selfbench_wrapper(int sensor_index, void* run_sensor_param, int stage) {
+	run_sensor_struct *run_sensor;
+	int64_t latency;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
+	if (stage == PROCESS) {
+		if (check_sample_timestamp_difference_wrapper(sensor_index, run_sensor_param,
+			PROCESS) == -1)
+			return -1;
+		latency = get_timestamp_realtime() - g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		if (latency >= 0)
+			histogram_add(&current_step->latency, latency);
+		return 0;
+	}
+
+	/* the first sensor finalized stops all of them */
+	stop_devices();
+	/* simulated sensors aren't reported one by one, the envelope is */
+	histogram_reset(&run_sensor->profile->wakeup);
+	histogram_reset(&run_sensor->profile->read);
+	histogram_reset(&run_sensor->profile->decode);
+	histogram_reset(&run_sensor->profile->wrapper);
+	return 0;
+}
+
+/* trigger mode sensors with the layout of a 3 axis sensor */
+static sensor_info_iio_ext_t* create_simulated_sensors(void) {
+	sensor_info_iio_ext_t *sensors;
+	sensor_info_iio_ext_t *sensor;
+	channel_info_t *channel;
+	int s;
+	int c;
+
+	sensors = (sensor_info_iio_ext_t*)arena_alloc(&g_test_arena,
+		SELFBENCH_MAX_SENSORS * sizeof(sensor_info_iio_ext_t));
+	memset(sensors, 0, SELFBENCH_MAX_SENSORS * sizeof(sensor_info_iio_ext_t));
+	for (s = 0; s < SELFBENCH_MAX_SENSORS; s++) {
+		sensor = &sensors[s];
+		snprintf(sensor->tag, MAX_NAME_SIZE, "simulated");
+		snprintf(sensor->id, MAX_NAME_SIZE, "simulated#%d", s);
+		sensor->instance = s;
+		sensor->mode = MODE_TRIGGER;
+		sensor->discovered = 1;
+		/* a device of its own for set_scan_layout */
+		sensor->dev_num = -1 - s;
+		sensor->scale = 1;
+		sensor->read_fd = -1;
+		sensor->write_fd = -1;
+		sensor->warm_fd = -1;
+		sensor->num_channels = SELFBENCH_CHANNELS;
+		sensor->channel_info = (channel_info_t*)arena_alloc(&g_test_arena,
+			SELFBENCH_CHANNELS * sizeof(channel_info_t));
+		sensor->channel_descriptor = (channel_descriptor_t*)arena_alloc(&g_test_arena,
+			SELFBENCH_CHANNELS * sizeof(channel_descriptor_t));
+		memset(sensor->channel_info, 0, SELFBENCH_CHANNELS * sizeof(channel_info_t));
+		memset(sensor->channel_descriptor, 0, SELFBENCH_CHANNELS * sizeof(channel_descriptor_t));
+		for (c = 0; c < SELFBENCH_CHANNELS; c++) {
+			channel = &sensor->channel_info[c];
+			snprintf(channel->type_spec, MAX_TYPE_SPEC_LEN, "%s", SELFBENCH_TYPE_SPEC);
+			channel->size = decode_type_spec(channel->type_spec, &channel->type_info);
+			channel->index = c;
+			sensor->channel_descriptor[c].name = (char*)channel_names[c];
+		}
+		snprintf(sensor->timestamp.type_spec, MAX_TYPE_SPEC_LEN, "%s", SELFBENCH_TIMESTAMP_SPEC);
+		sensor->timestamp.size = decode_type_spec(sensor->timestamp.type_spec,
+			&sensor->timestamp.type_info);
+		sensor->timestamp.index = SELFBENCH_CHANNELS;
+	}
+	return sensors;
+}
+
+/* stream from the first sensors simulated sensors at freq for one step */
+static int run_step(int sensors, float freq, selfbench_step_struct *step) {
+	int64_t p50;
+	int64_t p99;
+	int s;
+
+	memset(step, 0, sizeof(selfbench_step_struct));
+	histogram_reset(&step->latency);
+	step->sensors = sensors;
+	step->freq = freq;
+	step->produced_rate = freq;
+	current_step = step;
+
+	for (s = 0; s < sensors; s++) {
+		g_sensor_info_iio_ext[s].data_rate = freq;
+		selected_sensors[s].sensor_index = s;
+		selected_sensors[s].time_attributes.freq = freq;
+		/* timestamps are checked by the wrapper but never fail a step */
+		selected_sensors[s].time_attributes.max_delay = INT_MAX;
+	}
+	selected_sensors_count = sensors;
+
+	if (poll_sensors(selfbench_initialize, selfbench_wrapper, SELFBENCH_STEP_SECS) == -1) {
+		stop_devices();
+		return -1;
+	}
+	stop_devices();
+
+	p50 = histogram_percentile(&step->latency, 50);
+	p99 = histogram_percentile(&step->latency, 99);
+	step->sustained = step->latency.counter > 0 && step->dropped == 0 &&
+		step->produced_rate >= freq * SELFBENCH_MIN_RATE_RATIO &&
+		(baseline_latency < 0 ||
+		p99 <= baseline_latency + SELFBENCH_LATENCY_MARGIN_US * 1000LL);
+	log_msg_and_exit_on_error(DEBUG, "%d simulated sensors at %.0f Hz: %lld samples, %lld dropped, "
+		"produced %.0f Hz, latency p50 = %lld us p99 = %lld us, %s\n", sensors, freq,
+		step->written, step->dropped, step->produced_rate, CONVERT_NANO_TO_MICRO(p50),
+		CONVERT_NANO_TO_MICRO(p99), step->sustained ? "sustained" : "not sustained");
+	return 0;
+}
+
+/* highest rate sustained by every sensor count, then the target */
+static void ramp(int target_sensors, float target_freq) {
+	char metric_name[MAX_NAME_SIZE];
+	selfbench_step_struct step;
+	float max_freq;
+	int s;
+	int f;
+
+	/* latency of the harness when it is almost idle */
+	baseline_latency = -1;
+	if (run_step(1, freq_steps[0], &step) == -1 || !step.sustained) {
+		log_msg_and_exit_on_error(ERROR, "Harness doesn't keep up with one sensor at %.0f Hz!\n",
+			freq_steps[0]);
+		set_test_state(FAILED);
+		return;
+	}
+	baseline_latency = histogram_percentile(&step.latency, 99);
+	record_metric(-1, "baseline_latency_p99", CONVERT_NANO_TO_MICRO(baseline_latency), NAN, "us");
+
+	for (s = 0; s < (int)(sizeof(sensor_steps) / sizeof(sensor_steps[0])); s++) {
+		max_freq = 0;
+		for (f = 0; f < (int)(sizeof(freq_steps) / sizeof(freq_steps[0])); f++) {
+			if (run_step(sensor_steps[s], freq_steps[f], &step) == -1)
+				return;
+			if (!step.sustained)
+				break;
+			max_freq = freq_steps[f];
+		}
+		log_msg_and_exit_on_error(DEBUG, "Harness sustains %d sensors up to %.0f Hz\n",
+			sensor_steps[s], max_freq);
+		snprintf(metric_name, MAX_NAME_SIZE, "max_freq_%d_sensors", sensor_steps[s]);
+		record_metric(-1, metric_name, max_freq, NAN, "Hz");
+		if (max_freq == 0)
+			break;
+	}
+
+	if (run_step(target_sensors, target_freq, &step) == -1)
+		return;
+	record_metric(-1, "target_dropped", step.dropped, 0, NULL);
+	record_histogram(-1, "target_latency", &step.latency);
+	if (!step.sustained) {
+		log_msg_and_exit_on_error(ERROR, "Harness doesn't keep up with %d sensors at %.0f Hz!\n",
+			target_sensors, target_freq);
+		set_test_state(FAILED);
+		return;
+	}
+	log_msg_and_exit_on_error(DEBUG, "Harness keeps up with %d sensors at %.0f Hz\n",
+		target_sensors, target_freq);
+}
+
+/* run the benchmark on simulated sensors, the real ones are put back after */
+int selfbench(int target_sensors, float target_freq) {
+	sensor_info_iio_ext_t *real_sensors;
+	selected_sensor_struct *real_selected_sensors;
+	int real_sensors_size;
+	int real_selected_count;
+	int s;
+
+	if (target_sensors <= 0 || target_sensors > SELFBENCH_MAX_SENSORS || target_freq <= 0) {
+		log_msg_and_exit_on_error(ERROR, "selfbench needs 1 to %d sensors and a rate!\n",
+			SELFBENCH_MAX_SENSORS);
+		set_test_state(FAILED);
+		return -1;
+	}
+
+	real_sensors = g_sensor_info_iio_ext;
+	real_sensors_size = g_sensor_info_size;
+	real_selected_sensors = selected_sensors;
+	real_selected_count = selected_sensors_count;
+
+	g_sensor_info_iio_ext = create_simulated_sensors();
+	g_sensor_info_size = SELFBENCH_MAX_SENSORS;
+	for (s = 0; s < SELFBENCH_MAX_SENSORS; s++)
+		g_sensor_info_iio_ext[s].sample_size = set_scan_layout(s);
+	selected_sensors = (selected_sensor_struct*)arena_alloc(&g_test_arena,
+		(SELFBENCH_MAX_SENSORS + 1) * sizeof(selected_sensor_struct));
+
+	ramp(target_sensors, target_freq);
+
+	g_sensor_info_iio_ext = real_sensors;
+	g_sensor_info_size = real_sensors_size;
+	selected_sensors = real_selected_sensors;
+	selected_sensors_count = real_selected_count;
+	return 0;
+}
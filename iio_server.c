@@ -0,0 +1,150 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "iio_server.h"
+#include "iio_arena.h"
+#include "iio_results.h"
+#include "iio_control.h"
+#include "iio_parser.h"
+#include "iio_utils.h"
+
+/*
+** Server mode: sensors are enumerated once, then commands with the same
+** syntax as -c are read line by line from a local socket. Messages of a
+** command are streamed to the client, followed by a line such as
+** "@result state=passed duration_ms=1203 command=check_freq accel freq 50".
+** Device fds and triggers are kept set up between commands.
+*/
+
+static void serve_command(int client_fd, char *cmd) {
+	char command[BUFFER_SIZE];
+	int msg_fd;
+
+	/* parse_cmd moves through cmd, keep it for the result line */
+	snprintf(command, BUFFER_SIZE, "%s", cmd);
+	msg_fd = current_fd;
+	current_fd = client_fd;
+	nr_test = 0;
+	/* as for a command given with -c, logs go with the rest to the client */
+	memset(&tests[nr_test], 0, sizeof(test_info_t));
+	tests[nr_test].description = command;
+	tests[nr_test].log_fd = -1;
+	tests[nr_test].state = PASSED;
+
+	begin_test_record();
+	parse_cmd(cmd);
+	end_test_record(nr_test, command);
+	arena_reset(&g_test_arena);
+	log_msg_and_exit_on_error(NOTHING, "@result state=%s duration_ms=%lld command=%s\n",
+		test_state_name(tests[nr_test].state), (long long)tests[nr_test].duration_ms, command);
+
+	tests[nr_test].description = NULL;
+	current_fd = msg_fd;
+}
+
+/* serve one client until it closes the connection or sends quit;
+** return 0 when shutdown was requested
+*/
+static int serve_client(int client_fd) {
+	FILE *client;
+	char line[BUFFER_SIZE];
+
+	client = fdopen(client_fd, "r");
+	if (client == NULL) {
+		close(client_fd);
+		return 1;
+	}
+
+	while (fgets(line, BUFFER_SIZE, client) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '\0')
+			continue;
+		if (!strcmp(line, "quit"))
+			break;
+		if (!strcmp(line, "shutdown")) {
+			fclose(client);
+			return 0;
+		}
+		serve_command(client_fd, line);
+	}
+	fclose(client);
+	return 1;
+}
+
+int run_server(const char *socket_path) {
+	struct sockaddr_un addr;
+	int server_fd;
+	int client_fd;
+	int running;
+
+	/* a client leaving must not kill the server */
+	signal(SIGPIPE, SIG_IGN);
+
+	server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (server_fd == -1) {
+		log_msg_and_exit_on_error(FATAL, "Can't create socket: %s\n", strerror(errno));
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+	unlink(socket_path);
+	if (bind(server_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+		listen(server_fd, SERVER_BACKLOG) == -1) {
+		log_msg_and_exit_on_error(FATAL, "Can't listen on %s: %s\n", socket_path,
+			strerror(errno));
+		close(server_fd);
+		return -1;
+	}
+
+	tests = (test_info_t*)malloc(1 * sizeof(test_info_t));
+	if (tests == NULL) {   
+		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+		exit(-1);
+	}
+	g_keep_warm = 1;
+	log_msg_and_exit_on_error(DEBUG, "Listening on %s\n", socket_path);
+
+	running = 1;
+	while (running) {
+		client_fd = accept(server_fd, NULL, NULL);
+		if (client_fd == -1) {
+			if (errno == EINTR)
+				continue;
+			log_msg_and_exit_on_error(ERROR, "Error accept: %s\n", strerror(errno));
+			break;
+		}
+		running = serve_client(client_fd);
+	}
+
+	g_keep_warm = 0;
+	close_warm_fds();
+	arena_release(&g_test_arena);
+	free(tests);
+	tests = NULL;
+	close(server_fd);
+	unlink(socket_path);
+	log_msg_and_exit_on_error(DEBUG, "Server on %s stopped\n", socket_path);
+	return 0;
+}
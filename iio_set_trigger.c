@@ -24,8 +24,9 @@
 #include <time.h>
 #include <stdarg.h>
 #include <dirent.h>
-#include "cutils/hashmap.h"
+#include <unistd.h>
 #include "iio_set_trigger.h"
+#include "iio_trace.h"
 #include "iio_utils.h"
 #include "iio_common.h"
 
@@ -56,10 +57,12 @@ int enable_trigger(int dev_num, const char* trigger_val) {
 
 	log_msg_and_exit_on_error(VERBOSE, "Setting %s to %s.\n", sysfs_path, trigger_val);
 
+	trace_begin("iio_trigger dev%d %s", dev_num, trigger_val[0] == '\n' ? "none" : trigger_val);
 	while (ret == -1 && attempts) {
 		ret = sysfs_write_str(sysfs_path, trigger_val);
 		attempts--;
 	}
+	trace_end();
 	if (ret == -1) {
 		log_msg_and_exit_on_error(DEBUG, "Setting %s to %s was a failure.\n", sysfs_path, trigger_val);
 	}
@@ -75,11 +78,25 @@ void propose_new_trigger (int s, char trigger_name[MAX_NAME_SIZE], int hr_trigge
 	** The format is something like sensor_name-dev0.
 	*/
 	int trigger_nr;
+	int triggers_size;
 	int sensor_name_len;
+	char (*triggers)[MAX_NAME_SIZE];
 
 	sensor_name_len = strnlen(g_sensor_info_iio_ext[s].internal_name, MAX_NAME_SIZE);
 	trigger_nr = g_sensor_info_iio_ext[s].trigger_nr;
-	strncpy(g_sensor_info_iio_ext[s].triggers[trigger_nr], trigger_name, strlen(trigger_name));
+	triggers_size = g_sensor_info_iio_ext[s].triggers_size;
+
+	if (trigger_nr == triggers_size) {
+		triggers_size = triggers_size ? triggers_size * 2 : TRIGGERS_INITIAL_SIZE;
+		triggers = realloc(g_sensor_info_iio_ext[s].triggers, triggers_size * MAX_NAME_SIZE);
+		if (triggers == NULL) {
+			log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+			exit(-1);
+		}
+		g_sensor_info_iio_ext[s].triggers = triggers;
+		g_sensor_info_iio_ext[s].triggers_size = triggers_size;
+	}
+	snprintf(g_sensor_info_iio_ext[s].triggers[trigger_nr], MAX_NAME_SIZE, "%s", trigger_name);
 	g_sensor_info_iio_ext[s].trigger_nr++;
 
 
@@ -93,32 +110,135 @@ void propose_new_trigger (int s, char trigger_name[MAX_NAME_SIZE], int hr_trigge
 		g_sensor_info_iio_ext[s].hr_trigger_nr = hr_trigger_nr;
 
 }
-int create_hrtimer_trigger(int s, int hr_trigger_nr) {
+
+/* look for the triggerN entry exposing the given name */
+int get_trigger_nr_from_name(const char *name) {
+	char sysfs_path[PATH_MAX];
+	char trigger_name[MAX_NAME_SIZE];
+	int *triggers;
+	int triggers_count;
+	int trigger_nr;
+	int i;
+
+	trigger_nr = -1;
+	triggers_count = list_iio_entries(TRIGGER_PREFIX, &triggers);
+	for (i = 0; i < triggers_count; i++) {
+		memset(trigger_name, '\0', MAX_NAME_SIZE);
+		snprintf(sysfs_path, PATH_MAX, TRIGGER_FILE_PATH, triggers[i]);
+		if (sysfs_read_str(sysfs_path, trigger_name, MAX_NAME_SIZE) < 0)
+			continue;
+		if (!strncmp(trigger_name, name, MAX_NAME_SIZE)) {
+			trigger_nr = triggers[i];
+			break;
+		}
+	}
+	free(triggers);
+	return trigger_nr;
+}
+/*
+** hrtimer triggers are made in configfs for sensors without a trigger of
+** their own. They are kept in a pool: a trigger is made once, reused by
+** every test of the run and programmed at the rate of its device. The
+** sensors cache lists the triggers the framework made, so they outlive
+** the run and the next start finds them; they are only removed at exit
+** when the cache can't be written. Triggers which were already there are
+** adopted and left as found.
+*/
+static hrtimer_struct *hrtimers;
+static int hrtimers_count;
+static int hrtimers_size;
+
+static hrtimer_struct* find_hrtimer(const char *name) {
+	int h;
+
+	for (h = 0; h < hrtimers_count; h++)
+		if (!strncmp(hrtimers[h].name, name, MAX_NAME_SIZE))
+			return &hrtimers[h];
+	return NULL;
+}
+
+/* hrtimer trigger called name from the pool, made if it doesn't exist */
+static hrtimer_struct* acquire_hrtimer(const char *name) {
 	struct stat dir_status;
-	char buf[MAX_NAME_SIZE];
 	char hrtimer_path[PATH_MAX];
-	char hrtimer_name[MAX_NAME_SIZE];
+	hrtimer_struct *hrtimer;
+	int created;
+	int trigger_nr;
 
-	memset(buf, '\0', MAX_NAME_SIZE);
-	memset(hrtimer_path, '\0', PATH_MAX);
-	memset(hrtimer_name, '\0', MAX_NAME_SIZE);
+	hrtimer = find_hrtimer(name);
+	if (hrtimer != NULL && get_trigger_nr_from_name(name) == hrtimer->trigger_nr)
+		return hrtimer;
 
-	snprintf(buf, MAX_NAME_SIZE, "hrtimer-%s-hr-dev%d",
-		g_sensor_info_iio_ext[s].internal_name, g_sensor_info_iio_ext[s].dev_num);
-	snprintf(hrtimer_name, MAX_NAME_SIZE, "%s-hr-dev%d",
-		g_sensor_info_iio_ext[s].internal_name, g_sensor_info_iio_ext[s].dev_num);
-	snprintf(hrtimer_path, PATH_MAX, "%s%s", CONFIGFS_TRIGGER_PATH, buf);
+	memset(hrtimer_path, '\0', PATH_MAX);
+	snprintf(hrtimer_path, PATH_MAX, "%shrtimer-%s", CONFIGFS_TRIGGER_PATH, name);
 
 	/* Get parent dir status */
 	if (stat(CONFIGFS_TRIGGER_PATH, &dir_status))
-		return -1;
+		return NULL;
 
 	/* Create hrtimer with the same access rights as it's parent */
-	if (mkdir(hrtimer_path, dir_status.st_mode))
+	created = 1;
+	if (mkdir(hrtimer_path, dir_status.st_mode)) {
 		if (errno != EEXIST)
-			return -1;
-	g_sensor_info_iio_ext[s].hr_trigger_nr = hr_trigger_nr;
-	propose_new_trigger(s, hrtimer_name, hr_trigger_nr);	
+			return NULL;
+		created = 0;
+	}
+
+	/* trigger numbers may be sparse, find the one the kernel picked */
+	trigger_nr = get_trigger_nr_from_name(name);
+	if (trigger_nr == -1) {
+		log_msg_and_exit_on_error(DEBUG, "Can't find trigger %s\n", name);
+		if (created)
+			rmdir(hrtimer_path);
+		return NULL;
+	}
+
+	if (hrtimer == NULL) {
+		if (hrtimers_count == hrtimers_size) {
+			hrtimers_size = hrtimers_size ? hrtimers_size * 2 : HRTIMERS_INITIAL_SIZE;
+			hrtimer = (hrtimer_struct*)realloc(hrtimers, hrtimers_size * sizeof(hrtimer_struct));
+			if (hrtimer == NULL) {
+				log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+				exit(-1);
+			}
+			hrtimers = hrtimer;
+		}
+		hrtimer = &hrtimers[hrtimers_count++];
+		snprintf(hrtimer->name, MAX_NAME_SIZE, "%s", name);
+		hrtimer->created = 0;
+	}
+	/* made again after a removal outside of the framework */
+	hrtimer->created |= created;
+	hrtimer->trigger_nr = trigger_nr;
+	hrtimer->freq = 0;
+	log_msg_and_exit_on_error(VERBOSE, "%s hrtimer trigger %s (trigger%d)\n",
+		created ? "Created" : "Adopted", name, trigger_nr);
+	return hrtimer;
+}
+
+int create_hrtimer_trigger(int s) {
+	char hrtimer_name[MAX_NAME_SIZE];
+	hrtimer_struct *hrtimer;
+	int t;
+
+	memset(hrtimer_name, '\0', MAX_NAME_SIZE);
+	if (snprintf(hrtimer_name, MAX_NAME_SIZE, "%s-hr-dev%d", g_sensor_info_iio_ext[s].internal_name,
+		g_sensor_info_iio_ext[s].dev_num) >= MAX_NAME_SIZE) {
+		log_msg_and_exit_on_error(ERROR, "Name of device%d is too long for an hrtimer trigger\n",
+			g_sensor_info_iio_ext[s].dev_num);
+		return -1;
+	}
+
+	hrtimer = acquire_hrtimer(hrtimer_name);
+	if (hrtimer == NULL)
+		return -1;
+
+	g_sensor_info_iio_ext[s].hr_trigger_nr = hrtimer->trigger_nr;
+	for (t = 0; t < g_sensor_info_iio_ext[s].trigger_nr; t++)
+		if (!strncmp(g_sensor_info_iio_ext[s].triggers[t], hrtimer_name, MAX_NAME_SIZE))
+			break;
+	if (t == g_sensor_info_iio_ext[s].trigger_nr)
+		propose_new_trigger(s, hrtimer_name, hrtimer->trigger_nr);
 	strncpy (g_sensor_info_iio_ext[s].init_trigger_name, hrtimer_name, MAX_NAME_SIZE);
 	log_msg_and_exit_on_error(VERBOSE, "Device%d has trigger %s\n",
 		g_sensor_info_iio_ext[s].dev_num, g_sensor_info_iio_ext[s].init_trigger_name);	
@@ -126,6 +246,142 @@ int create_hrtimer_trigger(int s, int hr_trigger_nr) {
 	return 0;
 }
 
+/* hrtimer listed by the sensors cache: made by an earlier run, so it is
+** the framework's to remove even though it exists already
+*/
+void own_hrtimer(const char *name) {
+	hrtimer_struct *hrtimer;
+
+	hrtimer = acquire_hrtimer(name);
+	if (hrtimer == NULL) {
+		log_msg_and_exit_on_error(DEBUG, "Can't restore hrtimer trigger %s\n", name);
+		return;
+	}
+	hrtimer->created = 1;
+}
+
+/* call callback(name, context) for every hrtimer the framework made */
+void for_each_owned_hrtimer(void (*callback) (const char*, void*), void* context) {
+	int h;
+
+	for (h = 0; h < hrtimers_count; h++)
+		if (hrtimers[h].created)
+			callback(hrtimers[h].name, context);
+}
+
+/* trigger number of an hrtimer of the pool which isn't tied to a device,
+** ex: a trigger shared by several devices; -1 if it can't be made
+*/
+int get_shared_hrtimer(const char *name) {
+	hrtimer_struct *hrtimer;
+
+	hrtimer = acquire_hrtimer(name);
+	if (hrtimer == NULL)
+		return -1;
+	return hrtimer->trigger_nr;
+}
+
+/* sensors restored from the cache get their hrtimers back in the pool,
+** made again if they were removed since; their trigger number may change
+*/
+void restore_hrtimer_triggers(void) {
+	char hrtimer_name[MAX_NAME_SIZE];
+	int s;
+
+	for (s = 0; s < g_sensor_info_size; s++) {
+		if (!g_sensor_info_iio_ext[s].discovered || g_sensor_info_iio_ext[s].mode != MODE_TRIGGER ||
+			g_sensor_info_iio_ext[s].hr_trigger_nr == -1)
+			continue;
+		/* create_hrtimer_trigger didn't make one with a truncated name */
+		if (snprintf(hrtimer_name, MAX_NAME_SIZE, "%s-hr-dev%d", g_sensor_info_iio_ext[s].internal_name,
+			g_sensor_info_iio_ext[s].dev_num) >= MAX_NAME_SIZE)
+			continue;
+		if (strncmp(g_sensor_info_iio_ext[s].init_trigger_name, hrtimer_name, MAX_NAME_SIZE))
+			continue;
+		if (create_hrtimer_trigger(s) == -1)
+			log_msg_and_exit_on_error(DEBUG, "Can't restore trigger %s for device%d\n",
+				hrtimer_name, g_sensor_info_iio_ext[s].dev_num);
+	}
+}
+
+/* program a trigger at the rate of its device; hrtimers of the pool keep
+** the last rate written so it isn't written again
+*/
+int set_hrtimer_freq(int trigger_nr, float freq) {
+	char sysfs_path[PATH_MAX];
+	hrtimer_struct *hrtimer;
+	float current_freq;
+	int h;
+
+	hrtimer = NULL;
+	for (h = 0; h < hrtimers_count; h++)
+		if (hrtimers[h].trigger_nr == trigger_nr)
+			hrtimer = &hrtimers[h];
+	if (hrtimer != NULL && hrtimer->freq == freq)
+		return 0;
+
+	memset(sysfs_path, '\0', PATH_MAX);
+	snprintf(sysfs_path, PATH_MAX, TRIGGER_FREQ_PATH, trigger_nr);
+	if (sysfs_read_float(sysfs_path, &current_freq) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path); 
+		return -1;
+	}
+	if (current_freq != freq && sysfs_write_float(sysfs_path, freq) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Can't write value to %s\n", sysfs_path); 
+		return -1;
+	}
+	if (hrtimer != NULL)
+		hrtimer->freq = freq;
+	return 0;
+}
+
+/* detach devices from the hrtimers made by the framework, and remove
+** them unless keep; keep when the sensors cache lists them for the next run
+*/
+void release_hrtimer_triggers(int keep) {
+	char hrtimer_path[PATH_MAX];
+	char sysfs_path[PATH_MAX];
+	char current_trigger[MAX_NAME_SIZE];
+	int enabled;
+	int h;
+	int s;
+
+	for (h = 0; h < hrtimers_count; h++) {
+		if (!hrtimers[h].created)
+			continue;
+		for (s = 0; s < g_sensor_info_size; s++) {
+			if (!g_sensor_info_iio_ext[s].discovered || g_sensor_info_iio_ext[s].is_virtual ||
+				g_sensor_info_iio_ext[s].mode != MODE_TRIGGER)
+				continue;
+			memset(current_trigger, '\0', MAX_NAME_SIZE);
+			snprintf(sysfs_path, PATH_MAX, TRIGGER_PATH, g_sensor_info_iio_ext[s].dev_num);
+			if (sysfs_read_str(sysfs_path, current_trigger, MAX_NAME_SIZE) < 0 ||
+				strncmp(current_trigger, hrtimers[h].name, MAX_NAME_SIZE))
+				continue;
+			/* a buffer can't stream without its trigger */
+			snprintf(sysfs_path, PATH_MAX, ENABLE_PATH, g_sensor_info_iio_ext[s].dev_num);
+			if (!sysfs_read_int(sysfs_path, &enabled) && enabled)
+				sysfs_write_int(sysfs_path, 0);
+			enable_trigger(g_sensor_info_iio_ext[s].dev_num, "\n");
+			g_sensor_info_iio_ext[s].trigger_attached = 0;
+		}
+		if (keep)
+			continue;
+		snprintf(hrtimer_path, PATH_MAX, "%shrtimer-%s", CONFIGFS_TRIGGER_PATH,
+			hrtimers[h].name);
+		if (rmdir(hrtimer_path))
+			log_msg_and_exit_on_error(DEBUG, "Can't remove hrtimer trigger %s: %s\n",
+				hrtimers[h].name, strerror(errno));
+		else
+			log_msg_and_exit_on_error(VERBOSE, "Removed hrtimer trigger %s\n",
+				hrtimers[h].name);
+	}
+	free(hrtimers);
+	hrtimers = NULL;
+	hrtimers_count = 0;
+	hrtimers_size = 0;
+}
+
 void update_sensor_matching_trigger_name (char name[MAX_NAME_SIZE], int trigger_nr) {
 	/*
 	** Check if we have a sensor matching the specified trigger name, 
@@ -181,20 +437,24 @@ void select_trigger(void) {
 	int s;
 	char sysfs_path[PATH_MAX];
 	char trigger_name[MAX_NAME_SIZE];
+	int *triggers;
+	int triggers_count;
 	int trigger;
 
 	memset(sysfs_path, '\0', PATH_MAX);
-	memset(trigger_name, '\0', MAX_NAME_SIZE);
 
 	/* Now have a look to /sys/bus/iio/devices/triggerX entries */
-	for (trigger = 0; trigger < MAX_TRIGGERS; trigger++) {
-		snprintf(sysfs_path, PATH_MAX, TRIGGER_FILE_PATH, trigger);
+	triggers_count = list_iio_entries(TRIGGER_PREFIX, &triggers);
+	for (trigger = 0; trigger < triggers_count; trigger++) {
+		memset(trigger_name, '\0', MAX_NAME_SIZE);
+		snprintf(sysfs_path, PATH_MAX, TRIGGER_FILE_PATH, triggers[trigger]);
 		if(sysfs_read_str(sysfs_path, trigger_name, MAX_NAME_SIZE) < 0)
-			break;
+			continue;
 
 		/* Record initial and any-motion triggers names */
-		update_sensor_matching_trigger_name(trigger_name, trigger);
+		update_sensor_matching_trigger_name(trigger_name, triggers[trigger]);
 	}
+	free(triggers);
 
 	/* By default, use the name-dev convention that most drivers use*/ 
 	for (s = 0; s < g_sensor_info_size; s++) {
@@ -203,8 +463,15 @@ void select_trigger(void) {
 		if(g_sensor_info_iio_ext[s].mode == MODE_POLL)
 			continue;		
 		else if(g_sensor_info_iio_ext[s].found_implicit_trigger == 1) {
-			snprintf(g_sensor_info_iio_ext[s].init_trigger_name, MAX_NAME_SIZE, "%s-dev%d",
-				g_sensor_info_iio_ext[s].internal_name, g_sensor_info_iio_ext[s].dev_num);
+			if (snprintf(g_sensor_info_iio_ext[s].init_trigger_name, MAX_NAME_SIZE, "%s-dev%d",
+				g_sensor_info_iio_ext[s].internal_name,
+				g_sensor_info_iio_ext[s].dev_num) >= MAX_NAME_SIZE) {
+				/* a truncated name would select another trigger */
+				g_sensor_info_iio_ext[s].init_trigger_name[0] = '\0';
+				log_msg_and_exit_on_error(ERROR, "Name of device%d is too long for its "
+					"trigger\n", g_sensor_info_iio_ext[s].dev_num);
+				continue;
+			}
 			log_msg_and_exit_on_error(VERBOSE, "Device%d has trigger %s\n",
 				g_sensor_info_iio_ext[s].dev_num, g_sensor_info_iio_ext[s].init_trigger_name);	
 			continue;
@@ -212,8 +479,8 @@ void select_trigger(void) {
 		
 		}
 		else if(g_sensor_info_iio_ext[s].trigger_nr > 0) {
-			strncpy(g_sensor_info_iio_ext[s].init_trigger_name, g_sensor_info_iio_ext[s].triggers[0],
-				strlen(g_sensor_info_iio_ext[s].triggers[0]));
+			snprintf(g_sensor_info_iio_ext[s].init_trigger_name, MAX_NAME_SIZE, "%s",
+				g_sensor_info_iio_ext[s].triggers[0]);
 			log_msg_and_exit_on_error(VERBOSE, "Device%d has trigger %s\n",
 				g_sensor_info_iio_ext[s].dev_num, g_sensor_info_iio_ext[s].init_trigger_name);	
 			continue;
@@ -221,8 +488,7 @@ void select_trigger(void) {
 		else{
 			log_msg_and_exit_on_error(VERBOSE, "Device%d has no trigger!\n",
 				g_sensor_info_iio_ext[s].dev_num);
-			create_hrtimer_trigger(s, trigger);
-			trigger++;
+			create_hrtimer_trigger(s);
 
 		}
 	}
@@ -13,11 +13,19 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 */
-
+#include "iio_common.h"
 #ifndef __IIO_SET_TRIGGER_H__
 #define __IIO_SET_TRIGGER_H__
 
 void list_triggers();
 void select_trigger(void);
+void propose_new_trigger(int s, char trigger_name[MAX_NAME_SIZE], int hr_trigger_nr);
 int enable_trigger(int dev_num, const char* trigger_val);
+int create_hrtimer_trigger(int s);
+void own_hrtimer(const char *name);
+void for_each_owned_hrtimer(void (*callback) (const char*, void*), void* context);
+int get_shared_hrtimer(const char *name);
+void restore_hrtimer_triggers(void);
+int set_hrtimer_freq(int trigger_nr, float freq);
+void release_hrtimer_triggers(int keep);
 #endif
@@ -0,0 +1,543 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "iio_soak.h"
+#include "iio_arena.h"
+#include "iio_histogram.h"
+#include "iio_results.h"
+#include "iio_tests.h"
+#include "iio_trace.h"
+#include "iio_utils.h"
+
+/*
+** Soak: the sensors of the command stream for hours or days. Nothing is
+** kept per sample: sample intervals, channel values and delays go into
+** Welford sums and histograms, once for the current interval and once
+** for the whole soak, so memory doesn't grow with the duration.
+**
+** Every SOAK_INTERVAL_SECS a JSON line per sensor is appended to
+** soak_metrics.jsonl and the totals are written in soak_checkpoint,
+** through a temporary file renamed over it. A soak of the same command
+** started after a crash or a reboot resumes from the checkpoint, losing at
+** most the interval which was running; the checkpoint is removed when the
+** soak ends.
+*/
+
+static const char *soak_command;
+static char checkpoint_path[PATH_MAX];
+static int metrics_fd = -1;
+static int64_t soak_start;	/* monotonic, start of this run */
+static int64_t elapsed_before;	/* ns streamed by runs before a resume */
+static int64_t interval_end;
+static int intervals;
+/* totals read from the checkpoint, given to sensors of the same id */
+static soak_struct *restored;
+static int restored_count;
+
+static void stats_init(soak_stats_struct *stats, int num_channels) {
+	stats->channel_mean = (double*)arena_alloc(&g_test_arena, (num_channels + 1) *
+		sizeof(double));
+	stats->channel_m2 = (double*)arena_alloc(&g_test_arena, (num_channels + 1) *
+		sizeof(double));
+}
+
+static void stats_reset(soak_stats_struct *stats, int num_channels) {
+	stats->counter = 0;
+	stats->intervals = 0;
+	stats->gaps = 0;
+	stats->interval_mean = 0;
+	stats->interval_m2 = 0;
+	memset(stats->channel_mean, 0, num_channels * sizeof(double));
+	memset(stats->channel_m2, 0, num_channels * sizeof(double));
+	histogram_reset(&stats->delay);
+}
+
+static void welford_add(int64_t count, double *mean, double *m2, double value) {
+	double delta;
+
+	delta = value - *mean;
+	*mean += delta / count;
+	*m2 += delta * (value - *mean);
+}
+
+/* standard deviation of sample intervals over their mean, in % */
+static float stats_jitter(const soak_stats_struct *stats) {
+	if (stats->intervals < 2 || stats->interval_mean <= 0)
+		return 0;
+	return sqrt(stats->interval_m2 / (stats->intervals - 1)) / stats->interval_mean * 100;
+}
+
+static void stats_add(soak_stats_struct *stats, soak_struct *soak, int64_t interval,
+	int64_t delay) {
+	int c;
+
+	stats->counter++;
+	if (interval > 0) {
+		stats->intervals++;
+		welford_add(stats->intervals, &stats->interval_mean, &stats->interval_m2, interval);
+		if (soak->period && interval > SOAK_GAP_PERIODS * soak->period)
+			stats->gaps++;
+	}
+	if (delay >= 0)
+		histogram_add(&stats->delay, delay);
+	for (c = 0; c < soak->num_channels; c++)
+		welford_add(stats->counter, &stats->channel_mean[c], &stats->channel_m2[c],
+			g_sensor_info_iio_ext[soak->sensor_index].channel_info[c].last_value);
+}
+
+soak_struct* new_soak_sensor(int sensor_index) {
+	soak_struct *soak;
+	int i;
+
+	soak = (soak_struct*)arena_alloc(&g_test_arena, sizeof(soak_struct));
+	soak->sensor_index = sensor_index;
+	soak->num_channels = g_sensor_info_iio_ext[sensor_index].num_channels;
+	if (g_sensor_info_iio_ext[sensor_index].data_rate > 0)
+		soak->period = (int64_t)(CONVERT_SEC_TO_NANO(1) /
+			g_sensor_info_iio_ext[sensor_index].data_rate);
+	stats_init(&soak->interval, soak->num_channels);
+	stats_init(&soak->total, soak->num_channels);
+
+	for (i = 0; i < restored_count; i++) {
+		if (restored[i].sensor_index != sensor_index ||
+			restored[i].num_channels != soak->num_channels)
+			continue;
+		soak->worst_jitter = restored[i].worst_jitter;
+		soak->worst_delay_p99 = restored[i].worst_delay_p99;
+		soak->violations = restored[i].violations;
+		soak->total = restored[i].total;
+		log_msg_and_exit_on_error(DEBUG, "Device %s resumes soak with %lld samples\n",
+			g_sensor_info_iio_ext[sensor_index].id, soak->total.counter);
+		break;
+	}
+	return soak;
+}
+
+void soak_add_sample(int sensor_index, soak_struct *soak) {
+	int64_t timestamp;
+	int64_t interval;
+	int64_t delay;
+
+	timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+	delay = get_timestamp_realtime() - timestamp;
+	/* the first sample of a run has no interval, even after a resume */
+	interval = soak->last_timestamp ? timestamp - soak->last_timestamp : 0;
+	soak->last_timestamp = timestamp;
+	stats_add(&soak->interval, soak, interval, delay);
+	stats_add(&soak->total, soak, interval, delay);
+}
+
+static void write_histogram(FILE *file, const histogram_struct *histogram) {
+	int count;
+	int b;
+
+	count = 0;
+	for (b = 0; b < HISTOGRAM_BUCKETS; b++)
+		if (histogram->buckets[b])
+			count++;
+	fprintf(file, "delay %lld %lld %lld %lld %d", (long long)histogram->counter,
+		(long long)histogram->min, (long long)histogram->max, (long long)histogram->sum, count);
+	for (b = 0; b < HISTOGRAM_BUCKETS; b++)
+		if (histogram->buckets[b])
+			fprintf(file, " %d %lld", b, (long long)histogram->buckets[b]);
+	fprintf(file, "\n");
+}
+
+static int read_histogram(FILE *file, histogram_struct *histogram) {
+	long long counter, min, max, sum, value;
+	int count;
+	int b;
+
+	if (fscanf(file, " delay %lld %lld %lld %lld %d", &counter, &min, &max, &sum, &count) != 5)
+		return -1;
+	histogram->counter = counter;
+	histogram->min = min;
+	histogram->max = max;
+	histogram->sum = sum;
+	for (; count > 0; count--) {
+		if (fscanf(file, "%d %lld", &b, &value) != 2 || b < 0 || b >= HISTOGRAM_BUCKETS)
+			return -1;
+		histogram->buckets[b] = value;
+	}
+	return 0;
+}
+
+/* totals of every sensor, written next to the checkpoint then renamed
+** over it so a crash leaves the old or the new one; "end" closes a
+** complete checkpoint, and on any error the old one is kept
+*/
+static int write_checkpoint(run_context_struct *run_context, int64_t elapsed) {
+	char path[PATH_MAX];
+	soak_struct *soak;
+	FILE *file;
+	int i;
+	int c;
+
+	if (!checkpoint_path[0])
+		return 0;
+	if (snprintf(path, PATH_MAX, "%s.tmp", checkpoint_path) >= PATH_MAX) {
+		log_msg_and_exit_on_error(ERROR, "Soak checkpoint path %s is too long\n", checkpoint_path);
+		return -1;
+	}
+	file = fopen(path, "w");
+	if (file == NULL) {
+		log_msg_and_exit_on_error(ERROR, "Cannot open %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+	fprintf(file, "iio_testing_framework soak %d\n", SOAK_CHECKPOINT_VERSION);
+	fprintf(file, "command %s\n", soak_command);
+	fprintf(file, "elapsed %lld %d\n", (long long)elapsed, intervals);
+	for (i = 0; i < run_context->sensors_count; i++) {
+		soak = (soak_struct*)run_context->sensors[i].values;
+		if (soak == NULL)
+			continue;
+		fprintf(file, "sensor %s %d %lld %lld %lld %.17g %.17g %g %lld %d\n",
+			g_sensor_info_iio_ext[soak->sensor_index].id, soak->num_channels,
+			(long long)soak->total.counter, (long long)soak->total.intervals,
+			(long long)soak->total.gaps,
+			soak->total.interval_mean, soak->total.interval_m2, soak->worst_jitter,
+			(long long)soak->worst_delay_p99, soak->violations);
+		write_histogram(file, &soak->total.delay);
+		for (c = 0; c < soak->num_channels; c++)
+			fprintf(file, "channel %.17g %.17g\n", soak->total.channel_mean[c],
+				soak->total.channel_m2[c]);
+	}
+	fprintf(file, "end\n");
+	/* evaluated in order, every check runs until one fails */
+	if (ferror(file) || fflush(file) == EOF || fsync(fileno(file)) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Cannot write %s (%s)\n", path, strerror(errno));
+		fclose(file);
+		unlink(path);
+		return -1;
+	}
+	if (fclose(file) == EOF) {
+		log_msg_and_exit_on_error(ERROR, "Cannot write %s (%s)\n", path, strerror(errno));
+		unlink(path);
+		return -1;
+	}
+	if (rename(path, checkpoint_path) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Cannot rename %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* totals of a soak of the same command which didn't end; 0 if there
+** is nothing to resume, including a checkpoint which doesn't end cleanly
+*/
+static int load_checkpoint(void) {
+	char line[BUFFER_SIZE];
+	char word[MAX_NAME_SIZE];
+	char id[MAX_NAME_SIZE];
+	long long elapsed, counter, sample_intervals, gaps, worst_delay_p99;
+	soak_struct *soak;
+	FILE *file;
+	int version;
+	int corrupted;
+	int c;
+	int s;
+
+	file = fopen(checkpoint_path, "r");
+	if (file == NULL)
+		return 0;
+	if (fscanf(file, "iio_testing_framework soak %d\n", &version) != 1 ||
+		version != SOAK_CHECKPOINT_VERSION || fgets(line, BUFFER_SIZE, file) == NULL ||
+		strncmp(line, "command ", 8)) {
+		log_msg_and_exit_on_error(VERBOSE, "Soak checkpoint %s has an unknown format\n",
+			checkpoint_path);
+		fclose(file);
+		return 0;
+	}
+	line[strcspn(line, "\n")] = '\0';
+	if (strcmp(line + 8, soak_command) || fscanf(file, "elapsed %lld %d\n", &elapsed,
+		&intervals) != 2) {
+		log_msg_and_exit_on_error(VERBOSE, "Soak checkpoint %s is for another soak\n",
+			checkpoint_path);
+		fclose(file);
+		intervals = 0;
+		return 0;
+	}
+
+	restored = (soak_struct*)arena_alloc(&g_test_arena, (g_sensor_info_size + 1) *
+		sizeof(soak_struct));
+	restored_count = 0;
+	corrupted = 0;
+	word[0] = '\0';
+	while (fscanf(file, "%31s", word) == 1 && !strcmp(word, "sensor")) {
+		soak = &restored[restored_count];
+		if (restored_count == g_sensor_info_size ||
+			fscanf(file, "%31s %d %lld %lld %lld %lg %lg %g %lld %d", id,
+			&soak->num_channels, &counter, &sample_intervals, &gaps,
+			&soak->total.interval_mean, &soak->total.interval_m2, &soak->worst_jitter,
+			&worst_delay_p99, &soak->violations) != 10 || soak->num_channels < 0) {
+			corrupted = 1;
+			break;
+		}
+		soak->total.counter = counter;
+		soak->total.intervals = sample_intervals;
+		soak->total.gaps = gaps;
+		soak->worst_delay_p99 = worst_delay_p99;
+		stats_init(&soak->total, soak->num_channels);
+		if (read_histogram(file, &soak->total.delay) == -1) {
+			corrupted = 1;
+			break;
+		}
+		for (c = 0; c < soak->num_channels; c++)
+			if (fscanf(file, " channel %lg %lg", &soak->total.channel_mean[c],
+				&soak->total.channel_m2[c]) != 2)
+				break;
+		if (c < soak->num_channels) {
+			corrupted = 1;
+			break;
+		}
+		soak->sensor_index = -1;
+		for (s = 0; s < g_sensor_info_size; s++)
+			if (!strncmp(g_sensor_info_iio_ext[s].id, id, MAX_NAME_SIZE))
+				soak->sensor_index = s;
+		restored_count++;
+	}
+	fclose(file);
+	/* a partial resume would silently drop the totals of some sensors */
+	if (corrupted || strcmp(word, "end")) {
+		log_msg_and_exit_on_error(ERROR, "Soak checkpoint %s is corrupted, the soak starts "
+			"again\n", checkpoint_path);
+		restored = NULL;
+		restored_count = 0;
+		intervals = 0;
+		return 0;
+	}
+	elapsed_before = elapsed;
+	log_msg_and_exit_on_error(DEBUG, "Resuming soak after %lld s from %s\n",
+		CONVERT_NANO_TO_MILLI(elapsed) / 1000, checkpoint_path);
+	return 1;
+}
+
+/* one JSON line with the metrics of the interval of a sensor */
+static void write_interval(soak_struct *soak, int64_t elapsed, float seconds) {
+	char line[SOAK_LINE_SIZE];
+	const soak_stats_struct *stats;
+	int len;
+	int c;
+
+	stats = &soak->interval;
+	len = snprintf(line, SOAK_LINE_SIZE, "{\"time_ns\":%lld,\"elapsed_s\":%lld,\"sensor\":\"%s\","
+		"\"samples\":%lld,\"rate_hz\":%.6g,\"interval_mean_us\":%.6g,\"jitter_pct\":%.6g,"
+		"\"gaps\":%lld,\"delay_p50_us\":%lld,\"delay_p99_us\":%lld,\"delay_max_us\":%lld,"
+		"\"std\":[", (long long)get_timestamp_realtime(),
+		(long long)CONVERT_NANO_TO_MILLI(elapsed) / 1000,
+		g_sensor_info_iio_ext[soak->sensor_index].id, (long long)stats->counter,
+		seconds > 0 ? stats->counter / seconds : 0, stats->interval_mean / 1000,
+		stats_jitter(stats), (long long)stats->gaps,
+		(long long)CONVERT_NANO_TO_MICRO(histogram_percentile(&stats->delay, 50)),
+		(long long)CONVERT_NANO_TO_MICRO(histogram_percentile(&stats->delay, 99)),
+		(long long)CONVERT_NANO_TO_MICRO(stats->delay.max));
+	for (c = 0; c < soak->num_channels && len < SOAK_LINE_SIZE - 32; c++)
+		len += snprintf(line + len, SOAK_LINE_SIZE - len, "%s%.6g", c ? "," : "",
+			stats->counter > 1 ? sqrt(stats->channel_m2[c] / (stats->counter - 1)) : 0);
+	len += snprintf(line + len, SOAK_LINE_SIZE - len, "]}\n");
+	if (len >= SOAK_LINE_SIZE)
+		len = SOAK_LINE_SIZE - 1;
+
+	log_msg_and_exit_on_error(VERBOSE, "%s", line);
+	if (metrics_fd == -1)
+		return;
+	if (write(metrics_fd, line, len) != len)
+		log_msg_and_exit_on_error(ERROR, "Can't write soak metrics: %s\n", strerror(errno));
+}
+
+/* at the end of an interval, or when forced, write the metrics of every
+** sensor and the checkpoint, then start the next interval
+*/
+void soak_check_interval(run_context_struct *run_context, int force) {
+	soak_struct *soak;
+	int64_t now;
+	int64_t p99;
+	int max_delay;
+	float seconds;
+	float jitter;
+	int i;
+
+	now = get_timestamp_monotonic();
+	if (!force && now < interval_end)
+		return;
+	seconds = (float)(now - (interval_end - CONVERT_SEC_TO_NANO((int64_t)SOAK_INTERVAL_SECS))) /
+		CONVERT_SEC_TO_NANO(1);
+
+	for (i = 0; i < run_context->sensors_count; i++) {
+		soak = (soak_struct*)run_context->sensors[i].values;
+		if (soak == NULL)
+			continue;
+		write_interval(soak, elapsed_before + now - soak_start, seconds);
+
+		if (soak->interval.counter == 0) {
+			/* the last interval of the soak may be too short for a sample */
+			if (force && (soak->period == 0 ||
+				seconds * CONVERT_SEC_TO_NANO(1) < SOAK_GAP_PERIODS * soak->period))
+				continue;
+			/* a sensor which stopped streaming mid-soak */
+			log_msg_and_exit_on_error(ERROR, "No data received from %s during %.0f s\n",
+				g_sensor_info_iio_ext[soak->sensor_index].id, seconds);
+			set_test_state(FAILED);
+			soak->violations++;
+			continue;
+		}
+		jitter = stats_jitter(&soak->interval);
+		if (jitter > soak->worst_jitter)
+			soak->worst_jitter = jitter;
+		p99 = histogram_percentile(&soak->interval.delay, 99);
+		if (p99 > soak->worst_delay_p99)
+			soak->worst_delay_p99 = p99;
+		max_delay = run_context->sensors[i].time_attributes->max_delay;
+		if (max_delay > 0 && p99 > CONVERT_MILLI_TO_NANO((int64_t)max_delay)) {
+			trace_violation(soak->sensor_index, "soak_delay_p99", CONVERT_NANO_TO_MICRO(p99),
+				max_delay * 1000);
+			log_msg_and_exit_on_error(ERROR, "Device %s exceed max delay = %d ms after %lld s "
+				"of soak, having %lld us\n", g_sensor_info_iio_ext[soak->sensor_index].id,
+				max_delay, CONVERT_NANO_TO_MILLI(elapsed_before + now - soak_start) / 1000,
+				CONVERT_NANO_TO_MICRO(p99));
+			set_test_state(FAILED);
+			soak->violations++;
+		}
+		stats_reset(&soak->interval, soak->num_channels);
+	}
+	if (metrics_fd != -1)
+		fsync(metrics_fd);
+	intervals++;
+	write_checkpoint(run_context, elapsed_before + now - soak_start);
+	interval_end = now + CONVERT_SEC_TO_NANO((int64_t)SOAK_INTERVAL_SECS);
+}
+
+/* metrics of the whole soak; once for the run, from the first sensor
+** which streamed
+*/
+int soak_report(run_context_struct *run_context) {
+	soak_struct *soak;
+	float seconds;
+	float jitter;
+	int error;
+	int i;
+
+	soak_check_interval(run_context, 1);
+	seconds = (float)CONVERT_NANO_TO_MILLI(elapsed_before + get_timestamp_monotonic() -
+		soak_start) / 1000;
+	record_metric(-1, "soak_duration", seconds, NAN, "s");
+	record_metric(-1, "soak_intervals", intervals, NAN, NULL);
+
+	error = 0;
+	for (i = 0; i < run_context->sensors_count; i++) {
+		soak = (soak_struct*)run_context->sensors[i].values;
+		if (soak == NULL)
+			continue;
+		jitter = stats_jitter(&soak->total);
+		log_msg_and_exit_on_error(DEBUG, "Device %s streamed %lld samples in %.0f s, jitter %f %%, "
+			"%lld gaps, worst interval jitter %f %%\n", g_sensor_info_iio_ext[soak->sensor_index].id,
+			soak->total.counter, seconds, jitter, soak->total.gaps, soak->worst_jitter);
+		histogram_print(&soak->total.delay, g_sensor_info_iio_ext[soak->sensor_index].id,
+			"soak delay");
+		record_metric(soak->sensor_index, "soak_samples", soak->total.counter, NAN, NULL);
+		record_metric(soak->sensor_index, "soak_rate", seconds > 0 ?
+			soak->total.counter / seconds : 0, NAN, "Hz");
+		record_metric(soak->sensor_index, "soak_jitter", jitter, MAX_JITTER, "%");
+		record_metric(soak->sensor_index, "soak_worst_interval_jitter", soak->worst_jitter,
+			NAN, "%");
+		record_metric(soak->sensor_index, "soak_worst_interval_delay_p99",
+			CONVERT_NANO_TO_MICRO(soak->worst_delay_p99), NAN, "us");
+		record_metric(soak->sensor_index, "soak_gaps", soak->total.gaps, NAN, NULL);
+		record_metric(soak->sensor_index, "soak_violations", soak->violations, 0, NULL);
+		record_histogram(soak->sensor_index, "soak_delay", &soak->total.delay);
+
+		if (jitter > MAX_JITTER) {
+			trace_violation(soak->sensor_index, "soak_jitter", jitter, MAX_JITTER);
+			log_msg_and_exit_on_error(ERROR, "Jitter measured for device %s over the soak = %f "
+				"is bigger than standard jitter = %d\n",
+				g_sensor_info_iio_ext[soak->sensor_index].id, jitter, MAX_JITTER);
+			error = 1;
+		}
+		if (soak->violations)
+			error = 1;
+	}
+
+	/* the soak ended, the next one starts over */
+	if (checkpoint_path[0] && unlink(checkpoint_path) == -1 && errno != ENOENT)
+		log_msg_and_exit_on_error(ERROR, "Cannot remove %s (%s)\n", checkpoint_path,
+			strerror(errno));
+	if (error) {
+		set_test_state(FAILED);
+		return -1;
+	}
+	return 0;
+}
+
+/* stream the sensors of cmd for duration seconds in all, resuming an
+** unfinished soak of the same command
+*/
+int soak(const char *cmd, int duration) {
+	char path[PATH_MAX];
+	const char *results_dir;
+	int remaining;
+	int flags;
+
+	soak_command = cmd;
+	elapsed_before = 0;
+	intervals = 0;
+	restored = NULL;
+	restored_count = 0;
+	checkpoint_path[0] = '\0';
+	flags = O_CREAT|O_WRONLY|O_APPEND;
+
+	results_dir = get_results_dir();
+	if (results_dir == NULL) {
+		log_msg_and_exit_on_error(DEBUG, "No results path, soak metrics are only logged\n");
+	}
+	else {
+		if (snprintf(checkpoint_path, PATH_MAX, "%s%s", results_dir, SOAK_CHECKPOINT) >= PATH_MAX ||
+			snprintf(path, PATH_MAX, "%s%s", results_dir, SOAK_METRICS_JSONL) >= PATH_MAX) {
+			log_msg_and_exit_on_error(ERROR, "Results path %s is too long for the soak files\n",
+				results_dir);
+			checkpoint_path[0] = '\0';
+			path[0] = '\0';
+		}
+		/* metrics of an unfinished soak are kept */
+		else if (!load_checkpoint())
+			flags |= O_TRUNC;
+		if (path[0])
+			metrics_fd = open(path, flags, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+		if (path[0] && metrics_fd == -1)
+			log_msg_and_exit_on_error(ERROR, "Cannot open %s (%s)\n", path, strerror(errno));
+	}
+
+	remaining = duration - (int)(CONVERT_NANO_TO_MILLI(elapsed_before) / 1000);
+	if (remaining < 1)
+		remaining = 1;
+	soak_start = get_timestamp_monotonic();
+	interval_end = soak_start + CONVERT_SEC_TO_NANO((int64_t)SOAK_INTERVAL_SECS);
+	poll_sensors(soak_initialize, soak_wrapper, remaining);
+
+	if (metrics_fd != -1)
+		close(metrics_fd);
+	metrics_fd = -1;
+	restored = NULL;
+	restored_count = 0;
+	return 0;
+}
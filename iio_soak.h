@@ -0,0 +1,25 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_SOAK_H__
+#define __IIO_SOAK_H__
+
+soak_struct* new_soak_sensor(int sensor_index);
+void soak_add_sample(int sensor_index, soak_struct *soak);
+void soak_check_interval(run_context_struct *run_context, int force);
+int soak_report(run_context_struct *run_context);
+int soak(const char *cmd, int duration);
+#endif
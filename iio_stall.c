@@ -0,0 +1,201 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "iio_stall.h"
+#include "iio_arena.h"
+#include "iio_results.h"
+#include "iio_trace.h"
+#include "iio_utils.h"
+
+/*
+** Stall detection. Every sensor watched by poll_sensors has a timerfd in
+** the same epoll set, armed for a few periods of the sensor and armed
+** again after each sample. When it fires the sensor stalls: this is
+** logged right away, and when samples come back the gap is logged with
+** its start and length, taken from the timestamps of the samples around
+** it. Stalls are counted per test in the results record; they don't fail
+** a test by themselves, the checks of the test do.
+*/
+
+/* wall clock time of a timestamp, ex: 14:03:12.345 */
+static void format_time(int64_t timestamp, char *buffer) {
+	struct tm timeinfo;
+	time_t seconds;
+
+	seconds = timestamp / CONVERT_SEC_TO_NANO(1);
+	localtime_r(&seconds, &timeinfo);
+	snprintf(buffer, TIME_SIZE, "%02d:%02d:%02d.%03lld", timeinfo.tm_hour, timeinfo.tm_min,
+		timeinfo.tm_sec, (long long)CONVERT_NANO_TO_MILLI(timestamp % CONVERT_SEC_TO_NANO(1)));
+}
+
+static int arm_timer(stall_struct *stall, int64_t deadline) {
+	struct itimerspec timer;
+
+	memset(&timer, 0, sizeof(struct itimerspec));
+	timer.it_value.tv_sec = deadline / CONVERT_SEC_TO_NANO(1);
+	timer.it_value.tv_nsec = deadline % CONVERT_SEC_TO_NANO(1);
+	return timerfd_settime(stall->timer_fd, 0, &timer, NULL);
+}
+
+/* STALL_PERIODS periods at rate, at least STALL_MIN_MILLISECS */
+static int64_t get_deadline(float rate) {
+	int64_t deadline;
+
+	deadline = (int64_t)(STALL_PERIODS * (CONVERT_SEC_TO_NANO(1) / rate));
+	if (deadline < CONVERT_MILLI_TO_NANO((int64_t)STALL_MIN_MILLISECS))
+		deadline = CONVERT_MILLI_TO_NANO((int64_t)STALL_MIN_MILLISECS);
+	return deadline;
+}
+
+/* add a deadline timer for a sensor whose fd was just watched; without
+** a rate or a timer the sensor isn't checked
+*/
+int watch_stall(run_sensor_struct *run_sensor) {
+	struct epoll_event ev;
+	run_sensor_struct *stall_watcher;
+	stall_struct *stall;
+	float rate;
+
+	rate = g_sensor_info_iio_ext[run_sensor->sensor_index].data_rate;
+	if (rate <= 0)
+		return 0;
+
+	stall = (stall_struct*)arena_alloc(&g_test_arena, sizeof(stall_struct));
+	stall->deadline = get_deadline(rate);
+	stall->last_timestamp = get_timestamp_realtime();
+	stall->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (stall->timer_fd == -1) {
+		log_msg_and_exit_on_error(DEBUG, "No stall detection for %s: %s\n",
+			g_sensor_info_iio_ext[run_sensor->sensor_index].id, strerror(errno));
+		return 0;
+	}
+
+	/* the copy in the epoll set tells the timer from the device fd */
+	stall_watcher = (run_sensor_struct*)arena_alloc(&g_test_arena, sizeof(run_sensor_struct));
+	memcpy(stall_watcher, run_sensor, sizeof(run_sensor_struct));
+	stall_watcher->mode = MODE_STALL;
+	stall_watcher->stall = stall;
+
+	ev.data.ptr = stall_watcher;
+	ev.events = EPOLLIN;
+	if (arm_timer(stall, stall->deadline +
+		CONVERT_MILLI_TO_NANO((int64_t)STALL_FIRST_SAMPLE_MILLISECS)) == -1 ||
+		epoll_ctl(run_sensor->context->epfd, EPOLL_CTL_ADD, stall->timer_fd, &ev) == -1) {
+		log_msg_and_exit_on_error(DEBUG, "No stall detection for %s: %s\n",
+			g_sensor_info_iio_ext[run_sensor->sensor_index].id, strerror(errno));
+		close(stall->timer_fd);
+		return 0;
+	}
+	run_sensor->stall = stall;
+	return 0;
+}
+
+/* a sample was read: end a stall and move the deadline, from the
+** current rate since a test may switch it while streaming
+*/
+void stall_rearm(run_sensor_struct *run_sensor) {
+	char start[TIME_SIZE];
+	stall_struct *stall;
+	int64_t timestamp;
+	int64_t gap;
+	float rate;
+
+	stall = run_sensor->stall;
+	timestamp = g_sensor_info_iio_ext[run_sensor->sensor_index].last_timestamp;
+	/* no new sample */
+	if (timestamp == stall->last_timestamp)
+		return;
+	if (timestamp <= 0)
+		timestamp = get_timestamp_realtime();
+
+	if (stall->stalled) {
+		gap = timestamp - stall->last_timestamp;
+		stall->stalled = 0;
+		stall->count++;
+		stall->total += gap;
+		if (gap > stall->longest)
+			stall->longest = gap;
+		format_time(stall->last_timestamp, start);
+		trace_violation(run_sensor->sensor_index, "stall", CONVERT_NANO_TO_MILLI(gap),
+			CONVERT_NANO_TO_MILLI(stall->deadline));
+		log_msg_and_exit_on_error(ERROR, "Device %s stalled for %lld ms from %s\n",
+			g_sensor_info_iio_ext[run_sensor->sensor_index].id, CONVERT_NANO_TO_MILLI(gap),
+			start);
+	}
+	stall->last_timestamp = timestamp;
+	rate = g_sensor_info_iio_ext[run_sensor->sensor_index].data_rate;
+	if (rate > 0)
+		stall->deadline = get_deadline(rate);
+	arm_timer(stall, stall->deadline);
+}
+
+/* the deadline passed without a sample */
+void stall_expired(run_sensor_struct *stall_watcher) {
+	char start[TIME_SIZE];
+	stall_struct *stall;
+	uint64_t expirations;
+
+	stall = stall_watcher->stall;
+	if (read(stall->timer_fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t) ||
+		stall->stalled)
+		return;
+	stall->stalled = 1;
+	format_time(stall->last_timestamp, start);
+	trace_marker("stall %s since %lld", g_sensor_info_iio_ext[stall_watcher->sensor_index].id,
+		stall->last_timestamp);
+	log_msg_and_exit_on_error(ERROR, "Device %s has no sample since %s (%lld ms)\n",
+		g_sensor_info_iio_ext[stall_watcher->sensor_index].id, start,
+		CONVERT_NANO_TO_MILLI(get_timestamp_realtime() - stall->last_timestamp));
+}
+
+/* stalls of the test, a stall lasting at the end counts up to now */
+void stall_report(run_sensor_struct *run_sensor) {
+	stall_struct *stall;
+	int64_t gap;
+
+	stall = run_sensor->stall;
+	if (stall->stalled) {
+		gap = get_timestamp_realtime() - stall->last_timestamp;
+		stall->count++;
+		stall->total += gap;
+		if (gap > stall->longest)
+			stall->longest = gap;
+		log_msg_and_exit_on_error(ERROR, "Device %s was still stalled after %lld ms\n",
+			g_sensor_info_iio_ext[run_sensor->sensor_index].id, CONVERT_NANO_TO_MILLI(gap));
+	}
+	close(stall->timer_fd);
+	run_sensor->stall = NULL;
+
+	record_metric(run_sensor->sensor_index, "stalls", stall->count, NAN, NULL);
+	if (stall->count == 0)
+		return;
+	log_msg_and_exit_on_error(DEBUG, "Device %s stalled %d times, longest %lld ms, "
+		"%lld ms in all\n", g_sensor_info_iio_ext[run_sensor->sensor_index].id, stall->count,
+		CONVERT_NANO_TO_MILLI(stall->longest), CONVERT_NANO_TO_MILLI(stall->total));
+	record_metric(run_sensor->sensor_index, "stall_longest", CONVERT_NANO_TO_MILLI(stall->longest),
+		NAN, "ms");
+	record_metric(run_sensor->sensor_index, "stall_total", CONVERT_NANO_TO_MILLI(stall->total),
+		NAN, "ms");
+}
@@ -0,0 +1,227 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "iio_sync.h"
+#include "iio_histogram.h"
+#include "iio_results.h"
+#include "iio_trace.h"
+#include "iio_utils.h"
+
+/*
+** Timestamp alignment between sensors streamed together. Every sensor
+** is compared with the first one of the command: each sample of the
+** slower sensor of the pair is matched with the nearest sample of the
+** faster one by a single merge of the two timestamp arrays. Skew is the
+** timestamp of the other sensor minus the one of the first sensor.
+**
+** Nearest matching wraps the skew within half a period of the faster
+** sensor; it is unwrapped before fitting a line over time, whose slope
+** is the drift of one sensor's timestamps against the other's.
+*/
+
+/* least squares slope of unwrapped skew over time */
+typedef struct {
+	int64_t count;
+	double sum_t;
+	double sum_s;
+	double sum_tt;
+	double sum_ts;
+} drift_fit_t;
+
+static void drift_fit_add(drift_fit_t *fit, double t, double skew) {
+	fit->count++;
+	fit->sum_t += t;
+	fit->sum_s += skew;
+	fit->sum_tt += t * t;
+	fit->sum_ts += t * skew;
+}
+
+static double drift_fit_slope(const drift_fit_t *fit) {
+	double denominator;
+
+	denominator = fit->count * fit->sum_tt - fit->sum_t * fit->sum_t;
+	if (fit->count < 2 || denominator == 0)
+		return 0;
+	return (fit->count * fit->sum_ts - fit->sum_t * fit->sum_s) / denominator;
+}
+
+static int share_trigger(int sensor_a, int sensor_b, const sync_struct *a, const sync_struct *b) {
+	if (g_sensor_info_iio_ext[sensor_a].dev_num == g_sensor_info_iio_ext[sensor_b].dev_num)
+		return 1;
+	return a->trigger[0] != '\0' && strcmp(a->trigger, b->trigger) == 0;
+}
+
+/* compare other with the reference sensor */
+static int sync_pair(run_sensor_struct *reference, run_sensor_struct *other) {
+	const sync_struct *ref_sync;
+	const sync_struct *other_sync;
+	const sync_struct *slow;
+	const sync_struct *fast;
+	histogram_struct skews;
+	drift_fit_t fit;
+	char name[BUFFER_SIZE];
+	int64_t fast_period;
+	int64_t nearest;
+	int64_t skew;
+	int64_t previous;
+	int64_t unwrap;
+	int64_t skew_sum;
+	int64_t p99;
+	int sign;
+	int max_delay;
+	int i;
+	int j;
+
+	ref_sync = (sync_struct*)reference->values;
+	other_sync = (sync_struct*)other->values;
+	if (other_sync->counter < 2) {
+		log_msg_and_exit_on_error(ERROR, "No data received from %s\n",
+			g_sensor_info_iio_ext[other->sensor_index].id);
+		set_test_state(FAILED);
+		return -1;
+	}
+
+	/* match every sample of the slower sensor */
+	if ((ref_sync->timestamp_values[ref_sync->counter - 1] - ref_sync->timestamp_values[0]) /
+		(ref_sync->counter - 1) >=
+		(other_sync->timestamp_values[other_sync->counter - 1] - other_sync->timestamp_values[0]) /
+		(other_sync->counter - 1)) {
+		slow = ref_sync;
+		fast = other_sync;
+		sign = 1;
+	}
+	else {
+		slow = other_sync;
+		fast = ref_sync;
+		sign = -1;
+	}
+	fast_period = (fast->timestamp_values[fast->counter - 1] - fast->timestamp_values[0]) /
+		(fast->counter - 1);
+
+	histogram_reset(&skews);
+	memset(&fit, 0, sizeof(drift_fit_t));
+	skew_sum = 0;
+	previous = 0;
+	unwrap = 0;
+	j = 0;
+	for (i = 0; i < slow->counter; i++) {
+		while (j + 1 < fast->counter && fast->timestamp_values[j + 1] <= slow->timestamp_values[i])
+			j++;
+		nearest = fast->timestamp_values[j];
+		if (j + 1 < fast->counter && fast->timestamp_values[j + 1] - slow->timestamp_values[i] <
+			slow->timestamp_values[i] - nearest)
+			nearest = fast->timestamp_values[j + 1];
+		/* outside of the other stream */
+		if (llabs(nearest - slow->timestamp_values[i]) > fast_period)
+			continue;
+
+		skew = sign * (nearest - slow->timestamp_values[i]);
+		histogram_add(&skews, llabs(skew));
+		if (skews.counter > 1) {
+			if (skew - previous > fast_period / 2)
+				unwrap -= fast_period;
+			else if (previous - skew > fast_period / 2)
+				unwrap += fast_period;
+		}
+		previous = skew;
+		skew_sum += skew;
+		drift_fit_add(&fit, (double)(slow->timestamp_values[i] - slow->timestamp_values[0]) /
+			CONVERT_SEC_TO_NANO(1), (double)(skew + unwrap) / 1000);
+	}
+	if (skews.counter == 0) {
+		log_msg_and_exit_on_error(ERROR, "Devices %s and %s didn't stream at the same time\n",
+			g_sensor_info_iio_ext[reference->sensor_index].id,
+			g_sensor_info_iio_ext[other->sensor_index].id);
+		set_test_state(FAILED);
+		return -1;
+	}
+
+	snprintf(name, BUFFER_SIZE, "skew to %s", g_sensor_info_iio_ext[reference->sensor_index].id);
+	histogram_print(&skews, g_sensor_info_iio_ext[other->sensor_index].id, name);
+	log_msg_and_exit_on_error(DEBUG, "Device %s has mean skew %lld us and drift %f us/s to %s\n",
+		g_sensor_info_iio_ext[other->sensor_index].id,
+		CONVERT_NANO_TO_MICRO(skew_sum / skews.counter), drift_fit_slope(&fit),
+		g_sensor_info_iio_ext[reference->sensor_index].id);
+	record_histogram(other->sensor_index, "skew", &skews);
+	record_metric(other->sensor_index, "skew_mean",
+		CONVERT_NANO_TO_MICRO((double)skew_sum / skews.counter), NAN, "us");
+	record_metric(other->sensor_index, "skew_drift", drift_fit_slope(&fit), NAN, "us/s");
+
+	p99 = histogram_percentile(&skews, 99);
+	if (share_trigger(reference->sensor_index, other->sensor_index, ref_sync, other_sync)) {
+		if (p99 > SYNC_SHARED_TRIGGER_TOLERANCE_US * 1000LL) {
+			trace_violation(other->sensor_index, "skew_p99", CONVERT_NANO_TO_MICRO(p99),
+				SYNC_SHARED_TRIGGER_TOLERANCE_US);
+			log_msg_and_exit_on_error(ERROR, "Devices %s and %s share a trigger but their "
+				"timestamps differ by %lld us\n", g_sensor_info_iio_ext[reference->sensor_index].id,
+				g_sensor_info_iio_ext[other->sensor_index].id, CONVERT_NANO_TO_MICRO(p99));
+			set_test_state(FAILED);
+			return -1;
+		}
+		return 0;
+	}
+
+	max_delay = other->time_attributes->max_delay;
+	if (max_delay > 0 && p99 > CONVERT_MILLI_TO_NANO((int64_t)max_delay)) {
+		trace_violation(other->sensor_index, "skew_p99", CONVERT_NANO_TO_MICRO(p99),
+			max_delay * 1000);
+		log_msg_and_exit_on_error(ERROR, "Device %s exceed max skew = %d ms to %s, having %lld us\n",
+			g_sensor_info_iio_ext[other->sensor_index].id, max_delay,
+			g_sensor_info_iio_ext[reference->sensor_index].id, CONVERT_NANO_TO_MICRO(p99));
+		set_test_state(FAILED);
+		return -1;
+	}
+	return 0;
+}
+
+/* compare every sensor of the run which streamed with the first one */
+int sync_report(run_context_struct *run_context) {
+	run_sensor_struct *reference;
+	int compared;
+	int error;
+	int i;
+
+	reference = NULL;
+	compared = 0;
+	error = 0;
+	for (i = 0; i < run_context->sensors_count; i++) {
+		if (run_context->sensors[i].values == NULL)
+			continue;
+		if (reference == NULL) {
+			reference = &run_context->sensors[i];
+			if (((sync_struct*)reference->values)->counter < 2) {
+				log_msg_and_exit_on_error(ERROR, "No data received from %s\n",
+					g_sensor_info_iio_ext[reference->sensor_index].id);
+				set_test_state(FAILED);
+				return -1;
+			}
+			continue;
+		}
+		if (sync_pair(reference, &run_context->sensors[i]) == -1)
+			error = 1;
+		compared++;
+	}
+	if (compared == 0) {
+		log_msg_and_exit_on_error(ERROR, "check_sync needs at least two sensors streaming!\n");
+		set_test_state(FAILED);
+		return -1;
+	}
+	return error ? -1 : 0;
+}
@@ -31,11 +31,18 @@
 #include <stdarg.h>
 #include <dirent.h>
 #include <pthread.h>
-#include "cutils/hashmap.h"
 #include "iio_parser.h"
 #include "iio_utils.h"
 #include "iio_sample_format.h"
 #include "iio_enumeration.h"
+#include "iio_cache.h"
+#include "iio_server.h"
+#include "iio_arena.h"
+#include "iio_results.h"
+#include "iio_trace.h"
+#include "iio_perf.h"
+#include "iio_fusion.h"
+#include "iio_set_trigger.h"
 
 int current_fd;
 int nr_test;
@@ -43,26 +50,117 @@ level log_level;
 
 int main(int argc, char *argv[]) {
 	int sensor_index, dev_num, counter, max_delay, duration, msg_fd;
+	int opt, use_cache, server, ret, trace, perf;
 	float freq;
 	char sysfs_path[PATH_MAX];
 	char buffer[BUFFER_SIZE];
+	char *suite_path, *results_path, *cmd, *socket_path;
 
 	nr_test = 0;
-	log_level = atoi(argv[2]);
-	sprintf(sysfs_path, "%s%s", argv[6], TESTS_MSG);
-
-	msg_fd = open(sysfs_path, O_CREAT|O_WRONLY|O_TRUNC, S_IWOTH);
-	if (msg_fd == -1) {
-		printf("Cannot open %s (%s)\n", sysfs_path, strerror(errno));
+	use_cache = 1;
+	server = 0;
+	trace = 0;
+	perf = 0;
+	socket_path = SERVER_SOCKET_PATH;
+	suite_path = NULL;
+	results_path = NULL;
+	cmd = NULL;
+	while ((opt = getopt(argc, argv, "l:s:p:c:ndu:jtTP")) != -1) {
+		switch (opt) {
+			case 'l':
+				log_level = atoi(optarg);
+				break;
+			case 's':
+				suite_path = optarg;
+				break;
+			case 'p':
+				results_path = optarg;
+				break;
+			case 'c':
+				cmd = optarg;
+				break;
+			/* enumerate again even if cached sensors are still valid */
+			case 'n':
+				use_cache = 0;
+				break;
+			/* serve commands over a local socket until shutdown */
+			case 'd':
+				server = 1;
+				break;
+			case 'u':
+				socket_path = optarg;
+				break;
+			/* JUnit XML summary next to the other results */
+			case 'j':
+				g_write_junit = 1;
+				break;
+			/* markers in ftrace, -T also keeps the trace of failing tests */
+			case 't':
+				trace = TRACE_MARKERS;
+				break;
+			case 'T':
+				trace = TRACE_SNAPSHOTS;
+				break;
+			/* perf counters of the acquisition thread */
+			case 'P':
+				perf = 1;
+				break;
+			default:
+				printf(USAGE, argv[0], argv[0]);
+				exit(-1);
+		}
+	}
+	if (!server && (results_path == NULL || (suite_path == NULL && cmd == NULL))) {
+		printf(USAGE, argv[0], argv[0]);
 		exit(-1);
 	}
 
+	/* server messages go to stdout unless a results path is given */
+	msg_fd = STDOUT_FILENO;
+	if (results_path != NULL) {
+		sprintf(sysfs_path, "%s%s", results_path, TESTS_MSG);
+
+		msg_fd = open(sysfs_path, O_CREAT|O_WRONLY|O_TRUNC, S_IWOTH);
+		if (msg_fd == -1) {
+			printf("Cannot open %s (%s)\n", sysfs_path, strerror(errno));
+			exit(-1);
+		}
+	}
+
 	current_fd = msg_fd;
+	if (results_path != NULL)
+		open_results_file(results_path);
+	if (trace)
+		open_trace(trace);
+	if (perf)
+		open_perf_counters();
 
-	enumerate_sensors();
-	set_sample_format();
-	if (argc == 7) 
-		return read_tests(argv[4], argv[6]);
+	own_cached_hrtimers(SENSORS_CACHE_PATH);
+	if (!use_cache || load_sensors_cache(SENSORS_CACHE_PATH) == -1) {
+		enumerate_sensors();
+		set_sample_format();
+		save_sensors_cache(SENSORS_CACHE_PATH);
+	}
+	else
+		restore_hrtimer_triggers();
+	add_fused_sensors();
+	if (server) {
+		ret = run_server(socket_path);
+		release_hrtimer_triggers(save_sensors_cache(SENSORS_CACHE_PATH) == 0);
+		close_results_file();
+		close_trace();
+		close_perf_counters();
+		return ret;
+	}
+	if (cmd == NULL) {
+		ret = read_tests(suite_path, results_path);
+		/* keep the hrtimers for the next run */
+		release_hrtimer_triggers(save_sensors_cache(SENSORS_CACHE_PATH) == 0);
+		close_results_file();
+		close_trace();
+		close_perf_counters();
+		return ret;
+	}
 
 	/* single test from cmd line */
 	else {
@@ -71,8 +169,18 @@ int main(int argc, char *argv[]) {
 			log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
 			exit(-1);
 		}
+		/* parse_cmd moves through cmd, keep it for the results */
+		snprintf(buffer, BUFFER_SIZE, "%s", cmd);
+		memset(&tests[nr_test], 0, sizeof(test_info_t));
+		tests[nr_test].description = buffer;
+		tests[nr_test].log_fd = -1;
 		tests[nr_test].state = PASSED;
-		parse_cmd(argv[8]);
+		begin_test_record();
+		parse_cmd(cmd);
+		end_test_record(nr_test, buffer);
+		arena_release(&g_test_arena);
+		if (g_write_junit)
+			write_junit_results(results_path, 1);
 		if (tests[nr_test].state == PASSED) {
 			log_msg_and_exit_on_error(NOTHING, "Test has passed!\n");
 		}
@@ -83,6 +191,10 @@ int main(int argc, char *argv[]) {
 			log_msg_and_exit_on_error(NOTHING, "Test was skipped!\n");
   
 	}
+	release_hrtimer_triggers(save_sensors_cache(SENSORS_CACHE_PATH) == 0);
+	close_results_file();
+	close_trace();
+	close_perf_counters();
 	free(tests);
 	return 0;
 }
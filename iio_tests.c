@@ -31,18 +31,30 @@
 #include <stdarg.h>
 #include <dirent.h>
 #include <pthread.h>
-#include "cutils/hashmap.h"
 #include "iio_tests.h"
 #include "iio_control.h"
 #include "iio_control_frequency.h"
 #include "iio_utils.h"
-
-Hashmap *map_fd_to_sensor_index;
-static int epfd;
-static pthread_t threads[MAX_SENSORS];
+#include "iio_arena.h"
+#include "iio_parser.h"
+#include "iio_results.h"
+#include "iio_profile.h"
+#include "iio_trace.h"
+#include "iio_perf.h"
+#include "iio_allan_variance.h"
+#include "iio_noise_spectrum.h"
+#include "iio_sync.h"
+#include "iio_fusion.h"
+#include "iio_events.h"
+#include "iio_histogram.h"
+#include "iio_trigger_accuracy.h"
+#include "iio_fanout.h"
+#include "iio_soak.h"
+#include "iio_stall.h"
+#include "iio_early_stop.h"
 
 /* collect and compute data necessary to measure frequency for each sensor */ 
-int measure_freq_wrapper(int sensor_index, void* timestamp_info_param, int stage) {
+int measure_freq_wrapper(int sensor_index, void* run_sensor_param, int stage) {
 	int64_t last_timestamp;
 	int64_t new_timestamp;
 	int64_t delay;    
@@ -53,7 +65,9 @@ int measure_freq_wrapper(int sensor_index, void* timestamp_info_param, int stage
 	buf_size = g_sensor_info_iio_ext[sensor_index].sample_size;
 	char buf[buf_size];
 	timestamp_info_struct *timestamp_info;
+	run_sensor_struct *run_sensor;
 	
+	run_sensor = (run_sensor_struct*)run_sensor_param;
 	memset(buf, '\0', buf_size);
 	
 	/* collect data from sensors */
@@ -62,45 +76,53 @@ int measure_freq_wrapper(int sensor_index, void* timestamp_info_param, int stage
 		new_timestamp = get_timestamp_realtime();
 		g_sensor_info_iio_ext[sensor_index].last_timestamp = new_timestamp;
 
-		if (sysfs_read_from_fd(g_sensor_info_iio_ext[sensor_index].read_fd, buf, buf_size) == -1) {
+		if (sysfs_read_from_fd(run_sensor->fd, buf, buf_size) == -1) {
 			log_msg_and_exit_on_error(ERROR, "Can't read samples from %s \n",
-				g_sensor_info_iio_ext[sensor_index].tag); 
+				g_sensor_info_iio_ext[sensor_index].id); 
 			set_test_state(FAILED);
 			return -1;
 		}
+		trace_marker("read %s", g_sensor_info_iio_ext[sensor_index].id);
 		/* don't compute any difference for first value */
 		if (last_timestamp != -1) {
-			timestamp_info = (timestamp_info_struct*)timestamp_info_param;
+			timestamp_info = (timestamp_info_struct*)run_sensor->values;
 			timestamp_info->all_consec_timestamps_diff += (new_timestamp - last_timestamp);
 			timestamp_info->counter ++;
+			/* rate within 10% of the set rate, as interval */
+			set_rate = g_sensor_info_iio_ext[sensor_index].data_rate;
+			early_stop_add(run_sensor, new_timestamp - last_timestamp);
+			early_stop_mean(run_sensor, CONVERT_SEC_TO_NANO(1) / (1.1 * set_rate),
+				CONVERT_SEC_TO_NANO(1) / (0.9 * set_rate));
 			
 			log_msg_and_exit_on_error(VERBOSE, "Device %s  has system last timestamp %lld ns\n",
-				g_sensor_info_iio_ext[sensor_index].tag, last_timestamp);
+				g_sensor_info_iio_ext[sensor_index].id, last_timestamp);
 			log_msg_and_exit_on_error(VERBOSE, "Device %s  has system new timestamp  %lld ns\n",
-				g_sensor_info_iio_ext[sensor_index].tag, new_timestamp);        
+				g_sensor_info_iio_ext[sensor_index].id, new_timestamp);        
 			log_msg_and_exit_on_error(VERBOSE, "Device %s  has difference between system timestamps %lld ns\n",
-				g_sensor_info_iio_ext[sensor_index].tag, 
+				g_sensor_info_iio_ext[sensor_index].id, 
 				new_timestamp - last_timestamp);
 		}
 	}
 	/* compute collected data */
 	else{
-		timestamp_info = (timestamp_info_struct*)timestamp_info_param;
+		timestamp_info = (timestamp_info_struct*)run_sensor->values;
 		nr = timestamp_info->counter;
 		delay = timestamp_info->all_consec_timestamps_diff; 
-		free(timestamp_info);  
+		record_metric(sensor_index, "samples", nr, NAN, NULL);
 		if (nr == 0) {
-			log_msg_and_exit_on_error(ERROR, "No data received from %s\n", g_sensor_info_iio_ext[sensor_index].tag);
+			log_msg_and_exit_on_error(ERROR, "No data received from %s\n", g_sensor_info_iio_ext[sensor_index].id);
 			set_test_state(FAILED);
 			return -1;
 		}
 
-		log_msg_and_exit_on_error(DEBUG, "Device %s  has frequency %f\n", g_sensor_info_iio_ext[sensor_index].tag, 
+		log_msg_and_exit_on_error(DEBUG, "Device %s  has frequency %f\n", g_sensor_info_iio_ext[sensor_index].id, 
 			g_sensor_info_iio_ext[sensor_index].data_rate);
 		
 		delay /= nr;
 		measured_rate = (CONVERT_SEC_TO_NANO(1)/delay);
 		set_rate = g_sensor_info_iio_ext[sensor_index].data_rate;
+		record_metric(sensor_index, "measured_rate", measured_rate, NAN, "Hz");
+		record_metric(sensor_index, "rate_error", fabs(measured_rate - set_rate), set_rate/10, "Hz");
 
 		/* measured rate rate is OK
 		** the absolute difference between measured rate and set rate is 
@@ -109,12 +131,13 @@ int measure_freq_wrapper(int sensor_index, void* timestamp_info_param, int stage
 		*/
 		if (fabs(measured_rate - set_rate) <= set_rate/10) {
 			log_msg_and_exit_on_error(DEBUG, "Rate measured for device %s = %f is close to set rate = %f\n", 
-				g_sensor_info_iio_ext[sensor_index].tag, measured_rate, set_rate);
+				g_sensor_info_iio_ext[sensor_index].id, measured_rate, set_rate);
 			return 0;
 		}
 		/* there is a big difference between measured rate and set rate */
+		trace_violation(sensor_index, "rate_error", fabs(measured_rate - set_rate), set_rate/10);
 		log_msg_and_exit_on_error(ERROR, "Rate measured for device %s = %f is different than set rate = %f\n", 
-			g_sensor_info_iio_ext[sensor_index].tag, measured_rate, set_rate);
+			g_sensor_info_iio_ext[sensor_index].id, measured_rate, set_rate);
 		set_test_state(FAILED);
 		return -1;  
 
@@ -125,7 +148,7 @@ int measure_freq_wrapper(int sensor_index, void* timestamp_info_param, int stage
 /* check if difference between every client delay and set delay
 ** is less than test given delay
 */
-int check_sample_timestamp_difference_wrapper(int sensor_index, void* timestamp_info_param, int stage) {
+int check_sample_timestamp_difference_wrapper(int sensor_index, void* run_sensor_param, int stage) {
 	int set_delay;
 	int difference_delay;
 	int nr;
@@ -136,6 +159,9 @@ int check_sample_timestamp_difference_wrapper(int sensor_index, void* timestamp_
 	float new_freq;
 	timestamp_info_struct *timestamp_info;
 	time_attributes_struct* time_attributes;
+	run_sensor_struct *run_sensor;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
 
 	/* collect data from sensors */
 	if (stage == PROCESS) {
@@ -146,20 +172,22 @@ int check_sample_timestamp_difference_wrapper(int sensor_index, void* timestamp_
 		/* don't compute any difference for first value */
 		if (last_timestamp != -1) {
 			
-			timestamp_info = (timestamp_info_struct*)timestamp_info_param;
-			time_attributes = (time_attributes_struct*)hashmapGet(map_sensor_index_to_time_attributes,
-				(void*)sensor_index);
+			timestamp_info = (timestamp_info_struct*)run_sensor->values;
+			time_attributes = run_sensor->time_attributes;
 			max_delay = time_attributes->max_delay;
 			
 			delay = CONVERT_NANO_TO_MILLI(new_timestamp - last_timestamp);
 			set_delay = CONVERT_SEC_TO_MILLI(1/g_sensor_info_iio_ext[sensor_index].data_rate);
 			
 			difference_delay = abs(delay - set_delay);
+			if (difference_delay > timestamp_info->max_difference)
+				timestamp_info->max_difference = difference_delay;
 
 			if (difference_delay > max_delay) {
+				trace_violation(sensor_index, "sample_timestamp_difference", difference_delay, max_delay);
 				log_msg_and_exit_on_error(ERROR, "Device %s exceed max sample timestamp difference = %d ms, "
 					"having %d ms delay\n", 
-					g_sensor_info_iio_ext[sensor_index].tag, max_delay, difference_delay);
+					g_sensor_info_iio_ext[sensor_index].id, max_delay, difference_delay);
 				set_test_state(FAILED);
 				if (timestamp_info->counter != -1)
 					timestamp_info->counter = -1;
@@ -179,31 +207,31 @@ int check_sample_timestamp_difference_wrapper(int sensor_index, void* timestamp_
 
 	/* compute collected data */
 	else {
-		timestamp_info = (timestamp_info_struct*)timestamp_info_param;
-		time_attributes = (time_attributes_struct*)hashmapGet(map_sensor_index_to_time_attributes,
-			(void*)sensor_index);
+		timestamp_info = (timestamp_info_struct*)run_sensor->values;
+		time_attributes = run_sensor->time_attributes;
 		max_delay = time_attributes->max_delay;
 		nr = timestamp_info->counter;
-		free(timestamp_info);
+		record_metric(sensor_index, "max_sample_timestamp_difference",
+			timestamp_info->max_difference, max_delay, "ms");
 		if (nr == 0) {
 			log_msg_and_exit_on_error(ERROR, "No data received from %s\n",
-				g_sensor_info_iio_ext[sensor_index].tag);
+				g_sensor_info_iio_ext[sensor_index].id);
 			set_test_state(FAILED);
 			return -1;
 		}  
 
 		log_msg_and_exit_on_error(DEBUG, "Device %s  has frequency %f\n",
-			g_sensor_info_iio_ext[sensor_index].tag, 
+			g_sensor_info_iio_ext[sensor_index].id, 
 			g_sensor_info_iio_ext[sensor_index].data_rate);
 
 		if (nr == -1) {
 			log_msg_and_exit_on_error(ERROR, "Device %s exceed max sample timestamp difference = %d ms\n", 
-				g_sensor_info_iio_ext[sensor_index].tag, max_delay);
+				g_sensor_info_iio_ext[sensor_index].id, max_delay);
 			set_test_state(FAILED);
 			return -1;
 		}
 		log_msg_and_exit_on_error(DEBUG, "Device %s hasn't exceed max sample timestamp difference = %d ms\n",
-			g_sensor_info_iio_ext[sensor_index].tag, max_delay);
+			g_sensor_info_iio_ext[sensor_index].id, max_delay);
 		return 0;    
 	}
 
@@ -212,8 +240,7 @@ int check_sample_timestamp_difference_wrapper(int sensor_index, void* timestamp_
 ** is less than test given delay
 */
 int check_sample_timestamp_average_difference_wrapper(int sensor_index,
-	void *timestamp_info_param, int stage) {
-
+	void* run_sensor_param, int stage) {
 	int nr;
 	int set_delay;
 	int avg_delay;
@@ -224,7 +251,9 @@ int check_sample_timestamp_average_difference_wrapper(int sensor_index,
 	int64_t delay;
 	timestamp_info_struct *timestamp_info;
 	time_attributes_struct* time_attributes;
+	run_sensor_struct *run_sensor;
 
+	run_sensor = (run_sensor_struct*)run_sensor_param;
 	/* collect data from sensors */
 	if (stage == PROCESS) {
 		last_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
@@ -233,45 +262,54 @@ int check_sample_timestamp_average_difference_wrapper(int sensor_index,
 		new_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
 		/* don't compute any difference for first value */
 		if (last_timestamp != -1) {
-			timestamp_info = (timestamp_info_struct*)timestamp_info_param;
+			timestamp_info = (timestamp_info_struct*)run_sensor->values;
 			timestamp_info->all_consec_timestamps_diff += (new_timestamp - last_timestamp);
 			timestamp_info->counter ++;
+			set_delay = CONVERT_SEC_TO_MILLI(1/g_sensor_info_iio_ext[sensor_index].data_rate);
+			max_delay = run_sensor->time_attributes->max_delay;
+			early_stop_add(run_sensor, new_timestamp - last_timestamp);
+			early_stop_mean(run_sensor, CONVERT_MILLI_TO_NANO((double)set_delay - max_delay),
+				CONVERT_MILLI_TO_NANO((double)set_delay + max_delay + 1));
 			log_msg_and_exit_on_error(VERBOSE, "Device %s  has difference between sample timestamp %d ms\n",
-				g_sensor_info_iio_ext[sensor_index].tag, CONVERT_NANO_TO_MILLI(new_timestamp - last_timestamp));
+				g_sensor_info_iio_ext[sensor_index].id, CONVERT_NANO_TO_MILLI(new_timestamp - last_timestamp));
 		}
 	}
 
 	/* compute collected data */
 	else{
-		timestamp_info = (timestamp_info_struct*)timestamp_info_param;
+		timestamp_info = (timestamp_info_struct*)run_sensor->values;
 		delay = timestamp_info->all_consec_timestamps_diff;
-		time_attributes = (time_attributes_struct*)hashmapGet(map_sensor_index_to_time_attributes, (void*)sensor_index);
+		time_attributes = run_sensor->time_attributes;
 		max_delay = time_attributes->max_delay;
 		nr = timestamp_info->counter;
-		free(timestamp_info);
 		if (nr == 0) {
-			log_msg_and_exit_on_error(ERROR, "No data received from %s\n", g_sensor_info_iio_ext[sensor_index].tag);
+			log_msg_and_exit_on_error(ERROR, "No data received from %s\n", g_sensor_info_iio_ext[sensor_index].id);
 			set_test_state(FAILED);
 			return -1;
 		}
 
-		log_msg_and_exit_on_error(DEBUG, "Device %s  has frequency %f\n", g_sensor_info_iio_ext[sensor_index].tag, 
+		log_msg_and_exit_on_error(DEBUG, "Device %s  has frequency %f\n", g_sensor_info_iio_ext[sensor_index].id, 
 			g_sensor_info_iio_ext[sensor_index].data_rate);
 
 		avg_delay = (float)(CONVERT_NANO_TO_MILLI(delay)/nr); 
 		set_delay = CONVERT_SEC_TO_MILLI(1/g_sensor_info_iio_ext[sensor_index].data_rate);
 		
 		difference_delay = abs(avg_delay - set_delay);
+		record_metric(sensor_index, "samples", nr, NAN, NULL);
+		record_metric(sensor_index, "average_sample_timestamp_difference",
+			difference_delay, max_delay, "ms");
 
 		if (difference_delay > max_delay) {
+			trace_violation(sensor_index, "average_sample_timestamp_difference",
+				difference_delay, max_delay);
 			log_msg_and_exit_on_error(ERROR, "Device %s exceed max sample timestamp average difference = %d ms, having %d ms delay\n", 
-				g_sensor_info_iio_ext[sensor_index].tag, max_delay, difference_delay);
+				g_sensor_info_iio_ext[sensor_index].id, max_delay, difference_delay);
 			set_test_state(FAILED);
 			return -1;
 		}
 		else{
 			log_msg_and_exit_on_error(DEBUG, "Device %s has measured sample timestamp average difference = %d ms less than" 
-				" max sample timestamp average difference = %d ms\n", g_sensor_info_iio_ext[sensor_index].tag, 
+				" max sample timestamp average difference = %d ms\n", g_sensor_info_iio_ext[sensor_index].id, 
 					difference_delay, max_delay);
 		}
 		
@@ -281,7 +319,7 @@ int check_sample_timestamp_average_difference_wrapper(int sensor_index,
 /* check if each difference between system timestamp and client
 ** timestamp is less than test given delay
 */
-int check_client_delay_wrapper(int sensor_index, void* timestamp_info_param, int stage) {
+int check_client_delay_wrapper(int sensor_index, void* run_sensor_param, int stage) {
 	int nr;
 	int64_t sample_timestamp;
 	int64_t sys_timestamp;
@@ -289,6 +327,9 @@ int check_client_delay_wrapper(int sensor_index, void* timestamp_info_param, int
 	int max_delay;
 	timestamp_info_struct *timestamp_info;
 	time_attributes_struct* time_attributes;
+	run_sensor_struct *run_sensor;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
 
 	/* collect data from sensors */
 	if (stage == PROCESS) {
@@ -299,16 +340,18 @@ int check_client_delay_wrapper(int sensor_index, void* timestamp_info_param, int
 
 		log_msg_and_exit_on_error(VERBOSE, "Value for system timestamp is %lld: \n", sys_timestamp);
 		
-		timestamp_info = (timestamp_info_struct*)timestamp_info_param;
-		time_attributes = (time_attributes_struct*)hashmapGet(map_sensor_index_to_time_attributes,
-			(void*)sensor_index);
+		timestamp_info = (timestamp_info_struct*)run_sensor->values;
+		time_attributes = run_sensor->time_attributes;
 		max_delay = time_attributes->max_delay;
 		
 		delay = abs(CONVERT_NANO_TO_MILLI(sample_timestamp - sys_timestamp));
+		if (delay > timestamp_info->max_difference)
+			timestamp_info->max_difference = delay;
 		
 		if (delay > max_delay) {
+			trace_violation(sensor_index, "client_delay", delay, max_delay);
 			log_msg_and_exit_on_error(ERROR, "Device %s exceed max client delay = %d ms, having %d ms delay\n", 
-				g_sensor_info_iio_ext[sensor_index].tag, max_delay, delay);
+				g_sensor_info_iio_ext[sensor_index].id, max_delay, delay);
 			set_test_state(FAILED);
 			if (timestamp_info->counter != -1) {
 				timestamp_info->counter = -1;
@@ -318,7 +361,7 @@ int check_client_delay_wrapper(int sensor_index, void* timestamp_info_param, int
 		else{
 			log_msg_and_exit_on_error(DEBUG, "Device %s has measured client delay = %d ms less "
 				"than max client delay = %d ms\n",
-				g_sensor_info_iio_ext[sensor_index].tag, delay, max_delay);
+				g_sensor_info_iio_ext[sensor_index].id, delay, max_delay);
 			if (timestamp_info->counter != -1) {
 				timestamp_info->counter ++;
 			}
@@ -329,29 +372,29 @@ int check_client_delay_wrapper(int sensor_index, void* timestamp_info_param, int
 
 	/* compute collected data */
 	else{
-		timestamp_info_struct *timestamp_info = (timestamp_info_struct*)timestamp_info_param;
-		time_attributes = (time_attributes_struct*)hashmapGet(map_sensor_index_to_time_attributes,
-			(void*)sensor_index);
+		timestamp_info_struct *timestamp_info = (timestamp_info_struct*)run_sensor->values;
+		time_attributes = run_sensor->time_attributes;
 		max_delay = time_attributes->max_delay;
 		nr = timestamp_info->counter;
-		free(timestamp_info);
+		record_metric(sensor_index, "max_client_delay", timestamp_info->max_difference,
+			max_delay, "ms");
 		if (nr == 0) {
 			log_msg_and_exit_on_error(ERROR, "No data received from %s\n",
-				g_sensor_info_iio_ext[sensor_index].tag);
+				g_sensor_info_iio_ext[sensor_index].id);
 			set_test_state(FAILED);
 			return -1;
 		}
 
 		log_msg_and_exit_on_error(DEBUG, "Device %s  has frequency %f\n",
-			g_sensor_info_iio_ext[sensor_index].tag, g_sensor_info_iio_ext[sensor_index].data_rate);
+			g_sensor_info_iio_ext[sensor_index].id, g_sensor_info_iio_ext[sensor_index].data_rate);
 
 		if (nr == -1) {
 			log_msg_and_exit_on_error(ERROR, "Device %s exceed max client delay = %d ms\n", 
-				g_sensor_info_iio_ext[sensor_index].tag, max_delay);
+				g_sensor_info_iio_ext[sensor_index].id, max_delay);
 			return -1;
 		}
 		log_msg_and_exit_on_error(DEBUG, "Device %s hasn't exceed max client delay = %d ms\n",
-			g_sensor_info_iio_ext[sensor_index].tag, max_delay);
+			g_sensor_info_iio_ext[sensor_index].id, max_delay);
 		return 0;    
 		
 	}
@@ -361,8 +404,7 @@ int check_client_delay_wrapper(int sensor_index, void* timestamp_info_param, int
 ** timestamp is less than test given delay
 */
 int check_client_average_delay_wrapper(int sensor_index,
-	void* timestamp_info_param, int stage) {
-
+	void* run_sensor_param, int stage) {
 	int nr;
 	int max_delay;
 	int64_t sys_timestamp;
@@ -371,7 +413,9 @@ int check_client_average_delay_wrapper(int sensor_index,
 	int avg_delay;
 	timestamp_info_struct *timestamp_info;
 	time_attributes_struct* time_attributes;
+	run_sensor_struct *run_sensor;
 
+	run_sensor = (run_sensor_struct*)run_sensor_param;
 	/* collect data from sensors */
 	if (stage == PROCESS) {
 		if (get_data_triggered_mode(sensor_index) == -1)
@@ -379,42 +423,46 @@ int check_client_average_delay_wrapper(int sensor_index,
 		sample_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
 		sys_timestamp = get_timestamp_realtime();
 		
-		timestamp_info = (timestamp_info_struct*)timestamp_info_param;
+		timestamp_info = (timestamp_info_struct*)run_sensor->values;
 		timestamp_info->all_consec_timestamps_diff += llabs(sample_timestamp - sys_timestamp);
 		timestamp_info->counter ++;
+		early_stop_add(run_sensor, llabs(sample_timestamp - sys_timestamp));
+		early_stop_mean(run_sensor, -INFINITY,
+			CONVERT_MILLI_TO_NANO((double)run_sensor->time_attributes->max_delay + 1));
 		
 		log_msg_and_exit_on_error(VERBOSE, "Device %s  has system timestamp  %lld ns\n",
-			g_sensor_info_iio_ext[sensor_index].tag, sys_timestamp);
+			g_sensor_info_iio_ext[sensor_index].id, sys_timestamp);
 		log_msg_and_exit_on_error(VERBOSE, "Device %s  has client delay %lld ns\n",
-			g_sensor_info_iio_ext[sensor_index].tag, llabs(sys_timestamp - sample_timestamp));
+			g_sensor_info_iio_ext[sensor_index].id, llabs(sys_timestamp - sample_timestamp));
 	}
 
 	/* compute collected data */
 	else{
-		timestamp_info = (timestamp_info_struct*)timestamp_info_param;
+		timestamp_info = (timestamp_info_struct*)run_sensor->values;
 		delay = timestamp_info->all_consec_timestamps_diff;
-		time_attributes = (time_attributes_struct*)hashmapGet(map_sensor_index_to_time_attributes,
-			(void*)sensor_index);
+		time_attributes = run_sensor->time_attributes;
 		max_delay = time_attributes->max_delay;
 		nr = timestamp_info->counter;
-		free(timestamp_info);
 		if (nr == 0) {
 			log_msg_and_exit_on_error(ERROR, "No data received from %s\n",
-				g_sensor_info_iio_ext[sensor_index].tag);
+				g_sensor_info_iio_ext[sensor_index].id);
 			set_test_state(FAILED);
 			return -1;
 		}
 
 		log_msg_and_exit_on_error(DEBUG, "Device %s  has frequency %f\n",
-			g_sensor_info_iio_ext[sensor_index].tag, 
+			g_sensor_info_iio_ext[sensor_index].id, 
 			g_sensor_info_iio_ext[sensor_index].data_rate);
 
 
 		avg_delay = (float)(CONVERT_NANO_TO_MILLI(delay)/nr); 
+		record_metric(sensor_index, "samples", nr, NAN, NULL);
+		record_metric(sensor_index, "average_client_delay", avg_delay, max_delay, "ms");
 		
 		if (avg_delay > max_delay) {
+			trace_violation(sensor_index, "average_client_delay", avg_delay, max_delay);
 			log_msg_and_exit_on_error(ERROR, "Device %s exceed max client average delay = %d ms, "
-				"having %d ms delay\n", g_sensor_info_iio_ext[sensor_index].tag, max_delay, avg_delay);
+				"having %d ms delay\n", g_sensor_info_iio_ext[sensor_index].id, max_delay, avg_delay);
 			set_test_state(FAILED);
 			return -1;
 		}
@@ -425,10 +473,144 @@ int check_client_average_delay_wrapper(int sensor_index,
 	}
 	return 0;
 }
+/* switch rate while streaming and measure how long it takes until
+** the difference between sample timestamps settles to the new rate
+*/
+int check_rate_switch_wrapper(int sensor_index, void* run_sensor_param, int stage) {
+	int max_delay;
+	int64_t last_timestamp;
+	int64_t new_timestamp;
+	int64_t interval;
+	int64_t new_period;
+	int64_t old_period;
+	int64_t tolerance;
+	int64_t settle_time;
+	rate_switch_struct *rate_switch;
+	time_attributes_struct* time_attributes;
+	run_sensor_struct *run_sensor;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
+
+	rate_switch = (rate_switch_struct*)run_sensor->values;
+	time_attributes = run_sensor->time_attributes;
+	max_delay = time_attributes->max_delay;
+
+	/* collect data from sensors */
+	if (stage == PROCESS) {
+		last_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		if (get_data_triggered_mode(sensor_index) == -1)
+			return -1; 
+		new_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+
+		if (!rate_switch->switched) {
+			if (rate_switch->first_timestamp == -1)
+				rate_switch->first_timestamp = new_timestamp;
+			if (CONVERT_NANO_TO_MILLI(new_timestamp - rate_switch->first_timestamp) < RATE_SWITCH_WARMUP_MS)
+				return 0;
+
+			/* buffer stays open, write_freq disables and enables it again */
+			rate_switch->switched = 1;
+			rate_switch->switch_timestamp = get_timestamp_realtime();
+			if (write_freq(sensor_index, rate_switch->new_rate) == -1) {
+				log_msg_and_exit_on_error(ERROR, "Can't switch rate for %s to %f\n",
+					g_sensor_info_iio_ext[sensor_index].id, rate_switch->new_rate);
+				return -1;
+			}
+			rate_switch->switch_done_timestamp = get_timestamp_realtime();
+			rate_switch->new_rate = g_sensor_info_iio_ext[sensor_index].data_rate;
+			log_msg_and_exit_on_error(DEBUG, "Device %s switched rate from %f to %f in %lld us\n",
+				g_sensor_info_iio_ext[sensor_index].id, rate_switch->old_rate, rate_switch->new_rate,
+				CONVERT_NANO_TO_MICRO(rate_switch->switch_done_timestamp - rate_switch->switch_timestamp));
+			return 0;
+		}
+
+		/* samples produced before the switch may still be queued */
+		if (new_timestamp < rate_switch->switch_timestamp || last_timestamp == -1)
+			return 0;
+
+		rate_switch->counter++;
+		/* the buffer was off around the switch, that gap isn't lost samples;
+		** intervals are counted from the first sample after it
+		*/
+		if (last_timestamp < rate_switch->switch_timestamp)
+			return 0;
+		interval = new_timestamp - last_timestamp;
+		new_period = CONVERT_SEC_TO_NANO(1) / rate_switch->new_rate;
+		old_period = CONVERT_SEC_TO_NANO(1) / rate_switch->old_rate;
+		tolerance = CONVERT_MILLI_TO_NANO((int64_t)max_delay);
+
+		log_msg_and_exit_on_error(VERBOSE, "Device %s has difference between sample timestamps "
+			"%lld ns after rate switch\n", g_sensor_info_iio_ext[sensor_index].id, interval);
+
+		if (llabs(interval - new_period) <= tolerance) {
+			if (rate_switch->settled_intervals == 0)
+				rate_switch->settle_candidate_timestamp = last_timestamp;
+			rate_switch->settled_intervals++;
+			if (!rate_switch->settled &&
+				rate_switch->settled_intervals >= RATE_SWITCH_SETTLE_INTERVALS) {
+				rate_switch->settled = 1;
+				rate_switch->settle_timestamp = rate_switch->settle_candidate_timestamp;
+			}
+			return 0;
+		}
+
+		rate_switch->settled_intervals = 0;
+		if (!rate_switch->settled && llabs(interval - old_period) <= tolerance) {
+			rate_switch->old_rate_samples++;
+			return 0;
+		}
+		/* a gap of several periods means samples were lost */
+		if (interval > new_period + new_period / 2)
+			rate_switch->lost_samples += (int)((interval + new_period / 2) / new_period) - 1;
+		return 0;
+	}
+
+	/* compute collected data */
+	else{
+		if (!rate_switch->switched) {
+			log_msg_and_exit_on_error(ERROR, "Device %s has not streamed long enough to switch rate\n",
+				g_sensor_info_iio_ext[sensor_index].id);
+			set_test_state(FAILED);
+			return -1;
+		}
+		if (rate_switch->counter == 0) {
+			log_msg_and_exit_on_error(ERROR, "No data received from %s after rate switch\n",
+				g_sensor_info_iio_ext[sensor_index].id);
+			set_test_state(FAILED);
+			return -1;
+		}
+
+		record_metric(sensor_index, "switch_write_duration",
+			CONVERT_NANO_TO_MICRO(rate_switch->switch_done_timestamp - rate_switch->switch_timestamp),
+			NAN, "us");
+		record_metric(sensor_index, "old_rate_samples", rate_switch->old_rate_samples, NAN, NULL);
+		record_metric(sensor_index, "lost_samples", rate_switch->lost_samples, NAN, NULL);
+		log_msg_and_exit_on_error(DEBUG, "Device %s has %d samples at old rate and %d lost samples "
+			"after rate switch from %f to %f\n", g_sensor_info_iio_ext[sensor_index].id,
+			rate_switch->old_rate_samples, rate_switch->lost_samples,
+			rate_switch->old_rate, rate_switch->new_rate);
+
+		if (!rate_switch->settled) {
+			trace_marker("violation %s rate switch not settled", g_sensor_info_iio_ext[sensor_index].id);
+			log_msg_and_exit_on_error(ERROR, "Device %s has not settled to rate %f with tolerance %d ms\n",
+				g_sensor_info_iio_ext[sensor_index].id, rate_switch->new_rate, max_delay);
+			set_test_state(FAILED);
+			return -1;
+		}
+
+		settle_time = rate_switch->settle_timestamp - rate_switch->switch_timestamp;
+		if (settle_time < 0)
+			settle_time = 0;
+		record_metric(sensor_index, "settle_time", CONVERT_NANO_TO_MICRO(settle_time), NAN, "us");
+		log_msg_and_exit_on_error(DEBUG, "Device %s has settled to rate %f after %lld us\n",
+			g_sensor_info_iio_ext[sensor_index].id, rate_switch->new_rate,
+			CONVERT_NANO_TO_MICRO(settle_time));
+	}
+	return 0;
+}
 /* collect and compute data necessary to measure standard deviation for each sensor */ 
 int standard_deviation_wrapper(int sensor_index,
-	void *standard_deviation_info_param, int stage) {
-
+	void* run_sensor_param, int stage) {
 	int dev_num;
 	int counter; 
 	int redundant_part;
@@ -446,29 +628,28 @@ int standard_deviation_wrapper(int sensor_index,
 	float standard_dev;
 	float max_dev;
 	const char* name;
+	run_sensor_struct *run_sensor;
 
+	run_sensor = (run_sensor_struct*)run_sensor_param;
 	num_channels = g_sensor_info_iio_ext[sensor_index].num_channels;
 	error = 0;
 	memset(buffer, '\0', BUFFER_SIZE);
 	
 	/* collect data from sensors */
 	if (stage == PROCESS) {
-		standard_deviation_info = (standard_deviation_struct*)standard_deviation_info_param;
+		standard_deviation_info = (standard_deviation_struct*)run_sensor->values;
 		counter = standard_deviation_info->counter;
 		channels_values_size = standard_deviation_info->channels_values_size;
 		 
+		/* only if the device streams well above its advertised rate */
 		if (counter >= channels_values_size) {
 			standard_deviation_info->channels_values_size *= 2;
 			for (i = 0; i < num_channels; i++) {
 				standard_deviation_info->channels_values[i] =
-					(float*)realloc(standard_deviation_info->channels_values[i],
-					channels_values_size * sizeof(float));
-					
-				if (standard_deviation_info->channels_values[i] == NULL) {
-					log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-					set_test_state(FAILED);
-					exit(-1);
-				}
+					(float*)arena_grow(&g_test_arena,
+					standard_deviation_info->channels_values[i],
+					channels_values_size * sizeof(float),
+					2 * channels_values_size * sizeof(float));
 			}
 		}
 		if (g_sensor_info_iio_ext[sensor_index].mode == MODE_TRIGGER) {
@@ -480,9 +661,9 @@ int standard_deviation_wrapper(int sensor_index,
 			if (get_data_polling_mode(sensor_index) == -1) {
 				return -1;
 			}
-			if (sysfs_read_from_fd(g_sensor_info_iio_ext[sensor_index].read_fd, buffer, 1) == -1) {
+			if (sysfs_read_from_fd(run_sensor->fd, buffer, 1) == -1) {
 				log_msg_and_exit_on_error(ERROR, "Can't read samples from %s \n",
-					g_sensor_info_iio_ext[sensor_index].tag); 
+					g_sensor_info_iio_ext[sensor_index].id); 
 				set_test_state(FAILED);
 				return -1;
 			}
@@ -497,26 +678,26 @@ int standard_deviation_wrapper(int sensor_index,
 	} else {
 
 		if (g_sensor_info_iio_ext[sensor_index].mode == MODE_POLL) {
-			if (pthread_join(threads[sensor_index], NULL)) {
+			if (pthread_join(run_sensor->thread, NULL)) {
 				log_msg_and_exit_on_error(ERROR, "Can't destroy thread for sensor %s\n",
-					g_sensor_info_iio_ext[sensor_index].tag);
+					g_sensor_info_iio_ext[sensor_index].id);
 				set_test_state(FAILED);
 				return -1;
 			}
 		}
 		
-		standard_deviation_info = (standard_deviation_struct*)standard_deviation_info_param;
+		standard_deviation_info = (standard_deviation_struct*)run_sensor->values;
 		counter = standard_deviation_info->counter;
 			
 		max_dev = get_standard_deviation_value(sensor_index);
 		if (counter == 0) {
 			log_msg_and_exit_on_error(ERROR, "No data received from %s\n",
-				g_sensor_info_iio_ext[sensor_index].tag);
+				g_sensor_info_iio_ext[sensor_index].id);
 			set_test_state(FAILED);
 			return -1;
 		}
 		log_msg_and_exit_on_error(DEBUG, "Got %d measurements from %s\n", counter,
-			g_sensor_info_iio_ext[sensor_index].tag);
+			g_sensor_info_iio_ext[sensor_index].id);
 		/* compute standard deviation for each channel */            
 
 		for (channel = 0; channel < num_channels; ++channel) {
@@ -535,7 +716,7 @@ int standard_deviation_wrapper(int sensor_index,
 			}
 			medium /= counter;
 			log_msg_and_exit_on_error(DEBUG, "Device %s has medium value on channel %s = %f\n",
-				g_sensor_info_iio_ext[sensor_index].tag, 
+				g_sensor_info_iio_ext[sensor_index].id, 
 				g_sensor_info_iio_ext[sensor_index].channel_descriptor[channel].name, medium);
 			for (i = init; i < final; ++i) {
 				standard_dev +=
@@ -547,24 +728,22 @@ int standard_deviation_wrapper(int sensor_index,
 			standard_devs[channel] = sqrt(standard_dev);
 		}
 
-		for (i = 0; i < num_channels; i++) {
-			free(standard_deviation_info->channels_values[i]);
-		}
-		free(standard_deviation_info->channels_values);
-		free(standard_deviation_info);
 		/* check max deviation */
 		for (channel = 0; channel < num_channels; ++channel) {
 			name = g_sensor_info_iio_ext[sensor_index].channel_descriptor[channel].name;
+			snprintf(buffer, BUFFER_SIZE, "standard_deviation_%s", name);
+			record_metric(sensor_index, buffer, standard_devs[channel], max_dev, NULL);
 			if (standard_devs[channel] > max_dev) {
+				trace_violation(sensor_index, buffer, standard_devs[channel], max_dev);
 				log_msg_and_exit_on_error(ERROR, "Deviation measured for device %s for channel %s = %f "
-					"is bigger than real standard deviation = %f\n", g_sensor_info_iio_ext[sensor_index].tag,
+					"is bigger than real standard deviation = %f\n", g_sensor_info_iio_ext[sensor_index].id,
 					name, standard_devs[channel], max_dev);
 				set_test_state(FAILED);
 				error = 1;
 			}
 			else{
 				log_msg_and_exit_on_error(DEBUG, "Deviation measured for device %s on channel %s is %f "
-					"close to real standard deviation = %f\n", g_sensor_info_iio_ext[sensor_index].tag,
+					"close to real standard deviation = %f\n", g_sensor_info_iio_ext[sensor_index].id,
 					name, standard_devs[channel], max_dev);
 			}
 		}
@@ -574,7 +753,7 @@ int standard_deviation_wrapper(int sensor_index,
 	return 0;
 }
 /* compute and process data necessary to measure jitter for each sensor */ 
-int test_jitter_wrapper(int sensor_index, void* jitter_info_param, int stage) {
+int test_jitter_wrapper(int sensor_index, void* run_sensor_param, int stage) {
 	int counter;
 	int timestamp_values_size;  
 	int i;  
@@ -583,65 +762,59 @@ int test_jitter_wrapper(int sensor_index, void* jitter_info_param, int stage) {
 	float medium;
 	float standard_dev;
 	jitter_struct* jitter_info;
+	run_sensor_struct *run_sensor;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
 
 	standard_dev = 0.0;
 	medium = 0.0;
 	
 	/* collect data from sensors */
 	if (stage == PROCESS) {
-		jitter_info = (jitter_struct*)jitter_info_param;
+		jitter_info = (jitter_struct*)run_sensor->values;
 		counter = jitter_info->counter;
 		timestamp_values_size = jitter_info->timestamp_values_size;
+		/* only if the device streams well above its advertised rate */
 		if (counter >= timestamp_values_size) {
-			timestamp_values_size *= 2;
 			jitter_info->timestamp_values =
-				(int64_t *)realloc(jitter_info->timestamp_values,
-				timestamp_values_size * sizeof(int64_t));
-
-			if (jitter_info->timestamp_values == NULL) {
-				log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-				set_test_state(FAILED);
-				exit(-1);
-			}
-			jitter_info->timestamp_values_size = timestamp_values_size;
+				(int64_t *)arena_grow(&g_test_arena, jitter_info->timestamp_values,
+				timestamp_values_size * sizeof(int64_t),
+				2 * timestamp_values_size * sizeof(int64_t));
+			jitter_info->timestamp_values_size = 2 * timestamp_values_size;
 		}
 
 		if (get_data_triggered_mode(sensor_index) == -1)
 			return -1;
 		jitter_info->timestamp_values[counter] =
 			g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		if (counter > 0) {
+			early_stop_add(run_sensor, jitter_info->timestamp_values[counter] -
+				jitter_info->timestamp_values[counter - 1]);
+			early_stop_jitter(run_sensor, MAX_JITTER);
+		}
 
 		jitter_info->counter ++;            
 	}
 
 	/* compute value of jitter */
 	else{
-		jitter_info = (jitter_struct*)jitter_info_param;
+		jitter_info = (jitter_struct*)run_sensor->values;
 		counter = jitter_info->counter;
 
 		if (counter == 0) {
 			log_msg_and_exit_on_error(ERROR, "No data received from %s\n",
-				g_sensor_info_iio_ext[sensor_index].tag);
+				g_sensor_info_iio_ext[sensor_index].id);
 			set_test_state(FAILED);
-			free(jitter_info->timestamp_values);
-			free(jitter_info);
 			return -1;
 		}
 		/* compute jitter */
 		counter --;
-		diff_timestamp = (int64_t *)malloc(counter * sizeof(int64_t));
-		if (diff_timestamp == NULL) {
-			log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-			set_test_state(FAILED);
-			exit(-1);
-		}
+		diff_timestamp = (int64_t *)arena_alloc(&g_test_arena, (counter + 1) * sizeof(int64_t));
 
 		for (i = 0; i < counter; ++i) {
 			diff_timestamp[i] =
 				jitter_info->timestamp_values[i + 1] - jitter_info->timestamp_values[i];
 		}
-		free(jitter_info->timestamp_values);
-		free(jitter_info);
 		for (i = 0; i < counter; ++i) {
 			medium += diff_timestamp[i];
 		}
@@ -650,33 +823,258 @@ int test_jitter_wrapper(int sensor_index, void* jitter_info_param, int stage) {
 			standard_dev += (diff_timestamp[i] - medium) * (diff_timestamp[i] - medium);
 		} 
 
-		free(diff_timestamp);
-		
+
 		standard_dev /= counter;
 		standard_dev = sqrt(standard_dev);
 
 		log_msg_and_exit_on_error(DEBUG, "Device %s has standard deviation for difference "
-			"between sample timestamps = %f\n", g_sensor_info_iio_ext[sensor_index].tag,
+			"between sample timestamps = %f\n", g_sensor_info_iio_ext[sensor_index].id,
 			standard_dev);
 		log_msg_and_exit_on_error(DEBUG, "Device %s has medium difference between "
-			"sample timestamps = %f\n", g_sensor_info_iio_ext[sensor_index].tag, medium);
+			"sample timestamps = %f\n", g_sensor_info_iio_ext[sensor_index].id, medium);
 
 		standard_dev = standard_dev / medium * 100;
+		record_metric(sensor_index, "samples", counter + 1, NAN, NULL);
+		record_metric(sensor_index, "average_sample_interval", medium, NAN, "ns");
+		record_metric(sensor_index, "jitter", standard_dev, MAX_JITTER, "%");
 		
 		/* check jitter */
 		if (standard_dev > (float)MAX_JITTER) {
+			trace_violation(sensor_index, "jitter", standard_dev, MAX_JITTER);
 			log_msg_and_exit_on_error(ERROR, "Jitter measured for device %s = %f is bigger "
-				"than standard jitter  = %d\n", g_sensor_info_iio_ext[sensor_index].tag,
+				"than standard jitter  = %d\n", g_sensor_info_iio_ext[sensor_index].id,
 				standard_dev, MAX_JITTER);
 			set_test_state(FAILED);
 			return -1;
 		}
 		log_msg_and_exit_on_error(DEBUG, "Jitter measured for device %s is %f\n",
-			g_sensor_info_iio_ext[sensor_index].tag, standard_dev);
+			g_sensor_info_iio_ext[sensor_index].id, standard_dev);
 		return 0;
 	}   
 	return 0; 
 }
+/* feed every sample to the Allan variance of each channel */
+int allan_variance_wrapper(int sensor_index, void* run_sensor_param, int stage) {
+	int c;
+	allan_variance_struct *allan;
+	run_sensor_struct *run_sensor;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
+	allan = (allan_variance_struct*)run_sensor->values;
+
+	/* collect data from sensors */
+	if (stage == PROCESS) {
+		if (get_data_triggered_mode(sensor_index) == -1)
+			return -1;
+		if (allan->first_timestamp == -1)
+			allan->first_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		allan->last_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		allan->counter++;
+		for (c = 0; c < allan->num_channels; c++)
+			allan_variance_add(allan, c,
+				g_sensor_info_iio_ext[sensor_index].channel_info[c].last_value);
+		return 0;
+	}
+
+	/* compute collected data */
+	log_msg_and_exit_on_error(DEBUG, "Got %lld samples from %s\n", allan->counter,
+		g_sensor_info_iio_ext[sensor_index].id);
+	return allan_variance_report(sensor_index, allan);
+}
+/* feed every sample to the noise spectrum of the sensor */
+int noise_spectrum_wrapper(int sensor_index, void* run_sensor_param, int stage) {
+	int num_channels;
+	int c;
+	noise_spectrum_struct *spectrum;
+	run_sensor_struct *run_sensor;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
+	spectrum = (noise_spectrum_struct*)run_sensor->values;
+	num_channels = spectrum->num_channels;
+
+	/* collect data from sensors */
+	if (stage == PROCESS) {
+		float values[num_channels];
+
+		if (get_data_triggered_mode(sensor_index) == -1)
+			return -1;
+		if (spectrum->first_timestamp == -1)
+			spectrum->first_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		spectrum->last_timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		for (c = 0; c < num_channels; c++)
+			values[c] = g_sensor_info_iio_ext[sensor_index].channel_info[c].last_value;
+		noise_spectrum_add(spectrum, values);
+		return 0;
+	}
+
+	/* compute collected data */
+	log_msg_and_exit_on_error(DEBUG, "Got %lld samples from %s\n", spectrum->counter,
+		g_sensor_info_iio_ext[sensor_index].id);
+	return noise_spectrum_report(sensor_index, spectrum);
+}
+/* collect timestamps of every sensor, then compare them with the
+** timestamps of the first sensor of the command
+*/
+int check_sync_wrapper(int sensor_index, void* run_sensor_param, int stage) {
+	int i;
+	int counter;
+	int timestamp_values_size;
+	sync_struct *sync_info;
+	run_sensor_struct *run_sensor;
+	run_context_struct *run_context;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
+	sync_info = (sync_struct*)run_sensor->values;
+
+	/* collect data from sensors */
+	if (stage == PROCESS) {
+		counter = sync_info->counter;
+		timestamp_values_size = sync_info->timestamp_values_size;
+		if (counter >= timestamp_values_size) {
+			sync_info->timestamp_values =
+				(int64_t *)arena_grow(&g_test_arena, sync_info->timestamp_values,
+				timestamp_values_size * sizeof(int64_t),
+				2 * timestamp_values_size * sizeof(int64_t));
+			sync_info->timestamp_values_size = 2 * timestamp_values_size;
+		}
+		if (get_data_triggered_mode(sensor_index) == -1)
+			return -1;
+		sync_info->timestamp_values[counter] = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		sync_info->counter++;
+		return 0;
+	}
+
+	/* compute collected data, once for the whole run */
+	log_msg_and_exit_on_error(DEBUG, "Got %d timestamps from %s\n", sync_info->counter,
+		g_sensor_info_iio_ext[sensor_index].id);
+	run_context = run_sensor->context;
+	for (i = 0; i < run_context->sensors_count; i++)
+		if (run_context->sensors[i].values != NULL)
+			break;
+	if (&run_context->sensors[i] != run_sensor)
+		return 0;
+	return sync_report(run_context);
+}
+/* count events of a sensor and their latency; samples of a triggered
+** sensor come in the same loop and are only read
+*/
+int check_events_wrapper(int sensor_index, void* run_sensor_param, int stage) {
+	events_struct *events;
+	run_sensor_struct *run_sensor;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
+	events = (events_struct*)run_sensor->values;
+
+	if (stage == PROCESS) {
+		if (run_sensor->mode == MODE_EVENT)
+			return read_event(sensor_index, events, run_sensor->time_attributes->max_delay);
+		if (get_data_triggered_mode(sensor_index) == -1)
+			return -1;
+		events->samples++;
+		return 0;
+	}
+
+	/* the event fd is owned by the test, unlike the device fd */
+	if (close(events->event_fd) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Error closing event fd for device %s: %s\n",
+			g_sensor_info_iio_ext[sensor_index].id, strerror(errno));
+		set_test_state(FAILED);
+	}
+	events->event_fd = -1;
+	disable_events(sensor_index, events);
+	events_report(sensor_index, events);
+	return 0;
+}
+/* intervals between samples of a sensor against the period of its hrtimer */
+int trigger_accuracy_wrapper(int sensor_index, void* run_sensor_param, int stage) {
+	int64_t timestamp;
+	int64_t interval;
+	int64_t ticks;
+	trigger_accuracy_struct *accuracy;
+	run_sensor_struct *run_sensor;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
+	accuracy = (trigger_accuracy_struct*)run_sensor->values;
+
+	if (stage == PROCESS) {
+		if (get_data_triggered_mode(sensor_index) == -1)
+			return -1;
+		timestamp = g_sensor_info_iio_ext[sensor_index].last_timestamp;
+		if (accuracy->counter++ == 0) {
+			accuracy->first_timestamp = timestamp;
+			accuracy->last_timestamp = timestamp;
+			return 0;
+		}
+		interval = timestamp - accuracy->last_timestamp;
+		accuracy->last_timestamp = timestamp;
+		/* a late tick shortens the next interval, a missed one doubles it */
+		ticks = (interval + accuracy->period / 2) / accuracy->period;
+		if (ticks >= 2)
+			accuracy->missed += ticks - 1;
+		accuracy->ticks += ticks;
+		histogram_add(&accuracy->jitter, llabs(interval - ticks * accuracy->period));
+		return 0;
+	}
+
+	log_msg_and_exit_on_error(DEBUG, "Got %lld samples from %s\n", accuracy->counter,
+		g_sensor_info_iio_ext[sensor_index].id);
+	return trigger_accuracy_report(run_sensor);
+}
+/* read samples of devices sharing a trigger, compare them at the end */
+int fanout_wrapper(int sensor_index, void* run_sensor_param, int stage) {
+	int i;
+	fanout_struct *fanout;
+	run_sensor_struct *run_sensor;
+	run_context_struct *run_context;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
+	fanout = (fanout_struct*)run_sensor->values;
+
+	if (stage == PROCESS) {
+		if (get_data_triggered_mode(sensor_index) == -1)
+			return -1;
+		fanout_add_sample(sensor_index, fanout);
+		return 0;
+	}
+
+	/* compute collected data, once for the whole step */
+	log_msg_and_exit_on_error(DEBUG, "Got %lld samples from %s\n", fanout->counter,
+		g_sensor_info_iio_ext[sensor_index].id);
+	run_context = run_sensor->context;
+	for (i = 0; i < run_context->sensors_count; i++)
+		if (run_context->sensors[i].values != NULL)
+			break;
+	if (&run_context->sensors[i] != run_sensor)
+		return 0;
+	return fanout_report(run_context);
+}
+/* feed every sample to the streaming metrics of the soak */
+int soak_wrapper(int sensor_index, void* run_sensor_param, int stage) {
+	int i;
+	soak_struct *soak;
+	run_sensor_struct *run_sensor;
+	run_context_struct *run_context;
+
+	run_sensor = (run_sensor_struct*)run_sensor_param;
+	soak = (soak_struct*)run_sensor->values;
+	run_context = run_sensor->context;
+
+	if (stage == PROCESS) {
+		if (get_data_triggered_mode(sensor_index) == -1)
+			return -1;
+		soak_add_sample(sensor_index, soak);
+		soak_check_interval(run_context, 0);
+		return 0;
+	}
+
+	/* compute collected data, once for the whole run */
+	for (i = 0; i < run_context->sensors_count; i++)
+		if (run_context->sensors[i].values != NULL)
+			break;
+	if (&run_context->sensors[i] != run_sensor)
+		return 0;
+	return soak_report(run_context);
+}
 /* signal data ready for polling mode sensors 
 ** in order to simulate a frequency for reading 
 ** samples
@@ -690,7 +1088,7 @@ void* thread_routine(void* params) {
 	time_t start_time;
 	time_t final_time;
 
-	sensor_index = (int)params;
+	sensor_index = (int)(intptr_t)params;
 	freq = g_sensor_info_iio_ext[sensor_index].data_rate;
 	duration = CONVERT_SEC_TO_NANO(1/freq);
 	
@@ -704,7 +1102,7 @@ void* thread_routine(void* params) {
 	while(difftime(final_time, start_time) <= (TIME_TO_MEASURE_SECS + 2)) { 
 		if (write(fd, DATA_READY_SIGNAL, 1) == -1) {
 			log_msg_and_exit_on_error(ERROR, "Can't write data in fifo for %s\n",
-				g_sensor_info_iio_ext[sensor_index].tag);
+				g_sensor_info_iio_ext[sensor_index].id);
 			set_test_state(FAILED);
 		}
 		nanosleep(&delay, &delay);
@@ -712,401 +1110,626 @@ void* thread_routine(void* params) {
 	}
 	if (close(fd) == -1) {
 		log_msg_and_exit_on_error(ERROR, "Error closing fd %d for writing for device %s: %s\n", 
-			fd, g_sensor_info_iio_ext[sensor_index].tag, strerror(errno));
+			fd, g_sensor_info_iio_ext[sensor_index].id, strerror(errno));
 		set_test_state(FAILED);
 	}            
 	else{
 		log_msg_and_exit_on_error(VERBOSE, "Closed fd for device %s\n",
-			g_sensor_info_iio_ext[sensor_index].tag);
+			g_sensor_info_iio_ext[sensor_index].id);
 	}
 	
 	return NULL;   
 
 }
-/* initialize structures, frequency
-** and reading fds used in tests which measure timestamp
-*/
-bool generic_initialize(void* key, void* value, void* context) {
-	char sysfs_path[PATH_MAX];
-	int sensor_index;
-	time_attributes_struct* time_attributes;
-	int enabled;
-	timestamp_info_struct* timestamp_info;
-	int fd;
-	int dev_num;
-	Hashmap* map_sensor_index_values;
+/* read samples of a sensor from fd; epoll hands back run_sensor itself */
+int watch_sensor_fd(run_sensor_struct *run_sensor, int fd) {
 	struct epoll_event ev;
+	int sensor_index;
 
-	map_sensor_index_values = (Hashmap*)context;
-	time_attributes = (time_attributes_struct*)value;
-	sensor_index = (int)key;
-	dev_num = g_sensor_info_iio_ext[sensor_index].dev_num;
-	memset(sysfs_path, '\0', PATH_MAX);
+	sensor_index = run_sensor->sensor_index;
+	run_sensor->fd = fd;
+	g_sensor_info_iio_ext[sensor_index].read_fd = fd;
+	g_sensor_info_iio_ext[sensor_index].last_timestamp = -1;
 
-	if (g_sensor_info_iio_ext[sensor_index].mode == MODE_POLL) {
-		log_msg_and_exit_on_error(ERROR, "This test is not available for %s!\n",
-			g_sensor_info_iio_ext[sensor_index].tag);
-		set_test_state(SKIPPED);
-		return true;
-	}
-	
-	if (set_freq(sensor_index, time_attributes->freq) == -1) {
-		return true;
+	ev.data.ptr = run_sensor;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(run_sensor->context->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Error epoll_ctl ADD for iio:device%d: %s\n",
+			g_sensor_info_iio_ext[sensor_index].dev_num, strerror(errno));
+		set_test_state(FAILED);
+		return -1;
 	}
-				
-	time_attributes->freq = g_sensor_info_iio_ext[sensor_index].data_rate;
-	hashmapPut(map_sensor_index_to_time_attributes, (void*)sensor_index,
-		(void*)time_attributes);
+	run_sensor->context->watched++;
+	return watch_stall(run_sensor);
+}
 
+/* watch the event fd of a sensor through a copy of its run sensor in
+** MODE_EVENT, so the wrapper can tell events from samples
+*/
+static int watch_event_fd(run_sensor_struct *run_sensor, int event_fd) {
+	struct epoll_event ev;
+	run_sensor_struct *event_sensor;
 
-	snprintf(sysfs_path, PATH_MAX, ENABLE_PATH, dev_num);
-	if (sysfs_read_int(sysfs_path, &enabled) == -1) {
-		log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path); 
+	event_sensor = (run_sensor_struct*)arena_alloc(&g_test_arena, sizeof(run_sensor_struct));
+	*event_sensor = *run_sensor;
+	event_sensor->fd = event_fd;
+	event_sensor->mode = MODE_EVENT;
+	/* stages of events aren't mixed with those of samples */
+	event_sensor->profile = (stage_profile_struct*)arena_alloc(&g_test_arena,
+		sizeof(stage_profile_struct));
+
+	ev.data.ptr = event_sensor;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(run_sensor->context->epfd, EPOLL_CTL_ADD, event_fd, &ev) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Error epoll_ctl ADD for events of %s: %s\n",
+			g_sensor_info_iio_ext[run_sensor->sensor_index].id, strerror(errno));
 		set_test_state(FAILED);
-		return true;
+		return -1;
 	}
-	if (!enabled) {
-		if (activate_sensor(sensor_index, 1) == -1) {
-			return true;
-		}    
+	run_sensor->context->watched++;
+	return 0;
+}
+
+/* enable buffer of a triggered sensor unless it already is */
+static int ensure_sensor_active(int sensor_index) {
+	char sysfs_path[PATH_MAX];
+	int sources[FUSION_SOURCES];
+	int enabled;
+	int count;
+	int i;
+
+	/* a virtual sensor streams while its sources do */
+	if (g_sensor_info_iio_ext[sensor_index].is_virtual) {
+		count = get_fusion_sources(sensor_index, sources);
+		for (i = 0; i < count; i++)
+			if (ensure_sensor_active(sources[i]) == -1)
+				return -1;
+		return 0;
 	}
 
-	timestamp_info = (timestamp_info_struct*)malloc(sizeof(timestamp_info_struct));
-	if (timestamp_info == NULL) {
-		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+	memset(sysfs_path, '\0', PATH_MAX);
+	snprintf(sysfs_path, PATH_MAX, ENABLE_PATH, g_sensor_info_iio_ext[sensor_index].dev_num);
+	if (sysfs_read_int(sysfs_path, &enabled) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path); 
 		set_test_state(FAILED);
-		exit(-1);
+		return -1;
 	}
-	timestamp_info->all_consec_timestamps_diff = 0;
-	timestamp_info->counter = 0;
-	
-	hashmapPut(map_sensor_index_values, (void*)sensor_index, (void*)timestamp_info);
-	g_sensor_info_iio_ext[sensor_index].last_timestamp = -1;
+	if (!enabled)
+		return activate_sensor(sensor_index, 1);
+	return 0;
+}
 
-	snprintf(sysfs_path, PATH_MAX, DEV_FILE_PATH, dev_num);
-	fd = open(sysfs_path, O_RDONLY);
-	
+/* open device of a triggered sensor and watch it */
+static int open_and_watch_sensor(run_sensor_struct *run_sensor) {
+	int fd;
+
+	fd = open_device_fd(run_sensor->sensor_index, 0);
 	if (fd == -1) {
 		log_msg_and_exit_on_error(ERROR, "Error opening file iio:device%d: %s\n",
-			dev_num, strerror(errno));
+			g_sensor_info_iio_ext[run_sensor->sensor_index].dev_num, strerror(errno));
 		set_test_state(FAILED);
-		return true;
+		return -1;
 	}
-	ev.data.fd = fd;
-	ev.events = EPOLLIN;
-	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
-		log_msg_and_exit_on_error(ERROR, "Error epoll_ctl ADD for iio:device%d: %s\n",
-			g_sensor_info_iio_ext[sensor_index].dev_num, strerror(errno));
-		set_test_state(FAILED);        
-		return true;
+	return watch_sensor_fd(run_sensor, fd);
+}
+
+/* common setup of the tests which stream a triggered sensor, before
+** they allocate their accumulator: set the rate to freq (with 0, the
+** sensor streams at its current rate) and enable the buffer
+*/
+static int start_stream(run_sensor_struct *run_sensor, float freq) {
+	int sensor_index;
+
+	sensor_index = run_sensor->sensor_index;
+
+	if (g_sensor_info_iio_ext[sensor_index].mode == MODE_POLL) {
+		log_msg_and_exit_on_error(ERROR, "This test is not available for %s!\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(SKIPPED);
+		return -1;
 	}
-	
-	g_sensor_info_iio_ext[sensor_index].read_fd = fd;    
-	hashmapPut(map_fd_to_sensor_index, (void*)fd, (void*)sensor_index);
-	
-	return true;
+
+	if (freq != 0 && set_freq(sensor_index, freq) == -1)
+		return -1;
+	return ensure_sensor_active(sensor_index);
+}
+
+/* samples a sensor delivers in TIME_TO_MEASURE_SECS at its current rate,
+** with margin, so accumulators never grow while streaming
+*/
+static int expected_samples(int sensor_index) {
+	int samples;
+
+	samples = (int)(g_sensor_info_iio_ext[sensor_index].data_rate *
+		(TIME_TO_MEASURE_SECS + 2)) * 2;
+	if (samples < COUNTER)
+		samples = COUNTER;
+	return samples;
+}
+
+/* initialize structures, frequency
+** and reading fds used in tests which measure timestamp
+*/
+int generic_initialize(run_sensor_struct *run_sensor) {
+	int sensor_index;
+	time_attributes_struct* time_attributes;
+	timestamp_info_struct* timestamp_info;
+
+	time_attributes = run_sensor->time_attributes;
+	sensor_index = run_sensor->sensor_index;
+
+	if (start_stream(run_sensor, time_attributes->freq) == -1)
+		return -1;
+	time_attributes->freq = g_sensor_info_iio_ext[sensor_index].data_rate;
+
+	timestamp_info = (timestamp_info_struct*)arena_alloc(&g_test_arena,
+		sizeof(timestamp_info_struct));
+	run_sensor->values = timestamp_info;
+
+	return open_and_watch_sensor(run_sensor);
+}
+/* initialize structures and reading fds used in rate switch tests;
+** rate is not set here, the wrapper switches it while streaming
+*/
+int rate_switch_initialize(run_sensor_struct *run_sensor) {
+	int sensor_index;
+	time_attributes_struct* time_attributes;
+	rate_switch_struct* rate_switch;
+
+	time_attributes = run_sensor->time_attributes;
+	sensor_index = run_sensor->sensor_index;
+
+	if (g_sensor_info_iio_ext[sensor_index].data_rate <= 0 ||
+		g_sensor_info_iio_ext[sensor_index].data_rate == time_attributes->freq) {
+		log_msg_and_exit_on_error(ERROR, "Device %s already has rate %f, nothing to switch!\n",
+			g_sensor_info_iio_ext[sensor_index].id, g_sensor_info_iio_ext[sensor_index].data_rate);
+		set_test_state(SKIPPED);
+		return -1;
+	}
+
+	/* the rate is switched by the wrapper */
+	if (start_stream(run_sensor, 0) == -1)
+		return -1;
+
+	rate_switch = (rate_switch_struct*)arena_alloc(&g_test_arena, sizeof(rate_switch_struct));
+	rate_switch->old_rate = g_sensor_info_iio_ext[sensor_index].data_rate;
+	rate_switch->new_rate = time_attributes->freq;
+	rate_switch->first_timestamp = -1;
+	run_sensor->values = rate_switch;
+
+	return open_and_watch_sensor(run_sensor);
 }
 /* initialize structures, frequency, reading fds
 ** used in standard deviation tests  
 ** and start threads for polling mode sensors
 */
-bool standard_deviation_initialize(void* key, void* value, void* context) {
-	
-	int fd;
-	int dev_num;
-	int return_value;
-	int counter;  
+int standard_deviation_initialize(run_sensor_struct *run_sensor) {
 	int i;
 	int num_channels;
-	int mem_counter;
 	int sensor_index;
-	float standard_dev;
+	int values_size;
 	float max_dev;
-	char sysfs_path[PATH_MAX];
-	struct epoll_event ev;
 	standard_deviation_struct* st_dev_info;
-	int enabled;
 	int pfd[2];
-	Hashmap *sensor_info;
-	pthread_t thread;
 		
-	/*if returns false the other sensors won't be analysed */
-	sensor_index = (int)key;
+	sensor_index = run_sensor->sensor_index;
 	max_dev = get_standard_deviation_value(sensor_index);
 	if (max_dev == -1) {
 		log_msg_and_exit_on_error(ERROR, "This test is not available for %s!\n",
-			g_sensor_info_iio_ext[sensor_index].tag);
+			g_sensor_info_iio_ext[sensor_index].id);
 		set_test_state(SKIPPED);
-		return true;
+		return -1;
 	}
 
 	num_channels = g_sensor_info_iio_ext[sensor_index].num_channels;
-	dev_num = g_sensor_info_iio_ext[sensor_index].dev_num;
-	sensor_info = (Hashmap*) context;
-	memset(sysfs_path, '\0', PATH_MAX);
 
-	st_dev_info = (standard_deviation_struct*)malloc(sizeof(standard_deviation_struct));    
-	if (st_dev_info == NULL) {
-		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-		set_test_state(FAILED);
-		exit(-1);
-	}
-	st_dev_info->channels_values = (float**)malloc(sizeof(float*) * num_channels);
-	if (st_dev_info->channels_values == NULL) {
-			log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-			set_test_state(FAILED);
-			exit(-1);
-	}
-	for (i = 0; i < num_channels; i++) {
-		st_dev_info->channels_values[i] = (float *)malloc(COUNTER * sizeof(float));
-		if (st_dev_info->channels_values[i] == NULL) {
-			log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-			set_test_state(FAILED);
-			exit(-1);
-		}
+	if (g_sensor_info_iio_ext[sensor_index].mode == MODE_TRIGGER) {
+		if (start_stream(run_sensor, get_cdd_freq(sensor_index, 0)) == -1)
+			return -1;
 	}
+	else if (set_cdd_freq(sensor_index) == -1)
+		return -1;
 
-	st_dev_info->channels_values_size = COUNTER;
-	st_dev_info->counter = 0;
-
-	hashmapPut(sensor_info, (void*)sensor_index, (void*)st_dev_info);
-
-	if (set_cdd_freq(sensor_index) == -1)
-		return true;
+	values_size = expected_samples(sensor_index);
+	st_dev_info = (standard_deviation_struct*)arena_alloc(&g_test_arena,
+		sizeof(standard_deviation_struct));
+	st_dev_info->channels_values = (float**)arena_alloc(&g_test_arena,
+		sizeof(float*) * num_channels);
+	for (i = 0; i < num_channels; i++)
+		st_dev_info->channels_values[i] = (float *)arena_alloc(&g_test_arena,
+			values_size * sizeof(float));
+	st_dev_info->channels_values_size = values_size;
+	run_sensor->values = st_dev_info;
 	
 	/* sensors in trigger mode */
-	if (g_sensor_info_iio_ext[sensor_index].mode == MODE_TRIGGER) {
-		snprintf(sysfs_path, PATH_MAX, ENABLE_PATH, dev_num);
-		if (sysfs_read_int(sysfs_path, &enabled) == -1) {
-			log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path); 
-			set_test_state(FAILED);
-			return true;
-		}
-		if (!enabled) {
-			if (activate_sensor(sensor_index, 1) == -1) {
-				return true;
-			}  
-		}
+	if (g_sensor_info_iio_ext[sensor_index].mode == MODE_TRIGGER)
+		return open_and_watch_sensor(run_sensor);
 
-		snprintf(sysfs_path, PATH_MAX, DEV_FILE_PATH, dev_num);
-		fd = open(sysfs_path, O_RDONLY);
-		if (fd == -1) {
-			log_msg_and_exit_on_error(ERROR, "Error opening file iio:device%d: %s\n",
-				dev_num, strerror(errno));  
-			set_test_state(FAILED);
-			return true;
-		}
-	}
 	/* sensors in polling mode => use threads and pipes to simulate 
 	** a frequency for reading samples
 	*/
-	else{
-		if (pipe(pfd) == -1) {
-			log_msg_and_exit_on_error(ERROR, "Can't create pipe for polling sensor %s\n",
-				g_sensor_info_iio_ext[sensor_index].tag);
-			set_test_state(FAILED);
-			return true;
-		}
-		g_sensor_info_iio_ext[sensor_index].write_fd = pfd[WRITE];
-		if (pthread_create(&thread, NULL, &thread_routine, (void*)sensor_index)) {
-			log_msg_and_exit_on_error(ERROR, "Can't create thread for sensor %s\n",
-				g_sensor_info_iio_ext[sensor_index].tag);
-			set_test_state(FAILED);
-			return true;
-		}
-		threads[sensor_index] = thread;
-		fd = pfd[READ];
+	if (pipe(pfd) == -1) {
+		log_msg_and_exit_on_error(ERROR, "Can't create pipe for polling sensor %s\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(FAILED);
+		return -1;
 	}
-	
-	g_sensor_info_iio_ext[sensor_index].read_fd = fd;
-	g_sensor_info_iio_ext[sensor_index].last_timestamp = -1;    
-
-	ev.data.fd = fd;
-	ev.events = EPOLLIN;
-	if (epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
-		log_msg_and_exit_on_error(ERROR, "Error epoll_ctl ADD for iio:device%d: %s\n",
-			dev_num, strerror(errno));
+	g_sensor_info_iio_ext[sensor_index].write_fd = pfd[WRITE];
+	if (pthread_create(&run_sensor->thread, NULL, &thread_routine, (void*)(intptr_t)sensor_index)) {
+		log_msg_and_exit_on_error(ERROR, "Can't create thread for sensor %s\n",
+			g_sensor_info_iio_ext[sensor_index].id);
 		set_test_state(FAILED);
-		return true;
+		return -1;
 	}
-	hashmapPut(map_fd_to_sensor_index, (void*)fd, (void*)sensor_index);    
-
-	return true; 
+	return watch_sensor_fd(run_sensor, pfd[READ]);
 }
 
 /* initialize structures, frequency
 ** and reading fds used in jitter tests
 */
-bool jitter_initialize(void* key, void* value, void* context) {
+int jitter_initialize(run_sensor_struct *run_sensor) {
 	int sensor_index;
-	char sysfs_path[PATH_MAX];
 	jitter_struct* jitter_info;
-	Hashmap *sensor_info;
-	int fd;
-	int dev_num; 
-	struct epoll_event ev;
-	int enabled;
 
-	sensor_index = (int)key;
-	dev_num = g_sensor_info_iio_ext[sensor_index].dev_num;
-	sensor_info = (Hashmap*) context;
-	memset(sysfs_path, '\0', PATH_MAX);
+	sensor_index = run_sensor->sensor_index;
 
-	if (g_sensor_info_iio_ext[sensor_index].mode == MODE_POLL) {
-		log_msg_and_exit_on_error(ERROR, "This test is not available for %s!\n",
-			g_sensor_info_iio_ext[sensor_index].tag);
-		set_test_state(SKIPPED);
-		return true;
-	}   
+	if (start_stream(run_sensor, get_cdd_freq(sensor_index, 0)) == -1)
+		return -1;
 
-	jitter_info = (jitter_struct*)malloc(sizeof(jitter_struct));
-	 if (jitter_info == NULL) {
-		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-		set_test_state(FAILED);
-		exit(-1);
-	}
+	jitter_info = (jitter_struct*)arena_alloc(&g_test_arena, sizeof(jitter_struct));
+	jitter_info->timestamp_values_size = expected_samples(sensor_index);
+	jitter_info->timestamp_values = (int64_t *)arena_alloc(&g_test_arena,
+		jitter_info->timestamp_values_size * sizeof(int64_t));
+	run_sensor->values = jitter_info;
+	return open_and_watch_sensor(run_sensor);
+}
 
-	jitter_info->timestamp_values = (int64_t *)malloc(COUNTER * sizeof(int64_t));
-	if (jitter_info->timestamp_values == NULL) {
-		log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
-		set_test_state(FAILED);
-		exit(-1);
-	}
-	jitter_info->timestamp_values_size = COUNTER;
-	jitter_info->counter = 0;
+/* initialize frequency, Allan variance accumulators
+** and reading fds used in allan_variance tests
+*/
+int allan_variance_initialize(run_sensor_struct *run_sensor) {
+	allan_variance_struct* allan;
 
-	hashmapPut(sensor_info, (void*)sensor_index, (void*)jitter_info);
+	if (start_stream(run_sensor, run_sensor->time_attributes->freq) == -1)
+		return -1;
+	allan = (allan_variance_struct*)arena_alloc(&g_test_arena, sizeof(allan_variance_struct));
+	allan_variance_init(allan, g_sensor_info_iio_ext[run_sensor->sensor_index].num_channels);
+	run_sensor->values = allan;
+	return open_and_watch_sensor(run_sensor);
+}
 
-	if (set_cdd_freq(sensor_index) == -1) {
-		return true;
-	}
+/* initialize frequency, spectrum accumulators
+** and reading fds used in noise_spectrum tests
+*/
+int noise_spectrum_initialize(run_sensor_struct *run_sensor) {
+	noise_spectrum_struct* spectrum;
 
-	snprintf(sysfs_path, PATH_MAX, ENABLE_PATH, dev_num);
-	if (sysfs_read_int(sysfs_path, &enabled) == -1) {
-		log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path); 
-		set_test_state(FAILED);
-		return true;
+	if (start_stream(run_sensor, run_sensor->time_attributes->freq) == -1)
+		return -1;
+	spectrum = (noise_spectrum_struct*)arena_alloc(&g_test_arena, sizeof(noise_spectrum_struct));
+	noise_spectrum_init(spectrum, g_sensor_info_iio_ext[run_sensor->sensor_index].num_channels);
+	run_sensor->values = spectrum;
+	return open_and_watch_sensor(run_sensor);
+}
+
+/* initialize frequency, timestamps and reading fds used in check_sync
+** tests; the current trigger tells which sensors should be in sync
+*/
+int sync_initialize(run_sensor_struct *run_sensor) {
+	char sysfs_path[PATH_MAX];
+	int sensor_index;
+	sync_struct* sync_info;
+
+	if (start_stream(run_sensor, run_sensor->time_attributes->freq) == -1)
+		return -1;
+	sensor_index = run_sensor->sensor_index;
+	sync_info = (sync_struct*)arena_alloc(&g_test_arena, sizeof(sync_struct));
+	memset(sync_info, 0, sizeof(sync_struct));
+	memset(sysfs_path, '\0', PATH_MAX);
+	snprintf(sysfs_path, PATH_MAX, TRIGGER_PATH, g_sensor_info_iio_ext[sensor_index].dev_num);
+	if (sysfs_read_str(sysfs_path, sync_info->trigger, MAX_NAME_SIZE) == -1)
+		sync_info->trigger[0] = '\0';
+	sync_info->timestamp_values_size = expected_samples(sensor_index);
+	sync_info->timestamp_values = (int64_t *)arena_alloc(&g_test_arena,
+		sync_info->timestamp_values_size * sizeof(int64_t));
+	run_sensor->values = sync_info;
+
+	return open_and_watch_sensor(run_sensor);
+}
+
+/* disable events enabled by events_initialize when it fails */
+static int abort_events(int sensor_index, events_struct *events) {
+	if (events->event_fd != -1)
+		close(events->event_fd);
+	disable_events(sensor_index, events);
+	return -1;
+}
+
+/* enable threshold and motion events of a sensor and watch its event
+** fd; the buffer of a triggered sensor is streamed in the same loop
+*/
+int events_initialize(run_sensor_struct *run_sensor) {
+	int sensor_index;
+	int fd;
+	time_attributes_struct* time_attributes;
+	events_struct *events;
+
+	time_attributes = run_sensor->time_attributes;
+	sensor_index = run_sensor->sensor_index;
+
+	events = (events_struct*)arena_alloc(&g_test_arena, sizeof(events_struct));
+	events->event_fd = -1;
+	events->start = get_timestamp_monotonic();
+	if (enable_events(sensor_index, events) == 0) {
+		log_msg_and_exit_on_error(ERROR, "Device %s has no threshold or motion events!\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(SKIPPED);
+		return -1;
 	}
-	if (!enabled) {
-		if (activate_sensor(sensor_index, 1) == -1) {
-			return true;
-		}  
+
+	if (g_sensor_info_iio_ext[sensor_index].mode == MODE_TRIGGER) {
+		if (time_attributes->freq > 0 && set_freq(sensor_index, time_attributes->freq) == -1)
+			return abort_events(sensor_index, events);
+		if (ensure_sensor_active(sensor_index) == -1)
+			return abort_events(sensor_index, events);
 	}
-	snprintf(sysfs_path, PATH_MAX, DEV_FILE_PATH, dev_num);
-	fd = open(sysfs_path, O_RDONLY);
+
+	fd = open_device_fd(sensor_index, 0);
 	if (fd == -1) {
 		log_msg_and_exit_on_error(ERROR, "Error opening file iio:device%d: %s\n",
-			dev_num, strerror(errno));   
+			g_sensor_info_iio_ext[sensor_index].dev_num, strerror(errno));
 		set_test_state(FAILED);
-		return true;
+		return abort_events(sensor_index, events);
 	}
+	/* the copy watching events shares the values */
+	run_sensor->values = events;
+	events->event_fd = get_event_fd(sensor_index, fd);
+	if (events->event_fd == -1 || watch_event_fd(run_sensor, events->event_fd) == -1) {
+		run_sensor->values = NULL;
+		close_device_fd(sensor_index, fd);
+		return abort_events(sensor_index, events);
+	}
+	if (g_sensor_info_iio_ext[sensor_index].mode == MODE_TRIGGER)
+		return watch_sensor_fd(run_sensor, fd);
+	return close_device_fd(sensor_index, fd);
+}
 
-	g_sensor_info_iio_ext[sensor_index].read_fd = fd;
-	g_sensor_info_iio_ext[sensor_index].last_timestamp = -1;
-	ev.data.fd = fd;
-	ev.events = EPOLLIN;
-	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
-		log_msg_and_exit_on_error(ERROR, "Error epoll_ctl ADD for iio:device%d: %s\n",
-			dev_num, strerror(errno));
+/* program the hrtimer of a sensor and watch it in check_trigger tests */
+int trigger_accuracy_initialize(run_sensor_struct *run_sensor) {
+	char sysfs_path[PATH_MAX];
+	int sensor_index;
+	int hr_trigger_nr;
+	time_attributes_struct* time_attributes;
+	trigger_accuracy_struct *accuracy;
+
+	time_attributes = run_sensor->time_attributes;
+	sensor_index = run_sensor->sensor_index;
+	hr_trigger_nr = g_sensor_info_iio_ext[sensor_index].hr_trigger_nr;
+
+	if (g_sensor_info_iio_ext[sensor_index].mode != MODE_TRIGGER ||
+		g_sensor_info_iio_ext[sensor_index].is_virtual || hr_trigger_nr == -1) {
+		log_msg_and_exit_on_error(ERROR, "Device %s has no hrtimer trigger!\n",
+			g_sensor_info_iio_ext[sensor_index].id);
+		set_test_state(SKIPPED);
+		return -1;
+	}
+
+	/* without freq, the hrtimer fires at the current rate of the sensor */
+	if (set_freq(sensor_index, time_attributes->freq > 0 ? time_attributes->freq :
+		g_sensor_info_iio_ext[sensor_index].data_rate) == -1)
+		return -1;
+
+	accuracy = (trigger_accuracy_struct*)arena_alloc(&g_test_arena,
+		sizeof(trigger_accuracy_struct));
+	memset(sysfs_path, '\0', PATH_MAX);
+	snprintf(sysfs_path, PATH_MAX, TRIGGER_FREQ_PATH, hr_trigger_nr);
+	if (sysfs_read_float(sysfs_path, &accuracy->freq) == -1 || accuracy->freq <= 0) {
+		log_msg_and_exit_on_error(ERROR, "Can't read value from %s\n", sysfs_path);
 		set_test_state(FAILED);
-		return true;
+		return -1;
 	}
-	hashmapPut(map_fd_to_sensor_index, (void*)fd, (void*)sensor_index);
-	return true;    
+	accuracy->period = (int64_t)(CONVERT_SEC_TO_NANO(1) / accuracy->freq);
+	accuracy->concurrent = run_sensor->context->sensors_count > 1;
+	run_sensor->values = accuracy;
+
+	if (ensure_sensor_active(sensor_index) == -1)
+		return -1;
+	return open_and_watch_sensor(run_sensor);
+}
+
+/* initialize frequency and reading fds of devices attached to the
+** trigger of check_fanout tests
+*/
+int fanout_initialize(run_sensor_struct *run_sensor) {
+	int sensor_index;
+	time_attributes_struct* time_attributes;
+
+	time_attributes = run_sensor->time_attributes;
+	sensor_index = run_sensor->sensor_index;
+
+	if (set_freq(sensor_index, time_attributes->freq) == -1)
+		return -1;
+	if (ensure_sensor_active(sensor_index) == -1)
+		return -1;
+	run_sensor->values = new_fanout_device();
+	return open_and_watch_sensor(run_sensor);
+}
+
+/* initialize frequency, streaming metrics and reading fds used in soak */
+int soak_initialize(run_sensor_struct *run_sensor) {
+	if (start_stream(run_sensor, run_sensor->time_attributes->freq) == -1)
+		return -1;
+	/* the period comes from the rate just set */
+	run_sensor->values = new_soak_sensor(run_sensor->sensor_index);
+	return open_and_watch_sensor(run_sensor);
 }
 
 /* call compute phase and close fds */
-bool generic_finalize(void* key, void* value, void* context) {
+void generic_finalize(run_sensor_struct *run_sensor, int (*wrapper) (int, void*, int)) {
 	int sensor_index;
 	int fd;
 
-	sensor_index = (int)key;
-	fd = g_sensor_info_iio_ext[sensor_index].read_fd;
-	
-	int (*wrapper) (int, void*, int) = (int (*) (int, void*, int))context;
+	sensor_index = run_sensor->sensor_index;
+	fd = run_sensor->fd;
 	
-	wrapper(sensor_index, value, FINALIZE);
+	wrapper(sensor_index, run_sensor, FINALIZE);
+	if (run_sensor->profile->wrapper.counter)
+		report_stage_profile(sensor_index, run_sensor->profile);
 	if (fd != -1) {
-		if (close(fd) == -1) {
+		if (close_device_fd(sensor_index, fd) == -1) {
 			log_msg_and_exit_on_error(ERROR, "Error closing fd %d for device %s: %s\n", 
-				fd, g_sensor_info_iio_ext[sensor_index].tag, strerror(errno));
+				fd, g_sensor_info_iio_ext[sensor_index].id, strerror(errno));
 			set_test_state(FAILED);
 		}    
 		else{
 			log_msg_and_exit_on_error(VERBOSE, "Closed fd %d for device %s\n", fd,
-				g_sensor_info_iio_ext[sensor_index].tag);
+				g_sensor_info_iio_ext[sensor_index].id);
 		}
 		g_sensor_info_iio_ext[sensor_index].read_fd= -1;
+		run_sensor->fd = -1;
 	}
+}
+
+/* copy sensors selected by the command in the dense array of the run */
+static bool add_run_sensor(void* key, void* value, void* context) {
+	run_context_struct *run_context;
+	run_sensor_struct *run_sensor;
+
+	run_context = (run_context_struct*)context;
+	run_sensor = &run_context->sensors[run_context->sensors_count++];
+	run_sensor->sensor_index = (int)(intptr_t)key;
+	run_sensor->time_attributes = (time_attributes_struct*)value;
+	run_sensor->fd = -1;
+	run_sensor->mode = g_sensor_info_iio_ext[run_sensor->sensor_index].mode;
+	run_sensor->context = run_context;
+	run_sensor->profile = (stage_profile_struct*)arena_alloc(&g_test_arena,
+		sizeof(stage_profile_struct));
 	return true;
 }
 
+/* a device has one buffer: a second sensor of it in the same command
+** would fail to open it (EBUSY), or get the same warm fd in server mode
+** and fail to watch it twice, so the command is rejected up front
+*/
+static int check_shared_devices(run_context_struct *run_context) {
+	int a;
+	int b;
+	int i;
+	int j;
+
+	for (i = 0; i < run_context->sensors_count; i++) {
+		a = run_context->sensors[i].sensor_index;
+		if (g_sensor_info_iio_ext[a].is_virtual)
+			continue;
+		for (j = 0; j < i; j++) {
+			b = run_context->sensors[j].sensor_index;
+			if (g_sensor_info_iio_ext[b].is_virtual ||
+				g_sensor_info_iio_ext[a].dev_num != g_sensor_info_iio_ext[b].dev_num)
+				continue;
+			log_msg_and_exit_on_error(ERROR, "Devices %s and %s share iio:device%d and "
+				"can't be read in the same command\n", g_sensor_info_iio_ext[b].id,
+				g_sensor_info_iio_ext[a].id, g_sensor_info_iio_ext[a].dev_num);
+			set_test_state(FAILED);
+			return -1;
+		}
+	}
+	return 0;
+}
+
 /* initialize, poll and call specific wrapper functions when data ready */
-int poll_sensors(bool (*initialize) (void*, void*, void*),
+int poll_sensors(int (*initialize) (run_sensor_struct*),
 	int (*wrapper) (int, void*, int), int duration) {
 	
 	int duration_to_millisecs;
-	struct epoll_event ret_ev;
+	int events_count;
+	int samples;
+	int i;
 	time_t start_time, final_time;
-	int sensor_index;
-	Hashmap *map_sensor_index_values;
-	
-	map_fd_to_sensor_index = hashmapCreate(HASHMAP_SIZE, hash, intEquals);
-	if (map_fd_to_sensor_index == NULL) {
-		log_msg_and_exit_on_error(ERROR, "Error creating Hashmap!\n");
-		set_test_state(FAILED);
-		return -1;
-	}
+	run_sensor_struct *run_sensor;
+	run_context_struct run_context;
 
-	map_sensor_index_values = hashmapCreate(HASHMAP_SIZE, hash, intEquals);
-	if (map_sensor_index_values == NULL) {
-		log_msg_and_exit_on_error(ERROR, "Error creating Hashmap!\n");
-		set_test_state(FAILED);
+	memset(&run_context, 0, sizeof(run_context_struct));
+	run_context.sensors = (run_sensor_struct*)arena_alloc(&g_test_arena,
+		(selected_sensors_count + 1) * sizeof(run_sensor_struct));
+	for_each_selected_sensor(add_run_sensor, (void*)&run_context);
+
+	/* no device can be tested */
+	if (run_context.sensors_count == 0) {
 		return -1;
 	}
+	if (check_shared_devices(&run_context) == -1)
+		return -1;
 
-   
-	duration_to_millisecs = CONVERT_SEC_TO_MILLI(duration);
-	epfd = epoll_create(hashmapSize(map_sensor_index_to_time_attributes));
-	if (epfd == -1) {
+	/* a duration of 0 still waits for samples, epoll_wait must not spin */
+	duration_to_millisecs = CONVERT_SEC_TO_MILLI(duration > 0 && duration < POLL_MAX_WAIT_SECS ?
+		duration : POLL_MAX_WAIT_SECS);
+	run_context.epfd = epoll_create(run_context.sensors_count);
+	if (run_context.epfd == -1) {
 		log_msg_and_exit_on_error(ERROR, "Error epoll_create: %s\n", strerror(errno));
 		set_test_state(FAILED);
 		return -1;
 	}
 
-	hashmapForEach(map_sensor_index_to_time_attributes, initialize,
-		(void*)map_sensor_index_values);
-	
+	for (i = 0; i < run_context.sensors_count; i++)
+		initialize(&run_context.sensors[i]);
+
+	struct epoll_event ret_ev[run_context.sensors_count];
+
 	/* no device can be tested */
-	if ((hashmapSize(map_fd_to_sensor_index) == 0) || (hashmapSize(map_sensor_index_values) == 0))
+	if (run_context.watched == 0) {
+		close(run_context.epfd);
 		return -1;
+	}
+	samples = 0;
+	start_perf_counters();
 	time(&start_time);
 	time(&final_time); 
 	while((difftime(final_time, start_time) <= duration)) {
-		if (epoll_wait(epfd, &ret_ev, 1, duration_to_millisecs) == -1) {
+		events_count = epoll_wait(run_context.epfd, ret_ev, run_context.sensors_count,
+			duration_to_millisecs);
+		if (events_count == -1) {
 			log_msg_and_exit_on_error(ERROR, "Error epoll_wait: %s\n", strerror(errno));
 			set_test_state(FAILED); 
-			return -1;
+			break;
 		}
-		if ((ret_ev.events & EPOLLIN) != 0) {
-			sensor_index = (int)hashmapGet(map_fd_to_sensor_index, (void*)ret_ev.data.fd);
-			void* timestamp_info = (void*)hashmapGet(map_sensor_index_values, (void*)sensor_index);
-			wrapper(sensor_index, timestamp_info, PROCESS);
+		profile_epoll_return();
+		for (i = 0; i < events_count; i++) {
+			if ((ret_ev[i].events & EPOLLIN) == 0)
+				continue;
+			run_sensor = (run_sensor_struct*)ret_ev[i].data.ptr;
+			if (run_sensor->mode == MODE_STALL) {
+				stall_expired(run_sensor);
+				continue;
+			}
+			wrapper(run_sensor->sensor_index, run_sensor, PROCESS);
+			profile_wrapper_done(run_sensor->profile);
+			if (run_sensor->stall != NULL)
+				stall_rearm(run_sensor);
+			samples++;
 		}
+		/* the outcome of every sensor is known, see iio_early_stop.c */
+		if (run_context.settled == run_context.watched)
+			break;
 		time(&final_time);
 	}
+	stop_perf_counters(samples);
+
+	for (i = 0; i < run_context.sensors_count; i++)
+		if (run_context.sensors[i].stall != NULL)
+			stall_report(&run_context.sensors[i]);
+	for (i = 0; i < run_context.sensors_count; i++)
+		if (run_context.sensors[i].early_stop != NULL)
+			early_stop_report(&run_context.sensors[i]);
+	for (i = 0; i < run_context.sensors_count; i++)
+		if (run_context.sensors[i].values != NULL)
+			generic_finalize(&run_context.sensors[i], wrapper);
 	
-	hashmapForEach(map_sensor_index_values, generic_finalize, (void*)wrapper);
-	
-	if (close(epfd) == -1) {
+	if (close(run_context.epfd) == -1) {
 		log_msg_and_exit_on_error(ERROR, "Error closing fd for epoll: %s\n", strerror(errno));
 		set_test_state(FAILED);
 		return -1;
 	}
 	log_msg_and_exit_on_error(VERBOSE, "Closed fd for epoll\n");
-	free(map_sensor_index_values);
-	free(map_fd_to_sensor_index);
 	return 0;         
 	
 }
-
@@ -18,11 +18,20 @@
 #ifndef __IIO_TESTS_H__
 #define __IIO_TESTS_H__
 
-int poll_sensors(bool (*initialize) (void*, void*, void*), int (*wrapper) (int, void*, int), int duration);
-bool generic_initialize(void* key, void* value, void* context);
-bool jitter_initialize(void* key, void* value, void* context);
-bool standard_deviation_initialize(void* key, void* value, void* context);
-bool generic_finalize(void* key, void* value, void* context);
+int poll_sensors(int (*initialize) (run_sensor_struct*), int (*wrapper) (int, void*, int), int duration);
+int watch_sensor_fd(run_sensor_struct *run_sensor, int fd);
+int generic_initialize(run_sensor_struct *run_sensor);
+int jitter_initialize(run_sensor_struct *run_sensor);
+int standard_deviation_initialize(run_sensor_struct *run_sensor);
+int rate_switch_initialize(run_sensor_struct *run_sensor);
+int allan_variance_initialize(run_sensor_struct *run_sensor);
+int noise_spectrum_initialize(run_sensor_struct *run_sensor);
+int sync_initialize(run_sensor_struct *run_sensor);
+int events_initialize(run_sensor_struct *run_sensor);
+int trigger_accuracy_initialize(run_sensor_struct *run_sensor);
+int fanout_initialize(run_sensor_struct *run_sensor);
+int soak_initialize(run_sensor_struct *run_sensor);
+void generic_finalize(run_sensor_struct *run_sensor, int (*wrapper) (int, void*, int));
 int standard_deviation_wrapper(int sensor_index, void* counter_timestamp, int stage);
 int check_client_average_delay_wrapper(int sensor_index, void* counter_timestamp, int stage);
 int check_client_delay_wrapper(int sensor_index, void* counter_timestamp, int stage);
@@ -30,5 +39,13 @@ int measure_freq_wrapper(int sensor_index, void* counter_timestamp, int stage);
 int check_sample_timestamp_average_difference_wrapper(int sensor_index, void* counter_timestamp, int stage);
 int check_sample_timestamp_difference_wrapper(int sensor_index, void* counter_timestamp, int stage);
 int test_jitter_wrapper(int sensor_index, void* counter_timestamp, int stage);
+int check_rate_switch_wrapper(int sensor_index, void* counter_timestamp, int stage);
+int allan_variance_wrapper(int sensor_index, void* counter_timestamp, int stage);
+int noise_spectrum_wrapper(int sensor_index, void* counter_timestamp, int stage);
+int check_sync_wrapper(int sensor_index, void* counter_timestamp, int stage);
+int check_events_wrapper(int sensor_index, void* counter_timestamp, int stage);
+int trigger_accuracy_wrapper(int sensor_index, void* counter_timestamp, int stage);
+int fanout_wrapper(int sensor_index, void* counter_timestamp, int stage);
+int soak_wrapper(int sensor_index, void* counter_timestamp, int stage);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,212 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include "iio_trace.h"
+#include "iio_utils.h"
+
+/*
+** ftrace integration: with -t, harness events are written to tracefs
+** trace_marker so they appear in the same timeline as the IRQ and
+** iio_trigger tracepoints. Actions which take time (buffer enable,
+** trigger and rate writes, tests) are begin/end slices in the atrace
+** format ("B|pid|name" ... "E|pid") that systrace and perfetto draw;
+** reads and threshold violations are plain markers.
+** With -T the ring buffer is also cleared when a test starts and, if
+** the test fails, swapped into the snapshot buffer and saved next to the
+** test logs, so the trace of a failing test is kept whatever follows.
+*/
+
+int g_trace;
+static int marker_fd = -1;
+static pid_t trace_pid;
+static char tracing_path[PATH_MAX];
+
+static int write_tracing_file(const char *name, const char *value, int flags) {
+	char path[PATH_MAX];
+	int fd;
+	int ret;
+
+	if (snprintf(path, PATH_MAX, "%s/%s", tracing_path, name) >= PATH_MAX) {
+		log_msg_and_exit_on_error(ERROR, "Tracing path %s/%s is too long\n", tracing_path, name);
+		return -1;
+	}
+	fd = open(path, O_WRONLY | flags);
+	if (fd == -1) {
+		log_msg_and_exit_on_error(DEBUG, "Cannot open %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+	ret = write(fd, value, strlen(value));
+	close(fd);
+	return ret == -1 ? -1 : 0;
+}
+
+/* open trace_marker of the tracefs mounted in dir, -1 if it can't be */
+static int open_marker(const char *dir) {
+	char path[PATH_MAX];
+
+	if (snprintf(tracing_path, PATH_MAX, "%s", dir) >= PATH_MAX ||
+		snprintf(path, PATH_MAX, "%s/trace_marker", tracing_path) >= PATH_MAX) {
+		log_msg_and_exit_on_error(ERROR, "Tracing path %s is too long\n", dir);
+		return -1;
+	}
+	return open(path, O_WRONLY);
+}
+
+int open_trace(int mode) {
+	marker_fd = open_marker(TRACEFS_PATH);
+	if (marker_fd == -1)
+		marker_fd = open_marker(DEBUGFS_TRACING_PATH);
+	if (marker_fd == -1) {
+		log_msg_and_exit_on_error(ERROR, "Cannot open trace_marker in %s or %s (%s)\n",
+			TRACEFS_PATH, DEBUGFS_TRACING_PATH, strerror(errno));
+		return -1;
+	}
+	trace_pid = getpid();
+	g_trace = mode;
+	return 0;
+}
+
+void close_trace(void) {
+	if (marker_fd != -1)
+		close(marker_fd);
+	marker_fd = -1;
+	g_trace = 0;
+}
+
+static void write_marker(const char *prefix, const char *format, va_list arg) {
+	char marker[TRACE_MARKER_SIZE];
+	int len;
+
+	len = snprintf(marker, TRACE_MARKER_SIZE, "%s", prefix);
+	len += vsnprintf(marker + len, TRACE_MARKER_SIZE - len, format, arg);
+	if (len >= TRACE_MARKER_SIZE)
+		len = TRACE_MARKER_SIZE - 1;
+	/* tracing is best effort, a full or disabled buffer is not an error */
+	if (write(marker_fd, marker, len) == -1)
+		return;
+}
+
+void trace_marker(const char *format, ...) {
+	va_list arg;
+
+	if (marker_fd == -1)
+		return;
+	va_start(arg, format);
+	write_marker("iio_tf: ", format, arg);
+	va_end(arg);
+}
+
+void trace_begin(const char *format, ...) {
+	char prefix[MAX_NAME_SIZE];
+	va_list arg;
+
+	if (marker_fd == -1)
+		return;
+	snprintf(prefix, MAX_NAME_SIZE, "B|%d|", trace_pid);
+	va_start(arg, format);
+	write_marker(prefix, format, arg);
+	va_end(arg);
+}
+
+void trace_end(void) {
+	char marker[MAX_NAME_SIZE];
+
+	if (marker_fd == -1)
+		return;
+	snprintf(marker, MAX_NAME_SIZE, "E|%d", trace_pid);
+	if (write(marker_fd, marker, strlen(marker)) == -1)
+		return;
+}
+
+void trace_violation(int sensor_index, const char *metric, double value, double threshold) {
+	trace_marker("violation %s %s %g > %g", g_sensor_info_iio_ext[sensor_index].id,
+		metric, value, threshold);
+}
+
+/* empty the ring buffer and allocate the snapshot buffer before the
+** test, so a snapshot holds only what happened during it
+*/
+void trace_test_begin(int test) {
+	if (g_trace == TRACE_SNAPSHOTS) {
+		if (write_tracing_file("snapshot", "1", 0) == -1 ||
+			write_tracing_file("snapshot", "2", 0) == -1)
+			log_msg_and_exit_on_error(DEBUG, "Can't arm trace snapshot\n");
+		write_tracing_file("trace", "", O_TRUNC);
+	}
+	trace_begin("iio_test %d", test);
+}
+
+/* copy the snapshot buffer in path */
+static int save_snapshot(const char *path) {
+	char snapshot_path[PATH_MAX];
+	char buffer[BUFFER_SIZE];
+	int in_fd;
+	int out_fd;
+	ssize_t len;
+
+	if (snprintf(snapshot_path, PATH_MAX, "%s/snapshot", tracing_path) >= PATH_MAX) {
+		log_msg_and_exit_on_error(ERROR, "Tracing path %s is too long\n", tracing_path);
+		return -1;
+	}
+	in_fd = open(snapshot_path, O_RDONLY);
+	if (in_fd == -1) {
+		log_msg_and_exit_on_error(ERROR, "Cannot open %s (%s)\n", snapshot_path, strerror(errno));
+		return -1;
+	}
+	out_fd = open(path, O_CREAT|O_WRONLY|O_TRUNC, S_IWOTH);
+	if (out_fd == -1) {
+		log_msg_and_exit_on_error(ERROR, "Cannot open %s (%s)\n", path, strerror(errno));
+		close(in_fd);
+		return -1;
+	}
+	while ((len = read(in_fd, buffer, BUFFER_SIZE)) > 0)
+		if (write(out_fd, buffer, len) != len)
+			break;
+	close(in_fd);
+	if (close(out_fd) == -1 || len != 0) {
+		log_msg_and_exit_on_error(ERROR, "Cannot save trace snapshot in %s (%s)\n", path,
+			strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* take the snapshot of a failing test, then free the snapshot buffer */
+void trace_test_end(int test, test_state state, const char *results_path) {
+	char path[PATH_MAX];
+
+	trace_end();
+	if (g_trace != TRACE_SNAPSHOTS)
+		return;
+	if (state == FAILED && results_path != NULL) {
+		trace_marker("iio_test %d failed, snapshot", test);
+		if (write_tracing_file("snapshot", "1", 0) == 0) {
+			if (snprintf(path, PATH_MAX, "%s%s%d", results_path, TESTS_TRACES, test) >= PATH_MAX)
+				log_msg_and_exit_on_error(ERROR, "Trace path for test %d is too long\n", test);
+			else if (save_snapshot(path) == 0)
+				log_msg_and_exit_on_error(DEBUG, "Trace of test %d saved in %s\n",
+					test, path);
+		}
+	}
+	write_tracing_file("snapshot", "0", 0);
+}
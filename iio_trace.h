@@ -0,0 +1,28 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include "iio_common.h"
+#ifndef __IIO_TRACE_H__
+#define __IIO_TRACE_H__
+
+int open_trace(int mode);
+void close_trace(void);
+void trace_marker(const char *format, ...);
+void trace_begin(const char *format, ...);
+void trace_end(void);
+void trace_violation(int sensor_index, const char *metric, double value, double threshold);
+void trace_test_begin(int test);
+void trace_test_end(int test, test_state state, const char *results_path);
+#endif
@@ -0,0 +1,153 @@
+/*
+// Copyright (c) 2015 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "iio_trigger_accuracy.h"
+#include "iio_arena.h"
+#include "iio_histogram.h"
+#include "iio_results.h"
+#include "iio_tests.h"
+#include "iio_trace.h"
+#include "iio_utils.h"
+
+/*
+** Accuracy of hrtimer triggers. The timestamp of a sample is taken when
+** its trigger fires, so the intervals between samples are the intervals
+** between ticks of the hrtimer. Every sensor of the command is first run
+** alone, then all of them together to see how hrtimers firing at the same
+** time disturb each other; metrics of the second run end in _concurrent.
+**
+** An interval is rounded to a whole number of periods: more than one is a
+** missed tick, the remainder is the jitter of the tick. The rate is the
+** number of periods elapsed over the time they took.
+*/
+
+/* rate error, jitter and missed ticks of one sensor */
+int trigger_accuracy_report(run_sensor_struct *run_sensor) {
+	trigger_accuracy_struct *accuracy;
+	char name[MAX_NAME_SIZE];
+	const char *suffix;
+	const char *id;
+	double rate;
+	double rate_error;
+	int64_t p99;
+	int sensor_index;
+	int max_delay;
+	int error;
+
+	sensor_index = run_sensor->sensor_index;
+	accuracy = (trigger_accuracy_struct*)run_sensor->values;
+	id = g_sensor_info_iio_ext[sensor_index].id;
+	suffix = accuracy->concurrent ? "_concurrent" : "";
+
+	if (accuracy->ticks == 0) {
+		log_msg_and_exit_on_error(ERROR, "No data received from %s\n", id);
+		set_test_state(FAILED);
+		return -1;
+	}
+
+	rate = (double)accuracy->ticks * CONVERT_SEC_TO_NANO(1) /
+		(accuracy->last_timestamp - accuracy->first_timestamp);
+	rate_error = fabs(rate - accuracy->freq) / accuracy->freq * 1000000;
+	log_msg_and_exit_on_error(DEBUG, "Device %s trigger fired at %f Hz for %f Hz (%.0f ppm), "
+		"%lld ticks missed%s\n", id, rate, accuracy->freq, rate_error, accuracy->missed,
+		accuracy->concurrent ? " with other triggers" : "");
+	histogram_print(&accuracy->jitter, id, "trigger jitter");
+
+	snprintf(name, MAX_NAME_SIZE, "trigger_freq%s", suffix);
+	record_metric(sensor_index, name, rate, NAN, "Hz");
+	snprintf(name, MAX_NAME_SIZE, "trigger_rate_error%s", suffix);
+	record_metric(sensor_index, name, rate_error, TRIGGER_MAX_RATE_ERROR_PPM, "ppm");
+	snprintf(name, MAX_NAME_SIZE, "trigger_missed%s", suffix);
+	record_metric(sensor_index, name, accuracy->missed, 0, NULL);
+	snprintf(name, MAX_NAME_SIZE, "trigger_jitter%s", suffix);
+	record_histogram(sensor_index, name, &accuracy->jitter);
+
+	error = 0;
+	if (rate_error > TRIGGER_MAX_RATE_ERROR_PPM) {
+		trace_violation(sensor_index, "trigger_rate_error", rate_error, TRIGGER_MAX_RATE_ERROR_PPM);
+		log_msg_and_exit_on_error(ERROR, "Trigger of device %s is off by %.0f ppm, more than "
+			"%d ppm\n", id, rate_error, TRIGGER_MAX_RATE_ERROR_PPM);
+		error = 1;
+	}
+	if (accuracy->missed) {
+		trace_violation(sensor_index, "trigger_missed", accuracy->missed, 0);
+		log_msg_and_exit_on_error(ERROR, "Trigger of device %s missed %lld ticks\n", id,
+			accuracy->missed);
+		error = 1;
+	}
+	max_delay = run_sensor->time_attributes->max_delay;
+	p99 = histogram_percentile(&accuracy->jitter, 99);
+	if (max_delay > 0 && p99 > CONVERT_MILLI_TO_NANO((int64_t)max_delay)) {
+		trace_violation(sensor_index, "trigger_jitter_p99", CONVERT_NANO_TO_MICRO(p99),
+			max_delay * 1000);
+		log_msg_and_exit_on_error(ERROR, "Trigger of device %s exceed max jitter = %d ms, "
+			"having %lld us\n", id, max_delay, CONVERT_NANO_TO_MICRO(p99));
+		error = 1;
+	}
+	if (error) {
+		set_test_state(FAILED);
+		return -1;
+	}
+	return 0;
+}
+
+/* run every sensor with an hrtimer alone, then all of them at once */
+int check_trigger(int duration) {
+	selected_sensor_struct *selected;
+	selected_sensor_struct *hrtimer_sensors;
+	int selected_count;
+	int count;
+	int s;
+
+	selected = selected_sensors;
+	selected_count = selected_sensors_count;
+	hrtimer_sensors = (selected_sensor_struct*)arena_alloc(&g_test_arena,
+		(selected_count + 1) * sizeof(selected_sensor_struct));
+	count = 0;
+	for (s = 0; s < selected_count; s++) {
+		if (g_sensor_info_iio_ext[selected[s].sensor_index].hr_trigger_nr == -1 ||
+			g_sensor_info_iio_ext[selected[s].sensor_index].is_virtual) {
+			log_msg_and_exit_on_error(DEBUG, "Device %s has no hrtimer trigger\n",
+				g_sensor_info_iio_ext[selected[s].sensor_index].id);
+			continue;
+		}
+		hrtimer_sensors[count++] = selected[s];
+	}
+	if (count == 0) {
+		log_msg_and_exit_on_error(ERROR, "No device with an hrtimer trigger!\n");
+		set_test_state(SKIPPED);
+		return -1;
+	}
+
+	for (s = 0; s < count; s++) {
+		selected_sensors = &hrtimer_sensors[s];
+		selected_sensors_count = 1;
+		poll_sensors(trigger_accuracy_initialize, trigger_accuracy_wrapper, duration);
+	}
+	if (count > 1) {
+		selected_sensors = hrtimer_sensors;
+		selected_sensors_count = count;
+		poll_sensors(trigger_accuracy_initialize, trigger_accuracy_wrapper, duration);
+	}
+
+	selected_sensors = selected;
+	selected_sensors_count = selected_count;
+	return 0;
+}
@@ -18,11 +18,14 @@
 #include <stdio.h>
 #include <fcntl.h> 
 #include <errno.h>
+#include <unistd.h>
+#include <string.h>
 #include <ctype.h>
 #include <time.h>
 #include <stdarg.h>
-#include "cutils/hashmap.h"
+#include <dirent.h>
 #include "iio_utils.h"
+#include "iio_profile.h"
 
 /* write content in a file given by it's fd */
 int sysfs_write_fd(int fd, const void *buf, const int buf_len)
@@ -76,6 +79,11 @@ int log_msg_and_exit_on_error(level msg_level, const char *format, ...) {
 		}
 		vsprintf(msg + strlen(msg), format, arg);
 		len = write(current_fd, msg, strlen(msg));
+		/* a server client may go away in the middle of a command */
+		if (len == -1 && (errno == EPIPE || errno == ECONNRESET)) {
+			va_end(arg);
+			return 0;
+		}
 		/* exit if data can't be write */
 		if (len == -1) {
 			printf("[FATAL] Cannot write: (%s)\n", strerror(errno));
@@ -101,7 +109,7 @@ int sysfs_read_from_fd(int fd, char *buf, int buf_len)
 
 	
 	len = read(fd, buf, buf_len);
-
+	profile_read_done();
 
 	if (len == -1) {
 		log_msg_and_exit_on_error(DEBUG, "Cannot read: (%s)\n",
@@ -266,24 +274,67 @@ int64_t get_timestamp_realtime (void)
 	clock_gettime(CLOCK_REALTIME, &ts);
 	return 1000000000LL * ts.tv_sec + ts.tv_nsec;
 }
+int64_t get_timestamp_monotonic (void)
+{
+	struct timespec ts = {0};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return 1000000000LL * ts.tv_sec + ts.tv_nsec;
+}
 void set_timestamp (struct timespec *out, int64_t target_ns)
 {
 	out->tv_sec  = target_ns / 1000000000LL;
 	out->tv_nsec = target_ns % 1000000000LL;
 }
 
-/* hash function for hashmap used to test multiple 
-** devices in the same time 
+static int compare_int(const void *a, const void *b) {
+	return *(const int*)a - *(const int*)b;
+}
+
+/* find entries named prefixN under /sys/bus/iio/devices, numbering 
+** may be sparse; returns how many were found and their sorted numbers
+** in *entries, which must be freed by caller
 */
-int hash(void* x_void) {
-	unsigned int x = (unsigned int)x_void;
-	x = ((x >> 16) ^ x) * 0x45d9f3b;
-	x = ((x >> 16) ^ x) * 0x45d9f3b;
-	x = ((x >> 16) ^ x);
-	return x;
+int list_iio_entries(const char *prefix, int **entries) {
+	DIR *dir;
+	struct dirent *d;
+	int *new_entries;
+	int prefix_len;
+	int count;
+	int size;
+	char *end;
+	long nr;
+
+	*entries = NULL;
+	dir = opendir(IIO_DEVICES_PATH);
+	if (!dir) {
+		log_msg_and_exit_on_error(DEBUG, "Cannot open %s (%s)\n", IIO_DEVICES_PATH,
+			strerror(errno));
+		return 0;
+	}
+
+	prefix_len = strlen(prefix);
+	count = 0;
+	size = 0;
+	while ((d = readdir(dir))) {
+		if (strncmp(d->d_name, prefix, prefix_len) || !isdigit(d->d_name[prefix_len]))
+			continue;
+		nr = strtol(d->d_name + prefix_len, &end, 10);
+		if (*end != '\0')
+			continue;
+		if (count == size) {
+			size = size ? size * 2 : SENSORS_INITIAL_SIZE;
+			new_entries = (int*)realloc(*entries, size * sizeof(int));
+			if (new_entries == NULL) {
+				log_msg_and_exit_on_error(FATAL, "Out of memory!\n");
+				exit(-1);
+			}
+			*entries = new_entries;
+		}
+		(*entries)[count++] = (int)nr;
+	}
+	closedir(dir);
+
+	if (count)
+		qsort(*entries, count, sizeof(int), compare_int);
+	return count;
 }
-bool intEquals(void* keyA, void* keyB) {
-	int a = (int)keyA;
-	int b = (int)keyB;
-	return a == b;
-}
\ No newline at end of file
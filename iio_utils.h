@@ -33,9 +33,9 @@ int sysfs_write_str(const char path[PATH_MAX], const char *str);
 int sysfs_write_int(const char path[PATH_MAX], int value);
 int sysfs_write_float(const char path[PATH_MAX], float value);
 int64_t get_timestamp_realtime(void);
+int64_t get_timestamp_monotonic(void);
 void set_timestamp (struct timespec *out, int64_t target_ns);
-int hash(void* x_void);
-bool intEquals(void* keyA, void* keyB);
+int list_iio_entries(const char *prefix, int **entries);
 #endif
 
 